@@ -0,0 +1,195 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Runs a Minsky model without the GUI, optionally logging selected
+  variables, and reports simulation throughput.
+
+  usage: minskyBatch [options] model.mky
+*/
+
+#include "minsky.h"
+#include "minsky_epilogue.h"
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+using namespace minsky;
+using namespace std;
+
+namespace minsky
+{
+  Minsky& minsky() {
+    static Minsky m;
+    return m;
+  }
+  // no GUI events to process
+  void doOneEvent(bool idleTasksOnly) {}
+  // not used, but needed for the linker
+  LocalMinsky::LocalMinsky(Minsky& m) {}
+  LocalMinsky::~LocalMinsky() {}
+}
+namespace ecolab {Tk_Window mainWin=0;}
+
+namespace
+{
+  void usage(const char* prog)
+  {
+    cout << "Usage: "<<prog<<" [options] model.mky\n";
+    cout << " -t T, --tmax T: run until simulation time T\n";
+    cout << " -n N, --steps N: run N iterations (each of nSteps solver steps)\n";
+    cout << " -o F, --output F: log variables to F, as CSV if F ends in .csv,\n";
+    cout << "                   otherwise in the binary log format\n";
+    cout << " -v V, --var V: log variable V. May be repeated. Default is all variables\n";
+    cout << " -p P, --plots P: export the data of all plots to CSV files named P-*.csv\n";
+    cout << " -j N, --threads N: threads used for tensor operations (0 = one per core)\n";
+    cout << " -h, --help: print this help message\n";
+    cout << "At least one of --tmax or --steps must be given.\n";
+  }
+
+  double seconds(SimulationStats::Clock::time_point start)
+  {return chrono::duration<double>(SimulationStats::Clock::now()-start).count();}
+}
+
+int main(int argc, const char* argv[])
+{
+  string modelFile, output, plots;
+  vector<string> vars;
+  double tmax=nan("");
+  size_t maxSteps=0;
+  int threads=-1;
+
+  for (int i=1; i<argc; ++i)
+    {
+      string arg=argv[i];
+      auto value=[&]() {
+        if (i+1>=argc)
+          {
+            cerr << arg << " requires an argument\n";
+            exit(1);
+          }
+        return string(argv[++i]);
+      };
+      if (arg=="-h" || arg=="--help")
+        {
+          usage(argv[0]);
+          return 0;
+        }
+      else if (arg=="-t" || arg=="--tmax")
+        tmax=atof(value().c_str());
+      else if (arg=="-n" || arg=="--steps")
+        maxSteps=strtoul(value().c_str(),nullptr,10);
+      else if (arg=="-o" || arg=="--output")
+        output=value();
+      else if (arg=="-v" || arg=="--var")
+        vars.push_back(value());
+      else if (arg=="-p" || arg=="--plots")
+        plots=value();
+      else if (arg=="-j" || arg=="--threads")
+        threads=atoi(value().c_str());
+      else if (arg[0]=='-' || !modelFile.empty())
+        {
+          usage(argv[0]);
+          return 1;
+        }
+      else
+        modelFile=arg;
+    }
+  if (modelFile.empty() || (isnan(tmax) && maxSteps==0))
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+  try
+    {
+      auto& m=minsky::minsky();
+      auto start=SimulationStats::Clock::now();
+      m.load(modelFile);
+      double loadTime=seconds(start);
+      if (threads>=0)
+        m.numThreads=threads;
+      m.reset();
+
+      // log to a temporary binary log, if CSV output is requested
+      bool csv=boost::filesystem::path(output).extension()==".csv";
+      string logFile=csv? output+".mlog": output;
+      if (!output.empty())
+        {
+          m.logVarList.clear();
+          if (vars.empty())
+            {
+              for (auto& v: m.variableValues)
+                if (v.first.find("constant:")!=0)
+                  m.logVarList.insert(v.first);
+            }
+          else
+            for (auto& v: vars)
+              {
+                auto valueId=VariableValue::valueId(v);
+                if (!m.variableValues.count(valueId))
+                  throw runtime_error("unknown variable "+v);
+                m.logVarList.insert(valueId);
+              }
+          m.openLogFile(logFile);
+        }
+
+      start=SimulationStats::Clock::now();
+      size_t iterations=0;
+      double t0=m.t;
+      while ((maxSteps==0 || iterations<maxSteps) && (isnan(tmax) || m.t<tmax))
+        {
+          m.step();
+          ++iterations;
+        }
+      double runTime=seconds(start);
+      auto& stats=m.simulationStats;
+
+      start=SimulationStats::Clock::now();
+      if (!output.empty())
+        {
+          m.closeLogFile();
+          if (csv)
+            {
+              m.logFileToCSV(logFile, output);
+              boost::filesystem::remove(logFile);
+            }
+        }
+      if (!plots.empty())
+        m.exportAllPlotsAsCSV(plots);
+      double outputTime=seconds(start);
+
+      cout << "model: "<<modelFile<<"\n";
+      cout << "simulated time: "<<t0<<" to "<<m.t<<"\n";
+      cout << "stock variables: "<<m.stockVars.size()<<" flow variables: "<<m.flowVars.size()<<"\n";
+      cout << "wall time (s): "<<runTime<<"\n";
+      cout << "steps/s: "<<(runTime>0? iterations/runTime: 0)<<"\n";
+      cout << "RHS evaluations/s: "<<(runTime>0? stats.rhsEvaluations/runTime: 0)<<"\n";
+      stats.report(cout);
+      cout << "  load: "<<loadTime<<"\n";
+      cout << "  output: "<<outputTime<<"\n";
+    }
+  catch (const std::exception& ex)
+    {
+      cerr << "Exception: "<<ex.what() << endl;
+      return 1;
+    }
+  return 0;
+}
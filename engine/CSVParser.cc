@@ -19,6 +19,7 @@
 
 #include "CSVParser.h"
 #include "minsky.h"
+#include "threadPool.h"
 #include "minsky_epilogue.h"
 using namespace minsky;
 using namespace std;
@@ -26,6 +27,12 @@ using namespace std;
 #include <boost/type_traits.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/token_functions.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
 
 typedef boost::escaped_list_separator<char> Parser;
 typedef boost::tokenizer<Parser> Tokenizer;
@@ -374,193 +381,515 @@ namespace minsky
       reportFromCSVFileT<Parser>(input,output,spec);
   }
 
-  template <class P>
-  void loadValueFromCSVFileT(VariableValue& v, istream& input, const DataSpec& spec)
+  namespace
   {
-    P csvParser(spec.escape,spec.separator,spec.quote);
-    string buf;
-    typedef vector<string> Key;
-    map<Key,double> tmpData;
-    multimap<Key,double> tmpAll; 
-    map<Key,int> tmpCnt;
-    vector<map<string,size_t>> dimLabels(spec.dimensionCols.size());
-    bool tabularFormat=false;
-    Hypercube hc;
-    vector<string> horizontalLabels;
-
-    for (size_t i=0; i<spec.nColAxes(); ++i)
-      if (spec.dimensionCols.count(i))
-        {
-          hc.xvectors.push_back(i<spec.dimensionNames.size()? spec.dimensionNames[i]: "dim"+str(i));
-          hc.xvectors.back().dimension=spec.dimensions[i];
-        }
-    try
+    /// Tokenises a line into fields, with the same semantics as
+    /// Parser, or SpaceSeparatorParser if the separator is a
+    /// space. Fields are decoded into an internal buffer, so no memory
+    /// is allocated per field.
+    class LineTokenizer
+    {
+      char escape, separator, quote;
+      string buffer;
+      void escapedList(const char* next, const char* end);
+      void spaceSeparated(const char* next, const char* end);
+    public:
+      struct Field
       {
-        for (size_t row=0; getline(input, buf); ++row)
-          {
-            // remove trailing carriage returns
-            if (buf.back()=='\r') buf=buf.substr(0,buf.size()-1);//buf.erase(buf.end()-1);
-            boost::tokenizer<P> tok(buf.begin(), buf.end(), csvParser);
+        const char *begin, *end;
+        Field(const char* begin, const char* end): begin(begin), end(end) {}
+      };
+      vector<Field> fields;
+
+      LineTokenizer(const DataSpec& spec):
+        escape(spec.escape), separator(spec.separator), quote(spec.quote) {}
+      /// tokenise [begin,end) into fields
+      void operator()(const char* begin, const char* end) {
+        fields.clear();
+        buffer.clear();
+        // decoded fields are never longer than the line, so the
+        // buffer is not reallocated whilst tokenising
+        buffer.reserve(end-begin);
+        if (separator==' ')
+          spaceSeparated(begin,end);
+        else
+          escapedList(begin,end);
+      }
+    };
 
-            assert(spec.headerRow<=spec.nRowAxes());
-            if (row==spec.headerRow && !spec.columnar) // in header section
+    void LineTokenizer::escapedList(const char* next, const char* end)
+    {
+      if (next==end) return;
+      for (;;)
+        {
+          size_t start=buffer.size();
+          bool inQuote=false, moreFields=false;
+          for (; next!=end; ++next)
+            if (*next==escape)
               {
-                vector<string> parsedRow(tok.begin(), tok.end());
-                if (parsedRow.size()>spec.nColAxes()+1)
-                  {
-                    tabularFormat=true;
-                    horizontalLabels.assign(parsedRow.begin()+spec.nColAxes(), parsedRow.end());
-                    hc.xvectors.emplace_back(spec.horizontalDimName);
-                    hc.xvectors.back().dimension=spec.horizontalDimension;
-                    for (auto& i: horizontalLabels) hc.xvectors.back().push_back(i);
-                    dimLabels.emplace_back();
-                    for (size_t i=0; i<horizontalLabels.size(); ++i)
-                      dimLabels.back()[horizontalLabels[i]]=i;
-                  }
+                if (++next==end)
+                  throw boost::escaped_list_error("cannot end with escape");
+                if (*next==escape || *next==separator || *next==quote)
+                  buffer+=*next;
+                else if (*next=='n')
+                  buffer+='\n';
+                else
+                  throw boost::escaped_list_error("unknown escape sequence");
               }
-            else if (row>=spec.nRowAxes())// in data section
+            else if (*next==separator && !inQuote)
               {
-                Key key;
-                auto field=tok.begin();
-                for (size_t i=0, dim=0; i<spec.nColAxes() && field!=tok.end(); ++i, ++field)
-                  if (spec.dimensionCols.count(i))
-                    {
-                      if (dim>=hc.xvectors.size())
-                        hc.xvectors.emplace_back("?"); // no header present
-                      key.push_back(*field);
-                      if (dimLabels[dim].emplace(*field, dimLabels[dim].size()).second)
-                        hc.xvectors[dim].push_back(*field);
-                      dim++;
-                    }
-                    
-                if (field==tok.end())
-                  throw NoDataColumns();
-          
-                for (size_t col=0; field != tok.end(); ++field, ++col)
+                ++next;
+                moreFields=true;
+                break;
+              }
+            else if (*next==quote)
+              inQuote=!inQuote;
+            else
+              buffer+=*next;
+          fields.emplace_back(buffer.data()+start, buffer.data()+buffer.size());
+          // a trailing separator introduces a final empty field
+          if (!moreFields) return;
+        }
+    }
+
+    void LineTokenizer::spaceSeparated(const char* next, const char* end)
+    {
+      for (;;)
+        {
+          size_t start=buffer.size();
+          bool quoted=false;
+          for (; next!=end; ++next)
+            if (*next==escape)
+              {
+                if (++next==end) break;
+                buffer+=*next;
+              }
+            else if (*next==quote)
+              quoted=!quoted;
+            else if (!quoted && isspace(*next))
+              break;
+            else
+              buffer+=*next;
+          if (next==end)
+            {
+              if (buffer.size()>start)
+                fields.emplace_back(buffer.data()+start, buffer.data()+buffer.size());
+              return;
+            }
+          // merge whitespace separators
+          while (next!=end && isspace(*next)) ++next;
+          fields.emplace_back(buffer.data()+start, buffer.data()+buffer.size());
+        }
+    }
+
+    const double exactPowersOf10[]=
+      {1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+       1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+
+    /// parse a numerical field into \a r, ignoring whitespace and
+    /// thousands separators, with the same semantics as stod. \a
+    /// buf is scratch space.
+    /// @return false if the field is not numerical
+    bool parseNumber(const char* begin, const char* end, char decSeparator, string& buf, double& r)
+    {
+      // remove thousands separators, and set decimal separator to '.' ("C" locale)
+      buf.clear();
+      for (; begin!=end; ++begin)
+        if (*begin==decSeparator)
+          buf+='.';
+        else if (!isspace(*begin) && *begin!='.' && *begin!=',')
+          buf+=*begin;
+
+      // Fast path for decimal numbers whose significand and power of
+      // ten are exactly representable, as the correctly rounded
+      // result is then given by a single multiplication or division
+      const char* p=buf.data(), *pEnd=p+buf.size();
+      bool negative=false, exact=true, anyDigits=false;
+      if (p!=pEnd && (*p=='+' || *p=='-'))
+        negative=*p++=='-';
+      uint64_t significand=0;
+      int digits=0, exponent=0;
+      auto digit=[&](char c) {
+        anyDigits=true;
+        if (digits<19)
+          {
+            significand=10*significand+(c-'0');
+            if (significand) ++digits;
+          }
+        else
+          exact=false;
+      };
+      for (; p!=pEnd && *p>='0' && *p<='9'; ++p)
+        digit(*p);
+      if (p!=pEnd && *p=='.')
+        for (++p; p!=pEnd && *p>='0' && *p<='9'; ++p, --exponent)
+          digit(*p);
+      if (anyDigits && p!=pEnd && (*p=='e' || *p=='E'))
+        {
+          ++p;
+          bool negativeExponent=false;
+          if (p!=pEnd && (*p=='+' || *p=='-'))
+            negativeExponent=*p++=='-';
+          if (p==pEnd || *p<'0' || *p>'9') exact=false;
+          int e=0;
+          for (; p!=pEnd && *p>='0' && *p<='9'; ++p)
+            if (e<10000) e=10*e+(*p-'0');
+          exponent+=negativeExponent? -e: e;
+        }
+      if (anyDigits && exact && p==pEnd && significand<=(uint64_t(1)<<53) &&
+          exponent>=-22 && exponent<=22)
+        {
+          r=exponent<0? significand/exactPowersOf10[-exponent]:
+            significand*exactPowersOf10[exponent];
+          if (negative) r=-r;
+          return true;
+        }
+
+      // general case, including nan, inf and hexadecimal
+      char* endp;
+      errno=0;
+      r=strtod(buf.c_str(), &endp);
+      return endp!=buf.c_str() && errno!=ERANGE;
+    }
+
+    /// records parsed from a contiguous range of data lines
+    struct ParsedChunk
+    {
+      /// labels of each key dimension, in order of first appearance
+      vector<vector<string>> labels;
+      /// label ids of each record, rank ids per record
+      vector<unsigned> keys;
+      vector<double> values;
+      /// exception thrown parsing this chunk. Records prior to the
+      /// offending line are retained.
+      exception_ptr error;
+    };
+
+    struct ChunkParser
+    {
+      const DataSpec& spec;
+      /// whether each column<nColAxes is a dimension
+      vector<bool> keyCol;
+      size_t keyDims=0;
+      /// horizontal dimension ids of the data columns, for tabular format
+      bool tabular=false;
+      vector<unsigned> horizontalIds;
+
+      ChunkParser(const DataSpec& spec): spec(spec) {
+        for (size_t i=0; i<spec.nColAxes(); ++i)
+          {
+            keyCol.push_back(spec.dimensionCols.count(i));
+            keyDims+=keyCol.back();
+          }
+      }
+      size_t rank() const {return keyDims+tabular;}
+      void operator()(const char* begin, const char* end, ParsedChunk& chunk) const;
+    };
+
+    void ChunkParser::operator()(const char* begin, const char* end, ParsedChunk& chunk) const
+    {
+      LineTokenizer tok(spec);
+      vector<unordered_map<string,unsigned>> ids(keyDims);
+      chunk.labels.resize(keyDims);
+      vector<unsigned> key(rank());
+      string label, number;
+      try
+        {
+          for (auto line=begin; line<end;)
+            {
+              auto eol=static_cast<const char*>(memchr(line, '\n', end-line));
+              if (!eol) eol=end;
+              // remove trailing carriage returns
+              tok(line, eol>line && eol[-1]=='\r'? eol-1: eol);
+              line=eol==end? end: eol+1;
+
+              auto& fields=tok.fields;
+              size_t i=0;
+              for (size_t dim=0; i<spec.nColAxes() && i<fields.size(); ++i)
+                if (keyCol[i])
                   {
-                    if (tabularFormat)
-                      key.push_back(horizontalLabels[col]);
-
-                    // remove thousands separators, and set decimal separator to '.' ("C" locale)
-                    string s;
-                    for (auto c: *field)
-                      if (c==spec.decSeparator)
-                        s+='.';
-                      else if (!isspace(c) && c!='.' && c!=',')
-                        s+=c;                    
-
-                    auto i=tmpData.find(key);
-                    bool valueExists=true;
-                    double v=spec.missingValue;
-                    try
+                    label.assign(fields[i].begin, fields[i].end);
+                    auto id=ids[dim].find(label);
+                    if (id==ids[dim].end())
                       {
-                        v=stod(s);
+                        id=ids[dim].emplace(label, chunk.labels[dim].size()).first;
+                        chunk.labels[dim].push_back(label);
                       }
-                    catch (...) // value misunderstood
-                      {
-                        if (isnan(spec.missingValue)) // if spec.missingValue is NaN, then don't populate the tmpData map
-                          valueExists=false;
-                      }
-                    if (valueExists)
-                      {
-                        if (i==tmpData.end())
-                          tmpData.emplace(key,v);
-                        else	
-                          switch (spec.duplicateKeyAction)
-                            {
-                            case DataSpec::throwException:
-                              throw DuplicateKey(key); 
-                            case DataSpec::sum:
-                              i->second+=v;
-                              break;
-                            case DataSpec::product:
-                              i->second*=v;
-                              break;
-                            case DataSpec::min:
-                              if (v<i->second)
-                                i->second=v;
-                              break;
-                            case DataSpec::max:
-                              if (v>i->second)
-                                i->second=v;
-                              break;
-                            case DataSpec::av:
-                              {
-                                int& c=tmpCnt[key]; // c initialised to 0
-                                i->second=((c+1)*i->second + v)/(c+2);
-                                c++;
-                              }
-                              break;
-                            }
-                      }
-                    if (tabularFormat)
-                      key.pop_back();
+                    key[dim++]=id->second;
                   }
-              }
+              if (i==fields.size())
+                throw NoDataColumns();
+
+              for (size_t col=0; i<fields.size(); ++i, ++col)
+                {
+                  if (tabular)
+                    {
+                      if (col>=horizontalIds.size()) break; // no column heading
+                      key.back()=horizontalIds[col];
+                    }
+                  double v;
+                  if (!parseNumber(fields[i].begin, fields[i].end, spec.decSeparator, number, v))
+                    {
+                      // if spec.missingValue is NaN, then the value is not populated
+                      if (isnan(spec.missingValue)) continue;
+                      v=spec.missingValue;
+                    }
+                  chunk.keys.insert(chunk.keys.end(), key.begin(), key.end());
+                  chunk.values.push_back(v);
+                }
+            }
+        }
+      catch (...)
+        {
+          chunk.error=current_exception();
+        }
+    }
+
+    /// data lines are parsed concurrently in chunks of at least this size
+    const size_t minChunkSize=1<<20;
+
+    /// Load \a v from the CSV data in [begin,end). Data lines are
+    /// split into chunks that are parsed concurrently, with dimension
+    /// labels interned as integer ids. Records are then accumulated
+    /// in file order, so duplicate keys are handled as if the file
+    /// were read sequentially.
+    void loadValueFromCSVBuffer(VariableValue& v, const char* begin, const char* end, const DataSpec& spec)
+    {
+      assert(spec.headerRow<=spec.nRowAxes());
+      ChunkParser parser(spec);
+      Hypercube hc;
+      vector<vector<string>> labels; // of each dimension
+      for (size_t i=0; i<spec.nColAxes(); ++i)
+        if (spec.dimensionCols.count(i))
+          {
+            hc.xvectors.push_back(i<spec.dimensionNames.size()? spec.dimensionNames[i]: "dim"+str(i));
+            hc.xvectors.back().dimension=spec.dimensions[i];
+          }
+
+      // header section
+      auto data=begin;
+      for (size_t row=0; data<end && (row<spec.nRowAxes() || (row==spec.headerRow && !spec.columnar)); ++row)
+        {
+          auto eol=static_cast<const char*>(memchr(data, '\n', end-data));
+          if (!eol) eol=end;
+          if (row==spec.headerRow && !spec.columnar)
+            {
+              LineTokenizer tok(spec);
+              tok(data, eol>data && eol[-1]=='\r'? eol-1: eol);
+              if (tok.fields.size()>spec.nColAxes()+1)
+                {
+                  parser.tabular=true;
+                  labels.emplace_back();
+                  auto& horizontalLabels=labels.back();
+                  map<string,unsigned> ids;
+                  for (auto i=tok.fields.begin()+spec.nColAxes(); i!=tok.fields.end(); ++i)
+                    {
+                      horizontalLabels.emplace_back(i->begin, i->end);
+                      ids[horizontalLabels.back()]=horizontalLabels.size()-1;
+                    }
+                  for (auto& i: horizontalLabels)
+                    parser.horizontalIds.push_back(ids[i]);
+                }
+            }
+          data=eol==end? end: eol+1;
+        }
+
+      // split the data section into chunks at line boundaries, and
+      // parse them concurrently
+      size_t numChunks=min(size_t(4*max(1u, boost::thread::hardware_concurrency())),
+                           size_t(end-data)/minChunkSize+1);
+      vector<const char*> chunkBegin{data};
+      for (size_t i=1; i<numChunks; ++i)
+        {
+          auto p=max(chunkBegin.back(), data+i*(end-data)/numChunks);
+          if (auto eol=static_cast<const char*>(memchr(p, '\n', end-p)))
+            chunkBegin.push_back(eol+1);
+        }
+      chunkBegin.push_back(end);
+      vector<ParsedChunk> chunks(chunkBegin.size()-1);
+      if (chunks.size()==1)
+        parser(chunkBegin[0], chunkBegin[1], chunks[0]);
+      else
+        {
+          vector<ThreadPool::Task> tasks;
+          for (size_t i=0; i<chunks.size(); ++i)
+            tasks.emplace_back([&,i]() {parser(chunkBegin[i], chunkBegin[i+1], chunks[i]);});
+          SharedThreadPool::Lease(sharedThreadPool()).run(tasks);
+        }
+      // nothing after the first chunk in error contributes
+      for (size_t i=0; i<chunks.size(); ++i)
+        if (chunks[i].error)
+          {
+            chunks.resize(i+1);
+            break;
           }
+
+      // merge the chunk label ids into global ids, in order of first appearance
+      vector<vector<vector<unsigned>>> globalIds(chunks.size());
+      labels.insert(labels.begin(), parser.keyDims, vector<string>());
+      for (size_t dim=0; dim<parser.keyDims; ++dim)
+        {
+          unordered_map<string,unsigned> ids;
+          for (size_t c=0; c<chunks.size(); ++c)
+            {
+              globalIds[c].emplace_back();
+              for (auto& i: chunks[c].labels[dim])
+                {
+                  auto id=ids.emplace(i, labels[dim].size());
+                  if (id.second)
+                    {
+                      labels[dim].push_back(i);
+                      hc.xvectors[dim].push_back(i);
+                    }
+                  globalIds[c].back().push_back(id.first->second);
+                }
+              chunks[c].labels[dim].clear();
+            }
+        }
+      if (parser.tabular)
+        {
+          hc.xvectors.emplace_back(spec.horizontalDimName);
+          hc.xvectors.back().dimension=spec.horizontalDimension;
+          for (auto& i: labels.back()) hc.xvectors.back().push_back(i);
+        }
                   
-        for (auto& xv: hc.xvectors)
-          xv.imposeDimension();
-
-        size_t numHyperCubeElems=1;
-        for (auto& i : hc.xvectors) numHyperCubeElems*=i.size();
-                           
-        double sparsityRatio =  static_cast<double>(1.0-static_cast<double>(tmpData.size())/numHyperCubeElems); 
-
-        if (sparsityRatio <= 0.5) 
-          { // dense case
-            v.index({});
-            if (!cminsky().checkMemAllocation(hc.numElements()*sizeof(double)))
-              throw runtime_error("memory threshold exceeded");            
-            v.hypercube(hc);
-            // stash the data into vv tensorInit field
-            v.tensorInit.index({});
-            v.tensorInit.hypercube(hc);
-            for (auto& i: v.tensorInit)
-              i=spec.missingValue;
-            auto dims=v.hypercube().dims();
-            for (auto& i: tmpData)
-              {
-                size_t idx=0;
-                assert (hc.rank()==i.first.size());
-                assert(dimLabels.size()==hc.rank());
-                for (int j=hc.rank()-1; j>=0; --j)
-                  {
-                    assert(dimLabels[j].count(i.first[j]));
-                    idx = (idx*dims[j]) + dimLabels[j][i.first[j]];
-                  }
-                v.tensorInit[idx]=i.second;  
-              }
-          }    
-        else 
-          { // sparse case	
-            if (!cminsky().checkMemAllocation(tmpData.size()*sizeof(double)))
-              throw runtime_error("memory threshold exceeded");	  	  		
-            auto dims=hc.dims();
-              
-            map<size_t,double> indexValue; // intermediate stash to sort index vector
-            for (auto& i: tmpData)
-              {
-                size_t idx=0;
-                assert (dims.size()==i.first.size());
-                assert(dimLabels.size()==dims.size());
-                for (int j=dims.size()-1; j>=0; --j)
+      for (auto& xv: hc.xvectors)
+        xv.imposeDimension();
+
+      size_t numHyperCubeElems=1;
+      for (auto& i : hc.xvectors) numHyperCubeElems*=i.size();
+      auto dims=hc.dims();
+      const size_t rank=parser.rank();
+      assert(dims.size()==rank);
+      vector<size_t> strides(rank,1);
+      for (size_t j=1; j<rank; ++j)
+        strides[j]=strides[j-1]*dims[j-1];
+
+      // accumulate records into a dense array if the result may be
+      // dense, otherwise into a hash map
+      size_t numRecords=0;
+      for (auto& c: chunks) numRecords+=c.values.size();
+      bool denseAccumulator=numHyperCubeElems<=2*numRecords;
+      struct Accumulator
+      {
+        double value=0;
+        unsigned count=0;
+      };
+      vector<Accumulator> dense;
+      unordered_map<size_t,Accumulator> sparse;
+      if (denseAccumulator)
+        dense.resize(numHyperCubeElems);
+      else
+        sparse.reserve(numRecords);
+
+      for (size_t c=0; c<chunks.size(); ++c)
+        {
+          auto& chunk=chunks[c];
+          auto key=chunk.keys.begin();
+          for (auto x: chunk.values)
+            {
+              size_t idx=0;
+              for (size_t j=0; j<parser.keyDims; ++j, ++key)
+                idx+=strides[j]*globalIds[c][j][*key];
+              if (parser.tabular)
+                idx+=strides.back()* *key++;
+              auto& acc=denseAccumulator? dense[idx]: sparse[idx];
+              if (acc.count++==0)
+                {
+                  acc.value=x;
+                  continue;
+                }
+              switch (spec.duplicateKeyAction)
+                {
+                case DataSpec::throwException:
                   {
-                    assert(dimLabels[j].count(i.first[j]));
-                    idx = (idx*dims[j]) + dimLabels[j][i.first[j]];
+                    vector<string> keyLabels;
+                    for (size_t j=0; j<rank; ++j)
+                      keyLabels.push_back(labels[j][(idx/strides[j])%dims[j]]);
+                    throw DuplicateKey(keyLabels);
                   }
-                if (!isnan(i.second))
-                  indexValue.emplace(idx, i.second);
-              }
-
-            v.tensorInit.index(indexValue);
-            size_t j=0;
-            for (auto& i: indexValue)
-              v.tensorInit[j++]=i.second;
-            v.hypercube(hc);
-            v.tensorInit.hypercube(hc);
-          }                 
+                case DataSpec::sum:
+                  acc.value+=x;
+                  break;
+                case DataSpec::product:
+                  acc.value*=x;
+                  break;
+                case DataSpec::min:
+                  if (x<acc.value)
+                    acc.value=x;
+                  break;
+                case DataSpec::max:
+                  if (x>acc.value)
+                    acc.value=x;
+                  break;
+                case DataSpec::av:
+                  acc.value=((acc.count-1)*acc.value + x)/acc.count;
+                  break;
+                }
+            }
+          if (chunk.error)
+            rethrow_exception(chunk.error);
+          // release memory as we go
+          vector<unsigned>().swap(chunk.keys);
+          vector<double>().swap(chunk.values);
+        }
 
+      size_t numValues=sparse.size();
+      if (denseAccumulator)
+        numValues=count_if(dense.begin(), dense.end(), [](const Accumulator& x) {return x.count>0;});
+      double sparsityRatio=static_cast<double>(1.0-static_cast<double>(numValues)/numHyperCubeElems); 
+
+      if (sparsityRatio <= 0.5) 
+        { // dense case
+          assert(denseAccumulator);
+          v.index({});
+          if (!cminsky().checkMemAllocation(hc.numElements()*sizeof(double)))
+            throw runtime_error("memory threshold exceeded");            
+          v.hypercube(hc);
+          // stash the data into vv tensorInit field
+          v.tensorInit.index({});
+          v.tensorInit.hypercube(hc);
+          for (size_t i=0; i<dense.size(); ++i)
+            v.tensorInit[i]=dense[i].count? dense[i].value: spec.missingValue;
+        }    
+      else 
+        { // sparse case	
+          if (!cminsky().checkMemAllocation(numValues*sizeof(double)))
+            throw runtime_error("memory threshold exceeded");	  	  		
+          vector<pair<size_t,double>> indexValue; // intermediate stash to sort index vector
+          indexValue.reserve(numValues);
+          if (denseAccumulator)
+            {
+              for (size_t i=0; i<dense.size(); ++i)
+                if (dense[i].count && !isnan(dense[i].value))
+                  indexValue.emplace_back(i, dense[i].value);
+            }
+          else
+            {
+              for (auto& i: sparse)
+                if (!isnan(i.second.value))
+                  indexValue.emplace_back(i.first, i.second.value);
+              sort(indexValue.begin(), indexValue.end());
+            }
+          vector<size_t> index;
+          index.reserve(indexValue.size());
+          for (auto& i: indexValue) index.push_back(i.first);
+          v.tensorInit.index(Index(move(index)));
+          size_t j=0;
+          for (auto& i: indexValue)
+            v.tensorInit[j++]=i.second;
+          v.hypercube(hc);
+          v.tensorInit.hypercube(hc);
+        }
+    }
+  }
+  
+  void loadValueFromCSVFile(VariableValue& v, istream& input, const DataSpec& spec)
+  {
+    try
+      {
+        string buf{istreambuf_iterator<char>(input), istreambuf_iterator<char>()};
+        loadValueFromCSVBuffer(v, buf.data(), buf.data()+buf.size(), spec);
       }
     catch (const std::bad_alloc&)
       { // replace with a more user friendly error message
@@ -570,14 +899,40 @@ namespace minsky
       { // replace with a more user friendly error message
         throw std::runtime_error("exhausted memory - try reducing the rank");
       }
-
   }
-  
-  void loadValueFromCSVFile(VariableValue& v, istream& input, const DataSpec& spec)
+
+  void loadValueFromCSVFile(VariableValue& v, const string& fileName, const DataSpec& spec)
   {
-    if (spec.separator==' ')
-      loadValueFromCSVFileT<SpaceSeparatorParser>(v,input,spec);
-    else
-      loadValueFromCSVFileT<Parser>(v,input,spec);
+    using namespace boost::interprocess;
+    unique_ptr<mapped_region> region;
+    try
+      {
+        file_mapping file(fileName.c_str(), read_only);
+        region.reset(new mapped_region(file, read_only));
+        region->advise(mapped_region::advice_sequential);
+      }
+    catch (const interprocess_exception&)
+      {
+        region.reset(); // empty or unmappable file, fall through to stream input
+      }
+    if (!region)
+      {
+        ifstream is(fileName);
+        loadValueFromCSVFile(v, is, spec);
+        return;
+      }
+    try
+      {
+        auto data=static_cast<const char*>(region->get_address());
+        loadValueFromCSVBuffer(v, data, data+region->get_size(), spec);
+      }
+    catch (const std::bad_alloc&)
+      { // replace with a more user friendly error message
+        throw std::runtime_error("exhausted memory - try reducing the rank");
+      }
+    catch (const std::length_error&)
+      { // replace with a more user friendly error message
+        throw std::runtime_error("exhausted memory - try reducing the rank");
+      }
   }
 }
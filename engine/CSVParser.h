@@ -99,6 +99,9 @@ namespace minsky
 
   /// load a variableValue from a stream according to data spec
   void loadValueFromCSVFile(VariableValue&,std::istream&,const DataSpec&);
+  /// load a variableValue from a file according to data spec. The
+  /// file is memory mapped, and parsed concurrently.
+  void loadValueFromCSVFile(VariableValue&,const std::string& fileName,const DataSpec&);
 }
 
 #include "CSVParser.cd"
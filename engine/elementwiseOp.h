@@ -0,0 +1,100 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef ELEMENTWISEOP_H
+#define ELEMENTWISEOP_H
+
+#include "operationType.h"
+#include <math.h>
+#include <algorithm>
+
+namespace minsky
+{
+  // Formulas of the elementwise operations having vectorised kernels,
+  // shared by EvalOp<T>::evaluate() in evalOp.cc, and the kernels in
+  // vectorKernels.cc. Internal to each translation unit, so that each
+  // is compiled with that unit's floating point options.
+  namespace
+  {
+    template <OperationType::Type T> struct ElementwiseOp;
+    template <> struct ElementwiseOp<OperationType::add>
+    {static double evaluate(double in1, double in2) {return in1+in2;}};
+    template <> struct ElementwiseOp<OperationType::subtract>
+    {static double evaluate(double in1, double in2) {return in1-in2;}};
+    template <> struct ElementwiseOp<OperationType::multiply>
+    {static double evaluate(double in1, double in2) {return in1*in2;}};
+    template <> struct ElementwiseOp<OperationType::divide>
+    {static double evaluate(double in1, double in2) {return in1/in2;}};
+    template <> struct ElementwiseOp<OperationType::min>
+    {static double evaluate(double in1, double in2) {return std::min(in1,in2);}};
+    template <> struct ElementwiseOp<OperationType::max>
+    {static double evaluate(double in1, double in2) {return std::max(in1,in2);}};
+    template <> struct ElementwiseOp<OperationType::and_>
+    {static double evaluate(double in1, double in2) {return in1>0.5 && in2>0.5;}};
+    template <> struct ElementwiseOp<OperationType::or_>
+    {static double evaluate(double in1, double in2) {return in1>0.5 || in2>0.5;}};
+    template <> struct ElementwiseOp<OperationType::log>
+    {static double evaluate(double in1, double in2) {return ::log(in1)/::log(in2);}};
+    template <> struct ElementwiseOp<OperationType::pow>
+    {static double evaluate(double in1, double in2) {return ::pow(in1,in2);}};
+    template <> struct ElementwiseOp<OperationType::lt>
+    {static double evaluate(double in1, double in2) {return in1<in2;}};
+    template <> struct ElementwiseOp<OperationType::le>
+    {static double evaluate(double in1, double in2) {return in1<=in2;}};
+    template <> struct ElementwiseOp<OperationType::eq>
+    {static double evaluate(double in1, double in2) {return in1==in2;}};
+    template <> struct ElementwiseOp<OperationType::copy>
+    {static double evaluate(double in1, double in2) {return in1;}};
+    template <> struct ElementwiseOp<OperationType::sqrt>
+    {static double evaluate(double in1, double in2) {return ::sqrt(fabs(in1));}};
+    template <> struct ElementwiseOp<OperationType::exp>
+    {static double evaluate(double in1, double in2) {return ::exp(in1);}};
+    template <> struct ElementwiseOp<OperationType::ln>
+    {static double evaluate(double in1, double in2) {return ::log(in1);}};
+    template <> struct ElementwiseOp<OperationType::sin>
+    {static double evaluate(double in1, double in2) {return ::sin(in1);}};
+    template <> struct ElementwiseOp<OperationType::cos>
+    {static double evaluate(double in1, double in2) {return ::cos(in1);}};
+    template <> struct ElementwiseOp<OperationType::tan>
+    {static double evaluate(double in1, double in2) {return ::tan(in1);}};
+    template <> struct ElementwiseOp<OperationType::asin>
+    {static double evaluate(double in1, double in2) {return ::asin(in1);}};
+    template <> struct ElementwiseOp<OperationType::acos>
+    {static double evaluate(double in1, double in2) {return ::acos(in1);}};
+    template <> struct ElementwiseOp<OperationType::atan>
+    {static double evaluate(double in1, double in2) {return ::atan(in1);}};
+    template <> struct ElementwiseOp<OperationType::sinh>
+    {static double evaluate(double in1, double in2) {return ::sinh(in1);}};
+    template <> struct ElementwiseOp<OperationType::cosh>
+    {static double evaluate(double in1, double in2) {return ::cosh(in1);}};
+    template <> struct ElementwiseOp<OperationType::tanh>
+    {static double evaluate(double in1, double in2) {return ::tanh(in1);}};
+    template <> struct ElementwiseOp<OperationType::abs>
+    {static double evaluate(double in1, double in2) {return ::fabs(in1);}};
+    template <> struct ElementwiseOp<OperationType::floor>
+    {static double evaluate(double in1, double in2) {return ::floor(in1);}};
+    template <> struct ElementwiseOp<OperationType::frac>
+    {static double evaluate(double in1, double in2) {return in1-::floor(in1);}};
+    template <> struct ElementwiseOp<OperationType::not_>
+    {static double evaluate(double in1, double in2) {return in1<=0.5;}};
+    template <> struct ElementwiseOp<OperationType::percent>
+    {static double evaluate(double in1, double in2) {return 100.0*in1;}};
+  }
+}
+
+#endif
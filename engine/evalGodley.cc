@@ -93,4 +93,18 @@ namespace minsky
     for (size_t i=0; i<sidx.size(); ++i)
       sv[sidx[i]] += fv[fidx[i]] * m[i];
   }
+
+  void EvalGodley::evalBatch(double sv[], const double fv[], size_t N) const
+  {
+    for (size_t i=0; i<initIdx.size(); ++i)
+      std::fill(sv+size_t(initIdx[i])*N, sv+size_t(initIdx[i]+1)*N, 0.0);
+
+    for (size_t i=0; i<sidx.size(); ++i)
+      {
+        double* s=sv+size_t(sidx[i])*N;
+        const double* f=fv+size_t(fidx[i])*N;
+        for (size_t k=0; k<N; ++k)
+          s[k] += f[k] * m[i];
+      }
+  }
 }
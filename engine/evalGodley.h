@@ -55,6 +55,16 @@ namespace minsky
     /// size \c stockVars and \a fv is assumed to be of size \c
     /// flowVars.
     void eval(double sv[], const double fv[]) const;
+    /// as for eval(), over an ensemble of \a N instances stored
+    /// structure of arrays (see EvalOpProgram::evalBatch)
+    void evalBatch(double sv[], const double fv[], size_t N) const;
+
+    /// calls \a f(stockIdx, flowIdx) for each flow variable
+    /// contributing to a stock variable
+    template <class F> void forEachEntry(F f) const {
+      for (size_t i=0; i<sidx.size(); ++i)
+        f(sidx[i], fidx[i]);
+    }
 
     EvalGodley():  compatibility(false) {}
     /// if compatibility is true, then consttrainst between Godley
@@ -22,10 +22,15 @@
 #include "variable.h"
 #include "minsky.h"
 #include "str.h"
+#include "threadPool.h"
+#include "elementwiseOp.h"
 
 #include "minsky_epilogue.h"
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits>
 #undef Complex 
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/math/special_functions/polygamma.hpp>
@@ -83,6 +88,24 @@ namespace minsky
           }
   };
 
+  bool ScalarEvalOp::flowInputs(std::vector<Range>& ranges) const
+  {
+    if (numArgs()>0 && flow1)
+      for (auto i: in1)
+        ranges.emplace_back(i,i+1);
+    if (numArgs()>1 && flow2)
+      for (auto& i: in2)
+        for (auto& j: i)
+          ranges.emplace_back(j.idx,j.idx+1);
+    return true;
+  }
+
+  EvalOpBase::Range ScalarEvalOp::flowOutput() const
+  {
+    if (out<0) return Range(0,0);
+    return Range(out, out+max(in1.size(),size_t(1)));
+  }
+
   void ScalarEvalOp::deriv(double df[], size_t n, const double ds[],
                      const double sv[], const double fv[])
   {
@@ -133,12 +156,16 @@ namespace minsky
   double EvalOp<OperationType::constant>::d2(double x1, double x2) const
   {return 0;}
 
-  double EvalOpBase::t;
+  double& EvalOpBase::t()
+  {
+    static thread_local double t=0;
+    return t;
+  }
   string EvalOpBase::timeUnit;
 
   template <>
   double EvalOp<OperationType::time>::evaluate(double in1, double in2) const
-  {return t;}
+  {return t();}
   template <> 
   double EvalOp<OperationType::time>::d1(double x1, double x2) const
   {return 0;}
@@ -198,7 +225,7 @@ namespace minsky
   
   template <>
   double EvalOp<OperationType::copy>::evaluate(double in1, double in2) const
-  {return in1;}
+  {return ElementwiseOp<OperationType::copy>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::copy>::d1(double x1, double x2) const
   {return 1;}
@@ -248,7 +275,7 @@ namespace minsky
 
   template <> 
   double EvalOp<OperationType::sqrt>::evaluate(double in1, double in2) const
-  {return ::sqrt(fabs(in1));}
+  {return ElementwiseOp<OperationType::sqrt>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::sqrt>::d1(double x1, double x2) const
   {return 0.5/::sqrt(fabs(x1));}
@@ -258,7 +285,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::exp>::evaluate(double in1, double in2) const
-  {return ::exp(in1);}
+  {return ElementwiseOp<OperationType::exp>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::exp>::d1(double x1, double x2) const
   {return ::exp(x1);}
@@ -268,7 +295,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::ln>::evaluate(double in1, double in2) const
-  {return ::log(in1);}
+  {return ElementwiseOp<OperationType::ln>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::ln>::d1(double x1, double x2) const
   {return 1/x1;}
@@ -278,7 +305,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::log>::evaluate(double in1, double in2) const
-  {return ::log(in1)/::log(in2);}
+  {return ElementwiseOp<OperationType::log>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::log>::d1(double x1, double x2) const
   {return 1/(x1*::log(x2));}
@@ -288,7 +315,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::pow>::evaluate(double in1, double in2) const
-  {return ::pow(in1,in2);}
+  {return ElementwiseOp<OperationType::pow>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::pow>::d1(double x1, double x2) const
   {return ::pow(x1,x2)*x2/x1;}
@@ -298,7 +325,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::lt>::evaluate(double in1, double in2) const
-  {return in1<in2;}
+  {return ElementwiseOp<OperationType::lt>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::lt>::d1(double x1, double x2) const
   {throw error("lt cannot be used with an implicit method");}
@@ -308,7 +335,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::le>::evaluate(double in1, double in2) const
-  {return in1<=in2;}
+  {return ElementwiseOp<OperationType::le>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::le>::d1(double x1, double x2) const
   {throw error("le cannot be used with an implicit method");}
@@ -318,7 +345,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::eq>::evaluate(double in1, double in2) const
-  {return in1==in2;}
+  {return ElementwiseOp<OperationType::eq>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::eq>::d1(double x1, double x2) const
   {throw error("eq cannot be used with an implicit method");}
@@ -328,7 +355,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::min>::evaluate(double in1, double in2) const
-  {return std::min(in1,in2);}
+  {return ElementwiseOp<OperationType::min>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::min>::d1(double x1, double x2) const
   {return x1<=x2;} // TODO: thow exception if x1==x2?
@@ -338,7 +365,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::max>::evaluate(double in1, double in2) const
-  {return std::max(in1,in2);}
+  {return ElementwiseOp<OperationType::max>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::max>::d1(double x1, double x2) const
   {return x1>x2;} // TODO: thow exception if x1==x2?
@@ -348,7 +375,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::and_>::evaluate(double in1, double in2) const
-  {return in1>0.5 && in2>0.5;}
+  {return ElementwiseOp<OperationType::and_>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::and_>::d1(double x1, double x2) const
   {throw error("and cannot be used with an implicit method");}
@@ -358,7 +385,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::or_>::evaluate(double in1, double in2) const
-  {return in1>0.5 || in2>0.5;}
+  {return ElementwiseOp<OperationType::or_>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::or_>::d1(double x1, double x2) const
   {throw error("or cannot be used with an implicit method");}
@@ -368,7 +395,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::not_>::evaluate(double in1, double in2) const
-  {return in1<=0.5;}
+  {return ElementwiseOp<OperationType::not_>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::not_>::d1(double x1, double x2) const
   {throw error("not cannot be used with an implicit method");}
@@ -378,7 +405,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::sin>::evaluate(double in1, double in2) const
-  {return ::sin(in1);}
+  {return ElementwiseOp<OperationType::sin>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::sin>::d1(double x1, double x2) const
   {return ::cos(x1);}
@@ -388,7 +415,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::cos>::evaluate(double in1, double in2) const
-  {return ::cos(in1);}
+  {return ElementwiseOp<OperationType::cos>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::cos>::d1(double x1, double x2) const
   {return -::sin(x1);}
@@ -398,7 +425,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::tan>::evaluate(double in1, double in2) const
-  {return ::tan(in1);}
+  {return ElementwiseOp<OperationType::tan>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::tan>::d1(double x1, double x2) const
   {return 1/sqr(::cos(x1));}
@@ -408,7 +435,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::asin>::evaluate(double in1, double in2) const
-  {return ::asin(in1);}
+  {return ElementwiseOp<OperationType::asin>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::asin>::d1(double x1, double x2) const
   {return 1/::sqrt(1-sqr(x1));}
@@ -418,7 +445,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::acos>::evaluate(double in1, double in2) const
-  {return ::acos(in1);}
+  {return ElementwiseOp<OperationType::acos>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::acos>::d1(double x1, double x2) const
   {return -1/::sqrt(1-sqr(x1));}
@@ -428,7 +455,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::atan>::evaluate(double in1, double in2) const
-  {return ::atan(in1);}
+  {return ElementwiseOp<OperationType::atan>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::atan>::d1(double x1, double x2) const
   {return 1/(1+sqr(x1));}
@@ -438,7 +465,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::sinh>::evaluate(double in1, double in2) const
-  {return ::sinh(in1);}
+  {return ElementwiseOp<OperationType::sinh>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::sinh>::d1(double x1, double x2) const
   {return ::cosh(x1);}
@@ -448,7 +475,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::cosh>::evaluate(double in1, double in2) const
-  {return ::cosh(in1);}
+  {return ElementwiseOp<OperationType::cosh>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::cosh>::d1(double x1, double x2) const
   {return ::sinh(x1);}
@@ -458,7 +485,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::tanh>::evaluate(double in1, double in2) const
-  {return ::tanh(in1);}
+  {return ElementwiseOp<OperationType::tanh>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::tanh>::d1(double x1, double x2) const
   {return 1/sqr(::cosh(x1));}
@@ -468,7 +495,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::abs>::evaluate(double in1, double in2) const
-  {return ::fabs(in1);}
+  {return ElementwiseOp<OperationType::abs>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::abs>::d1(double x1, double x2) const
   {return (x1<0)? -1: 1;}
@@ -478,7 +505,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::floor>::evaluate(double in1, double in2) const
-  {return ::floor(in1);}
+  {return ElementwiseOp<OperationType::floor>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::floor>::d1(double x1, double x2) const
   {throw error("floor cannot be used with an implicit method");}
@@ -488,7 +515,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::frac>::evaluate(double in1, double in2) const
-  {return in1-::floor(in1);}
+  {return ElementwiseOp<OperationType::frac>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::frac>::d1(double x1, double x2) const
   {throw error("frac cannot be used with an implicit method");}
@@ -498,7 +525,7 @@ namespace minsky
   
   template <>
   double EvalOp<OperationType::percent>::evaluate(double in1, double in2) const
-  {return 100.0*in1;}
+  {return ElementwiseOp<OperationType::percent>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::percent>::d1(double x1, double x2) const
   {return 100.0;}
@@ -538,7 +565,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::add>::evaluate(double in1, double in2) const
-  {return in1+in2;}
+  {return ElementwiseOp<OperationType::add>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::add>::d1(double x1, double x2) const
   {return 1;}
@@ -548,7 +575,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::subtract>::evaluate(double in1, double in2) const
-  {return in1-in2;}
+  {return ElementwiseOp<OperationType::subtract>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::subtract>::d1(double x1, double x2) const
   {return 1;}
@@ -558,7 +585,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::multiply>::evaluate(double in1, double in2) const
-  {return in1*in2;}
+  {return ElementwiseOp<OperationType::multiply>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::multiply>::d1(double x1, double x2) const
   {return x2;}
@@ -568,7 +595,7 @@ namespace minsky
 
   template <>
   double EvalOp<OperationType::divide>::evaluate(double in1, double in2) const
-  {return in1/in2;}
+  {return ElementwiseOp<OperationType::divide>::evaluate(in1,in2);}
   template <>
   double EvalOp<OperationType::divide>::d1(double x1, double x2) const
   {return 1/x2;}
@@ -1013,4 +1040,496 @@ namespace minsky
 
   }
 
+
+  namespace
+  {
+    /// prototype instances used to evaluate lowered operations by a
+    /// qualified (non-virtual) call
+    template <OperationType::Type T> struct Prototype
+    {
+      static const EvalOp<T> op;
+      static double evaluate(double x1, double x2)
+      {return op.EvalOp<T>::evaluate(x1,x2);}
+    };
+    template <OperationType::Type T> const EvalOp<T> Prototype<T>::op;
+
+    /// returns true if operation \a t can be lowered to an instruction
+    bool lowerable(OperationType::Type t)
+    {
+      switch (t)
+        {
+        case OperationType::constant: case OperationType::time:
+        case OperationType::euler: case OperationType::pi:
+        case OperationType::zero: case OperationType::one:
+        case OperationType::inf:
+        case OperationType::add: case OperationType::subtract:
+        case OperationType::multiply: case OperationType::divide:
+        case OperationType::min: case OperationType::max:
+        case OperationType::and_: case OperationType::or_:
+        case OperationType::log: case OperationType::pow:
+        case OperationType::polygamma:
+        case OperationType::lt: case OperationType::le: case OperationType::eq:
+        case OperationType::copy: case OperationType::sqrt:
+        case OperationType::exp: case OperationType::ln:
+        case OperationType::sin: case OperationType::cos:
+        case OperationType::tan: case OperationType::asin:
+        case OperationType::acos: case OperationType::atan:
+        case OperationType::sinh: case OperationType::cosh:
+        case OperationType::tanh: case OperationType::abs:
+        case OperationType::floor: case OperationType::frac:
+        case OperationType::not_: case OperationType::percent:
+        case OperationType::gamma: case OperationType::fact:
+          return true;
+        default:
+          return false;
+        }
+    }
+
+    /// stride of the index sequence \a idx(i), i<n: 1 if
+    /// consecutive, 0 if constant and -1 otherwise
+    template <class F> int stride(F idx, size_t n)
+    {
+      bool consecutive=true, constant=true;
+      for (size_t i=1; i<n && (consecutive || constant); ++i)
+        {
+          if (idx(i)!=idx(0)+i) consecutive=false;
+          if (idx(i)!=idx(0)) constant=false;
+        }
+      return consecutive? 1: constant? 0: -1;
+    }
+  }
+
+  void EvalOpProgram::compile(const EvalOpVector& eqs)
+  {
+    clear();
+    ops=eqs;
+    for (unsigned s=0; s<ops.size(); ++s)
+      {
+        Instruction instr;
+        instr.source=s;
+        auto op=dynamic_cast<ScalarEvalOp*>(ops[s].get());
+        if (!op || op->out<0 || !lowerable(op->type()))
+          {
+            code.push_back(instr); // fallback
+            continue;
+          }
+        instr.op=op->type();
+        instr.numArgs=op->numArgs();
+        instr.flow1=op->flow1;
+        instr.flow2=op->flow2;
+        instr.checkFinite=op->in1.size()==1;
+        instr.out=op->out;
+
+        // elementwise tensor operations with regular operand layout
+        // are computed by a single vectorised instruction
+        if (instr.numArgs>0 && op->in1.size()>1 && vectorKernel(instr.op))
+          {
+            int s1=stride([&](size_t i) {return op->in1[i];}, op->in1.size());
+            int s2=s1;
+            if (instr.numArgs>1)
+              {
+                s2=-1;
+                if (all_of(op->in2.begin(), op->in2.end(), [](const vector<EvalOpBase::Support>& x)
+                           {return x.size()==1 && x[0].weight==1;}))
+                  s2=stride([&](size_t i) {return op->in2[i][0].idx;}, op->in2.size());
+              }
+            if (instr.numArgs>1 && op->in2.size()!=op->in1.size())
+              s2=-1;
+            if ((s1==1 && s2>=0) || (s1==0 && s2==1))
+              {
+                instr.count=op->in1.size();
+                instr.stride1=s1;
+                instr.stride2=s2;
+                instr.in1=op->in1[0];
+                if (instr.numArgs>1)
+                  {
+                    instr.in2Begin=support.size();
+                    support.push_back(op->in2[0][0]);
+                    instr.in2End=support.size();
+                  }
+                code.push_back(instr);
+                continue;
+              }
+          }
+
+        switch (instr.numArgs)
+          {
+          case 0:
+            if (instr.op!=OperationType::time)
+              {
+                // fold constant valued operations
+                instr.value=op->evaluate(0,0);
+                instr.op=OperationType::constant;
+              }
+            code.push_back(instr);
+            break;
+          case 1:
+            for (unsigned i=0; i<op->in1.size(); ++i)
+              {
+                instr.out=op->out+i;
+                instr.in1=op->in1[i];
+                code.push_back(instr);
+              }
+            break;
+          case 2:
+            assert(op->in1.size()==op->in2.size());
+            for (unsigned i=0; i<op->in1.size(); ++i)
+              {
+                instr.out=op->out+i;
+                instr.in1=op->in1[i];
+                instr.in2Begin=support.size();
+                support.insert(support.end(), op->in2[i].begin(), op->in2[i].end());
+                instr.in2End=support.size();
+                code.push_back(instr);
+              }
+            break;
+          }
+      }
+    level();
+  }
+
+#define LOWERED_OP(T)                                                   \
+  case OperationType::T: r=Prototype<OperationType::T>::evaluate(x1,x2); break;
+
+  inline void EvalOpProgram::exec(const Instruction& i, double fv[], size_t n,
+                                  const double sv[]) const
+  {
+    if (i.count>1)
+      {
+        assert(i.out+i.count<=n);
+        const double* x=(i.flow1? fv: sv)+i.in1;
+        if (i.numArgs>1)
+          vectorKernel(i.op)(fv+i.out, x, i.stride1, (i.flow2? fv: sv)+support[i.in2Begin].idx,
+                             i.stride2, i.count);
+        else
+          vectorKernel(i.op)(fv+i.out, x, i.stride1, x, i.stride1, i.count);
+        return;
+      }
+    double x1=0, x2=0, r;
+    if (i.numArgs>0)
+      {
+        assert(!i.flow1 || i.in1<n);
+        x1=i.flow1? fv[i.in1]: sv[i.in1];
+        if (i.numArgs>1)
+          {
+            const double* v=i.flow2? fv: sv;
+            for (unsigned j=i.in2Begin; j<i.in2End; ++j)
+              x2+=support[j].weight*v[support[j].idx];
+          }
+      }
+    switch (i.op)
+      {
+      case OperationType::constant: r=i.value; break;
+      case OperationType::time: r=EvalOpBase::t(); break;
+        LOWERED_OP(add);
+        LOWERED_OP(subtract);
+        LOWERED_OP(multiply);
+        LOWERED_OP(divide);
+        LOWERED_OP(min);
+        LOWERED_OP(max);
+        LOWERED_OP(and_);
+        LOWERED_OP(or_);
+        LOWERED_OP(log);
+        LOWERED_OP(pow);
+        LOWERED_OP(polygamma);
+        LOWERED_OP(lt);
+        LOWERED_OP(le);
+        LOWERED_OP(eq);
+        LOWERED_OP(copy);
+        LOWERED_OP(sqrt);
+        LOWERED_OP(exp);
+        LOWERED_OP(ln);
+        LOWERED_OP(sin);
+        LOWERED_OP(cos);
+        LOWERED_OP(tan);
+        LOWERED_OP(asin);
+        LOWERED_OP(acos);
+        LOWERED_OP(atan);
+        LOWERED_OP(sinh);
+        LOWERED_OP(cosh);
+        LOWERED_OP(tanh);
+        LOWERED_OP(abs);
+        LOWERED_OP(floor);
+        LOWERED_OP(frac);
+        LOWERED_OP(not_);
+        LOWERED_OP(percent);
+        LOWERED_OP(gamma);
+        LOWERED_OP(fact);
+      default:
+        ops[i.source]->eval(fv, n, sv);
+        return;
+      }
+    assert(i.out<n);
+    fv[i.out]=r;
+    if (i.checkFinite && !std::isfinite(r))
+      // rerun the reference implementation to generate the diagnostic
+      ops[i.source]->eval(fv, n, sv);
+  }
+
+  void EvalOpProgram::eval(double fv[], size_t n, const double sv[]) const
+  {
+    for (auto& i: code)
+      exec(i, fv, n, sv);
+  }
+
+  namespace
+  {
+    /// operations with fewer elements than this are not split
+    /// across threads
+    const size_t minConcurrentElements=16384;
+  }
+
+  void EvalOpProgram::eval(double fv[], size_t n, const double sv[], SharedThreadPool& sharedPool) const
+  {
+    if (!m_concurrent)
+      {
+        eval(fv, n, sv);
+        return;
+      }
+    // operations evaluated on the pool that are themselves
+    // concurrent find it held, and run serially
+    SharedThreadPool::Lease pool(sharedPool);
+    if (pool.size()<2)
+      {
+        eval(fv, n, sv);
+        return;
+      }
+    vector<ThreadPool::Task> tasks;
+    // pool threads evaluate at the calling thread's time
+    double t=EvalOpBase::t();
+    for (auto& l: levels)
+      {
+        for (auto i: l.sequential)
+          exec(code[i], fv, n, sv);
+        tasks.clear();
+        for (auto i: l.concurrent)
+          {
+            auto op=ops[code[i].source].get();
+            size_t size=op->prepareEval(fv, n, sv);
+            if (!size)
+              tasks.emplace_back([=]() {EvalOpBase::t()=t; op->eval(fv, n, sv);});
+            else
+              {
+                size_t chunks=size<minConcurrentElements? 1:
+                  min(size_t(4*pool.size()), size/(minConcurrentElements/4));
+                for (size_t c=0; c<chunks; ++c)
+                  {
+                    size_t begin=c*size/chunks, end=(c+1)*size/chunks;
+                    tasks.emplace_back([=]() {EvalOpBase::t()=t; op->evalRange(begin,end);});
+                  }
+              }
+          }
+        if (tasks.size()==1)
+          tasks[0]();
+        else
+          pool.run(tasks);
+      }
+  }
+
+  void EvalOpProgram::level()
+  {
+    levels.clear();
+    m_concurrent=false;
+    // one more than the level of the last instruction writing or
+    // reading each flow variable, 0 if none
+    vector<unsigned> lastWrite, lastRead;
+    auto last=[](const vector<unsigned>& v, unsigned i) {return i<v.size()? v[i]: 0;};
+    auto mark=[](vector<unsigned>& v, unsigned i, unsigned l) {
+      if (i>=v.size()) v.resize(i+1,0);
+      if (l>v[i]) v[i]=l;
+    };
+    unsigned barrier=0; // instructions with unknown dependencies act as a barrier
+    vector<EvalOpBase::Range> inputs;
+    for (unsigned k=0; k<code.size(); ++k)
+      {
+        auto& i=code[k];
+        inputs.clear();
+        EvalOpBase::Range output;
+        bool known=true, concurrent=false;
+        if (i.op==OperationType::numOps)
+          {
+            auto& op=*ops[i.source];
+            known=op.flowInputs(inputs);
+            output=op.flowOutput();
+            concurrent=known && op.concurrentEval();
+          }
+        else
+          {
+            output=EvalOpBase::Range(i.out, i.out+i.count);
+            if (i.numArgs>0 && i.flow1)
+              inputs.emplace_back(i.in1, i.in1+(i.count-1)*i.stride1+1);
+            if (i.numArgs>1 && i.flow2)
+              for (unsigned j=i.in2Begin; j<i.in2End; ++j)
+                inputs.emplace_back(support[j].idx, support[j].idx+(i.count-1)*i.stride2+1);
+          }
+
+        unsigned l=barrier;
+        if (known)
+          {
+            // after the writers of its inputs, and the previous
+            // readers and writers of its output
+            for (auto& r: inputs)
+              for (auto j=r.first; j<r.second; ++j)
+                l=max(l, last(lastWrite,j));
+            for (auto j=output.first; j<output.second; ++j)
+              l=max(l, max(last(lastWrite,j), last(lastRead,j)));
+            for (auto& r: inputs)
+              for (auto j=r.first; j<r.second; ++j)
+                mark(lastRead, j, l+1);
+            for (auto j=output.first; j<output.second; ++j)
+              mark(lastWrite, j, l+1);
+          }
+        else
+          {
+            l=max(barrier, unsigned(levels.size()));
+            barrier=l+1;
+          }
+
+        if (l>=levels.size()) levels.resize(l+1);
+        if (concurrent)
+          {
+            levels[l].concurrent.push_back(k);
+            if (levels[l].concurrent.size()>1 ||
+                output.second-output.first>=minConcurrentElements)
+              m_concurrent=true;
+          }
+        else
+          levels[l].sequential.push_back(k);
+      }
+  }
+#undef LOWERED_OP
+
+  namespace
+  {
+    /// evaluate an instruction over an ensemble of \a N instances.
+    /// The second argument is accumulated into the output prior to
+    /// applying \a f, as the output never aliases an input.
+    template <class F>
+    void batchApply(const EvalOpProgram::Instruction& i, const EvalOpBase::Support* support,
+                    double fv[], const double sv[], size_t N, F f)
+    {
+      for (unsigned e=0; e<i.count; ++e)
+        {
+          double* r=fv+size_t(i.out+e)*N;
+          if (i.numArgs==0)
+            {
+              for (size_t k=0; k<N; ++k) r[k]=f(0,0);
+              continue;
+            }
+          const double* x1=(i.flow1? fv: sv)+size_t(i.in1+e*i.stride1)*N;
+          if (i.numArgs==1)
+            {
+              for (size_t k=0; k<N; ++k) r[k]=f(x1[k],0);
+              continue;
+            }
+          const double* v=i.flow2? fv: sv;
+          fill(r, r+N, 0.0);
+          for (unsigned j=i.in2Begin; j<i.in2End; ++j)
+            {
+              const double* x2=v+size_t(support[j].idx+e*i.stride2)*N;
+              double w=support[j].weight;
+              for (size_t k=0; k<N; ++k) r[k]+=w*x2[k];
+            }
+          for (size_t k=0; k<N; ++k) r[k]=f(x1[k],r[k]);
+        }
+    }
+  }
+
+#define BATCH_OP(T)                                                     \
+  case OperationType::T:                                                \
+    batchApply(i, support.data(), fv, sv, N, [](double x1, double x2)   \
+               {return Prototype<OperationType::T>::evaluate(x1,x2);}); \
+    break;
+
+  void EvalOpProgram::evalBatch(double fv[], size_t n, const double sv[],
+                                size_t N, double t) const
+  {
+    for (auto& i: code)
+      switch (i.op)
+        {
+        case OperationType::constant:
+          {
+            double value=i.value;
+            batchApply(i, support.data(), fv, sv, N, [=](double,double) {return value;});
+            break;
+          }
+        case OperationType::time:
+          batchApply(i, support.data(), fv, sv, N, [=](double,double) {return t;});
+          break;
+          BATCH_OP(add);
+          BATCH_OP(subtract);
+          BATCH_OP(multiply);
+          BATCH_OP(divide);
+          BATCH_OP(min);
+          BATCH_OP(max);
+          BATCH_OP(and_);
+          BATCH_OP(or_);
+          BATCH_OP(log);
+          BATCH_OP(pow);
+          BATCH_OP(polygamma);
+          BATCH_OP(lt);
+          BATCH_OP(le);
+          BATCH_OP(eq);
+          BATCH_OP(copy);
+          BATCH_OP(sqrt);
+          BATCH_OP(exp);
+          BATCH_OP(ln);
+          BATCH_OP(sin);
+          BATCH_OP(cos);
+          BATCH_OP(tan);
+          BATCH_OP(asin);
+          BATCH_OP(acos);
+          BATCH_OP(atan);
+          BATCH_OP(sinh);
+          BATCH_OP(cosh);
+          BATCH_OP(tanh);
+          BATCH_OP(abs);
+          BATCH_OP(floor);
+          BATCH_OP(frac);
+          BATCH_OP(not_);
+          BATCH_OP(percent);
+          BATCH_OP(gamma);
+          BATCH_OP(fact);
+        default:
+          {
+            // scalar operations not lowered are called virtually per element
+            auto op=dynamic_cast<const ScalarEvalOp*>(ops[i.source].get());
+            if (!op)
+              throw runtime_error("tensor operations not supported in ensemble evaluation");
+            if (op->out<0) break;
+            assert(op->out+max(op->in1.size(),size_t(1))<=n);
+            double* r=fv+size_t(op->out)*N;
+            const double* v1=op->flow1? fv: sv;
+            const double* v2=op->flow2? fv: sv;
+            switch (op->numArgs())
+              {
+              case 0:
+                fill(r, r+N, op->evaluate(0,0));
+                break;
+              case 1:
+                for (size_t e=0; e<op->in1.size(); ++e, r+=N)
+                  {
+                    const double* x1=v1+size_t(op->in1[e])*N;
+                    for (size_t k=0; k<N; ++k) r[k]=op->evaluate(x1[k],0);
+                  }
+                break;
+              case 2:
+                for (size_t e=0; e<op->in1.size(); ++e, r+=N)
+                  {
+                    const double* x1=v1+size_t(op->in1[e])*N;
+                    fill(r, r+N, 0.0);
+                    for (auto& j: op->in2[e])
+                      {
+                        const double* x2=v2+size_t(j.idx)*N;
+                        for (size_t k=0; k<N; ++k) r[k]+=j.weight*x2[k];
+                      }
+                    for (size_t k=0; k<N; ++k) r[k]=op->evaluate(x1[k],r[k]);
+                  }
+                break;
+              }
+          }
+        }
+  }
+#undef BATCH_OP
+
 }
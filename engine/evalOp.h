@@ -43,14 +43,18 @@ namespace minsky
   using namespace classdesc;
   using namespace std;
 
+  class SharedThreadPool;
+
   struct EvalOpBase: public classdesc::PolyBase<minsky::OperationType::Type>,
                      //                     virtual public classdesc::PolyPackBase,
                      public OperationType
   {
     typedef OperationType::Type Type;
 
-    // value used for the time operator
-    static double t;
+    /// value used for the time operator. Each thread has its own, so
+    /// that the simulation worker steps at its own time whilst the
+    /// GUI thread evaluates at the time last installed.
+    static double& t();
     static std::string timeUnit;
 
     /// indexes into the flow/stock variables vector
@@ -95,12 +99,39 @@ namespace minsky
     /// evaluate expression on sv and current value of fv, storing result
     /// in output variable (of \a fv)
     /// @param n - size of fv array
-    virtual void eval(double fv[]=&ValueVector::flowVars[0], size_t n=ValueVector::flowVars.size(), 
-                      const double sv[]=&ValueVector::stockVars[0])=0;
+    virtual void eval(double fv[]=ValueVector::flowVars.data(), size_t n=ValueVector::flowVars.size(), 
+                      const double sv[]=ValueVector::stockVars.data())=0;
  
 
     /// set additional tensor operation related parameters
     virtual void setTensorParams(const VariableValue&,const OperationBase&) {}
+
+    /// @{ dependency information and concurrent evaluation support,
+    /// used by EvalOpProgram
+    typedef std::pair<unsigned,unsigned> Range; ///< [first,second)
+    /// append the flow variable ranges read by eval
+    /// @return false if not known
+    virtual bool flowInputs(std::vector<Range>&) const {return false;}
+    /// flow variable range written by eval
+    virtual Range flowOutput() const {return Range(0,0);}
+    /// true if this may be evaluated concurrently with operations
+    /// that neither read nor write its output
+    virtual bool concurrentEval() const {return false;}
+    /// prepare for evalRange
+    /// @return number of elements that may be computed in disjoint
+    /// ranges concurrently by evalRange, or 0 if eval must be called
+    /// instead
+    virtual size_t prepareEval(double[], size_t, const double[]) {return 0;}
+    /// compute elements [begin, end) of the output, after prepareEval
+    virtual void evalRange(size_t /*begin*/, size_t /*end*/) {}
+    /// @}
+
+    /// set the hypercube of a tensor valued output from that of the
+    /// operation's arguments, which may have changed since
+    /// construction. Called by the thread owning the variable values
+    /// whilst the equations are not being evaluated elsewhere, rather
+    /// than by eval, which may run on the simulation worker.
+    virtual void updateHypercube() {}
   };
 
   /// Legacy EvalOp base interface
@@ -116,6 +147,8 @@ namespace minsky
                        const double sv[], const double fv[]) override;
 
     void eval(double fv[], size_t, const double sv[]) override;
+    bool flowInputs(std::vector<Range>&) const override;
+    Range flowOutput() const override;
  
     /// evaluate expression on given arguments, returning result
     virtual double evaluate(double in1=0, double in2=0) const=0;
@@ -178,6 +211,101 @@ namespace minsky
 //       }
   };
 
+  /// elementwise kernel computing r[i]=op(x[i*sx], y[i*sy]) for
+  /// i<n, with strides \a sx, \a sy of 0 or 1. \a y is unused by
+  /// unary operations. \a r may overlap the operands, in which case
+  /// the elements are evaluated in order.
+  typedef void (*VectorKernel)(double* r, const double* x, size_t sx,
+                               const double* y, size_t sy, size_t n);
+  /// @return vectorised kernel for \a op, or nullptr if there is none
+  VectorKernel vectorKernel(OperationType::Type op);
+  /// instruction set selected at runtime for the vectorised kernels
+  std::string vectorISA();
+  /// if true, the exp, ln and log kernels use vectorised
+  /// approximations, accurate to within 1 ulp, in place of libm.
+  /// Compiled evaluation is then no longer bitwise identical to the
+  /// reference evaluation. Off by default.
+  extern bool approximateVectorMath;
+
+  /// A flattened, devirtualised representation of an EvalOpVector,
+  /// used for the RK inner loop. Scalar operations are lowered to a
+  /// contiguous instruction stream executed by a single switch
+  /// statement. Operations that cannot be lowered (tensor operations,
+  /// data ops etc) are called through their virtual eval method. The
+  /// EvalOpVector remains the reference implementation. Elementwise
+  /// tensor operations over contiguous (or broadcast scalar) operands
+  /// are lowered to a single instruction using a VectorKernel.
+  ///
+  /// Instructions are also levelled by their flow variable
+  /// dependencies, so that operations of the same level supporting
+  /// concurrent evaluation (tensor operations) can be executed on a
+  /// SharedThreadPool.
+  class EvalOpProgram
+  {
+  public:
+    struct Instruction
+    {
+      /// opcode. Constant valued ops are folded to
+      /// OperationType::constant, and numOps indicates a fallback to
+      /// the virtual EvalOpBase::eval() of the source operation
+      OperationType::Type op=OperationType::numOps;
+      int numArgs=0;
+      bool flow1=true, flow2=true;
+      /// check result is finite (scalar ops only)
+      bool checkFinite=false;
+      unsigned out=0, in1=0;
+      /// range of in2 support entries within the support vector
+      unsigned in2Begin=0, in2End=0;
+      /// value of a constant operation
+      double value=0;
+      /// index of the originating operation within the EvalOpVector
+      unsigned source=0;
+      /// number of elements computed by a vectorised instruction. in1
+      /// and the in2 support index advance by stride1 and stride2 (0
+      /// or 1) per element
+      unsigned count=1, stride1=1, stride2=1;
+    };
+
+    /// lower \a ops into an instruction stream
+    void compile(const EvalOpVector& ops);
+    /// evaluate the program, with the same semantics as calling
+    /// EvalOpBase::eval on each element of the source EvalOpVector
+    void eval(double fv[], size_t n, const double sv[]) const;
+    /// as eval, executing independent operations and the element
+    /// ranges of large operations concurrently on \a pool, if it is
+    /// free
+    void eval(double fv[], size_t n, const double sv[], SharedThreadPool& pool) const;
+    /// true if the program benefits from concurrent evaluation
+    bool concurrent() const {return m_concurrent;}
+    /// evaluate the program over an ensemble of \a N model
+    /// instances, stored structure of arrays, ie element i of
+    /// instance k is at fv[i*N+k] and sv[i*N+k]. \a n is the number
+    /// of flow variables per instance, and \a t is the simulation
+    /// time, used in place of EvalOpBase::t(). Non-finite results are
+    /// propagated rather than thrown.
+    /// @throw if the program contains tensor operations
+    void evalBatch(double fv[], size_t n, const double sv[], size_t N, double t) const;
+    void clear() {code.clear(); support.clear(); ops.clear(); levels.clear(); m_concurrent=false;}
+    size_t size() const {return code.size();}
+    const std::vector<Instruction>& instructions() const {return code;}
+  private:
+    CLASSDESC_ACCESS(EvalOpProgram);
+    std::vector<Instruction> code;
+    std::vector<EvalOpBase::Support> support;
+    /// source operations, used for fallback and error reporting
+    EvalOpVector ops;
+    /// instructions (indices into code) of each dependency level,
+    /// executed in order. Instructions within a level are independent.
+    struct Level
+    {
+      std::vector<unsigned> sequential; ///< executed on the calling thread
+      std::vector<unsigned> concurrent; ///< executed on the thread pool
+    };
+    std::vector<Level> levels;
+    bool m_concurrent=false;
+    void level();
+    void exec(const Instruction&, double fv[], size_t n, const double sv[]) const;
+  };
 
 }
 
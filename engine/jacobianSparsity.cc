@@ -0,0 +1,149 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jacobianSparsity.h"
+#include "minsky_epilogue.h"
+
+#include <algorithm>
+#include <iterator>
+using namespace std;
+
+namespace minsky
+{
+  namespace
+  {
+    /// set of stock variables a flow or stock derivative depends on
+    struct Dependencies
+    {
+      bool allStocks=false; // conservatively depends on everything
+      vector<unsigned> stocks; // sorted
+      void merge(const Dependencies& x) {
+        if (allStocks) return;
+        if (x.allStocks) {allStocks=true; stocks.clear(); return;}
+        vector<unsigned> tmp;
+        tmp.reserve(stocks.size()+x.stocks.size());
+        set_union(stocks.begin(), stocks.end(), x.stocks.begin(), x.stocks.end(),
+                  back_inserter(tmp));
+        stocks.swap(tmp);
+      }
+      void addStock(unsigned s) {
+        if (allStocks) return;
+        auto i=lower_bound(stocks.begin(), stocks.end(), s);
+        if (i==stocks.end() || *i!=s) stocks.insert(i,s);
+      }
+    };
+  }
+
+  void JacobianSparsity::analyse
+  (const EvalOpVector& equations, const EvalGodley& evalGodley,
+   const vector<Integral>& integrals, size_t nStocks, size_t nFlows)
+  {
+    clear();
+    vector<Dependencies> flowDeps(nFlows);
+    auto addInput=[&](Dependencies& d, bool flow, unsigned idx) {
+      if (flow)
+        {
+          if (idx<nFlows) d.merge(flowDeps[idx]);
+        }
+      else
+        d.addStock(idx);
+    };
+
+    bool tensorOps=false;
+    // propagate dependencies forward through the operations in evaluation order
+    for (auto& e: equations)
+      if (auto op=dynamic_cast<const ScalarEvalOp*>(e.get()))
+        {
+          if (op->out<0) continue;
+          for (size_t i=0; i<op->in1.size() && op->out+i<nFlows; ++i)
+            {
+              Dependencies d;
+              if (op->numArgs()>0)
+                addInput(d, op->flow1, op->in1[i]);
+              if (op->numArgs()>1 && i<op->in2.size())
+                for (auto& j: op->in2[i])
+                  addInput(d, op->flow2, j.idx);
+              if (!tensorOps)
+                flowDeps[op->out+i]=move(d);
+            }
+        }
+      else
+        {
+          // tensor operations may read and write any flow variable,
+          // so conservatively treat everything downstream as dense
+          Dependencies d; d.allStocks=true;
+          fill(flowDeps.begin(), flowDeps.end(), d);
+          tensorOps=true;
+        }
+
+    // rows of the Jacobian are the stock variable derivatives
+    vector<Dependencies> rowDeps(nStocks);
+    evalGodley.forEachEntry([&](int s, int f) {
+        if (s>=0 && size_t(s)<nStocks) addInput(rowDeps[s], true, f);
+      });
+    for (auto& i: integrals)
+      if (i.stock.idx()>=0 && size_t(i.stock.idx())<nStocks && i.input.idx()>=0)
+        addInput(rowDeps[i.stock.idx()], i.input.isFlowVar(), i.input.idx());
+
+    // transpose into column structure
+    columnRows.resize(nStocks);
+    vector<unsigned> denseRows;
+    for (unsigned i=0; i<nStocks; ++i)
+      if (rowDeps[i].allStocks)
+        denseRows.push_back(i);
+      else
+        for (auto j: rowDeps[i].stocks)
+          if (j<nStocks)
+            columnRows[j].push_back(i);
+    if (!denseRows.empty())
+      {
+        // every column intersects the dense rows, so one colour per column
+        for (unsigned j=0; j<nStocks; ++j)
+          {
+            auto& c=columnRows[j];
+            vector<unsigned> tmp;
+            set_union(c.begin(), c.end(), denseRows.begin(), denseRows.end(),
+                      back_inserter(tmp));
+            c.swap(tmp);
+            colourGroups.emplace_back(1,j);
+          }
+        return;
+      }
+
+    // greedy colouring of the column intersection graph
+    vector<int> colour(nStocks,-1);
+    vector<unsigned> forbiddenBy; // column last forbidding each colour
+    for (unsigned j=0; j<nStocks; ++j)
+      {
+        for (auto i: columnRows[j])
+          for (auto k: rowDeps[i].stocks)
+            if (k<nStocks && colour[k]>=0)
+              forbiddenBy[colour[k]]=j+1;
+        unsigned c=0;
+        for (; c<forbiddenBy.size() && forbiddenBy[c]==j+1; ++c);
+        if (c==forbiddenBy.size())
+          {
+            forbiddenBy.push_back(0);
+            colourGroups.emplace_back();
+          }
+        colour[j]=c;
+        colourGroups[c].push_back(j);
+      }
+  }
+}
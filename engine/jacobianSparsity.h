@@ -0,0 +1,53 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JACOBIANSPARSITY_H
+#define JACOBIANSPARSITY_H
+
+#include "evalOp.h"
+#include "evalGodley.h"
+#include "integral.h"
+#include <vector>
+
+namespace minsky
+{
+  /// Structure of the Jacobian of the system of equations, computed
+  /// by dependency analysis of the EvalOpVector, Godley tables and
+  /// integrals. Columns are grouped by colour (Curtis-Powell-Reid),
+  /// such that columns sharing a colour have disjoint row sparsity,
+  /// and so can be computed in a single derivative sweep.
+  class JacobianSparsity
+  {
+  public:
+    /// columns of the Jacobian grouped by colour
+    std::vector<std::vector<unsigned>> colourGroups;
+    /// rows of the nonzero entries of each column
+    std::vector<std::vector<unsigned>> columnRows;
+
+    /// analyse the dependency structure of the system
+    void analyse(const EvalOpVector& equations, const EvalGodley& evalGodley,
+                 const std::vector<Integral>& integrals,
+                 size_t nStocks, size_t nFlows);
+    size_t numColours() const {return colourGroups.size();}
+    size_t numColumns() const {return columnRows.size();}
+    void clear() {colourGroups.clear(); columnRows.clear();}
+  };
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "matrixProduct.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// see evalOp.cc
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__ELF__)
+#define MATRIX_KERNEL_TARGETS __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define MATRIX_KERNEL_TARGETS
+#endif
+
+namespace minsky
+{
+  namespace
+  {
+    // register tile of the result
+    const size_t MR=8, NR=6;
+    // cache blocking: a packed MC×KC block of a remains in L2 cache,
+    // and a KC×NR sliver of b in L1 cache
+    const size_t MC=128, KC=256, NC=4096;
+    // products with fewer multiply-adds than this are computed serially
+    const double minParallelWork=1e6;
+
+    inline double missingAsZero(double x) {return isnan(x)? 0: x;}
+
+    /// pack rows [i0,i0+mc) and columns [p0,p0+kc) of \a a into
+    /// slivers of MR rows, stored column by column, zero padded
+    void packA(double* buf, const MatrixView& a, size_t i0, size_t mc, size_t p0, size_t kc)
+    {
+      for (size_t ir=0; ir<mc; ir+=MR)
+        for (size_t p=0; p<kc; ++p)
+          for (size_t i=0; i<MR; ++i)
+            *buf++=ir+i<mc? missingAsZero(a(i0+ir+i, p0+p)): 0;
+    }
+
+    /// pack rows [p0,p0+kc) and columns [j0,j0+nc) of \a b into
+    /// slivers of NR columns, stored row by row, zero padded
+    void packB(double* buf, const MatrixView& b, size_t p0, size_t kc, size_t j0, size_t nc)
+    {
+      for (size_t jr=0; jr<nc; jr+=NR)
+        for (size_t p=0; p<kc; ++p)
+          for (size_t j=0; j<NR; ++j)
+            *buf++=jr+j<nc? missingAsZero(b(p0+p, j0+jr+j)): 0;
+    }
+
+    /// c(mc×nc) (+)= packed a(mc×kc) · packed b(kc×nc), where c has
+    /// leading dimension ldc
+    MATRIX_KERNEL_TARGETS
+    void blockProduct(double* c, size_t ldc, const double* ap, const double* bp,
+                      size_t mc, size_t nc, size_t kc, bool accumulate)
+    {
+      for (size_t jr=0; jr<nc; jr+=NR)
+        for (size_t ir=0; ir<mc; ir+=MR)
+          {
+            double t[MR*NR]={0};
+            const double* a=ap+ir*kc, *b=bp+jr*kc;
+            for (size_t p=0; p<kc; ++p, a+=MR, b+=NR)
+              for (size_t j=0; j<NR; ++j)
+                for (size_t i=0; i<MR; ++i)
+                  t[i+MR*j]+=a[i]*b[j];
+            size_t mr=min(MR, mc-ir), nr=min(NR, nc-jr);
+            for (size_t j=0; j<nr; ++j)
+              {
+                double* cj=c+ir+(jr+j)*ldc;
+                for (size_t i=0; i<mr; ++i)
+                  cj[i]=accumulate? cj[i]+t[i+MR*j]: t[i+MR*j];
+              }
+          }
+    }
+
+    /// compute the block [i0,i1)×[j0,j1) of c=a·b
+    void productBlock(double c[], const MatrixView& a, const MatrixView& b,
+                      size_t i0, size_t i1, size_t j0, size_t j1)
+    {
+      size_t m=a.rows, k=a.cols;
+      vector<double> ap((MC+MR-1)/MR*MR*KC), bp(KC*((min(NC,j1-j0)+NR-1)/NR*NR));
+      for (size_t jc=j0; jc<j1; jc+=NC)
+        {
+          size_t nc=min(NC, j1-jc);
+          for (size_t pc=0; pc<k; pc+=KC)
+            {
+              size_t kc=min(KC, k-pc);
+              packB(bp.data(), b, pc, kc, jc, nc);
+              for (size_t ic=i0; ic<i1; ic+=MC)
+                {
+                  size_t mc=min(MC, i1-ic);
+                  packA(ap.data(), a, ic, mc, pc, kc);
+                  blockProduct(c+ic+jc*m, m, ap.data(), bp.data(), mc, nc, kc, pc>0);
+                }
+            }
+        }
+    }
+  }
+
+  void matrixProduct(double c[], const MatrixView& a, const MatrixView& b)
+  {
+    assert(a.cols==b.rows);
+    size_t m=a.rows, n=b.cols, k=a.cols;
+    if (k==0)
+      {
+        fill(c, c+m*n, 0.0);
+        return;
+      }
+
+    SharedThreadPool::Lease pool(sharedThreadPool());
+    unsigned nThreads=double(m)*n*k>=minParallelWork? pool.size(): 1;
+    // split the larger dimension of the result between threads, in
+    // multiples of the register tile
+    size_t chunks=min(size_t(nThreads), n>=m? (n+NR-1)/NR: (m+MR-1)/MR);
+    if (chunks<2)
+      {
+        productBlock(c, a, b, 0, m, 0, n);
+        return;
+      }
+    vector<ThreadPool::Task> tasks;
+    for (size_t t=0; t<chunks; ++t)
+      if (n>=m)
+        {
+          size_t j0=(n+NR-1)/NR*t/chunks*NR, j1=min(n, (n+NR-1)/NR*(t+1)/chunks*NR);
+          tasks.emplace_back([=,&a,&b]() {productBlock(c, a, b, 0, m, j0, j1);});
+        }
+      else
+        {
+          size_t i0=(m+MR-1)/MR*t/chunks*MR, i1=min(m, (m+MR-1)/MR*(t+1)/chunks*MR);
+          tasks.emplace_back([=,&a,&b]() {productBlock(c, a, b, i0, i1, 0, n);});
+        }
+    pool.run(tasks);
+  }
+}
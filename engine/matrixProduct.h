@@ -0,0 +1,45 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MATRIXPRODUCT_H
+#define MATRIXPRODUCT_H
+
+#include <stddef.h>
+
+namespace minsky
+{
+  /// a matrix stored in a flat array, element (i,j) being at
+  /// data[i*rowStride+j*colStride]
+  struct MatrixView
+  {
+    const double* data;
+    size_t rows, cols, rowStride, colStride;
+    MatrixView(const double* data, size_t rows, size_t cols, size_t rowStride, size_t colStride):
+      data(data), rows(rows), cols(cols), rowStride(rowStride), colStride(colStride) {}
+    double operator()(size_t i, size_t j) const {return data[i*rowStride+j*colStride];}
+  };
+
+  /// Computes c=a·b, where c is stored column major,
+  /// ie c(i,j)=c[i+a.rows*j]. NaN (missing) elements of \a a and \a b
+  /// are treated as zero. The product is cache blocked and register
+  /// tiled, and large products are computed in parallel.
+  void matrixProduct(double c[], const MatrixView& a, const MatrixView& b);
+}
+
+#endif
@@ -19,8 +19,12 @@
 
 #include <classdesc.h>
 #include "minskyTensorOps.h"
+#include "matrixProduct.h"
+#include "ravelPlan.h"
+#include "threadPool.h"
 #include "minsky.h"
 #include "ravelWrap.h"
+#include <cstring>
 #include "minsky_epilogue.h"
 
 using namespace civita;
@@ -37,6 +41,47 @@ namespace minsky
 
   TensorOpFactory tensorOpFactory;
 
+  void EvalCommon::check(size_t i) const
+  {
+    auto& input=versions[i];
+    if (!input.evaluated || input.checked==m_updates) return;
+    input.checked=m_updates;
+    auto& v=*input.value;
+    const double* data=v.isFlowVar()? m_flowVars: m_stockVars;
+    if (!data || v.idx()<0)
+      {
+        input.values.clear();
+        input.change(m_timestamp,0);
+        return;
+      }
+    // compare bitwise, as missing data is represented by NaN
+    auto begin=data+v.idx();
+    size_t n=v.size();
+    if (input.values.size()!=n)
+      {
+        input.values.assign(begin, begin+n);
+        input.change(m_timestamp,0);
+      }
+    else if (memcmp(begin, input.values.data(), n*sizeof(double))!=0)
+      {
+        size_t first=0;
+        while (memcmp(begin+first, &input.values[first], sizeof(double))==0)
+          ++first;
+        copy(begin+first, begin+n, input.values.begin()+first);
+        input.change(m_timestamp,first);
+      }
+  }
+
+  size_t EvalCommon::firstChangedSince(size_t i, ITensor::Timestamp t) const
+  {
+    check(i);
+    auto& input=versions[i];
+    if (input.changed<=t) return input.value->size();
+    // changes before the last one are not recorded
+    if (input.previous>t) return 0;
+    return input.first;
+  }
+
   struct DerivativeNotDefined: public std::exception
   {
     const char* what() const throw() {return "Derivative not defined";}
@@ -45,7 +90,7 @@ namespace minsky
   struct TimeOp: public ITensor
   {
     size_t size() const override {return 1;}
-    double operator[](size_t) const override {return EvalOpBase::t;}
+    double operator[](size_t) const override {return EvalOpBase::t();}
     Timestamp timestamp() const override {return {};}
   };
   
@@ -54,6 +99,8 @@ namespace minsky
   {
     EvalOp<op> eo;
     MinskyTensorOp(): ElementWiseOp([this](double x){return eo.evaluate(x);}) {}
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {evalBlockWith([this](double x){return eo.EvalOp<op>::evaluate(x);}, r, begin, n);}
     void setArguments(const std::vector<TensorPtr>& a,const std::string&,double) override
     {if (!a.empty()) setArgument(a[0],{},0);}
     double dFlow(size_t ti, size_t fi) const override {
@@ -76,6 +123,8 @@ namespace minsky
   {
     EvalOp<op> eo;
     TensorBinOp(): BinOp([this](double x,double y){return eo.evaluate(x,y);}) {}
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {evalBlockWith([this](double x,double y){return eo.EvalOp<op>::evaluate(x,y);}, r, begin, n);}
     void setArguments(const std::vector<TensorPtr>& a1, const std::vector<TensorPtr>& a2) override
     {
       civita::BinOp::setArguments
@@ -109,34 +158,55 @@ namespace minsky
 
   template <OperationType::Type op> struct AccumArgs;
 
-  template <> struct AccumArgs<OperationType::add>: public civita::ReduceArguments
+  /// ReduceArguments accumulating with the static member T::accum,
+  /// which is called directly by block evaluation
+  template <class T> struct AccumArgsBase: public civita::ReduceArguments
   {
-    AccumArgs(): civita::ReduceArguments([](double& x,double y){x+=y;},0) {}
+    AccumArgsBase(double init): civita::ReduceArguments(T::accum,init) {}
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {evalBlockWith(T::accum,r,begin,n);}
+  };
+
+  template <> struct AccumArgs<OperationType::add>:
+    public AccumArgsBase<AccumArgs<OperationType::add>>
+  {
+    static void accum(double& x,double y) {x+=y;}
+    AccumArgs(): AccumArgsBase(0) {}
   };
   template <> struct AccumArgs<OperationType::subtract>: public AccumArgs<OperationType::add> {};
 
-  template <> struct AccumArgs<OperationType::multiply>: public civita::ReduceArguments
+  template <> struct AccumArgs<OperationType::multiply>:
+    public AccumArgsBase<AccumArgs<OperationType::multiply>>
   {
-    AccumArgs(): civita::ReduceArguments([](double& x,double y){x*=y;},1) {}
+    static void accum(double& x,double y) {x*=y;}
+    AccumArgs(): AccumArgsBase(1) {}
   };
   template <> struct AccumArgs<OperationType::divide>: public AccumArgs<OperationType::multiply> {};
 
-  template <> struct AccumArgs<OperationType::min>: public civita::ReduceArguments
+  template <> struct AccumArgs<OperationType::min>:
+    public AccumArgsBase<AccumArgs<OperationType::min>>
   {
-    AccumArgs(): civita::ReduceArguments([](double& x,double y){if (y<x) x=y;},std::numeric_limits<double>::max()) {}
+    static void accum(double& x,double y) {if (y<x) x=y;}
+    AccumArgs(): AccumArgsBase(std::numeric_limits<double>::max()) {}
   };
-  template <> struct AccumArgs<OperationType::max>: public civita::ReduceArguments
+  template <> struct AccumArgs<OperationType::max>:
+    public AccumArgsBase<AccumArgs<OperationType::max>>
   {
-    AccumArgs(): civita::ReduceArguments([](double& x,double y){if (y>x) x=y;},-std::numeric_limits<double>::max()) {}
+    static void accum(double& x,double y) {if (y>x) x=y;}
+    AccumArgs(): AccumArgsBase(-std::numeric_limits<double>::max()) {}
   };
 
-  template <> struct AccumArgs<OperationType::and_>: public civita::ReduceArguments
+  template <> struct AccumArgs<OperationType::and_>:
+    public AccumArgsBase<AccumArgs<OperationType::and_>>
   {
-    AccumArgs(): civita::ReduceArguments([](double& x,double y){x*=(y>0.5);},1) {}
+    static void accum(double& x,double y) {x*=(y>0.5);}
+    AccumArgs(): AccumArgsBase(1) {}
   };
-  template <> struct AccumArgs<OperationType::or_>: public civita::ReduceArguments
+  template <> struct AccumArgs<OperationType::or_>:
+    public AccumArgsBase<AccumArgs<OperationType::or_>>
   {
-    AccumArgs(): civita::ReduceArguments([](double& x,double y){if (y>0.5) x=1;},0) {}
+    static void accum(double& x,double y) {if (y>0.5) x=1;}
+    AccumArgs(): AccumArgsBase(0) {}
   };
 
   
@@ -271,24 +341,265 @@ namespace minsky
 
   };
   
+  namespace
+  {
+    /// values of a dense tensor
+    vector<double> denseValues(const ITensor& x)
+    {
+      vector<double> r(x.size());
+      for (size_t i=0; i<r.size(); i+=evalBlockSize)
+        x.evalBlock(r.data()+i, i, min(evalBlockSize, r.size()-i));
+      return r;
+    }
+
+    /// most recent timestamp of the arguments that are present
+    ITensor::Timestamp latest(const TensorPtr& a1, const TensorPtr& a2)
+    {
+      ITensor::Timestamp r;
+      if (a1) r=a1->timestamp();
+      if (a2) r=max(r, a2->timestamp());
+      return r;
+    }
+
+    /// arg1 viewed as an m×k matrix, whose contracted axis has
+    /// stride \a pre. Copied into \a buf if the axis is neither first
+    /// nor last.
+    MatrixView leftView(const vector<double>& a, size_t pre, size_t m, size_t k, vector<double>& buf)
+    {
+      size_t post=m/pre;
+      if (post==1) return MatrixView(a.data(),m,k,1,pre);
+      if (pre==1) return MatrixView(a.data(),m,k,k,1);
+      buf.resize(m*k);
+      for (size_t ipost=0; ipost<post; ++ipost)
+        for (size_t p=0; p<k; ++p)
+          copy(a.begin()+pre*(p+k*ipost), a.begin()+pre*(p+k*ipost+1), buf.begin()+pre*ipost+m*p);
+      return MatrixView(buf.data(),m,k,1,m);
+    }
+
+    /// arg2 viewed as a k×n matrix, whose contracted axis has stride \a pre
+    MatrixView rightView(const vector<double>& b, size_t pre, size_t k, size_t n, vector<double>& buf)
+    {
+      size_t post=n/pre;
+      if (post==1) return MatrixView(b.data(),k,n,pre,1);
+      if (pre==1) return MatrixView(b.data(),k,n,1,k);
+      buf.resize(k*n);
+      for (size_t jpost=0; jpost<post; ++jpost)
+        for (size_t p=0; p<k; ++p)
+          for (size_t jpre=0; jpre<pre; ++jpre)
+            buf[p+k*(jpre+pre*jpost)]=b[jpre+pre*(p+k*jpost)];
+      return MatrixView(buf.data(),k,n,1,k);
+    }
+  }
+  
+  /// contracts the axis the two arguments share, matched by name,
+  /// which must have the same labels in both. If more than one axis
+  /// is shared, the last axis of the first argument and the first of
+  /// the second are contracted if they match. The result has the
+  /// remaining axes of the first argument followed by those of the
+  /// second. Missing (NaN) elements are treated as zero.
   template <>
   struct GeneralTensorOp<OperationType::innerProduct>: public civita::CachedTensorOp
   {
     std::shared_ptr<ITensor> arg1, arg2;
-    void computeTensor() const override {//TODO
-      throw runtime_error("inner product not yet implemented");
+    /// dimensions of arg1 and arg2 as matrices, m×k and k×n
+    size_t m=1, n=1, k=1;
+    /// strides of the contracted axis in arg1 and arg2
+    size_t pre1=1, pre2=1;
+    /// row of the result and contracted index of arg1's element at hypercube index \a e
+    void split1(size_t e, size_t& i, size_t& p) const {
+      size_t ipre=e%pre1; e/=pre1;
+      p=e%k;
+      i=ipre+pre1*(e/k);
+    }
+    /// contracted index and column of the result of arg2's element at hypercube index \a e
+    void split2(size_t e, size_t& p, size_t& j) const {
+      size_t jpre=e%pre2; e/=pre2;
+      p=e%k;
+      j=jpre+pre2*(e/k);
+    }
+    void computeTensor() const override {
+      auto r=&cachedResult[0];
+      if (!arg1 || !arg2)
+        {
+          *r=nan("");
+          return;
+        }
+      if (arg1->index().empty() && arg2->index().empty())
+        {
+          auto a=denseValues(*arg1), b=denseValues(*arg2);
+          vector<double> abuf, bbuf;
+          matrixProduct(r, leftView(a,pre1,m,k,abuf), rightView(b,pre2,k,n,bbuf));
+          return;
+        }
+
+      // sparse case - accumulate products of the nonzero elements
+      fill(r, r+m*n, 0.0);
+      auto& idx1=arg1->index();
+      auto& idx2=arg2->index();
+      if (idx2.empty())
+        {
+          auto b=denseValues(*arg2);
+          vector<double> bbuf;
+          auto bv=rightView(b,pre2,k,n,bbuf);
+          for (size_t e=0; e<idx1.size(); ++e)
+            {
+              double x=(*arg1)[e];
+              if (isnan(x)) continue;
+              size_t i, p;
+              split1(idx1[e], i, p);
+              for (size_t j=0; j<n; ++j)
+                {
+                  double y=bv(p,j);
+                  if (!isnan(y)) r[i+m*j]+=x*y;
+                }
+            }
+        }
+      else if (idx1.empty())
+        {
+          auto a=denseValues(*arg1);
+          vector<double> abuf;
+          auto av=leftView(a,pre1,m,k,abuf);
+          for (size_t e=0; e<idx2.size(); ++e)
+            {
+              double y=(*arg2)[e];
+              if (isnan(y)) continue;
+              size_t p, j;
+              split2(idx2[e], p, j);
+              for (size_t i=0; i<m; ++i)
+                {
+                  double x=av(i,p);
+                  if (!isnan(x)) r[i+m*j]+=x*y;
+                }
+            }
+        }
+      else
+        {
+          // bucket the elements of arg2 by contracted index
+          vector<vector<pair<size_t,double>>> arg2ByP(k);
+          for (size_t e=0; e<idx2.size(); ++e)
+            {
+              double y=(*arg2)[e];
+              if (isnan(y)) continue;
+              size_t p, j;
+              split2(idx2[e], p, j);
+              arg2ByP[p].emplace_back(j, y);
+            }
+          for (size_t e=0; e<idx1.size(); ++e)
+            {
+              double x=(*arg1)[e];
+              if (isnan(x)) continue;
+              size_t i, p;
+              split1(idx1[e], i, p);
+              for (auto& y: arg2ByP[p])
+                r[i+m*y.first]+=x*y.second;
+            }
+        }
+    }
+    Timestamp timestamp() const override {return latest(arg1, arg2);}
+    void setArguments(const TensorPtr& a1, const TensorPtr& a2) override {
+      arg1=a1; arg2=a2;
+      cachedResult.index(Index());
+      if (!a1 || !a2)
+        {
+          cachedResult.hypercube(Hypercube());
+          return;
+        }
+      if (a1->rank()==0 || a2->rank()==0)
+        throw runtime_error("inner product arguments must be tensors");
+      auto& xv1=a1->hypercube().xvectors;
+      auto& xv2=a2->hypercube().xvectors;
+      // find the shared axis
+      size_t c1=xv1.size(), c2=xv2.size();
+      if (xv1.back().name==xv2.front().name)
+        {
+          c1=xv1.size()-1;
+          c2=0;
+        }
+      else
+        for (size_t i=0; i<xv1.size(); ++i)
+          for (size_t j=0; j<xv2.size(); ++j)
+            if (xv1[i].name==xv2[j].name)
+              {
+                if (c1<xv1.size())
+                  throw runtime_error("inner product arguments share more than one axis");
+                c1=i;
+                c2=j;
+              }
+      if (c1==xv1.size())
+        throw runtime_error("inner product arguments share no axis");
+      if (!(xv1[c1]==xv2[c2]))
+        throw runtime_error("axis "+xv1[c1].name+" has different labels in the inner product arguments");
+      k=xv1[c1].size();
+      m=n=1; pre1=pre2=1;
+      for (size_t i=0; i<xv1.size(); ++i)
+        if (i!=c1)
+          m*=xv1[i].size();
+      for (size_t i=0; i<c1; ++i) pre1*=xv1[i].size();
+      for (size_t j=0; j<xv2.size(); ++j)
+        if (j!=c2)
+          n*=xv2[j].size();
+      for (size_t j=0; j<c2; ++j) pre2*=xv2[j].size();
+      Hypercube hc;
+      for (size_t i=0; i<xv1.size(); ++i)
+        if (i!=c1)
+          hc.xvectors.push_back(xv1[i]);
+      for (size_t j=0; j<xv2.size(); ++j)
+        if (j!=c2)
+          hc.xvectors.push_back(xv2[j]);
+      cachedResult.hypercube(move(hc));
     }
-    Timestamp timestamp() const override {return max(arg1->timestamp(), arg2->timestamp());}
   };
 
+  /// r(i,j)=arg1(i)·arg2(j), with the axes of arg1 followed by those
+  /// of arg2. The result is sparse if either argument is.
   template <>
   struct GeneralTensorOp<OperationType::outerProduct>: public civita::CachedTensorOp
   {
     std::shared_ptr<ITensor> arg1, arg2;
-    void computeTensor() const override {//TODO
-      throw runtime_error("outer product not yet implemented");
+    void computeTensor() const override {
+      if (!arg1 || !arg2)
+        {
+          cachedResult[0]=nan("");
+          return;
+        }
+      auto a=denseValues(*arg1), b=denseValues(*arg2);
+      auto r=&cachedResult[0];
+      // arg1 is the innermost loop, matching the result layout
+      for (auto y: b)
+        for (auto x: a)
+          *r++=x*y;
+    }
+    Timestamp timestamp() const override {return latest(arg1, arg2);}
+    void setArguments(const TensorPtr& a1, const TensorPtr& a2) override {
+      arg1=a1; arg2=a2;
+      if (!a1 || !a2)
+        {
+          cachedResult.index(Index());
+          cachedResult.hypercube(Hypercube());
+          return;
+        }
+      auto& xv1=a1->hypercube().xvectors;
+      auto& xv2=a2->hypercube().xvectors;
+      Hypercube hc(xv1);
+      hc.xvectors.insert(hc.xvectors.end(), xv2.begin(), xv2.end());
+      auto& idx1=a1->index();
+      auto& idx2=a2->index();
+      if (idx1.empty() && idx2.empty())
+        cachedResult.index(Index());
+      else
+        {
+          // index of each pair of elements, which is sorted as the
+          // elements of arg2 vary slowest
+          size_t m=a1->hypercube().numElements();
+          vector<size_t> idx;
+          idx.reserve(a1->size()*a2->size());
+          for (size_t j=0; j<a2->size(); ++j)
+            for (size_t i=0; i<a1->size(); ++i)
+              idx.push_back(idx1[i]+m*idx2[j]);
+          cachedResult.index(Index(move(idx)));
+        }
+      cachedResult.hypercube(move(hc));
     }
-    Timestamp timestamp() const override {return max(arg1->timestamp(), arg2->timestamp());}
   };
 
   template <>
@@ -439,6 +750,14 @@ namespace minsky
     }
   };
 
+  /// large Ravel evaluations are split across sharedThreadPool(),
+  /// unless computed from within the tasks of another computation
+  /// holding it
+  void ravelParallelFor(size_t n, const std::function<void(size_t,size_t)>& f)
+  {
+    sharedThreadPool().parallelFor(n, f);
+  }
+
   class RavelTensor: public civita::ITensor
   {
     const Ravel& ravel;
@@ -451,10 +770,14 @@ namespace minsky
     void setArgument(const TensorPtr& a,const std::string&,double) override {
       // not sure how to avoid this const cast here
       const_cast<Ravel&>(ravel).populateHypercube(a->hypercube());
-      chain=civita::createRavelChain(ravel.getState(), a);
+      chain=civita::createFusedRavelChain(ravel.getState(), a, ravel.axisLabels, ravelParallelFor);
     }
 
     double operator[](size_t i) const override {return chain.empty()? 0: (*chain.back())[i];}
+    void evalBlock(double r[], size_t begin, size_t n) const override {
+      if (chain.empty()) fill(r, r+n, 0.0);
+      else chain.back()->evalBlock(r, begin, n);
+    }
     size_t size() const override {return chain.empty()? 1: chain.back()->size();}
     const Index& index() const override
     {if (chain.empty()) return m_index; else return chain.back()->index();}
@@ -468,6 +791,9 @@ namespace minsky
   {
     if (auto ravel=dynamic_cast<const Ravel*>(&it))
 	    {
+              // ravel results are cached, and reductions such as
+              // average hold evaluation state
+              if (tfp.ev) tfp.ev->concurrentElements=false;
 	      auto r=make_shared<RavelTensor>(*ravel);
 	      r->setArguments(tfp.tensorsFromPorts(it.ports));
 	      return r;
@@ -476,6 +802,18 @@ namespace minsky
       try
         {
           TensorPtr r{create(op->type())};
+          // cached, scan and index reduction operations hold evaluation state
+          if (tfp.ev)
+            switch (OperationType::classify(op->type()))
+              {
+              case OperationType::scan: case OperationType::tensor:
+                tfp.ev->concurrentElements=false;
+                break;
+              default:
+                if (op->type()==OperationType::infIndex || op->type()==OperationType::supIndex)
+                  tfp.ev->concurrentElements=false;
+                break;
+              }
           switch (op->ports.size())
             {
             case 2:
@@ -495,9 +833,24 @@ namespace minsky
           op->throw_error(ex.what());
         }
     else if (auto v=it.variableCast())
-      return make_shared<ConstTensorVarVal>(v->vValue(), tfp.ev);
+      {
+        auto r=make_shared<ConstTensorVarVal>(v->vValue(), tfp.ev);
+        if (tfp.ev)
+          {
+            tfp.ev->inputs.push_back(v->vValue());
+            // parameters and undefined flow variables are only
+            // written through their VariableValue, whereas stocks and
+            // defined flow variables are written by the evaluation
+            r->tracked=tfp.ev->trackInput
+              (v->vValue(), v->defined() || !v->vValue()->isFlowVar());
+          }
+        return r;
+      }
     else if (auto sw=dynamic_cast<const SwitchIcon*>(&it))
       {
+        // only the selected branch is evaluated, so cached operations
+        // in other branches may be computed lazily
+        if (tfp.ev) tfp.ev->concurrentElements=false;
         auto r=make_shared<SwitchTensor>();
         r->setArguments(tfp.tensorsFromPorts(it.ports));
         return r;
@@ -566,6 +919,7 @@ namespace minsky
     result.hypercube(src->hypercube());
     Operation<OperationType::copy> tmp;
     auto copy=dynamic_pointer_cast<ITensor>(tensorOpFactory.create(tmp));
+    result.ev->inputs.push_back(src);
     copy->setArgument(make_shared<ConstTensorVarVal>(src,result.ev));
     rhs=move(copy);
     assert(result.size()==rhs->size());
@@ -578,15 +932,42 @@ namespace minsky
         assert(result.idx()>=0);
         result.ev->update(fv, n, sv);
         //        assert(result.size()==rhs->size());
-        result.hypercube(rhs->hypercube());
-        for (size_t i=0; i<rhs->size(); ++i)
-          {
-            auto v=(*rhs)[i];
-            result[i]=v;
-            assert(!isfinite(result[i]) || fv[result.idx()+i]==v);
-          }
+        assert(result.idx()+rhs->size()<=n);
+        evalRange(0, rhs->size());
       }
   }
+
+  size_t TensorEval::prepareEval(double fv[], size_t n, const double sv[])
+  {
+    if (!rhs || !result.ev->concurrentElements) return 0;
+    assert(result.idx()>=0);
+    result.ev->update(fv, n, sv);
+    assert(result.idx()+rhs->size()<=n);
+    return rhs->size();
+  }
+
+  void TensorEval::evalRange(size_t begin, size_t end)
+  {
+    // evaluate directly into the result's flow variables, in blocks
+    // small enough for intermediate values to remain in cache
+    double* r=result.ev->flowVars()+result.idx();
+    for (size_t i=begin; i<end; i+=evalBlockSize)
+      rhs->evalBlock(r+i, i, min(evalBlockSize, end-i));
+  }
+
+  bool TensorEval::flowInputs(vector<Range>& ranges) const
+  {
+    for (auto& i: result.ev->inputs)
+      if (i->isFlowVar() && i->idx()>=0)
+        ranges.emplace_back(i->idx(), i->idx()+i->size());
+    return true;
+  }
+
+  EvalOpBase::Range TensorEval::flowOutput() const
+  {
+    if (!rhs || result.idx()<0) return Range(0,0);
+    return Range(result.idx(), result.idx()+result.size());
+  }
    
   void TensorEval::deriv(double df[], size_t n, const double ds[],
                          const double sv[], const double fv[])
@@ -38,11 +38,62 @@ namespace minsky
     size_t m_fvSize=0;
     const double* m_stockVars=nullptr;
     ITensor::Timestamp m_timestamp;
+    /// number of calls to update
+    size_t m_updates=0;
+    /// version of a tracked input
+    struct InputVersion
+    {
+      std::shared_ptr<const VariableValue> value;
+      /// true if the input is written by the evaluation (stocks and
+      /// defined flows), so that changes must be detected from its
+      /// values, rather than from its VariableValue's version
+      bool evaluated=false;
+      unsigned long version=0;
+      /// values as at the last change, if evaluated
+      std::vector<double> values;
+      /// update at which values were last compared
+      size_t checked=0;
+      /// the last two times the input changed, and the offset of the
+      /// first element that changed at the last of them
+      ITensor::Timestamp changed, previous;
+      size_t first=0;
+      void change(ITensor::Timestamp t, size_t f) {previous=changed; changed=t; first=f;}
+    };
+    /// values of evaluated inputs are only compared when consulted,
+    /// by cached operations, whose expressions are not evaluated
+    /// concurrently
+    mutable std::vector<InputVersion> versions;
+    /// compare the values of evaluated input \a i, at most once per update
+    void check(size_t i) const;
   public:
+    /// variables referenced by the expression, for dependency analysis
+    std::vector<std::shared_ptr<const VariableValue>> inputs;
+    /// false if the expression contains operations with mutable
+    /// evaluation state, so elements cannot be computed concurrently
+    bool concurrentElements=true;
     double* flowVars() const {return m_flowVars;}
     size_t fvSize() const {return m_fvSize;}
     const double* stockVars() const {return m_stockVars;}
     ITensor::Timestamp timestamp() const {return m_timestamp;}
+    /// track changes to \a v, so that cached operations depending
+    /// only on unchanged inputs are not recomputed. If \a evaluated,
+    /// \a v is written by the evaluation, otherwise only through the
+    /// VariableValue (eg parameters)
+    /// @return key to pass to timestamp(size_t)
+    size_t trackInput(const std::shared_ptr<const VariableValue>& v, bool evaluated=false) {
+      versions.emplace_back();
+      auto& i=versions.back();
+      i.value=v;
+      i.evaluated=evaluated;
+      i.version=v->version();
+      i.changed=ITensor::Timestamp::clock::now();
+      return versions.size()-1;
+    }
+    /// timestamp of the most recent update at which tracked input \a i had changed
+    ITensor::Timestamp timestamp(size_t i) const {check(i); return versions[i].changed;}
+    /// offset of the first element of tracked input \a i that may
+    /// have changed since \a t, or its size if none
+    size_t firstChangedSince(size_t i, ITensor::Timestamp t) const;
     /// initialise flow and stock var array pointers
     /// @param fv - pointer to flow variable vector
     /// @param n - size of flow variable vector
@@ -50,6 +101,17 @@ namespace minsky
     void update(double* fv, size_t n, const double* sv)
     {
       m_flowVars=fv; m_fvSize=n; m_stockVars=sv; m_timestamp=ITensor::Timestamp::clock::now();
+      ++m_updates;
+      for (auto& i: versions)
+        if (!i.evaluated)
+          {
+            auto v=i.value->version();
+            if (v!=i.version)
+              {
+                i.version=v;
+                i.change(m_timestamp,0);
+              }
+          }
     }
   };
 
@@ -101,13 +163,23 @@ namespace minsky
     /// flowVar and stockVarinfo
     shared_ptr<EvalCommon> ev;
 
+    /// key of value's version in ev, if tracked (see EvalCommon::trackInput)
+    int tracked=-1;
+
     int idx() const {return value->idx();}
     
     /// 
-    ITensor::Timestamp timestamp() const override {return ev->timestamp();}
+    ITensor::Timestamp timestamp() const override
+    {return tracked<0? ev->timestamp(): ev->timestamp(tracked);}
+    size_t firstChangedSince(ITensor::Timestamp t) const override
+    {return tracked<0? I::firstChangedSince(t): ev->firstChangedSince(tracked,t);}
     double operator[](size_t i) const override {
       return value->isFlowVar()? ev->flowVars()[value->idx()+i]: ev->stockVars()[value->idx()+i];
     }
+    void evalBlock(double r[], size_t begin, size_t n) const override {
+      auto v=(value->isFlowVar()? ev->flowVars(): ev->stockVars())+value->idx()+begin;
+      std::copy(v, v+n, r);
+    }
     TensorVarValBase(const std::shared_ptr<VV>& vv, const shared_ptr<EvalCommon>& ev):
       value(vv), ev(ev) {}
     const Hypercube& hypercube() const override {return value->hypercube();}
@@ -165,6 +237,14 @@ namespace minsky
                
     void eval(double fv[], size_t,const double sv[]) override;
     void deriv(double df[],size_t,const double ds[],const double sv[],const double fv[]) override;
+
+    bool flowInputs(std::vector<Range>&) const override;
+    Range flowOutput() const override;
+    bool concurrentEval() const override {return true;}
+    size_t prepareEval(double fv[], size_t n, const double sv[]) override;
+    void evalRange(size_t begin, size_t end) override;
+    void updateHypercube() override
+    {if (rhs && result.value->hypercube()!=rhs->hypercube()) result.hypercube(rhs->hypercube());}
   };
 }
   
@@ -0,0 +1,345 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "odeSolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+using namespace std;
+
+namespace minsky
+{
+  void ODESolver::init(double t, const double x[], size_t dim)
+  {
+    if (instances==0 || dim%instances)
+      throw invalid_argument("ODE dimension not a multiple of the number of instances");
+    n=dim;
+    y.assign(x, x+n);
+    yPrev=y;
+    yNew.resize(n);
+    yErr.resize(n);
+    tCur=tPrev=t;
+    h=hmax>0? hmax: 0.01;
+    restart();
+    recordOutput(t,x);
+  }
+
+  void ODESolver::sync(double t, const double x[], size_t dim)
+  {
+    if (dim!=n || t!=tOut || !equal(x, x+n, yOut.begin()))
+      init(t,x,dim);
+  }
+
+  void ODESolver::recordOutput(double t, const double x[])
+  {
+    tOut=t;
+    yOut.assign(x, x+n);
+  }
+
+  double ODESolver::errorNorm() const
+  {
+    if (n==0) return 0;
+    instanceErr.assign(instances,0);
+    for (size_t i=0; i<n; )
+      for (size_t k=0; k<instances; ++k, ++i)
+        {
+          double scale=epsAbs+epsRel*max(fabs(y[i]),fabs(yNew[i]));
+          double e=yErr[i]/scale;
+          instanceErr[k]+=e*e;
+        }
+    double sum=0;
+    for (auto e: instanceErr)
+      if (std::isnan(e)) return e; // reject the step
+      else sum=max(sum,e);
+    return sqrt(sum*instances/n);
+  }
+
+  void ODESolver::step()
+  {
+    const double safety=0.9, minScale=0.2, maxScale=5;
+    const double exponent=-1.0/(errorOrder()+1);
+    for (;;)
+      {
+        // smallest step that still advances t
+        double hMinimum=max(hmin, 16*numeric_limits<double>::epsilon()*fabs(tCur));
+        if (h<hMinimum) h=hMinimum;
+        trialStep(h);
+        double err=errorNorm();
+        if (isfinite(err) && err<=1)
+          {
+            accept();
+            tPrev=tCur;
+            tCur+=h;
+            yPrev.swap(y);
+            y.swap(yNew);
+            ++numSteps;
+            if (trialDone) trialDone(true);
+            h*=err>0? min(maxScale, max(minScale, safety*pow(err,exponent))): maxScale;
+            if (hmax>0) h=min(h,hmax);
+            return;
+          }
+
+        ++numRejected;
+        if (trialDone) trialDone(false);
+        if (h<=hMinimum)
+          throw runtime_error(isfinite(err)? "ODE step size underflow":
+                              "Invalid arithmetic operation detected");
+        // a non-finite result is treated as a very large error
+        h*=isfinite(err)? max(minScale, safety*pow(err,exponent)): 0.25;
+      }
+  }
+
+  double ODESolver::advanceTo(double t, double x[], size_t maxSteps)
+  {
+    for (size_t i=0; tCur<t && i<maxSteps; ++i)
+      step();
+    if (tCur<=t)
+      {
+        // either landed exactly on t, or ran out of steps
+        copy(y.begin(), y.end(), x);
+        t=tCur;
+      }
+    else
+      interpolate(t,x);
+    recordOutput(t,x);
+    return t;
+  }
+
+  double ODESolver::takeSteps(size_t nSteps, double x[])
+  {
+    for (size_t i=0; i<nSteps; ++i)
+      step();
+    copy(y.begin(), y.end(), x);
+    recordOutput(tCur,x);
+    return tCur;
+  }
+
+  namespace
+  {
+    // Dormand-Prince Butcher tableau
+    const double
+      c2=1.0/5, c3=3.0/10, c4=4.0/5, c5=8.0/9,
+      a21=1.0/5,
+      a31=3.0/40, a32=9.0/40,
+      a41=44.0/45, a42=-56.0/15, a43=32.0/9,
+      a51=19372.0/6561, a52=-25360.0/2187, a53=64448.0/6561, a54=-212.0/729,
+      a61=9017.0/3168, a62=-355.0/33, a63=46732.0/5247, a64=49.0/176,
+      a65=-5103.0/18656,
+      a71=35.0/384, a73=500.0/1113, a74=125.0/192, a75=-2187.0/6784,
+      a76=11.0/84,
+      // difference between 5th and embedded 4th order weights
+      e1=71.0/57600, e3=-71.0/16695, e4=71.0/1920, e5=-17253.0/339200,
+      e6=22.0/525, e7=-1.0/40,
+      // dense output (Hairer, Norsett & Wanner)
+      d1=-12715105075.0/11282082432, d3=87487479700.0/32700410799,
+      d4=-10690763975.0/1880347072, d5=701980252875.0/199316789632,
+      d6=-1453857185.0/822651844, d7=69997945.0/29380423;
+  }
+
+  void DormandPrince::restart()
+  {
+    for (auto v: {&k1,&k2,&k3,&k4,&k5,&k6,&k7,&tmp,&r1,&r2,&r3,&r4,&r5})
+      v->assign(n,0);
+    haveK1=false;
+  }
+
+  void DormandPrince::trialStep(double h)
+  {
+    // k1 is reused from the last stage of the previous step (FSAL)
+    if (!haveK1)
+      {
+        rhs(tCur, y.data(), k1.data());
+        haveK1=true;
+      }
+    for (size_t i=0; i<n; ++i)
+      tmp[i]=y[i]+h*a21*k1[i];
+    rhs(tCur+c2*h, tmp.data(), k2.data());
+    for (size_t i=0; i<n; ++i)
+      tmp[i]=y[i]+h*(a31*k1[i]+a32*k2[i]);
+    rhs(tCur+c3*h, tmp.data(), k3.data());
+    for (size_t i=0; i<n; ++i)
+      tmp[i]=y[i]+h*(a41*k1[i]+a42*k2[i]+a43*k3[i]);
+    rhs(tCur+c4*h, tmp.data(), k4.data());
+    for (size_t i=0; i<n; ++i)
+      tmp[i]=y[i]+h*(a51*k1[i]+a52*k2[i]+a53*k3[i]+a54*k4[i]);
+    rhs(tCur+c5*h, tmp.data(), k5.data());
+    for (size_t i=0; i<n; ++i)
+      tmp[i]=y[i]+h*(a61*k1[i]+a62*k2[i]+a63*k3[i]+a64*k4[i]+a65*k5[i]);
+    rhs(tCur+h, tmp.data(), k6.data());
+    for (size_t i=0; i<n; ++i)
+      yNew[i]=y[i]+h*(a71*k1[i]+a73*k3[i]+a74*k4[i]+a75*k5[i]+a76*k6[i]);
+    rhs(tCur+h, yNew.data(), k7.data());
+    for (size_t i=0; i<n; ++i)
+      yErr[i]=h*(e1*k1[i]+e3*k3[i]+e4*k4[i]+e5*k5[i]+e6*k6[i]+e7*k7[i]);
+  }
+
+  void DormandPrince::accept()
+  {
+    for (size_t i=0; i<n; ++i)
+      {
+        r1[i]=y[i];
+        r2[i]=yNew[i]-y[i];
+        r3[i]=h*k1[i]-r2[i];
+        r4[i]=r2[i]-h*k7[i]-r3[i];
+        r5[i]=h*(d1*k1[i]+d3*k3[i]+d4*k4[i]+d5*k5[i]+d6*k6[i]+d7*k7[i]);
+      }
+    k1.swap(k7);
+  }
+
+  void DormandPrince::interpolate(double t, double x[]) const
+  {
+    double dt=tCur-tPrev;
+    if (dt==0)
+      {
+        copy(y.begin(), y.end(), x);
+        return;
+      }
+    double s=(t-tPrev)/dt, s1=1-s;
+    for (size_t i=0; i<n; ++i)
+      x[i]=r1[i]+s*(r2[i]+s1*(r3[i]+s*(r4[i]+s1*r5[i])));
+  }
+
+  namespace
+  {
+    const double gamma=1/(2+sqrt(2.0)), e32=6+sqrt(2.0);
+  }
+
+  void Rosenbrock::restart()
+  {
+    for (auto v: {&f0,&f1,&f2,&dfdt,&k1,&k2,&k3,&tmp})
+      v->assign(n,0);
+    J.assign(n*n,0);
+    W.assign(n*n,0);
+    pivot.assign(n,0);
+    haveF0=haveJacobian=false;
+  }
+
+  bool Rosenbrock::factorise()
+  {
+    for (size_t k=0; k<n; ++k)
+      {
+        size_t p=k;
+        for (size_t i=k+1; i<n; ++i)
+          if (fabs(W[i*n+k])>fabs(W[p*n+k]))
+            p=i;
+        pivot[k]=p;
+        if (W[p*n+k]==0) return false;
+        if (p!=k)
+          swap_ranges(W.begin()+k*n, W.begin()+(k+1)*n, W.begin()+p*n);
+        for (size_t i=k+1; i<n; ++i)
+          {
+            double l=W[i*n+k]/=W[k*n+k];
+            for (size_t j=k+1; j<n; ++j)
+              W[i*n+j]-=l*W[k*n+j];
+          }
+      }
+    return true;
+  }
+
+  void Rosenbrock::solve(double b[]) const
+  {
+    for (size_t k=0; k<n; ++k)
+      if (pivot[k]!=k)
+        swap(b[k],b[pivot[k]]);
+    for (size_t i=0; i<n; ++i)
+      for (size_t j=0; j<i; ++j)
+        b[i]-=W[i*n+j]*b[j];
+    for (size_t i=n; i-->0;)
+      {
+        for (size_t j=i+1; j<n; ++j)
+          b[i]-=W[i*n+j]*b[j];
+        b[i]/=W[i*n+i];
+      }
+  }
+
+  void Rosenbrock::trialStep(double h)
+  {
+    if (!haveF0)
+      {
+        rhs(tCur, y.data(), f0.data());
+        haveF0=true;
+      }
+    if (!haveJacobian)
+      {
+        ++numJacobian;
+        jac(tCur, y.data(), J.data());
+        // time derivative of f by forward difference
+        double dt=sqrt(numeric_limits<double>::epsilon())*max(fabs(tCur),1.0);
+        rhs(tCur+dt, y.data(), tmp.data());
+        for (size_t i=0; i<n; ++i)
+          dfdt[i]=(tmp[i]-f0[i])/dt;
+        haveJacobian=true;
+      }
+
+    // W = I - h*gamma*J
+    for (size_t i=0; i<n; ++i)
+      for (size_t j=0; j<n; ++j)
+        W[i*n+j]=(i==j)-h*gamma*J[i*n+j];
+    if (!factorise())
+      {
+        // singular iteration matrix - force a step size reduction
+        fill(yErr.begin(), yErr.end(), numeric_limits<double>::infinity());
+        return;
+      }
+
+    for (size_t i=0; i<n; ++i)
+      k1[i]=f0[i]+h*gamma*dfdt[i];
+    solve(k1.data());
+    for (size_t i=0; i<n; ++i)
+      tmp[i]=y[i]+0.5*h*k1[i];
+    rhs(tCur+0.5*h, tmp.data(), f1.data());
+    for (size_t i=0; i<n; ++i)
+      k2[i]=f1[i]-k1[i];
+    solve(k2.data());
+    for (size_t i=0; i<n; ++i)
+      {
+        k2[i]+=k1[i];
+        yNew[i]=y[i]+h*k2[i];
+      }
+    rhs(tCur+h, yNew.data(), f2.data());
+    for (size_t i=0; i<n; ++i)
+      k3[i]=f2[i]-e32*(k2[i]-f1[i])-2*(k1[i]-f0[i])+h*gamma*dfdt[i];
+    solve(k3.data());
+    for (size_t i=0; i<n; ++i)
+      yErr[i]=h/6*(k1[i]-2*k2[i]+k3[i]);
+  }
+
+  void Rosenbrock::accept()
+  {
+    // f(t+h, yNew) is the first stage of the next step
+    f0.swap(f2);
+    haveJacobian=false;
+  }
+
+  void Rosenbrock::interpolate(double t, double x[]) const
+  {
+    double dt=tCur-tPrev;
+    if (dt==0)
+      {
+        copy(y.begin(), y.end(), x);
+        return;
+      }
+    double s=(t-tPrev)/dt;
+    double w1=s*(1-s)/(1-2*gamma), w2=s*(s-2*gamma)/(1-2*gamma);
+    for (size_t i=0; i<n; ++i)
+      x[i]=yPrev[i]+dt*(w1*k1[i]+w2*k2[i]);
+  }
+}
@@ -0,0 +1,153 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ODESOLVER_H
+#define ODESOLVER_H
+
+#include <functional>
+#include <vector>
+#include <stddef.h>
+
+namespace minsky
+{
+  /// Native adaptive step ODE integrator, operating directly on a
+  /// contiguous state vector. The solver retains its internal state
+  /// between calls, and provides a continuous (dense output)
+  /// approximation over the last accepted step, so the solution can
+  /// be sampled at arbitrary output times without truncating steps.
+  class ODESolver
+  {
+  public:
+    /// right hand side f=dy/dt
+    typedef std::function<void(double t, const double y[], double f[])> RHS;
+    /// Jacobian dfdy, stored row major as an n×n matrix
+    typedef std::function<void(double t, const double y[], double dfdy[])> Jacobian;
+
+    double hmin=0, hmax=0.01;
+    double epsAbs=1e-3, epsRel=1e-2;
+    /// number of independent systems integrated in lockstep, with
+    /// the state laid out system fastest. Steps are controlled by
+    /// the largest of the systems' error norms, so that one system's
+    /// error is not diluted by the others.
+    size_t instances=1;
+    /// if set, called after each trial step with whether it was accepted
+    std::function<void(bool accepted)> trialDone;
+
+    /// statistics
+    size_t numRHS=0, numJacobian=0, numSteps=0, numRejected=0;
+
+    ODESolver(const RHS& f): f(f) {}
+    virtual ~ODESolver() {}
+
+    /// (re)start the integration from state \a y at time \a t
+    void init(double t, const double y[], size_t n);
+    /// restart the integration if \a t, \a y differ from the last
+    /// output returned by advanceTo() or takeSteps()
+    void sync(double t, const double y[], size_t n);
+    /// perform a single accepted step
+    /// @throw std::runtime_error if the step size underflows
+    void step();
+    /// integrate until time \a tOut, storing the interpolated state
+    /// into \a y. At most \a maxSteps steps are taken.
+    /// @return time of the returned state, which is \a tOut unless
+    /// maxSteps was exceeded
+    double advanceTo(double tOut, double y[], size_t maxSteps);
+    /// perform \a nSteps steps, storing the resulting state into \a y
+    /// @return time of the returned state
+    double takeSteps(size_t nSteps, double y[]);
+    /// continuous approximation of the solution at time \a t within
+    /// the last accepted step [previousTime(), time()]
+    virtual void interpolate(double t, double y[]) const=0;
+
+    double time() const {return tCur;}
+    double previousTime() const {return tPrev;}
+    double stepSize() const {return h;}
+    const std::vector<double>& state() const {return y;}
+    size_t dimension() const {return y.size();}
+
+  protected:
+    RHS f;
+    size_t n=0;
+    double tCur=0, tPrev=0, h=0;
+    std::vector<double> y, yPrev, yNew, yErr;
+    /// last output returned to the caller
+    double tOut=0;
+    std::vector<double> yOut;
+
+    void rhs(double t, const double x[], double r[]) {++numRHS; f(t,x,r);}
+    /// order of the embedded error estimate, used for step size control
+    virtual int errorOrder() const=0;
+    /// allocate method specific workspace, and discard any stage
+    /// values cached from a previous step
+    virtual void restart() {}
+    /// compute trial step of size \a h from (tCur,y) into yNew and
+    /// error estimate into yErr
+    virtual void trialStep(double h)=0;
+    /// called when a trial step is accepted, prior to y being updated
+    virtual void accept() {}
+    /// maximum over instances of the weighted RMS norm of the error estimate
+    double errorNorm() const;
+    mutable std::vector<double> instanceErr;
+    void recordOutput(double t, const double x[]);
+  };
+
+  /// Dormand-Prince 5(4) explicit Runge-Kutta method, with 4th order
+  /// dense output
+  class DormandPrince: public ODESolver
+  {
+  public:
+    DormandPrince(const RHS& f): ODESolver(f) {}
+    void interpolate(double t, double y[]) const override;
+  protected:
+    std::vector<double> k1, k2, k3, k4, k5, k6, k7, tmp;
+    /// dense output coefficients of last accepted step
+    std::vector<double> r1, r2, r3, r4, r5;
+    bool haveK1=false;
+    int errorOrder() const override {return 4;}
+    void restart() override;
+    void trialStep(double h) override;
+    void accept() override;
+  };
+
+  /// Linearly implicit Rosenbrock method of order 2(3) (Shampine &
+  /// Reichelt's ode23s), suitable for stiff systems, with 2nd order
+  /// dense output
+  class Rosenbrock: public ODESolver
+  {
+  public:
+    Rosenbrock(const RHS& f, const Jacobian& jac): ODESolver(f), jac(jac) {}
+    void interpolate(double t, double y[]) const override;
+  protected:
+    Jacobian jac;
+    std::vector<double> J, W, f0, f1, f2, dfdt, k1, k2, k3, tmp;
+    std::vector<size_t> pivot;
+    bool haveF0=false, haveJacobian=false;
+    int errorOrder() const override {return 2;}
+    void restart() override;
+    void trialStep(double h) override;
+    void accept() override;
+    /// LU factorise W in place
+    /// @return false if W is singular
+    bool factorise();
+    /// solve W x = b, overwriting b with x
+    void solve(double b[]) const;
+  };
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "threadPool.h"
+#include <algorithm>
+
+namespace minsky
+{
+  ThreadPool::ThreadPool(unsigned nThreads)
+  {
+    if (!nThreads)
+      nThreads=std::max(1u, boost::thread::hardware_concurrency());
+    for (unsigned i=0; i<nThreads; ++i)
+      queues.emplace_back(new Queue);
+    for (unsigned i=1; i<nThreads; ++i)
+      workers.create_thread([this,i]() {work(i);});
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      quit=true;
+    }
+    workPosted.notify_all();
+    workers.join_all();
+  }
+
+  void ThreadPool::run(const std::vector<Task>& tasks)
+  {
+    if (tasks.empty()) return;
+    exception=nullptr;
+    remaining=tasks.size();
+    for (size_t i=0; i<tasks.size(); ++i)
+      {
+        auto& q=*queues[i%queues.size()];
+        boost::lock_guard<boost::mutex> lock(q.mutex);
+        q.tasks.push_back(&tasks[i]);
+      }
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      ++generation;
+    }
+    workPosted.notify_all();
+
+    // participate until no task remains to be started, then wait
+    // for those still executing on other threads
+    while (runOne(0)) {}
+    boost::unique_lock<boost::mutex> lock(mutex);
+    allDone.wait(lock, [this]() {return remaining==0;});
+    lock.unlock();
+    if (exception)
+      std::rethrow_exception(exception);
+  }
+
+  bool ThreadPool::runOne(size_t self)
+  {
+    const Task* task=nullptr;
+    {
+      auto& q=*queues[self];
+      boost::lock_guard<boost::mutex> lock(q.mutex);
+      if (!q.tasks.empty())
+        {
+          task=q.tasks.front();
+          q.tasks.pop_front();
+        }
+    }
+    for (size_t i=1; !task && i<queues.size(); ++i)
+      {
+        auto& q=*queues[(self+i)%queues.size()];
+        boost::lock_guard<boost::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+          {
+            task=q.tasks.back();
+            q.tasks.pop_back();
+          }
+      }
+    if (!task) return false;
+
+    try
+      {
+        (*task)();
+      }
+    catch (...)
+      {
+        boost::lock_guard<boost::mutex> lock(exceptionMutex);
+        if (!exception)
+          exception=std::current_exception();
+      }
+    if (--remaining==0)
+      {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        allDone.notify_all();
+      }
+    return true;
+  }
+
+  void ThreadPool::work(size_t self)
+  {
+    unsigned seen=0;
+    for (;;)
+      {
+        {
+          boost::unique_lock<boost::mutex> lock(mutex);
+          workPosted.wait(lock, [&]() {return quit || generation!=seen;});
+          if (quit) return;
+          seen=generation;
+        }
+        while (runOne(self));
+      }
+  }
+
+  void SharedThreadPool::Lease::run(const std::vector<ThreadPool::Task>& tasks)
+  {
+    if (pool)
+      pool->run(tasks);
+    else
+      for (auto& t: tasks) t();
+  }
+
+  void SharedThreadPool::resize(unsigned nThreads)
+  {
+    if (!nThreads)
+      nThreads=std::max(1u, boost::thread::hardware_concurrency());
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (pool->size()!=nThreads)
+      pool.reset(new ThreadPool(nThreads));
+  }
+
+  SharedThreadPool& sharedThreadPool()
+  {
+    static SharedThreadPool pool;
+    return pool;
+  }
+
+  void SharedThreadPool::parallelFor(size_t n, const std::function<void(size_t,size_t)>& f)
+  {
+    Lease lease(*this);
+    size_t chunks=std::min<size_t>(lease.size(), n);
+    if (chunks<2)
+      {
+        f(0,n);
+        return;
+      }
+    std::vector<ThreadPool::Task> tasks;
+    for (size_t i=0; i<chunks; ++i)
+      tasks.emplace_back([=,&f]() {f(i*n/chunks, (i+1)*n/chunks);});
+    lease.run(tasks);
+  }
+}
@@ -0,0 +1,127 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+//#include <thread>
+// std::thread apparently not supported on MXE for now...
+#include <boost/thread.hpp>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace minsky
+{
+  /// A fixed set of persistent worker threads executing batches of
+  /// tasks. Each thread has its own task queue, and idle threads
+  /// steal work from the back of other threads' queues, which
+  /// balances batches of unevenly sized tasks.
+  class ThreadPool
+  {
+  public:
+    typedef std::function<void()> Task;
+
+    /// @param nThreads total number of threads executing tasks,
+    /// including the thread calling run(). 0 means one per core.
+    explicit ThreadPool(unsigned nThreads=0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&)=delete;
+    void operator=(const ThreadPool&)=delete;
+
+    /// number of threads executing tasks, including the caller of run()
+    unsigned size() const {return queues.size();}
+    /// execute \a tasks to completion, the calling thread
+    /// participating. Must not be called from within a task.
+    /// @throw the first exception thrown by a task, once all tasks
+    /// have completed
+    void run(const std::vector<Task>& tasks);
+
+  private:
+    struct Queue
+    {
+      boost::mutex mutex;
+      std::deque<const Task*> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues; ///< queues[0] belongs to the caller of run()
+    boost::mutex mutex;
+    boost::condition_variable workPosted, allDone;
+    unsigned generation=0; ///< incremented each time a batch is posted
+    bool quit=false;
+    std::atomic<size_t> remaining{0};
+    std::exception_ptr exception;
+    boost::mutex exceptionMutex;
+    boost::thread_group workers;
+
+    /// execute one task, from thread \a self's queue if possible,
+    /// otherwise stolen from another
+    /// @return false if no task was available
+    bool runOne(size_t self);
+    void work(size_t self);
+  };
+
+  /// A ThreadPool for computations that may be started concurrently,
+  /// or from within the tasks of another computation using the
+  /// pool. A computation holds the pool only if it is free, and
+  /// otherwise runs serially, so that nested or concurrent use cannot
+  /// deadlock.
+  class SharedThreadPool
+  {
+  public:
+    explicit SharedThreadPool(unsigned nThreads=0): pool(new ThreadPool(nThreads)) {}
+
+    /// hold of the pool by one computation, if it was free
+    class Lease
+    {
+    public:
+      explicit Lease(SharedThreadPool& p): lock(p.mutex, boost::try_to_lock)
+      {if (lock) pool=p.pool.get();}
+      /// number of threads to divide the computation between
+      unsigned size() const {return pool? pool->size(): 1;}
+      /// execute \a tasks, concurrently if the pool is held
+      void run(const std::vector<ThreadPool::Task>& tasks);
+    private:
+      ThreadPool* pool=nullptr;
+      boost::unique_lock<boost::mutex> lock;
+    };
+
+    /// call \a f(begin,end) over a partition of [0,\a n), concurrently
+    /// if the pool is free
+    void parallelFor(size_t n, const std::function<void(size_t,size_t)>& f);
+
+    /// replace the pool with one of \a nThreads threads (0 meaning
+    /// one per core), waiting for any computation holding it to finish
+    void resize(unsigned nThreads);
+
+  private:
+    std::unique_ptr<ThreadPool> pool;
+    boost::mutex mutex;
+  };
+
+  /// the pool used for all concurrent computation: evaluation of
+  /// equations, tensor products, Ravels, CSV import and model
+  /// encoding. Computations started from within another's tasks run
+  /// serially.
+  SharedThreadPool& sharedThreadPool();
+}
+
+#endif
@@ -37,6 +37,12 @@ namespace minsky
     return *(&valRef()+i);
   }
 
+  void VariableValue::valueChanged()
+  {
+    ++m_version;
+    minsky().workerStateStale=true;
+  }
+
   const VariableValue& VariableValue::operator=(minsky::TensorVal const& x)
   {
     index(x.index());
@@ -44,6 +50,7 @@ namespace minsky
     assert((isFlowVar() && x.size()+m_idx<=ValueVector::flowVars.size()) ||
            (!isFlowVar() && x.size()+m_idx<=ValueVector::stockVars.size()));
     memcpy(&valRef(), x.begin(), x.size()*sizeof(x[0]));
+    valueChanged();
     return *this;
   }
 
@@ -53,6 +60,7 @@ namespace minsky
     hypercube(x.hypercube());
     for (size_t i=0; i<x.size(); ++i)
       (*this)[i]=x[i];
+    valueChanged();
     return *this;
   }
  
@@ -77,6 +85,7 @@ namespace minsky
         break;
       default: break;
       }
+    ++m_version;
     return *this;
   }
 
@@ -28,6 +28,7 @@
 #include "CSVDialog.h"
 #include "latexMarkup.h"
 #include <boost/regex.hpp>
+#include <atomic>
 #include <utility>
 #include <boost/locale.hpp>
 using namespace boost::locale::conv;
@@ -40,12 +41,22 @@ namespace minsky
   typedef std::shared_ptr<Group> GroupPtr;
   using namespace civita;
   
+  /// atomic counter that can be copied. Assigning to it counts as
+  /// a change.
+  struct VersionCounter: public std::atomic<unsigned long>
+  {
+    VersionCounter(): std::atomic<unsigned long>(0) {}
+    VersionCounter(const VersionCounter& x): std::atomic<unsigned long>(x.load()) {}
+    VersionCounter& operator=(const VersionCounter&) {++*this; return *this;}
+  };
+
   class VariableValue: public VariableType, public civita::ITensorVal
   {
     CLASSDESC_ACCESS(VariableValue);
   private:
     Type m_type;
     int m_idx; /// index into value vector
+    classdesc::Exclude<VersionCounter> m_version;
     double& valRef(); 
     const double& valRef() const;
     std::vector<unsigned> m_dims;
@@ -89,11 +100,24 @@ namespace minsky
     double value(size_t i=0) const {return operator[](i);}
     int idx() const {return m_idx;}
     void reset_idx() {m_idx=-1;}    
+    /// incremented whenever the value is written through this object,
+    /// so that computations cached from it can be reused until then
+    unsigned long version() const {return m_version.load();}
+    /// record a write of the value other than through this object
+    void bumpVersion() {++m_version;}
+    /// record a write of the value through the writable operator[],
+    /// so that cached computations pick it up. The simulation sees
+    /// every write, as it compares the values with its own copy
+    void valueChanged();
 
     // values are always live
     Timestamp timestamp() const override {return Timestamp::clock::now();}
     
     double operator[](size_t i) const override {return *(&valRef()+i);}
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {auto v=&valRef()+begin; std::copy(v, v+n, r);}
+    /// writable element access. Has no side effects, so writers
+    /// should call valueChanged() afterwards
     double& operator[](size_t i) override;
 
     const Index& index() const override {
@@ -259,6 +283,12 @@ namespace minsky
 #ifdef _CLASSDESC
 #pragma omit pack minsky::VariableValue
 #pragma omit unpack minsky::VariableValue
+#pragma omit pack minsky::VersionCounter
+#pragma omit unpack minsky::VersionCounter
+#pragma omit TCL_obj minsky::VersionCounter
+#pragma omit xml_pack minsky::VersionCounter
+#pragma omit xml_unpack minsky::VersionCounter
+#pragma omit xsd_generate minsky::VersionCounter
 #endif
 
 namespace classdesc_access
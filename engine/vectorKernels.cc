@@ -0,0 +1,270 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "evalOp.h"
+#include "elementwiseOp.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits>
+#include <string>
+
+#include "minsky_epilogue.h"
+
+// The vectorised kernels of EvalOpProgram. Kept apart from evalOp.cc
+// so that only these loops are compiled with the floating point
+// options they need (see Makefile), and not the reference
+// implementation.
+
+// runtime CPU dispatch of vectorised kernels, via GCC function multiversioning
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__ELF__)
+#define VECTOR_DISPATCH 1
+#define VECTOR_KERNEL_TARGETS __attribute__((target_clones("avx512f","avx2","default")))
+#define VECTOR_INLINE inline __attribute__((always_inline))
+#else
+#define VECTOR_DISPATCH 0
+#define VECTOR_KERNEL_TARGETS
+#define VECTOR_INLINE inline
+#endif
+
+namespace minsky
+{
+  namespace
+  {
+    inline double fromBits(uint64_t b) {double x; memcpy(&x,&b,sizeof(x)); return x;}
+    inline uint64_t toBits(double x) {uint64_t b; memcpy(&b,&x,sizeof(b)); return b;}
+    /// adding, then subtracting this rounds a double to an integer
+    const double roundMagic=6755399441055744.0; // 1.5*2^52
+    const double two52=4503599627370496.0;
+    /// ln(2), split so that n*ln2Hi is exact for the exponents of doubles
+    const double ln2Hi=6.93147180369123816490e-01, ln2Lo=1.90821492927058770002e-10;
+
+    /// @{ exp and log without branches, agreeing with libm to within 1
+    /// ulp, for the exp, ln and log kernels. Unlike calls into libm,
+    /// loops over these compile to SIMD instructions. vectorKernels.o
+    /// is compiled with -fno-trapping-math, so that the selections can
+    /// be if-converted.
+#pragma omp declare simd notinbranch
+    inline double vexp(double x)
+    {
+      double xc=x>-746? x: -746; // NaN is mapped to -746
+      xc=xc<710? xc: 710;
+      // exp(x)=2^n exp(r), |r|<=ln(2)/2
+      double n=xc*1.44269504088896338700+roundMagic-roundMagic;
+      double r=xc-n*ln2Hi-n*ln2Lo;
+      double p=1/6227020800.0;
+      p=p*r+1/479001600.0;
+      p=p*r+1/39916800.0;
+      p=p*r+1/3628800.0;
+      p=p*r+1/362880.0;
+      p=p*r+1/40320.0;
+      p=p*r+1/5040.0;
+      p=p*r+1/720.0;
+      p=p*r+1/120.0;
+      p=p*r+1/24.0;
+      p=p*r+1/6.0;
+      p=p*r+0.5;
+      p=p*r+1;
+      p=p*r+1;
+      // scale by 2^n in two steps, so that neither factor over or
+      // underflows. The exponent bits of n+roundMagic are n modulo 2^12.
+      double n1=n*0.5+roundMagic, n2=n-(n1-roundMagic)+roundMagic;
+      double e=p*fromBits((toBits(n1)+1023)<<52)*fromBits((toBits(n2)+1023)<<52);
+      bool overflow=x>709.782712893383973096, underflow=x<-745.133219101941108420, nan=x!=x;
+      e=overflow? std::numeric_limits<double>::infinity(): e;
+      e=underflow? 0: e;
+      return nan? x: e;
+    }
+
+#pragma omp declare simd notinbranch
+    inline double vlog(double x)
+    {
+      bool subnormal=x<std::numeric_limits<double>::min();
+      uint64_t b=toBits(subnormal? x*two52: x);
+      // x=2^e m, sqrt(2)/2<=m<sqrt(2)
+      double e=fromBits(0x4330000000000000|(b>>52))-two52-(subnormal? 1075: 1023);
+      double m=fromBits((b&0x000fffffffffffff)|0x3ff0000000000000);
+      bool high=m>1.41421356237309504880;
+      m=high? 0.5*m: m;
+      e=high? e+1: e;
+      // log(1+f), as in fdlibm's __ieee754_log
+      double f=m-1, s=f/(2+f), z=s*s, hfsq=0.5*f*f;
+      double R=1.479819860511658591e-01;
+      R=R*z+1.531383769920937332e-01;
+      R=R*z+1.818357216161805012e-01;
+      R=R*z+2.222219843214978396e-01;
+      R=R*z+2.857142874366239149e-01;
+      R=R*z+3.999999999940941908e-01;
+      R=R*z+6.666666666666735130e-01;
+      R*=z;
+      double l=e*ln2Hi-((hfsq-(s*(hfsq+R)+e*ln2Lo))-f);
+      bool positive=x>0, finite=x<std::numeric_limits<double>::infinity(), zero=x==0;
+      l=finite? l: x;
+      double nonPositive=zero? -std::numeric_limits<double>::infinity():
+        std::numeric_limits<double>::quiet_NaN();
+      return positive? l: nonPositive;
+    }
+    /// @}
+
+    /// elementwise operation computed by the kernel for \a T
+    template <OperationType::Type T> struct VectorOp: public ElementwiseOp<T> {};
+    template <> struct VectorOp<OperationType::exp>
+    {static VECTOR_INLINE double evaluate(double x, double) {return vexp(x);}};
+    template <> struct VectorOp<OperationType::ln>
+    {static VECTOR_INLINE double evaluate(double x, double) {return vlog(x);}};
+    template <> struct VectorOp<OperationType::log>
+    {static VECTOR_INLINE double evaluate(double x, double y) {return vlog(x)/vlog(y);}};
+
+    template <class Op, bool SX, bool SY> VECTOR_INLINE
+    void vectorLoop(double* __restrict r, const double* __restrict x,
+                    const double* __restrict y, size_t n)
+    {
+#pragma omp simd
+      for (size_t i=0; i<n; ++i)
+        r[i]=Op::evaluate(SX? x[i]: x[0], SY? y[i]: y[0]);
+    }
+
+    /// whether the \a n results at \a r overlap the operand \a x of stride \a sx
+    inline bool overlaps(const double* r, size_t n, const double* x, size_t sx)
+    {return x<r+n && r<x+(sx? n: 1);}
+
+    template <class Op> VECTOR_INLINE
+    void stridedLoop(double* r, const double* x, size_t sx, const double* y, size_t sy, size_t n)
+    {
+      // vectorLoop's operands are __restrict, so evaluate in place
+      // results with a plain loop
+      if (overlaps(r,n,x,sx) || overlaps(r,n,y,sy))
+        for (size_t i=0; i<n; ++i)
+          r[i]=Op::evaluate(x[i*sx], y[i*sy]);
+      else if (sx && sy)
+        vectorLoop<Op,true,true>(r,x,y,n);
+      else if (sx)
+        vectorLoop<Op,true,false>(r,x,y,n);
+      else
+        vectorLoop<Op,false,true>(r,x,y,n);
+    }
+
+#define VECTOR_KERNEL(T)                                                \
+    VECTOR_KERNEL_TARGETS void kernel_##T                               \
+    (double* r, const double* x, size_t sx, const double* y, size_t sy, size_t n) \
+    {stridedLoop<VectorOp<OperationType::T>>(r,x,sx,y,sy,n);}
+
+    VECTOR_KERNEL(add);
+    VECTOR_KERNEL(subtract);
+    VECTOR_KERNEL(multiply);
+    VECTOR_KERNEL(divide);
+    VECTOR_KERNEL(min);
+    VECTOR_KERNEL(max);
+    VECTOR_KERNEL(and_);
+    VECTOR_KERNEL(or_);
+    VECTOR_KERNEL(log);
+    VECTOR_KERNEL(pow);
+    VECTOR_KERNEL(lt);
+    VECTOR_KERNEL(le);
+    VECTOR_KERNEL(eq);
+    VECTOR_KERNEL(copy);
+    VECTOR_KERNEL(sqrt);
+    VECTOR_KERNEL(exp);
+    VECTOR_KERNEL(ln);
+    VECTOR_KERNEL(sin);
+    VECTOR_KERNEL(cos);
+    VECTOR_KERNEL(tan);
+    VECTOR_KERNEL(asin);
+    VECTOR_KERNEL(acos);
+    VECTOR_KERNEL(atan);
+    VECTOR_KERNEL(sinh);
+    VECTOR_KERNEL(cosh);
+    VECTOR_KERNEL(tanh);
+    VECTOR_KERNEL(abs);
+    VECTOR_KERNEL(floor);
+    VECTOR_KERNEL(frac);
+    VECTOR_KERNEL(not_);
+    VECTOR_KERNEL(percent);
+#undef VECTOR_KERNEL
+
+    // libm's exp and log, used unless approximateVectorMath is set,
+    // or when the vectorised versions would be slower (below AVX2)
+#define SCALAR_KERNEL(T)                                                \
+    void scalarKernel_##T                                               \
+    (double* r, const double* x, size_t sx, const double* y, size_t sy, size_t n) \
+    {stridedLoop<ElementwiseOp<OperationType::T>>(r,x,sx,y,sy,n);}
+    SCALAR_KERNEL(exp);
+    SCALAR_KERNEL(ln);
+    SCALAR_KERNEL(log);
+#undef SCALAR_KERNEL
+  }
+
+  bool approximateVectorMath=false;
+
+  VectorKernel vectorKernel(OperationType::Type op)
+  {
+    // the approximations are no faster than libm below AVX2
+    static const bool vectorISAFast=vectorISA()!="default";
+    bool vectorMath=approximateVectorMath && vectorISAFast;
+    switch (op)
+      {
+#define KERNEL(T) case OperationType::T: return kernel_##T;
+#define MATH_KERNEL(T) case OperationType::T: return vectorMath? kernel_##T: scalarKernel_##T;
+        KERNEL(add);
+        KERNEL(subtract);
+        KERNEL(multiply);
+        KERNEL(divide);
+        KERNEL(min);
+        KERNEL(max);
+        KERNEL(and_);
+        KERNEL(or_);
+        MATH_KERNEL(log);
+        KERNEL(pow);
+        KERNEL(lt);
+        KERNEL(le);
+        KERNEL(eq);
+        KERNEL(copy);
+        KERNEL(sqrt);
+        MATH_KERNEL(exp);
+        MATH_KERNEL(ln);
+        KERNEL(sin);
+        KERNEL(cos);
+        KERNEL(tan);
+        KERNEL(asin);
+        KERNEL(acos);
+        KERNEL(atan);
+        KERNEL(sinh);
+        KERNEL(cosh);
+        KERNEL(tanh);
+        KERNEL(abs);
+        KERNEL(floor);
+        KERNEL(frac);
+        KERNEL(not_);
+        KERNEL(percent);
+#undef KERNEL
+#undef MATH_KERNEL
+      default:
+        return nullptr;
+      }
+  }
+
+  std::string vectorISA()
+  {
+#if VECTOR_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return "avx512f";
+    if (__builtin_cpu_supports("avx2")) return "avx2";
+#endif
+    return "default";
+  }
+}
@@ -437,6 +437,7 @@ menu .menubar.rungeKutta
 .menubar.rungeKutta add command -label "Simulation" -command {
     foreach {var text} $rkVars { set rkVarInput($var) [$var] }
     set implicitSolver [implicit]
+    set nativeSolver [nativeSolver]
     deiconifyRKDataForm
     update idletasks
     ::tk::TabToWindow $rkVarInput(initial_focus)
@@ -598,6 +599,7 @@ menu .exportPlots
 .menubar.file add cascade -label "Export Plots" -menu .exportPlots
 .menubar.file add checkbutton -label "Log simulation" -variable simLogging \
     -command getLogVars
+.menubar.file add command -label "Convert Log to CSV" -command convertLogToCSV
 .menubar.file add checkbutton -label "Recording" -command toggleRecording -variable eventRecording
 .menubar.file add checkbutton -label "Replay recording" -command replay -variable recordingReplay 
     
@@ -702,7 +704,18 @@ proc logVarsOK {} {
     foreach i $indices {lappend vars [lindex $varIds $i]}
     logVarList $vars
     destroy .logVars
-    openLogFile [tk_getSaveFile -defaultextension .dat -initialdir $workDir]
+    openLogFile [tk_getSaveFile -defaultextension .mlog -initialdir $workDir \
+                     -filetypes {{"Minsky log" .mlog} {"All" *}}]
+}
+
+proc convertLogToCSV {} {
+    global workDir
+    set log [tk_getOpenFile -initialdir $workDir -filetypes {{"Minsky log" .mlog} {"All" *}}]
+    if {$log==""} return
+    set csv [tk_getSaveFile -defaultextension .csv -initialdir [file dirname $log] \
+                 -initialfile [file rootname [file tail $log]].csv]
+    if {$csv==""} return
+    logFileToCSV $log $csv
 }
 
 
@@ -1346,6 +1359,11 @@ proc toggleImplicitSolver {} {
     implicit $implicitSolver
 }
 
+proc toggleNativeSolver {} {
+    global nativeSolver
+    nativeSolver $nativeSolver
+}
+
 # invokes OK or cancel button with given window, depending on current focus
 proc invokeOKorCancel {window} {
     if [string equal [focus] "$window.cancel"] {
@@ -1365,6 +1383,7 @@ set rkVars {
     epsAbs     "Absolute error"
     epsRel     "Relative error"
     order      "Solver order (1,2 or 4)"
+    outputInterval "Output interval (native solver)"
 }
 
 proc tmax {args} {
@@ -1399,6 +1418,9 @@ proc deiconifyRKDataForm {} {
         }
         grid [label .rkDataForm.implicitlabel -text "Implicit solver"] -column 10 -row $row -sticky e
         grid [checkbutton  .rkDataForm.implicitcheck -variable implicitSolver -command toggleImplicitSolver] -column 20 -row $row -sticky ew
+        incr row 10
+        grid [label .rkDataForm.nativelabel -text "Native solver"] -column 10 -row $row -sticky e
+        grid [checkbutton  .rkDataForm.nativecheck -variable nativeSolver -command toggleNativeSolver] -column 20 -row $row -sticky ew
 
         set rkVarInput(initial_focus) ".rkDataForm.text$rowdict(Min Step Size)"
         frame .rkDataForm.buttonBar
@@ -88,7 +88,29 @@ namespace minsky
         if (!t || (!t->is_const && (!t->is_setterGetter || argc>1)))
           {
             //            cmdHist[argv0]++;
-            bool modelChanged=m.pushHistory();
+            // commands on the canvas' focussed objects only change
+            // those, and mouse handlers mark the objects they change,
+            // so only those need serialising into the history
+            bool modelChanged;
+            if (argv0.find("minsky.canvas.mouse")==0 || argv0=="minsky.canvas.controlMouseDown")
+              modelChanged=m.pushHistoryChanges();
+            else if (argv0.find("minsky.canvas.item.")==0 && m.canvas.item)
+              {
+                m.historyIds.markChanged(*m.canvas.item);
+                modelChanged=m.pushHistoryChanges();
+              }
+            else if (argv0.find("minsky.canvas.itemFocus.")==0 && m.canvas.itemFocus)
+              {
+                m.historyIds.markChanged(*m.canvas.itemFocus);
+                modelChanged=m.pushHistoryChanges();
+              }
+            else if (argv0.find("minsky.canvas.wire.")==0 && m.canvas.wire)
+              {
+                m.historyIds.markChanged(*m.canvas.wire);
+                modelChanged=m.pushHistoryChanges();
+              }
+            else
+              modelChanged=m.pushHistory();
             if (modelChanged && argv0!="minsky.load" && argv0!="minsky.reverse") m.markEdited();
             if (m.eventRecord.get() && argv0!="minsky.startRecording" &&
                 (modelChanged ||
@@ -76,7 +76,11 @@ namespace minsky
             break;
           case ClickType::onRavel:
             if (auto r=dynamic_cast<Ravel*>(itemFocus.get()))
-              r->onMouseDown(x,y);
+              {
+                r->onMouseDown(x,y);
+                r->renderCache.invalidate();
+                minsky().historyIds.markChanged(*r);
+              }
             break;
           case ClickType::onResize:
             lassoMode=LassoMode::itemResize;
@@ -95,8 +99,7 @@ namespace minsky
       }
     else
       {
-        wireFocus=model->findAny(&Group::wires,
-                       [&](const WirePtr& i){return i->near(x,y);});
+        wireFocus=wireAt(x,y);
         if (wireFocus)
           handleSelected=wireFocus->nearestHandle(x,y);
         else
@@ -111,26 +114,24 @@ namespace minsky
       }
   }
 
+  const CanvasIndex& Canvas::index() const
+  {
+    spatialIndex.update(*model);
+    return spatialIndex;
+  }
+
+  WirePtr Canvas::wireAt(float x, float y) const
+  {
+    for (auto& w: index().wires(LassoBox(x,y,x,y)))
+      if (w->near(x,y))
+        return w;
+    return nullptr;
+  }
+
   shared_ptr<Port> Canvas::closestInPort(float x, float y) const
   {
-    shared_ptr<Port> closestPort;
-    auto minD=numeric_limits<float>::max();
-    model->recursiveDo(&GroupItems::items,
-                       [&](const Items&, Items::const_iterator i)
-                       {
-                         if ((*i)->group.lock()->displayContents())
-                           for (auto& p: (*i)->ports)
-                             {
-                               float d=sqr(p->x()-x)+sqr(p->y()-y);
-                               if (d<minD)
-                                 {
-                                   minD=d;
-                                   closestPort=p;
-                                 }
-                             }
-                         return false;
-                       });
-    return closestPort;
+    return index().closestPort
+      (x,y,[](const Port& p){return p.item().group.lock()->displayContents();});
   }
   
   void Canvas::mouseUp(float x, float y)
@@ -141,6 +142,8 @@ namespace minsky
       if (auto r=dynamic_cast<Ravel*>(itemFocus.get()))
         {
           r->onMouseUp(x,y);
+          r->renderCache.invalidate();
+          minsky().historyIds.markChanged(*r);
           r->broadcastStateToLockGroup();
           itemFocus.reset(); // prevent spurious mousemove events being processed
           minsky().reset();
@@ -153,7 +156,10 @@ namespace minsky
       }
     
     if (wireFocus)
-      wireFocus->editHandle(handleSelected,x,y);
+      {
+        wireFocus->editHandle(handleSelected,x,y);
+        minsky().historyIds.markChanged(*wireFocus);
+      }
     
     switch (lassoMode)
       {
@@ -165,6 +171,7 @@ namespace minsky
         if (item)
           {
             item->resize(lasso);  
+            minsky().historyIds.markChanged(*item);
             requestRedraw();
           }
         break;
@@ -189,15 +196,24 @@ namespace minsky
                 updateRegion=LassoBox(itemFocus->x(),itemFocus->y(),x,y);
                 // move item relatively to avoid accidental moves on double click
                 if (selection.empty() || !selection.contains(itemFocus))
-                  itemFocus->moveTo(x-moveOffsX, y-moveOffsY);
+                  {
+                    itemFocus->moveTo(x-moveOffsX, y-moveOffsY);
+                    minsky().historyIds.markChanged(*itemFocus);
+                  }
                 else
                   {
                     // move the whole selection
                     auto deltaX=x-moveOffsX-itemFocus->x(), deltaY=y-moveOffsY-itemFocus->y();
                     for (auto& i: selection.items)
-                      i->moveTo(i->x()+deltaX, i->y()+deltaY);
+                      {
+                        i->moveTo(i->x()+deltaX, i->y()+deltaY);
+                        minsky().historyIds.markChanged(*i);
+                      }
                     for (auto& i: selection.groups)
-                      i->moveTo(i->x()+deltaX, i->y()+deltaY);
+                      {
+                        i->moveTo(i->x()+deltaX, i->y()+deltaY);
+                        minsky().historyIds.markChanged(*i);
+                      }
                   }
                 // check if the move has moved outside or into a group
                 if (auto g=itemFocus->group.lock())
@@ -211,18 +227,24 @@ namespace minsky
                             if (g->higher(*toGroup))
                               return;
                           toGroup->addItem(itemFocus);
+                          minsky().historyIds.markAllChanged();
                           toGroup->splitBoundaryCrossingWires();
                           g->splitBoundaryCrossingWires();
                         }
                       else
                         {
                           model->addItem(itemFocus);
+                          minsky().historyIds.markAllChanged();
                           model->splitBoundaryCrossingWires();
                           g->splitBoundaryCrossingWires();
                         }
                     }
                 if (auto g=itemFocus->group.lock())
-                  g->checkAddIORegion(itemFocus);
+                  {
+                    g->checkAddIORegion(itemFocus);
+                    // group's I/O region may have changed
+                    g->renderCache.invalidate();
+                  }
                 requestRedraw();
                 return;
               case ClickType::onSlider:
@@ -234,7 +256,8 @@ namespace minsky
                                  rw + 0.5*(v->sliderMin+v->sliderMax));
                     // push History to prevent an unnecessary reset when
                     // adjusting the slider whilst paused. See ticket #812
-                    minsky().pushHistory();
+                    minsky().historyIds.markChanged(*v);
+                    minsky().pushHistoryChanges();
                     if (minsky().reset_flag())
                       minsky().reset();
                     minsky().evalEquations();
@@ -244,12 +267,16 @@ namespace minsky
               case ClickType::onRavel:
                 if (auto r=dynamic_cast<Ravel*>(itemFocus.get()))
                   if (r->onMouseMotion(x,y))
-                    requestRedraw();
+                    {
+                      r->renderCache.invalidate();
+                      requestRedraw();
+                    }
                 return;
               case ClickType::legendMove: case ClickType::legendResize:
                 if (auto p=dynamic_cast<PlotWidget*>(itemFocus.get()))
                   {
                     p->mouseMove(x,y);
+                    minsky().historyIds.markChanged(*p);
                     requestRedraw();
                   }
                 return;
@@ -271,6 +298,7 @@ namespace minsky
         else if (wireFocus)
           {
             wireFocus->editHandle(handleSelected,x,y);
+            minsky().historyIds.markChanged(*wireFocus);
             requestRedraw();
           }
         else if (lassoMode==LassoMode::lasso)
@@ -308,7 +336,10 @@ namespace minsky
                                                             r->mouseFocus=true;
                                                             r->onBorder = false;
                                                             if (r->onMouseOver(x,y))
-                                                              requestRedraw();
+                                                              {
+                                                                r->renderCache.invalidate();
+                                                                requestRedraw();
+                                                              }
                                                           }
                                                       }
                                                     else
@@ -325,6 +356,7 @@ namespace minsky
                                                           {
                                                             r->onBorder = ct==ClickType::onItem;
                                                             r->onMouseLeave();
+                                                            r->renderCache.invalidate();
                                                             requestRedraw();
                                                           }
                                                       }
@@ -379,12 +411,12 @@ namespace minsky
 
     if (!topLevel) topLevel=&*model;
 
-    for (auto& i: topLevel->items)
-      if (i->visible() && lasso.intersects(*i))
+    for (auto& i: index().items(lasso))
+      if (i->group.lock().get()==topLevel && i->visible() && lasso.intersects(*i))
         selection.ensureItemInserted(i);
 
-    for (auto& i: topLevel->groups)
-      if (i->visible() && lasso.intersects(*i))
+    for (auto& i: index().groups(lasso))
+      if (i->group.lock().get()==topLevel && i->visible() && lasso.intersects(*i))
         selection.ensureGroupInserted(i);
 
     if (focusFollowsMouse)
@@ -397,28 +429,25 @@ namespace minsky
     // Fix for library dependency problem with items during Travis build     
     ItemPtr item;                    
     auto minD=numeric_limits<float>::max();
-    model->recursiveDo(&GroupItems::items,
-                       [&](const Items&, Items::const_iterator i)
-                       {
-                          float d=sqr((*i)->x()-x)+sqr((*i)->y()-y);
-                          if (d<minD && (*i)->visible() && (*i)->contains(x,y))
-                            {
-                              minD=d;
-                              item=*i;
-                            }
-                          return false;  
-                       });
+    for (auto& i: index().items(LassoBox(x,y,x,y)))
+      {
+        float d=sqr(i->x()-x)+sqr(i->y()-y);
+        if (d<minD && i->visible() && i->contains(x,y))
+          {
+            minD=d;
+            item=i;
+          }
+      }
     if (!item)
-      item=model->findAny
-        (&Group::groups, [&](const GroupPtr& i)
-                         {return i->visible() && i->clickType(x,y)!=ClickType::outside;});
+      for (auto& i: index().groups(LassoBox(x,y,x,y)))
+        if (i->visible() && i->clickType(x,y)!=ClickType::outside)
+          return i;
     return item;
   }
   
   void Canvas::getWireAt(float x, float y)
   {
-    wire=model->findAny(&Group::wires,
-                        [&](const WirePtr& i){return i->near(x,y);});
+    wire=wireAt(x,y);
   }
 
   void Canvas::groupSelection()
@@ -488,8 +517,7 @@ namespace minsky
   // For ticket 1092. Reinstate delete handle user interaction
   void Canvas::delHandle(float x, float y)
   {
-    wireFocus=model->findAny(&Group::wires,
-                   [&](const WirePtr& i){return i->near(x,y);});
+    wireFocus=wireAt(x,y);
     if (wireFocus)
       {
         wireFocus->deleteHandle(x,y);
@@ -736,7 +764,8 @@ namespace minsky
       if (item->handleArrows(dir,modifier))
         {
           requestRedraw();
-          minsky().pushHistory(); //for ticket #812
+          minsky().historyIds.markChanged(*item);
+          minsky().pushHistoryChanges(); //for ticket #812
         }
     
   }
@@ -821,48 +850,37 @@ namespace minsky
     cairo_rectangle(cairo,updateRegion.x0,updateRegion.y0,updateRegion.x1-updateRegion.x0,updateRegion.y1-updateRegion.y0);
     cairo_clip(cairo);
     cairo_set_line_width(cairo, 1);
+    // items whose state is unchanged since they were last drawn are
+    // painted from their retained rendering
+    auto drawItem=[&](const Item& it) {
+      if (it.visible() && updateRegion.intersects(it))
+        {
+          if (!it.renderCache.valid(it))
+            it.renderCache.render(it);
+          cairo_save(cairo);
+          cairo_identity_matrix(cairo);
+          cairo_translate(cairo,it.x(), it.y());
+          it.renderCache.replay(cairo);
+          cairo_restore(cairo);
+        }
+    };
+    
     // items
-    model->recursiveDo
-      (&GroupItems::items, [&](const Items&, Items::const_iterator i)
-       {
-         auto& it=**i;
-         if (it.visible() && updateRegion.intersects(it))
-           {
-             cairo_save(cairo);
-             cairo_identity_matrix(cairo);
-             cairo_translate(cairo,it.x(), it.y());
-             it.draw(cairo);
-             cairo_restore(cairo);
-           }
-         return false;
-       });
+    for (auto& i: index().items(updateRegion))
+      drawItem(*i);
 
     // groups
-    model->recursiveDo
-      (&GroupItems::groups, [&](const Groups&, Groups::const_iterator i)
-       {
-         auto& it=**i;
-         if (it.visible() && updateRegion.intersects(it))
-           {
-             cairo_save(cairo);
-             cairo_identity_matrix(cairo);
-             cairo_translate(cairo,it.x(), it.y());
-             it.draw(cairo);
-             cairo_restore(cairo);
-           }
-         return false;
-       });
+    for (auto& i: index().groups(updateRegion))
+      drawItem(*i);
 
     // draw all wires - wires will go over the top of any icons. TODO
-    // introduce an ordering concept if needed
-    model->recursiveDo
-      (&GroupItems::wires, [&](const Wires&, Wires::const_iterator i)
-       {
-         const Wire& w=**i;
-         if (w.visible()/* && updateRegion.intersects(w)*/)
-           w.draw(cairo);
-         return false;
-       });
+    // introduce an ordering concept if needed. The region is widened
+    // to take in arrow heads and handles.
+    const float wireMargin=10;
+    for (auto& w: index().wires(LassoBox(updateRegion.x0-wireMargin, updateRegion.y0-wireMargin,
+                                          updateRegion.x1+wireMargin, updateRegion.y1+wireMargin)))
+      if (w->visible())
+        w->draw(cairo);
 
     if (fromPort.get()) // we're in process of creating a wire
       {
@@ -28,6 +28,7 @@
 #include "wire.h"
 #include "ravelWrap.h"
 #include "sheet.h"
+#include "spatialIndex.h"
 #include <cairoSurfaceImage.h>
 
 #include <chrono>
@@ -51,6 +52,13 @@ namespace minsky
     void reportDrawTime(double) override;
     void mouseDownCommon(float x, float y);
 
+    /// spatial index of the model, for hit testing
+    mutable Exclude<CanvasIndex> spatialIndex;
+    /// returns spatialIndex, brought up to date with the model
+    const CanvasIndex& index() const;
+    /// wire that (x,y) is near, if any
+    WirePtr wireAt(float x, float y) const;
+
   public:
     typedef std::chrono::time_point<std::chrono::high_resolution_clock> Timestamp;
     struct Model: public GroupPtr
@@ -63,6 +71,7 @@ namespace minsky
       Model(const GroupPtr& g) {operator=(g);}
       Model& operator=(const GroupPtr& model) {
         updateTimestamp();
+        geometryChanged();
         if (this->get())
           {
             // restore previous stuff
@@ -0,0 +1,240 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dataLogger.h"
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+using namespace std;
+
+namespace minsky
+{
+  constexpr const char* DataLogger::magic;
+  const uint32_t DataLogger::version;
+
+  namespace
+  {
+    template <class T>
+    void writeRaw(ostream& o, const T& x) {o.write(reinterpret_cast<const char*>(&x), sizeof(x));}
+    template <class T>
+    bool readRaw(istream& i, T& x) {return bool(i.read(reinterpret_cast<char*>(&x), sizeof(x)));}
+
+    void writeCSVString(ostream& o, const string& x)
+    {
+      if (x.find_first_of(",\"\n")==string::npos)
+        o<<x;
+      else
+        {
+          o<<'"';
+          for (auto c: x)
+            {
+              if (c=='"') o<<'"';
+              o<<c;
+            }
+          o<<'"';
+        }
+    }
+  }
+
+  DataLogger::DataLogger(const string& fileName, const vector<Column>& columns,
+                         size_t blockSize, size_t numBlocks):
+    m_columns(columns), m_rowSize(1)
+  {
+    for (auto& c: columns)
+      m_rowSize+=c.size;
+    rowsPerBlock=max<size_t>(1, blockSize/m_rowSize);
+
+    out.open(fileName, ios::binary);
+    if (!out)
+      throw runtime_error("Unable to open log file "+fileName);
+    out.write(magic, strlen(magic));
+    writeRaw(out, version);
+    writeRaw(out, uint32_t(columns.size()));
+    for (auto& c: columns)
+      {
+        writeRaw(out, uint32_t(c.name.size()));
+        out.write(c.name.data(), c.name.size());
+        writeRaw(out, uint64_t(c.size));
+      }
+    if (!out)
+      throw runtime_error("Error writing log file "+fileName);
+
+    blocks.resize(max<size_t>(2, numBlocks));
+    blockRows.resize(blocks.size());
+    for (size_t i=0; i<blocks.size(); ++i)
+      {
+        blocks[i].resize(rowsPerBlock*m_rowSize);
+        freeBlocks.push_back(i);
+      }
+    thread=boost::thread([this]() {writeBlocks();});
+  }
+
+  DataLogger::~DataLogger()
+  {
+    try {flush();}
+    catch (...) {}
+  }
+
+  void DataLogger::close()
+  {
+    flush();
+    checkError();
+  }
+
+  void DataLogger::flush()
+  {
+    if (!thread.joinable()) return;
+    if (current>=0 && rowsInCurrent>0)
+      releaseBlock();
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      closing=true;
+    }
+    blockFull.notify_one();
+    thread.join();
+    out.close();
+  }
+
+  void DataLogger::checkError()
+  {
+    if (failed)
+      {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        throw runtime_error(errMsg);
+      }
+  }
+
+  void DataLogger::acquireBlock()
+  {
+    checkError();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    blockFree.wait(lock, [this]() {return !freeBlocks.empty();});
+    current=freeBlocks.front();
+    freeBlocks.pop_front();
+    rowsInCurrent=0;
+  }
+
+  void DataLogger::releaseBlock()
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex);
+      blockRows[current]=rowsInCurrent;
+      fullBlocks.push_back(current);
+    }
+    blockFull.notify_one();
+    current=-1;
+    rowsInCurrent=0;
+  }
+
+  void DataLogger::writeBlocks()
+  {
+    for (;;)
+      {
+        int block;
+        {
+          boost::unique_lock<boost::mutex> lock(mutex);
+          blockFull.wait(lock, [this]() {return closing || !fullBlocks.empty();});
+          if (fullBlocks.empty()) return; // closing, and all blocks written
+          block=fullBlocks.front();
+          fullBlocks.pop_front();
+        }
+
+        // after an error, blocks are returned unwritten, so that the
+        // producer is not blocked
+        if (!failed)
+          {
+            out.write(reinterpret_cast<const char*>(blocks[block].data()),
+                      blockRows[block]*m_rowSize*sizeof(double));
+            if (!out)
+              {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                errMsg="Error writing log file";
+                failed=true;
+              }
+          }
+
+        {
+          boost::lock_guard<boost::mutex> lock(mutex);
+          freeBlocks.push_back(block);
+        }
+        blockFree.notify_one();
+      }
+  }
+
+  void DataLogger::toCSV(const string& logFile, const string& csvFile)
+  {
+    ifstream in(logFile, ios::binary);
+    if (!in)
+      throw runtime_error("Unable to open log file "+logFile);
+    char m[8];
+    uint32_t fileVersion, numColumns;
+    if (!in.read(m, sizeof(m)) || strncmp(m, magic, sizeof(m))!=0 ||
+        !readRaw(in, fileVersion) || !readRaw(in, numColumns))
+      throw runtime_error(logFile+" is not a Minsky log file");
+    if (fileVersion>version)
+      throw runtime_error(logFile+" was written by a newer version of Minsky");
+
+    vector<Column> columns;
+    size_t rowSize=1;
+    for (uint32_t i=0; i<numColumns; ++i)
+      {
+        uint32_t nameLength;
+        uint64_t size;
+        if (!readRaw(in, nameLength))
+          throw runtime_error("Corrupt log file "+logFile);
+        string name(nameLength, ' ');
+        if (!in.read(&name[0], nameLength) || !readRaw(in, size))
+          throw runtime_error("Corrupt log file "+logFile);
+        columns.emplace_back(name, size);
+        rowSize+=size;
+      }
+
+    ofstream csv(csvFile);
+    if (!csv)
+      throw runtime_error("Unable to open "+csvFile);
+    csv<<"time";
+    for (auto& c: columns)
+      if (c.size==1)
+        {
+          csv<<',';
+          writeCSVString(csv, c.name);
+        }
+      else
+        for (size_t i=0; i<c.size; ++i)
+          {
+            csv<<',';
+            writeCSVString(csv, c.name+"["+to_string(i)+"]");
+          }
+    csv<<'\n';
+
+    csv<<setprecision(numeric_limits<double>::max_digits10);
+    vector<double> row(rowSize);
+    // a truncated final row is ignored
+    while (in.read(reinterpret_cast<char*>(row.data()), rowSize*sizeof(double)))
+      {
+        csv<<row[0];
+        for (size_t i=1; i<rowSize; ++i)
+          csv<<','<<row[i];
+        csv<<'\n';
+      }
+    if (!csv)
+      throw runtime_error("Error writing "+csvFile);
+  }
+}
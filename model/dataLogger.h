@@ -0,0 +1,126 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATALOGGER_H
+#define DATALOGGER_H
+
+#include <boost/thread.hpp>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  /**
+     Binary log of simulation output. The logged columns are fixed
+     when the log is opened. Rows are filled in directly in one of a
+     bounded number of blocks of memory, and full blocks are written
+     to file by a background thread. If all blocks are awaiting
+     output, the producer waits for the writer thread.
+
+     The file consists of a header followed by the rows, all in native
+     byte order:
+     - the 8 characters "MNSKYLOG"
+     - uint32 format version (currently 1)
+     - uint32 number of columns
+     - for each column, uint32 length of its name, the name in
+       UTF-8, and uint64 number of elements
+     - for each row, the time, then the elements of each column, as
+       doubles
+  */
+  class DataLogger
+  {
+  public:
+    struct Column
+    {
+      std::string name;
+      size_t size; ///< number of elements
+      Column(const std::string& name, size_t size=1): name(name), size(size) {}
+    };
+
+    static constexpr const char* magic="MNSKYLOG";
+    static const uint32_t version=1;
+
+    /// open \a fileName, and write its header
+    /// @param blockSize number of doubles in each buffer block
+    /// @param numBlocks number of buffer blocks
+    /// @throw std::runtime_error if the file cannot be opened
+    DataLogger(const std::string& fileName, const std::vector<Column>& columns,
+               size_t blockSize=1<<16, size_t numBlocks=8);
+    /// flushes any rows remaining, ignoring errors
+    ~DataLogger();
+    DataLogger(const DataLogger&)=delete;
+    void operator=(const DataLogger&)=delete;
+
+    const std::vector<Column>& columns() const {return m_columns;}
+    /// number of doubles in a row, including the time
+    size_t rowSize() const {return m_rowSize;}
+
+    /// space for the next row, of rowSize() elements, which is added
+    /// to the log by commit()
+    double* nextRow() {
+      if (current<0) acquireBlock();
+      return &blocks[current][rowsInCurrent*m_rowSize];
+    }
+    /// add the row returned by nextRow() to the log
+    /// @throw std::runtime_error if writing the file has failed
+    void commit() {
+      if (++rowsInCurrent==rowsPerBlock) releaseBlock();
+    }
+    /// write all rows committed to file, and close it
+    /// @throw std::runtime_error if writing the file has failed
+    void close();
+
+    /// convert log file \a logFile to comma separated values in \a
+    /// csvFile. Elements of tensor valued columns are given separate
+    /// columns, with the element's index appended to the name in
+    /// square brackets.
+    static void toCSV(const std::string& logFile, const std::string& csvFile);
+
+  private:
+    std::vector<Column> m_columns;
+    size_t m_rowSize, rowsPerBlock;
+    std::ofstream out;
+
+    std::vector<std::vector<double>> blocks;
+    std::vector<size_t> blockRows; ///< number of rows held in each block
+    /// block being filled by the producer, or -1 if none
+    int current=-1;
+    size_t rowsInCurrent=0;
+
+    boost::mutex mutex;
+    boost::condition_variable blockFull, blockFree;
+    std::deque<int> freeBlocks, fullBlocks;
+    bool closing=false;
+    std::atomic<bool> failed{false};
+    std::string errMsg;
+    boost::thread thread;
+
+    void acquireBlock();
+    void releaseBlock();
+    void checkError();
+    void flush();
+    void writeBlocks();
+  };
+}
+
+#endif
@@ -0,0 +1,263 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ensemble.h"
+#include "minsky.h"
+#include "odeSolver.h"
+#include "minsky_epilogue.h"
+
+#include <boost/thread.hpp>
+#include <fstream>
+using namespace std;
+
+namespace minsky
+{
+  Ensemble::Ensemble(Minsky& m, size_t size):
+    stepMin(m.stepMin), stepMax(m.stepMax), epsAbs(m.epsAbs), epsRel(m.epsRel),
+    m_minsky(m), N(size)
+  {
+    if (m.reset_flag())
+      m.reset();
+    for (auto& e: m.equations)
+      if (!dynamic_cast<ScalarEvalOp*>(e.get()))
+        throw error("ensemble simulation does not support tensor operations");
+    for (auto& i: m.integrals)
+      if (i.input.idx()<0)
+        throw error("integral not wired");
+
+    nStocks=ValueVector::stockVars.size();
+    nFlows=ValueVector::flowVars.size();
+    initialStocks.resize(nStocks*N);
+    initialFlows.resize(nFlows*N);
+    for (size_t i=0; i<nStocks; ++i)
+      fill(initialStocks.begin()+i*N, initialStocks.begin()+(i+1)*N, ValueVector::stockVars[i]);
+    for (size_t i=0; i<nFlows; ++i)
+      fill(initialFlows.begin()+i*N, initialFlows.begin()+(i+1)*N, ValueVector::flowVars[i]);
+
+    for (auto& v: m.variableValues)
+      if (v.second->idx()>=0 && v.second->size()==1)
+        locations[v.first]=Location{v.second->isFlowVar(), unsigned(v.second->idx())};
+  }
+
+  const Ensemble::Location& Ensemble::location(const string& valueId) const
+  {
+    auto l=locations.find(valueId);
+    if (l==locations.end())
+      l=locations.find(VariableValue::valueId(valueId));
+    if (l==locations.end())
+      throw error("unknown scalar variable %s", valueId.c_str());
+    return l->second;
+  }
+
+  void Ensemble::setValue(const string& valueId, size_t i, double value)
+  {
+    if (i>=N)
+      throw error("instance %d out of range", int(i));
+    auto& l=location(valueId);
+    (l.flow? initialFlows: initialStocks)[l.idx*N+i]=value;
+  }
+
+  void Ensemble::sweep(const string& valueId, double from, double to)
+  {
+    for (size_t i=0; i<N; ++i)
+      setValue(valueId, i, N>1? from+(to-from)*i/(N-1): from);
+  }
+
+  vector<string> Ensemble::variables() const
+  {
+    vector<string> r;
+    for (auto& l: locations)
+      r.push_back(l.first);
+    return r;
+  }
+
+  void Ensemble::run(double tmax, double interval, unsigned nThreads)
+  {
+    if (interval<=0)
+      throw error("output interval must be positive");
+    size_t nOut=1;
+    if (tmax>m_minsky.t0)
+      nOut+=size_t((tmax-m_minsky.t0)/interval*(1+1e-12));
+    m_times.resize(nOut);
+    for (size_t i=0; i<nOut; ++i)
+      m_times[i]=m_minsky.t0+i*interval;
+    results.clear();
+    for (auto& l: locations)
+      results[l.first].assign(nOut*N, nan(""));
+    m_failed.assign(N,0);
+
+    if (!nThreads)
+      nThreads=max(1u, boost::thread::hardware_concurrency());
+    nThreads=min(size_t(nThreads), N);
+    if (nThreads<=1)
+      {
+        integrate(0,N);
+        return;
+      }
+
+    vector<string> errors(nThreads);
+    boost::thread_group threads;
+    for (size_t j=0; j<nThreads; ++j)
+      threads.create_thread([this,j,nThreads,&errors]() {
+          try
+            {
+              integrate(j*N/nThreads, (j+1)*N/nThreads);
+            }
+          catch (const std::exception& ex)
+            {
+              errors[j]=ex.what();
+            }
+        });
+    threads.join_all();
+    for (auto& e: errors)
+      if (!e.empty())
+        throw error("%s",e.c_str());
+  }
+
+  void Ensemble::integrate(size_t begin, size_t end)
+  {
+    size_t n=end-begin;
+    if (!n) return;
+    auto& program=m_minsky.compiledEquations;
+    auto& integrals=m_minsky.integrals;
+
+    // this chunk's instances, structure of arrays
+    vector<double> y(nStocks*n), flows(nFlows*n), flowInit(nFlows*n), yOut(nStocks*n);
+    for (size_t i=0; i<nStocks; ++i)
+      copy(initialStocks.begin()+i*N+begin, initialStocks.begin()+i*N+end, y.begin()+i*n);
+    for (size_t i=0; i<nFlows; ++i)
+      copy(initialFlows.begin()+i*N+begin, initialFlows.begin()+i*N+end, flowInit.begin()+i*n);
+    vector<char> failed(n,0), trialFailed(n,0);
+
+    auto evalFlows=[&](double t, const double sv[]) {
+      copy(flowInit.begin(), flowInit.end(), flows.begin());
+      program.evalBatch(flows.data(), nFlows, sv, n, t);
+    };
+
+    auto rhs=[&](double t, const double sv[], double result[]) {
+      evalFlows(t, sv);
+      fill(result, result+nStocks*n, 0.0);
+      m_minsky.evalGodley.evalBatch(result, flows.data(), n);
+      for (auto& i: integrals)
+        {
+          const double* x=(i.input.isFlowVar()? flows.data(): sv)+size_t(i.input.idx())*n;
+          copy(x, x+n, result+size_t(i.stock.idx())*n);
+        }
+      // instances producing non-finite values are frozen, rather
+      // than aborting the whole ensemble, and marked as failed once
+      // the step is accepted
+      for (size_t s=0; s<nStocks; ++s)
+        for (size_t k=0; k<n; ++k)
+          if (!isfinite(result[s*n+k]))
+            trialFailed[k]=1;
+      for (size_t s=0; s<nStocks; ++s)
+        for (size_t k=0; k<n; ++k)
+          if (failed[k] || trialFailed[k])
+            result[s*n+k]=0;
+    };
+    auto recordFailures=[&](bool accepted) {
+      if (accepted)
+        for (size_t k=0; k<n; ++k)
+          failed[k]|=trialFailed[k];
+      fill(trialFailed.begin(), trialFailed.end(), 0);
+    };
+    // the first stage of the first step is reused across rejections
+    // of that step, so check the initial state separately
+    {
+      vector<double> f(y.size());
+      rhs(m_times[0], y.data(), f.data());
+      recordFailures(true);
+    }
+
+    DormandPrince solver(rhs);
+    solver.instances=n;
+    solver.trialDone=recordFailures;
+    solver.hmin=stepMin;
+    solver.hmax=stepMax;
+    solver.epsAbs=epsAbs;
+    solver.epsRel=epsRel;
+    solver.init(m_times[0], y.data(), y.size());
+
+    // output pointers for each recorded variable
+    vector<pair<Location, double*>> outputs;
+    for (auto& l: locations)
+      outputs.emplace_back(l.second, results.find(l.first)->second.data());
+
+    for (size_t ti=0; ti<m_times.size(); ++ti)
+      {
+        if (ti==0)
+          yOut=y;
+        else
+          solver.advanceTo(m_times[ti], yOut.data(), numeric_limits<size_t>::max());
+        evalFlows(m_times[ti], yOut.data());
+        for (auto& o: outputs)
+          {
+            const double* src=(o.first.flow? flows: yOut).data()+size_t(o.first.idx)*n;
+            double* dst=o.second+ti*N+begin;
+            for (size_t k=0; k<n; ++k)
+              dst[k]=failed[k]? nan(""): src[k];
+          }
+      }
+    for (size_t k=0; k<n; ++k)
+      m_failed[begin+k]=failed[k];
+  }
+
+  civita::TensorVal Ensemble::result(const string& valueId) const
+  {
+    auto r=results.find(valueId);
+    if (r==results.end())
+      r=results.find(VariableValue::valueId(valueId));
+    if (r==results.end())
+      throw error("no results for %s", valueId.c_str());
+
+    civita::XVector ensemble("ensemble", civita::Dimension(civita::Dimension::value,""));
+    for (size_t i=0; i<N; ++i)
+      ensemble.push_back(boost::any(double(i)));
+    civita::XVector time("time", civita::Dimension(civita::Dimension::value,m_minsky.timeUnit));
+    for (auto t: m_times)
+      time.push_back(boost::any(t));
+    civita::TensorVal tv;
+    tv.hypercube(civita::Hypercube(vector<civita::XVector>{ensemble, time}));
+    for (size_t i=0; i<r->second.size(); ++i)
+      tv[i]=r->second[i];
+    return tv;
+  }
+
+  void Ensemble::exportCSV(const string& filename, const string& valueId) const
+  {
+    auto tv=result(valueId);
+    ofstream of(filename);
+    of<<"\"time\"";
+    for (size_t i=0; i<N; ++i)
+      of<<","<<i;
+    of<<"\n";
+    for (size_t ti=0; ti<m_times.size(); ++ti)
+      {
+        of<<m_times[ti];
+        for (size_t i=0; i<N; ++i)
+          {
+            of<<",";
+            double x=tv[ti*N+i];
+            if (isfinite(x)) of<<x;
+          }
+        of<<"\n";
+      }
+    if (!of)
+      throw runtime_error("cannot write to "+filename);
+  }
+}
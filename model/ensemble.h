@@ -0,0 +1,104 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "tensorVal.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  class Minsky;
+
+  /// Simulates an ensemble of variants of a model concurrently, for
+  /// parameter sweeps and Monte Carlo studies. The equations of the
+  /// model are constructed once, and evaluated over all instances
+  /// at once, with each instance's stock and flow variables laid out
+  /// structure of arrays. The ensemble is partitioned across threads,
+  /// each integrating its instances in lockstep with the Dormand-Prince
+  /// solver.
+  ///
+  /// Only scalar models are supported. The Ensemble refers to the
+  /// equations of the Minsky object it was constructed from, which
+  /// must not be modified or reset whilst the Ensemble is in use.
+  class Ensemble
+  {
+  public:
+    /// solver parameters, initialised from the model's RungeKutta settings
+    double stepMin, stepMax, epsAbs, epsRel;
+
+    /// construct \a size instances of \a minsky's model, resetting it
+    /// if needed
+    /// @throw if the model contains tensor operations
+    Ensemble(Minsky& minsky, size_t size);
+
+    size_t size() const {return N;}
+
+    /// set a parameter, or the initial value of a stock variable,
+    /// for instance \a i
+    void setValue(const std::string& valueId, size_t i, double value);
+    /// vary \a valueId linearly from \a from to \a to across the ensemble
+    void sweep(const std::string& valueId, double from, double to);
+
+    /// integrate all instances from the model's start time until \a
+    /// tmax, recording all scalar variables every \a interval
+    /// @param nThreads number of threads, 0 means one per core
+    void run(double tmax, double interval, unsigned nThreads=0);
+
+    /// output times of the last run
+    const std::vector<double>& times() const {return m_times;}
+    /// valueIds of the recorded variables
+    std::vector<std::string> variables() const;
+    /// true if instance \a i produced non-finite values, after which
+    /// its results are NaN
+    bool failed(size_t i) const {return m_failed[i];}
+    /// ensemble × time tensor of the values of \a valueId, with the
+    /// ensemble index varying fastest
+    civita::TensorVal result(const std::string& valueId) const;
+    /// export result(valueId) as CSV, with one row per output time
+    /// and one column per instance
+    void exportCSV(const std::string& filename, const std::string& valueId) const;
+
+  private:
+    const Minsky& m_minsky;
+    size_t N, nStocks, nFlows;
+    /// initial stock values and flow variable values (including
+    /// parameters), structure of arrays
+    std::vector<double> initialStocks, initialFlows;
+    struct Location
+    {
+      bool flow;
+      unsigned idx;
+    };
+    std::map<std::string, Location> locations;
+    std::vector<double> m_times;
+    /// recorded values, indexed by valueId, then time*N+instance
+    std::map<std::string, std::vector<double>> results;
+    std::vector<char> m_failed; // not vector<bool>, as written concurrently
+
+    const Location& location(const std::string& valueId) const;
+    /// integrate instances [begin,end)
+    void integrate(size_t begin, size_t end);
+  };
+}
+
+#endif
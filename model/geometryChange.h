@@ -0,0 +1,66 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GEOMETRYCHANGE_H
+#define GEOMETRYCHANGE_H
+
+#include <deque>
+#include <memory>
+
+namespace minsky
+{
+  class Item;
+  class Wire;
+
+  /// A change to the position, extent or group membership of a model
+  /// object, recorded so that cached spatial information (see
+  /// CanvasIndex) can be brought up to date incrementally. Objects
+  /// are identified by address, and are not dereferenced unless
+  /// known to be alive.
+  struct GeometryChange
+  {
+    enum Type {insertItem, insertGroup, insertWire,
+               removeItem, removeGroup, removePort, removeWire,
+               moveItem, moveGroup, moveWire};
+    Type type;
+    /// the object changed, as a pointer to Item, Group, Port or Wire
+    const void* object;
+    /// for insertions, the object inserted
+    std::weak_ptr<Item> item;
+    std::weak_ptr<Wire> wire;
+  };
+
+  /// number of geometry changes made
+  extern unsigned long geometryVersion;
+  /// the most recent geometry changes, the last of which brought
+  /// geometryVersion to its current value. Changes not recorded
+  /// individually clear this.
+  extern std::deque<GeometryChange> geometryChanges;
+  /// @{ record a geometry change
+  void geometryChanged(GeometryChange::Type type, const void* object);
+  void geometryInserted(const std::shared_ptr<Item>&);
+  void geometryInserted(const std::shared_ptr<Wire>&);
+  /// \a x has moved or changed extent
+  void geometryMoved(const Item& x);
+  /// @}
+  /// record a change to the geometry of the whole model
+  void geometryChanged();
+}
+
+#endif
@@ -29,6 +29,7 @@
 #include <ctype.h>
 #include "minsky_epilogue.h"
 #include <boost/locale.hpp>
+#include <boost/functional/hash.hpp>
 using namespace boost::locale::conv;
 using namespace ecolab::cairo;
 using namespace ecolab;
@@ -358,6 +359,21 @@ namespace minsky
     return ItemPtr();
   }
 
+  size_t GodleyIcon::displayedState() const
+  {
+    auto r=Item::displayedState();
+    boost::hash_combine(r, table.title);
+    boost::hash_combine(r, editorMode());
+    boost::hash_combine(r, buttonDisplay());
+    boost::hash_combine(r, variableDisplay);
+    for (unsigned row=0; row<table.rows(); ++row)
+      for (unsigned col=0; col<table.cols(); ++col)
+        boost::hash_combine(r, table.cell(row,col));
+    for (auto& v: m_flowVars) boost::hash_combine(r, v->displayedState());
+    for (auto& v: m_stockVars) boost::hash_combine(r, v->displayedState());
+    return r;
+  }
+
   void GodleyIcon::draw(cairo_t* cairo) const
   {
     float z=zoomFactor()*scaleFactor();
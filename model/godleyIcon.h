@@ -118,6 +118,8 @@ namespace minsky
 
     /// draw icon to \a context
     void draw(cairo_t* context) const override;
+    /// values of the table's variables, displayed on the icon
+    std::size_t displayedState() const override;
 
     /// returns valueid for variable reference in table
     // TODO: this should be refactored to a more central location
@@ -24,6 +24,7 @@
 #include "minsky.h"
 #include <cairo_base.h>
 #include "minsky_epilogue.h"
+#include <boost/functional/hash.hpp>
 using namespace std;
 using namespace ecolab::cairo;
 
@@ -107,6 +108,28 @@ namespace minsky
     return r;
   }
 
+  namespace
+  {
+    /// record the removal of \a x, and its contents, from the model
+    void geometryRemoved(const Item& x)
+    {
+      if (auto g=dynamic_cast<const Group*>(&x))
+        {
+          geometryChanged(GeometryChange::removeGroup, g);
+          for (auto& i: g->items)
+            geometryRemoved(*i);
+          for (auto& i: g->groups)
+            geometryRemoved(*i);
+          for (auto& i: g->wires)
+            geometryChanged(GeometryChange::removeWire, i.get());
+        }
+      else
+        geometryChanged(GeometryChange::removeItem, &x);
+      for (auto& p: x.ports)
+        geometryChanged(GeometryChange::removePort, p.get());
+    }
+  }
+  
   ItemPtr Group::removeItem(const Item& it)
   {
     for (auto i=items.begin(); i!=items.end(); ++i)
@@ -114,6 +137,9 @@ namespace minsky
         {
           ItemPtr r=*i;
           items.erase(i);
+          geometryRemoved(*r);
+          // the group's box encloses its I/O variables
+          geometryMoved(*this);
           if (auto v=r->variableCast())
               if (v->ioVar())
                 {
@@ -130,6 +156,7 @@ namespace minsky
         {
           ItemPtr r=*i;
           groups.erase(i);
+          geometryRemoved(*r);
           return r;
         }
     
@@ -159,6 +186,7 @@ namespace minsky
         {
           WirePtr r=*i;
           wires.erase(i);
+          geometryChanged(GeometryChange::removeWire, r.get());
           return r;
         }
 
@@ -175,6 +203,7 @@ namespace minsky
         {
           GroupPtr r=*i;
           groups.erase(i);
+          geometryRemoved(*r);
           return r;
         }
 
@@ -288,6 +317,7 @@ namespace minsky
         }
          
     items.push_back(it);
+    geometryInserted(it);
     return items.back();
   }
 
@@ -437,10 +467,26 @@ namespace minsky
       return IORegion::none;
   }
 
+  float Group::clickRadius() const
+  {
+    float z=zoomFactor();
+    // the icon, including top and bottom margins
+    float r=hypot(0.5*iWidth()*z, (0.5*iHeight()+topMargin)*z);
+    // resize handles, at the bounding box corners
+    float dx=max(abs(left()-x()), abs(right()-x())), dy=max(abs(top()-y()), abs(bottom()-y()));
+    r=max(r, hypot(dx,dy)+float(M_SQRT2)*resizeHandleSize());
+    // I/O variables
+    for (auto vars: {&inVariables, &outVariables})
+      for (auto& v: *vars)
+        r=max(r, hypot(v->x()-x(), v->y()-y())+hypot(v->width(), v->height()));
+    return r;
+  }
+
   void Group::checkAddIORegion(const ItemPtr& x)
   {
     if (auto v=dynamic_pointer_cast<VariableBase>(x))
       {
+        auto prevIn=inVariables, prevOut=outVariables;
         remove(inVariables, v);
         remove(outVariables, v);
         switch (inIORegion(v->x(),v->y()))
@@ -457,6 +503,8 @@ namespace minsky
             v->controller.reset();
             break;
           }
+        if (inVariables!=prevIn || outVariables!=prevOut)
+          geometryMoved(*this);
       }
   }
 
@@ -492,6 +540,7 @@ namespace minsky
           {
             i->m_x*=sx;
             i->m_y*=sy;
+            geometryMoved(*i);
             //i->zoomFactor*=std::max(sx,sy);
           }
     }
@@ -517,6 +566,7 @@ namespace minsky
           {
             i->m_x-=xc;
             i->m_y-=yc;
+            geometryMoved(*i);
           }
     }
 
@@ -576,6 +626,7 @@ namespace minsky
     groups.push_back(g);
     g->group=self;
     g->self=groups.back();
+    geometryInserted(g);
     assert(nocycles());
     return groups.back();
   }
@@ -584,6 +635,7 @@ namespace minsky
   {
     assert(w->from() && w->to());
     wires.push_back(w);
+    geometryInserted(w);
     return wires.back();
   }
   WirePtr GroupItems::addWire
@@ -756,6 +808,7 @@ namespace minsky
   {
     double x0, x1, y0, y1, z=zoomFactor();
     relZoom=1;
+    geometryChanged();
     contentBounds(x0,y0,x1,y1);
     float l, r;
     margins(l,r);    
@@ -781,6 +834,7 @@ namespace minsky
   void Group::setZoom(float factor)
   {
     bool dpc=displayContents();
+    geometryChanged();
     //    zoomFactor=factor;
     if (!group.lock())
       relZoom=factor;
@@ -800,6 +854,7 @@ namespace minsky
   void Group::zoom(float xOrigin, float yOrigin,float factor)
   {
     bool dpc=displayContents();
+    geometryChanged();
     minsky::zoom(m_x,xOrigin+m_x-x(),factor);
     minsky::zoom(m_y,yOrigin+m_y-y(),factor);
     m_displayContentsChanged = dpc!=displayContents();
@@ -971,6 +1026,17 @@ namespace minsky
       }
   }
 
+  size_t Group::displayedState() const
+  {
+    auto r=Item::displayedState();
+    boost::hash_combine(r, title);
+    boost::hash_combine(r, displayContents());
+    for (auto& v: inVariables) boost::hash_combine(r, v->displayedState());
+    for (auto& v: outVariables) boost::hash_combine(r, v->displayedState());
+    if (displayPlot) boost::hash_combine(r, displayPlot->displayedState());
+    return r;
+  }
+
   void Group::drawEdgeVariables(cairo_t* cairo) const
   {
     float left, right; margins(left,right);    
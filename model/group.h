@@ -48,6 +48,7 @@ namespace minsky
     classdesc::Exclude<std::weak_ptr<Group>> self; ///< weak ref to this
     
     void clear() {
+      geometryChanged();
       items.clear();
       groups.clear();
       wires.clear();
@@ -206,6 +207,8 @@ namespace minsky
     ItemPtr addItem(Item* it) {return addItem(std::shared_ptr<Item>(it));}
 
     void draw(cairo_t*) const override;
+    /// state of edge variables and any display plot
+    std::size_t displayedState() const override;
 
     /// draw representations of edge variables around group icon
     void drawEdgeVariables(cairo_t*) const;
@@ -223,6 +226,8 @@ namespace minsky
     struct IORegion {enum type {none,input,output,topBottom};};
       
     IORegion::type inIORegion(float x, float y) const;
+    /// distance from (x(),y()) beyond which clickType() returns ClickType::outside
+    float clickRadius() const;
     /// check if item is a variable and located in an I/O region, and add it if it is
     void checkAddIORegion(const ItemPtr& x);
     
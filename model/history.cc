@@ -0,0 +1,190 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "history.h"
+#include "group.h"
+#include "operation.h"
+#include "variable.h"
+#include "wire.h"
+#include <schema/schema3.h>
+#include "minsky_epilogue.h"
+
+#include <cstring>
+using namespace std;
+
+namespace minsky
+{
+  void HistoryIds::markChanged(const Item& x)
+  {
+    if (dynamic_cast<const Group*>(&x))
+      {
+        allChanged=true;
+        return;
+      }
+    changed.insert(&x);
+    if (auto v=x.variableCast())
+      changedValues.insert(v->valueId());
+    if (auto i=dynamic_cast<const IntOp*>(&x))
+      if (i->intVar)
+        markChanged(*i->intVar);
+    for (auto& p: x.ports)
+      for (auto w: p->wires())
+        changed.insert(w);
+  }
+
+  void HistoryIds::markChanged(const Wire& x)
+  {
+    changed.insert(&x);
+  }
+
+  bool HistoryIds::isUnchanged(const void* o, int id) const
+  {
+    if (allChanged || changed.count(o) || !records.count(id))
+      return false;
+    auto i=objects.find(id);
+    return i!=objects.end() && i->second.lock().get()==o;
+  }
+
+  bool HistoryIds::isUnchanged(const Item& o, int id) const
+  {
+    if (auto v=o.variableCast())
+      if (changedValues.count(v->valueId()))
+        return false;
+    return isUnchanged(static_cast<const void*>(&o), id);
+  }
+  
+  namespace
+  {
+    typedef HistoryState::RecordPtr RecordPtr;
+
+    template <class T>
+    RecordPtr record(T& x, int id)
+    {
+      pack_t buf;
+      buf<<x;
+      return make_shared<HistoryState::Record>(string(buf.data(), buf.size()), id);
+    }
+
+    template <class T>
+    void unpackRecord(const HistoryState::Record& r, T& x)
+    {
+      pack_t buf;
+      buf.packraw(r.data.data(), r.data.size());
+      buf>>x;
+    }
+
+    /// @return the cached record of \a x, if unchanged, otherwise a
+    /// new record, which replaces the cached one if different
+    template <class T>
+    RecordPtr cachedRecord(T& x, HistoryIds& ids)
+    {
+      auto& cached=ids.records[x.id];
+      if (cached && ids.unchanged.count(x.id))
+        return cached;
+      auto r=record(x, x.id);
+      if (!cached || !(*cached==*r))
+        cached=r;
+      return cached;
+    }
+
+    bool sameTensor(const civita::TensorVal& x, const civita::TensorVal& y)
+    {
+      return x.hypercube()==y.hypercube() &&
+        x.index().size()==y.index().size() &&
+        equal(x.index().begin(), x.index().end(), y.index().begin()) &&
+        x.storedSize()==y.storedSize() &&
+        (x.storedSize()==0 ||
+         memcmp(x.begin(), y.begin(), x.storedSize()*sizeof(double))==0);
+    }
+
+    bool same(const vector<RecordPtr>& x, const vector<RecordPtr>& y)
+    {
+      if (x.size()!=y.size()) return false;
+      for (size_t i=0; i<x.size(); ++i)
+        if (x[i]!=y[i] && !(*x[i]==*y[i]))
+          return false;
+      return true;
+    }
+  }
+
+  HistoryState::HistoryState(schema3::Minsky&& m, const VariableValues& values,
+                             const HistoryState* prev, HistoryIds& ids)
+  {
+    for (auto& i: m.items)
+      items.push_back(cachedRecord(i, ids));
+    for (auto& i: m.wires)
+      wires.push_back(cachedRecord(i, ids));
+    for (auto& i: m.groups)
+      groups.push_back(cachedRecord(i, ids));
+    // forget records of deleted objects
+    for (auto i=ids.records.begin(); i!=ids.records.end();)
+      if (ids.objects.count(i->first))
+        ++i;
+      else
+        i=ids.records.erase(i);
+    m.items.clear();
+    m.wires.clear();
+    m.groups.clear();
+    settings=record(m, -1);
+    if (prev && prev->settings && *prev->settings==*settings)
+      settings=prev->settings;
+
+    for (auto& v: values)
+      if (v.second->tensorInit.rank())
+        {
+          auto& t=v.second->tensorInit;
+          if (prev)
+            {
+              auto p=prev->tensors.find(v.first);
+              if (p!=prev->tensors.end() &&
+                  (!ids.valueChanged(v.first) || sameTensor(*p->second, t)))
+                {
+                  tensors.emplace(v.first, p->second);
+                  continue;
+                }
+            }
+          tensors.emplace(v.first, make_shared<civita::TensorVal>(t));
+        }
+  }
+
+  void HistoryState::unpack(schema3::Minsky& m) const
+  {
+    unpackRecord(*settings, m);
+    m.items.resize(items.size());
+    for (size_t i=0; i<items.size(); ++i)
+      unpackRecord(*items[i], m.items[i]);
+    m.wires.resize(wires.size());
+    for (size_t i=0; i<wires.size(); ++i)
+      unpackRecord(*wires[i], m.wires[i]);
+    m.groups.resize(groups.size());
+    for (size_t i=0; i<groups.size(); ++i)
+      unpackRecord(*groups[i], m.groups[i]);
+  }
+
+  bool HistoryState::equivalent(const HistoryState& x) const
+  {
+    if (tensors.size()!=x.tensors.size())
+      return false;
+    for (auto i=tensors.begin(), j=x.tensors.begin(); i!=tensors.end(); ++i, ++j)
+      if (i->first!=j->first || i->second!=j->second)
+        return false;
+    return (settings==x.settings || *settings==*x.settings) &&
+      same(items, x.items) && same(wires, x.wires) && same(groups, x.groups);
+  }
+}
@@ -0,0 +1,134 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "variableValue.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace schema3
+{
+  struct Minsky;
+}
+
+namespace minsky
+{
+  class Item;
+  class Wire;
+
+  /// Ids given to model objects in the schema3 representations held
+  /// by the history. Schema3 ids are otherwise allocated in traversal
+  /// order, so inserting or deleting an item would renumber all those
+  /// after it, and their records could not be shared between states.
+  /// Here, an object keeps its id for as long as it exists.
+  ///
+  /// The records last created for each item and wire are cached here
+  /// too, and reused for objects not marked as changed since, so that
+  /// pushing a history state only serialises the objects that changed.
+  struct HistoryIds
+  {
+    /// serialised schema3 record of a model object
+    struct Record
+    {
+      std::string data; ///< classdesc packed representation
+      size_t hash;
+      int id; ///< id of the object this is a record of
+      Record(std::string&& data, int id):
+        data(std::move(data)), hash(std::hash<std::string>()(this->data)), id(id) {}
+      bool operator==(const Record& x) const {return hash==x.hash && data==x.data;}
+    };
+    typedef std::shared_ptr<const Record> RecordPtr;
+
+    std::map<void*,int> ids;
+    int nextId=0;
+    /// model objects by id, for detecting ids whose object has been
+    /// deleted, and its address reused by a new object
+    std::map<int, std::weak_ptr<const void>> objects;
+    /// records last created by id
+    std::map<int, RecordPtr> records;
+    /// ids of the items and wires left unconverted by the last
+    /// schema3 conversion, as their cached records are still current
+    std::set<int> unchanged;
+
+    /// mark \a x as changed since the last conversion, along with
+    /// the other instances of a variable, the variable of an
+    /// integral, and attached wires. Marking a group marks the whole
+    /// model, as the positions of its contents are relative to it.
+    void markChanged(const Item& x);
+    void markChanged(const Wire& x);
+    /// mark every object as changed
+    void markAllChanged() {allChanged=true;}
+    /// forget the changes marked
+    void clearChanges() {allChanged=false; changed.clear(); changedValues.clear();}
+
+    /// true if the cached record of \a o, with id \a id, can be reused
+    bool isUnchanged(const void* o, int id) const;
+    /// as above, for an item, whose record also depends on its variable value
+    bool isUnchanged(const Item& o, int id) const;
+    /// true if tensor data of valueId \a valueId may have changed
+    bool valueChanged(const std::string& valueId) const
+    {return allChanged || changedValues.count(valueId);}
+  private:
+    bool allChanged=true;
+    std::set<const void*> changed;
+    std::set<std::string> changedValues;
+  };
+
+  /// A model state stored in the undo history. The schema3
+  /// representation of the model is split into separately serialised
+  /// records for each item, wire and group, and the remaining model
+  /// wide settings. Parameter tensor data is stored unserialised, by
+  /// valueId. Records and tensors unchanged from the previous history
+  /// state are shared with it, so each state only adds the parts of
+  /// the model that changed. For records to be shared, the schema3
+  /// representation must be created with stable ids (see HistoryIds).
+  struct HistoryState
+  {
+    typedef HistoryIds::Record Record;
+    typedef HistoryIds::RecordPtr RecordPtr;
+
+    RecordPtr settings;
+    std::vector<RecordPtr> items, wires, groups;
+    std::map<std::string, std::shared_ptr<const civita::TensorVal>> tensors;
+
+    HistoryState() {}
+    /// decompose \a m, which must have been created without tensor
+    /// data, and the tensorInit fields of \a values, sharing
+    /// unchanged parts with \a prev, if not null. Items and wires
+    /// that \a ids records as unchanged take their cached records,
+    /// and the cache is updated with the others.
+    HistoryState(schema3::Minsky&& m, const VariableValues& values, const HistoryState* prev,
+                 HistoryIds& ids);
+
+    /// reconstruct the schema3 representation of this state, less
+    /// tensor data
+    void unpack(schema3::Minsky&) const;
+    /// true if this state represents the same model as \a x, ie its
+    /// records and tensors are equal
+    bool equivalent(const HistoryState& x) const;
+  };
+}
+
+#endif
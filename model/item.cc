@@ -29,12 +29,62 @@
 #include <cairo_base.h>
 #include "minsky_epilogue.h"
 #include <exception>
+#include <boost/functional/hash.hpp>
 
 using ecolab::Pango;
 using namespace std;
 
 namespace minsky
 {
+  unsigned long geometryVersion=0;
+  std::deque<GeometryChange> geometryChanges;
+
+  namespace
+  {
+    /// changes retained. Spatial indices further behind than this are rebuilt
+    const size_t maxGeometryChanges=4096;
+    
+    void recordChange(GeometryChange&& c)
+    {
+      geometryChanges.push_back(move(c));
+      if (geometryChanges.size()>maxGeometryChanges)
+        geometryChanges.pop_front();
+      ++geometryVersion;
+    }
+  }
+
+  void geometryChanged(GeometryChange::Type type, const void* object)
+  {
+    recordChange(GeometryChange{type, object, {}, {}});
+  }
+
+  void geometryInserted(const std::shared_ptr<Item>& x)
+  {
+    if (auto g=dynamic_cast<const Group*>(x.get()))
+      recordChange(GeometryChange{GeometryChange::insertGroup, g, x, {}});
+    else
+      recordChange(GeometryChange{GeometryChange::insertItem, x.get(), x, {}});
+  }
+
+  void geometryInserted(const std::shared_ptr<Wire>& x)
+  {
+    recordChange(GeometryChange{GeometryChange::insertWire, x.get(), {}, x});
+  }
+
+  void geometryMoved(const Item& x)
+  {
+    if (auto g=dynamic_cast<const Group*>(&x))
+      geometryChanged(GeometryChange::moveGroup, g);
+    else
+      geometryChanged(GeometryChange::moveItem, &x);
+  }
+
+  void geometryChanged()
+  {
+    geometryChanges.clear();
+    ++geometryVersion;
+  }
+
 
   void BoundingBox::update(const Item& x)
   {
@@ -58,10 +108,15 @@ namespace minsky
                                         &l,&t,&w,&h);
     // note (0,0) is relative to the (x,y) of icon.
     double invZ=1/x.zoomFactor();
-    m_left=l*invZ;
-    m_right=(l+w)*invZ;
-    m_top=t*invZ;
-    m_bottom=(t+h)*invZ; //coordinates increase down the page
+    float left=l*invZ, right=(l+w)*invZ, top=t*invZ, bottom=(t+h)*invZ; //coordinates increase down the page
+    if (left!=m_left || right!=m_right || top!=m_top || bottom!=m_bottom)
+      {
+        m_left=left;
+        m_right=right;
+        m_top=top;
+        m_bottom=bottom;
+        geometryMoved(x);
+      }
   }
 
   void Item::throw_error(const std::string& msg) const
@@ -168,6 +223,7 @@ namespace minsky
 
   void Item::moveTo(float x, float y)
   {
+    float prevX=m_x, prevY=m_y;
     if (auto g=group.lock())
       {
         float invZ=1/zoomFactor();
@@ -179,6 +235,8 @@ namespace minsky
         m_x=x;
         m_y=y;
       }
+    if (m_x!=prevX || m_y!=prevY)
+      geometryMoved(*this);
     assert(abs(x-this->x())<1 && abs(y-this->y())<1);
   }
 
@@ -197,10 +255,9 @@ namespace minsky
 
     if (onResizeHandle(x,y)) return ClickType::onResize;         
 
-    ecolab::cairo::Surface dummySurf
-                                (cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,nullptr));
-    draw(dummySurf.cairo());
-    if (cairo_in_clip(dummySurf.cairo(), (x-this->x()), (y-this->y())))
+    if (!renderCache.valid(*this))
+      renderCache.render(*this);
+    if (renderCache.inClip(x-this->x(), y-this->y()))
       return ClickType::onItem;               
     else                  
       return ClickType::outside;
@@ -310,6 +367,20 @@ namespace minsky
     if (selected) drawSelected(cairo);
   }
 
+  size_t Item::displayedState() const
+  {
+    size_t r=0;
+    boost::hash_combine(r, detailedText);
+    boost::hash_combine(r, tooltip);
+    if (mouseFocus) // tooltips display units
+      try
+        {
+          boost::hash_combine(r, units().str());
+        }
+      catch (...) {}
+    return r;
+  }
+
   void Item::dummyDraw() const
   {
     ecolab::cairo::Surface s(cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,NULL));
@@ -24,6 +24,8 @@
 #include "port.h"
 #include "intrusiveMap.h"
 #include "geometry.h"
+#include "renderCache.h"
+#include "geometryChange.h"
 //#include "RESTProcess_base.h"
 #include <accessor.h>
 #include <TCL_obj_base.h>
@@ -68,7 +70,7 @@ namespace minsky
   /// bounding box information (at zoom=1 scale)
   class BoundingBox
   {
-    float m_left=0, m_right=0, m_top, m_bottom;  	  
+    float m_left=0, m_right=0, m_top=0, m_bottom=0;  	  
   public:
     void update(const Item& x);
     bool contains(float x, float y) const {
@@ -101,6 +103,8 @@ namespace minsky
     classdesc::Exclude<std::weak_ptr<Group>> group; 
     /// canvas bounding box.
     mutable BoundingBox bb;
+    /// retained rendering, used for redrawing and hit testing
+    mutable classdesc::Exclude<RenderCache> renderCache;
     bool contains(float xx, float yy) {
       if (!bb.valid()) bb.update(*this);
       float invZ=1/zoomFactor();
@@ -115,6 +119,10 @@ namespace minsky
     virtual bool ioVar() const {return false;}
     /// current value of output port
     virtual double value() const {return 0;}
+    /// hash of the state drawn by this item, other than that recorded
+    /// directly in RenderCache::Key, such as its text, a variable's
+    /// value or a plot's labels. Overrides should combine this.
+    virtual std::size_t displayedState() const;
 
     double rotation() const {return m_rotation;}
     double rotation(const double& r) {
@@ -20,6 +20,9 @@
 #include "classdesc_access.h"
 #include "minsky.h"
 #include "flowCoef.h"
+#include "odeSolver.h"
+#include "simulationWorker.h"
+#include "threadPool.h"
 
 #include "TCL_obj_stl.h"
 #include <gsl/gsl_errno.h>
@@ -27,6 +30,7 @@
 #include <cairo_base.h>
 
 #include <schema/schema3.h>
+#include <schema/snapshot.h>
 
 
 //#include <thread>
@@ -71,7 +75,7 @@ namespace
   int jacobian(double t, const double y[], double * dfdy, double dfdt[], void * params)
   {
    if (params==NULL) return GSL_EBADFUNC;
-   Minsky::Matrix jac(ValueVector::stockVars.size(), dfdy);
+   Minsky::Matrix jac(((Minsky*)params)->solverWorkspace.stockVars.size(), dfdy);
    try
      {
        ((Minsky*)params)->jacobian(jac,t,y);
@@ -91,13 +95,34 @@ namespace minsky
   struct RKdata
   {
     gsl_odeiv2_system sys;
-    gsl_odeiv2_driver* driver;
+    gsl_odeiv2_driver* driver=nullptr; ///< null for explicit Euler or native solver
+    std::unique_ptr<ODESolver> native; ///< built in solver, if selected
 
     static void errHandler(const char* reason, const char* file, int line, int gsl_errno) {
       throw error("gsl: %s:%d: %s",file,line,reason);
     }
 
-    RKdata(Minsky* minsky) {
+    RKdata(Minsky* minsky)
+    {
+      if (minsky->nativeSolver)
+        {
+          ODESolver::RHS f=[minsky](double t, const double y[], double result[])
+            {minsky->evalEquations(result,t,y);};
+          if (minsky->implicit)
+            native.reset(new Rosenbrock(f, [minsky](double t, const double y[], double dfdy[]) {
+                  Minsky::Matrix jac(minsky->solverWorkspace.stockVars.size(), dfdy);
+                  minsky->jacobian(jac,t,y);
+                }));
+          else
+            native.reset(new DormandPrince(f));
+          native->hmin=minsky->stepMin;
+          native->hmax=minsky->stepMax;
+          native->epsAbs=minsky->epsAbs;
+          native->epsRel=minsky->epsRel;
+          return;
+        }
+      if (minsky->order==1 && !minsky->implicit)
+        return; // do explicit Euler
       gsl_set_error_handler(errHandler);
       sys.function=RKfunction;
       sys.jacobian=jacobian;
@@ -107,8 +132,6 @@ namespace minsky
       switch (minsky->order)
         {
         case 1: 
-          if (!minsky->implicit)
-            throw error("First order explicit solver not available");
           stepper=gsl_odeiv2_step_rk1imp;
           break;
         case 2: 
@@ -126,9 +149,146 @@ namespace minsky
       gsl_odeiv2_driver_set_hmax(driver, minsky->stepMax);
       gsl_odeiv2_driver_set_hmin(driver, minsky->stepMin);
     }
-    ~RKdata() {gsl_odeiv2_driver_free(driver);}
+    ~RKdata() {if (driver) gsl_odeiv2_driver_free(driver);}
   };
 
+  namespace
+  {
+    /// returns the simulation worker thread, starting it if necessary
+    SimulationWorker& simulationWorker(Minsky& m)
+    {
+      if (!m.worker)
+        m.worker.reset(new SimulationWorker([&m](const SimulationWorker::Command& command,
+                                                 SimulationSnapshot& snapshot) {
+          if (command.type==SimulationWorker::Command::reset)
+            {
+              // discard any solver state carried between steps
+              if (m.ode && m.ode->driver)
+                gsl_odeiv2_driver_reset(m.ode->driver);
+              return;
+            }
+          auto& ode=*m.ode;
+          auto& ws=m.solverWorkspace;
+
+          {
+            SimulationStats::Timer timer(ws.stats.solve);
+            auto& stockVars=ws.stockVars;
+            ws.reverse=command.reversed;
+            double tp=command.reversed? -ws.t: ws.t;
+            if (ode.native)
+              {
+                auto& solver=*ode.native;
+                // restart the solver if the stock variables or time
+                // have been altered since the last iteration
+                solver.sync(tp, stockVars.data(), stockVars.size());
+                if (command.outputInterval>0)
+                  tp=solver.advanceTo(tp+command.outputInterval, stockVars.data(),
+                                      numeric_limits<size_t>::max());
+                else
+                  tp=solver.takeSteps(command.nSteps, stockVars.data());
+              }
+            else if (ode.driver)
+              {
+                gsl_odeiv2_driver_set_nmax(ode.driver, command.nSteps);
+                snapshot.status=gsl_odeiv2_driver_apply
+                  (ode.driver, &tp, numeric_limits<double>::max(), stockVars.data());
+                // taking nSteps steps is the normal outcome
+                if (snapshot.status==GSL_EMAXITER)
+                  snapshot.status=GSL_SUCCESS;
+                // report any exception caught within the RK callbacks
+                if (!m.threadErrMsg.empty())
+                  {
+                    snapshot.errMsg.swap(m.threadErrMsg);
+                    m.threadErrMsg.clear();
+                    return;
+                  }
+                if (snapshot.status) return;
+              }
+            else // do explicit Euler method
+              {
+                auto& d=ws.deriv;
+                d.resize(stockVars.size());
+                for (int i=0; i<command.nSteps; ++i, tp+=command.stepMax)
+                  {
+                    m.evalEquations(d.data(), tp, stockVars.data());
+                    for (size_t j=0; j<d.size(); ++j)
+                      stockVars[j]+=d[j];
+                  }
+              }
+            ws.t=command.reversed? -tp: tp;
+          }
+
+          {
+            SimulationStats::Timer timer(ws.stats.flows);
+            EvalOpBase::t()=ws.t;
+            m.evalFlows(ws.flowVars.data(), ws.flowVars.size(), ws.stockVars.data());
+          }
+
+          snapshot.t=ws.t;
+          snapshot.stockVars.assign(ws.stockVars.begin(), ws.stockVars.end());
+          snapshot.flowVars.assign(ws.flowVars.begin(), ws.flowVars.end());
+          snapshot.stats=ws.stats;
+        }));
+      return *m.worker;
+    }
+
+    /// true if the state has been edited since last exchanged with
+    /// the worker. The values are compared, so that writes by any
+    /// means are seen, not just those flagged by workerStateStale.
+    bool workerStateEdited(const Minsky& m)
+    {
+      return m.workerStateStale || m.stockVars!=m.workerStockVars ||
+        m.flowVars!=m.workerFlowVars;
+    }
+    
+    /// passes any state edited since the last step, and changes to
+    /// the solver parameters or direction, to the worker, and sets
+    /// it running
+    void runSimulationWorker(Minsky& m, SimulationWorker& w)
+    {
+      auto& posted=w.posted();
+      bool newParameters=posted.nSteps!=m.nSteps ||
+        posted.outputInterval!=m.outputInterval || posted.stepMax!=m.stepMax;
+      bool newDirection=posted.reversed!=m.reverse;
+      if (workerStateEdited(m) || newParameters || newDirection)
+        {
+          // discard any step computed ahead, and restart from the
+          // state last installed, as edited
+          w.pause();
+          // tensor shapes are only updated whilst the worker is paused
+          for (auto& eq: m.equations)
+            eq->updateHypercube();
+          m.solverWorkspace.setState(m.t, m.stockVars, m.flowVars);
+          m.workerStockVars=m.stockVars;
+          m.workerFlowVars=m.flowVars;
+          // values edited whilst the worker ran are only now seen by
+          // it, so cached tensor operations must see them as changed
+          for (auto& v: m.variableValues)
+            v.second->bumpVersion();
+          SimulationWorker::Command reset;
+          reset.type=SimulationWorker::Command::reset;
+          reset.epoch=posted.epoch+1;
+          w.post(reset);
+          m.workerStateStale=false;
+        }
+      if (newDirection)
+        {
+          SimulationWorker::Command direction;
+          direction.type=SimulationWorker::Command::reverse;
+          direction.reversed=m.reverse;
+          w.post(direction);
+        }
+      if (newParameters || !w.busy())
+        {
+          SimulationWorker::Command run;
+          run.nSteps=m.nSteps;
+          run.outputInterval=m.outputInterval;
+          run.stepMax=m.stepMax;
+          w.post(run);
+        }
+    }
+  }
+
   struct BusyCursor
   {
     Minsky& minsky;
@@ -172,24 +332,58 @@ namespace minsky
   
   void Minsky::openLogFile(const string& name)
   {
-    outputDataFile.reset(new ofstream(name));
-    *outputDataFile<< "#time";
+    closeLogFile();
+    vector<DataLogger::Column> columns;
     for (auto& v: variableValues)
       if (logVarList.count(v.first))
-        *outputDataFile<<" "<<v.second->name;
-    *outputDataFile<<endl;
+        {
+          loggedValues.push_back(v.second);
+          columns.emplace_back(v.second->name, v.second->size());
+        }
+    try
+      {
+        dataLogger=make_shared<DataLogger>(name, columns);
+      }
+    catch (...)
+      {
+        loggedValues.clear();
+        throw;
+      }
+  }
+
+  void Minsky::closeLogFile()
+  {
+    auto logger=dataLogger;
+    dataLogger.reset();
+    loggedValues.clear();
+    if (logger)
+      logger->close();
   }
 
   /// write current state of all variables to the log file
   void Minsky::logVariables() const
   {
-    if (outputDataFile)
+    if (dataLogger)
       {
-        *outputDataFile<<t;
-        for (auto& v: variableValues)
-          if (logVarList.count(v.first))
-            *outputDataFile<<" "<<v.second->value();
-        *outputDataFile<<endl;
+        auto row=dataLogger->nextRow();
+        *row++=t;
+        auto& columns=dataLogger->columns();
+        for (size_t i=0; i<loggedValues.size(); ++i)
+          {
+            auto& v=*loggedValues[i];
+            size_t n=columns[i].size;
+            auto& values=v.isFlowVar()? ValueVector::flowVars: ValueVector::stockVars;
+            // a value resized or deallocated since the log was opened
+            // is padded with NaNs
+            size_t m=v.idx()<0? 0: min(n, v.size());
+            if (m && v.idx()+m<=values.size())
+              v.evalBlock(row, 0, m);
+            else
+              m=0;
+            fill(row+m, row+n, nan(""));
+            row+=n;
+          }
+        dataLogger->commit();
       }
   }        
         
@@ -197,9 +391,14 @@ namespace minsky
 
   void Minsky::clearAllMaps()
   {
+    // the worker evaluates the equations being torn down
+    if (worker) worker->pause();
+    workerStateStale=true;
     model->clear();
     equations.clear();
+    compiledEquations.clear();
     integrals.clear();
+    jacobianSparsity.clear();
     variableValues.clear();
     
     flowVars.clear();
@@ -427,7 +626,9 @@ namespace minsky
     stockVars.clear();
     flowVars.clear();
     equations.clear();
+    compiledEquations.clear();
     integrals.clear();
+    jacobianSparsity.clear();
 
     // remove all temporaries
     for (auto v=variableValues.begin(); v!=variableValues.end();)
@@ -472,6 +673,12 @@ namespace minsky
     assert(variableValues.validEntries());
     system.populateEvalOpVector(equations, integrals);
     assert(variableValues.validEntries());
+    compiledEquations.compile(equations);
+    // only models with sufficiently large independent tensor
+    // operations benefit from concurrent evaluation
+    concurrentEval=numThreads!=1 && compiledEquations.concurrent();
+    if (numThreads!=1)
+      sharedThreadPool().resize(numThreads);
     
     // attach the plots
     model->recursiveDo
@@ -799,6 +1006,12 @@ namespace minsky
     };
   }
 
+  Minsky::~Minsky()
+  {
+    // stop the simulation before the model it refers to is destroyed
+    worker.reset();
+  }
+
   void Minsky::initGodleys()
   {
     auto toGodleyIcon=[](const ItemPtr& i) {return dynamic_cast<GodleyIcon*>(i.get());};
@@ -817,27 +1030,34 @@ namespace minsky
         if (RKThreadRunning) return;
       }
 
+    // the worker must be idle whilst the equations and solver are rebuilt
+    if (worker) worker->pause();
     canvas.itemIndicator=false;
     BusyCursor busy(*this);
-    EvalOpBase::t=t=t0;
+    simulationStats.clear();
+    SimulationStats::Timer timer(simulationStats.reset);
+    EvalOpBase::t()=t=t0;
     constructEquations();
     // if no stock variables in system, add a dummy stock variable to
     // make the simulation proceed
     if (stockVars.empty()) stockVars.resize(1,0);
 
     initGodleys();
+    // Godley tables need to be initialised before analysing the Jacobian structure
+    jacobianSparsity.analyse(equations, evalGodley, integrals,
+                             stockVars.size(), flowVars.size());
 
+    solverWorkspace.resize(stockVars.size(), flowVars.size());
+    solverWorkspace.stats.clear();
+    solverWorkspace.reverse=reverse;
     if (stockVars.size()>0)
-      {
-        if (order==1 && !implicit)
-          ode.reset(); // do explicit Euler
-        else
-          ode.reset(new RKdata(this)); // set up GSL ODE routines
-      }
+      // set up GSL ODE routines unless doing explicit Euler
+      ode.reset(new RKdata(this));
 
       
     // update flow variable
     evalEquations();
+    solverWorkspace.setState(t, stockVars, flowVars);
     
     model->recursiveDo
       (&Group::items,
@@ -880,59 +1100,30 @@ namespace minsky
       reset();
     running=true;
     
-    // create a private copy for worker thread use
-    vector<double> stockVarsCopy(stockVars);
-    RKThreadRunning=true;
-    int err=GSL_SUCCESS;
     // run RK algorithm on a separate worker thread so as to no block UI. See ticket #6
-    boost::thread rkThread([&]() {
-      try
-        { 
-          double tp=reverse? -t: t;
-          if (ode)
-            {
-              gsl_odeiv2_driver_set_nmax(ode->driver, nSteps);
-              // we need to update Minsky's t synchronously to support the t operator
-              // potentially means t and stockVars out of sync on GUI, but should still be thread safe
-              err=gsl_odeiv2_driver_apply(ode->driver, &tp, numeric_limits<double>::max(), 
-                                          &stockVarsCopy[0]);
-            }
-          else // do explicit Euler method
-            {
-              vector<double> d(stockVarsCopy.size());
-              for (int i=0; i<nSteps; ++i, tp+=stepMax)
-                {
-                  evalEquations(&d[0], tp, &stockVarsCopy[0]);
-                  for (size_t j=0; j<d.size(); ++j)
-                    stockVarsCopy[j]+=d[j];
-                }
-            }
-          t=reverse? -tp:tp;
-        }
-      catch (const std::exception& ex)
-        {
-          // catch any thrown exception, and report back to GUI thread
-          threadErrMsg=ex.what();
-        }
-      catch (...)
-        {
-          threadErrMsg="Unknown exception thrown on ODE solver thread";
-        }
-      RKThreadRunning=false;
-    });
-
-    while (RKThreadRunning)
+    auto& w=simulationWorker(*this);
+    runSimulationWorker(*this, w);
+    RKThreadRunning=true;
+    ++simulationStats.steps;
+    // wait for the next step, discarding any computed before the
+    // worker was last reset
+    while (!w.snapshots.acquire() || w.snapshots.readBuffer().epoch!=w.posted().epoch)
       {
-        // while waiting for thread to finish, check and process any UI events
-        usleep(1000);
+        // while waiting for the step to finish, check and process any UI events
+        w.wait(1);
         doOneEvent(false);
+        if (workerStateEdited(*this)) // variables edited whilst waiting
+          runSimulationWorker(*this, w);
       }
-    rkThread.join();
+    RKThreadRunning=false;
+    auto& snapshot=w.snapshots.readBuffer();
 
-    if (!threadErrMsg.empty())
+    if (!snapshot.errMsg.empty())
       {
-        runtime_error err(threadErrMsg);
-        threadErrMsg.clear();
+        // the worker has stopped, so restart from the current state
+        workerStateStale=true;
+        runtime_error err(snapshot.errMsg);
+        snapshot.errMsg.clear();
         // rethrow exception so message gets displayed to user
         throw err;
       }
@@ -943,29 +1134,48 @@ namespace minsky
         return;
       }
 
-    switch (err)
+    switch (snapshot.status)
       {
-      case GSL_SUCCESS: case GSL_EMAXITER: break;
+      case GSL_SUCCESS: break;
       case GSL_FAILURE:
+        workerStateStale=true;
         throw error("unspecified error GSL_FAILURE returned");
       case GSL_EBADFUNC: 
-        gsl_odeiv2_driver_reset(ode->driver);
+        workerStateStale=true;
         throw error("Invalid arithmetic operation detected");
       default:
-        throw error("gsl error: %s",gsl_strerror(err));
+        workerStateStale=true;
+        throw error("gsl error: %s",gsl_strerror(snapshot.status));
       }
 
-    stockVars.swap(stockVarsCopy);
-
-    // update flow variables
-    evalEquations();
+    // install the snapshot as the state read by plots, the data
+    // logger and REST clients, handing our buffers back in exchange
+    t=snapshot.t;
+    EvalOpBase::t()=t;
+    stockVars.swap(snapshot.stockVars);
+    flowVars.swap(snapshot.flowVars);
+    workerStockVars=stockVars;
+    workerFlowVars=flowVars;
+    auto& stats=snapshot.stats;
+    simulationStats.rhsEvaluations=stats.rhsEvaluations;
+    simulationStats.jacobianEvaluations=stats.jacobianEvaluations;
+    simulationStats.solve=stats.solve;
+    simulationStats.rhs=stats.rhs;
+    simulationStats.jacobian=stats.jacobian;
+    simulationStats.flows=stats.flows;
 
-    logVariables();
+    {
+      SimulationStats::Timer timer(simulationStats.log);
+      logVariables();
+    }
 
-    model->recursiveDo
-      (&Group::items, 
-       [&](Items&, Items::iterator i) 
-       {(*i)->updateIcon(t); return false;});
+    {
+      SimulationStats::Timer timer(simulationStats.updateIcons);
+      model->recursiveDo
+        (&Group::items, 
+         [&](Items&, Items::iterator i) 
+         {(*i)->updateIcon(t); return false;});
+    }
 
     // throttle redraws
     time_duration maxWait=milliseconds(maxWaitMS);
@@ -992,19 +1202,35 @@ namespace minsky
     return "";
   }
 
+  void Minsky::evalEquations()
+  {
+    // the worker shares the equations, and is running ahead of the
+    // state evaluated here
+    if (worker) worker->pause();
+    workerStateStale=true;
+    EvalOpBase::t()=t;
+    for (auto& eq: equations)
+      eq->updateHypercube();
+    evalFlows(flowVars.data(), flowVars.size(), stockVars.data());
+  }
+
   void Minsky::evalEquations(double result[], double t, const double vars[])
   {
-    EvalOpBase::t=reverse? -t: t;
-    double reverseFactor=reverse? -1: 1;
+    // called on the worker thread, so uses its copy of the state
+    auto& ws=solverWorkspace;
+    ++ws.stats.rhsEvaluations;
+    SimulationStats::Timer timer(ws.stats.rhs);
+    EvalOpBase::t()=ws.reverse? -t: t;
+    double reverseFactor=ws.reverse? -1: 1;
     // firstly evaluate the flow variables. Initialise to flowVars so
     // that no input vars are correctly initialised
-    vector<double> flow(flowVars);
-    for (size_t i=0; i<equations.size(); ++i)
-      equations[i]->eval(&flow[0], flow.size(), vars);
+    auto& flow=ws.flow;
+    flow.assign(ws.flowVars.begin(), ws.flowVars.end());
+    evalFlows(flow.data(), flow.size(), vars);
 
     // then create the result using the Godley table
-    for (size_t i=0; i<stockVars.size(); ++i) result[i]=0;
-    evalGodley.eval(result, &flow[0]);
+    for (size_t i=0; i<ws.stockVars.size(); ++i) result[i]=0;
+    evalGodley.eval(result, flow.data());
 
     // integrations are kind of a copy
     for (vector<Integral>::iterator i=integrals.begin(); i<integrals.end(); ++i)
@@ -1022,34 +1248,66 @@ namespace minsky
 
   void Minsky::jacobian(Matrix& jac, double t, const double sv[])
   {
-    EvalOpBase::t=reverse? -t: t;
-    double reverseFactor=reverse? -1: 1;
+    auto& ws=solverWorkspace;
+    ++ws.stats.jacobianEvaluations;
+    SimulationStats::Timer timer(ws.stats.jacobian);
+    EvalOpBase::t()=ws.reverse? -t: t;
+    double reverseFactor=ws.reverse? -1: 1;
     // firstly evaluate the flow variables. Initialise to flowVars so
     // that no input vars are correctly initialised
-    vector<double> flow=flowVars;
-    for (size_t i=0; i<equations.size(); ++i)
-      equations[i]->eval(&flow[0], flow.size(), sv);
+    auto& flow=ws.flow;
+    flow.assign(ws.flowVars.begin(), ws.flowVars.end());
+    evalFlows(flow.data(), flow.size(), sv);
+
+    const size_t nStocks=ws.stockVars.size();
+    auto& ds=ws.ds; auto& df=ws.df; auto& d=ws.d;
+    ds.resize(nStocks);
+    df.resize(ws.flowVars.size());
+    d.resize(nStocks);
+    // computes into d the derivatives of the stock variables with
+    // respect to the stock variables seeded in ds
+    auto sweep=[&]() {
+      fill(df.begin(), df.end(), 0);
+      fill(d.begin(), d.end(), 0);
+      for (size_t i=0; i<equations.size(); ++i)
+        equations[i]->deriv(df.data(), df.size(), ds.data(), sv, flow.data());
+      evalGodley.eval(d.data(), df.data());
+      for (vector<Integral>::iterator i=integrals.begin(); 
+           i!=integrals.end(); ++i)
+        {
+          assert(i->stock.idx()>=0 && i->input.idx()>=0);
+          d[i->stock.idx()] = 
+            i->input.isFlowVar()? df[i->input.idx()]: ds[i->input.idx()];
+        }
+    };
 
-    // then determine the derivatives with respect to variable j
-    for (size_t j=0; j<stockVars.size(); ++j)
+    if (colouredJacobian && jacobianSparsity.numColumns()==nStocks)
       {
-        vector<double> ds(stockVars.size()), df(flowVars.size());
-        ds[j]=1;
-        for (size_t i=0; i<equations.size(); ++i)
-          equations[i]->deriv(&df[0], df.size(), &ds[0], sv, &flow[0]);
-        vector<double> d(stockVars.size());
-        evalGodley.eval(&d[0], &df[0]);
-        for (vector<Integral>::iterator i=integrals.begin(); 
-             i!=integrals.end(); ++i)
+        // columns within a colour group have disjoint row sparsity,
+        // so can be seeded and computed together
+        for (size_t i=0; i<nStocks; i++)
+          for (size_t j=0; j<nStocks; ++j)
+            jac(i,j)=0;
+        for (auto& group: jacobianSparsity.colourGroups)
           {
-            assert(i->stock.idx()>=0 && i->input.idx()>=0);
-            d[i->stock.idx()] = 
-              i->input.isFlowVar()? df[i->input.idx()]: ds[i->input.idx()];
+            fill(ds.begin(), ds.end(), 0);
+            for (auto j: group) ds[j]=1;
+            sweep();
+            for (auto j: group)
+              for (auto i: jacobianSparsity.columnRows[j])
+                jac(i,j)=reverseFactor*d[i];
           }
-        for (size_t i=0; i<stockVars.size(); i++)
-          jac(i,j)=reverseFactor*d[i];
       }
-  
+    else
+      // determine the derivatives with respect to variable j
+      for (size_t j=0; j<nStocks; ++j)
+        {
+          fill(ds.begin(), ds.end(), 0);
+          ds[j]=1;
+          sweep();
+          for (size_t i=0; i<nStocks; i++)
+            jac(i,j)=reverseFactor*d[i];
+        }
   }
 
   void Minsky::save(const std::string& filename)
@@ -1072,18 +1330,56 @@ namespace minsky
     fileVersion=minskyVersion;
   }
 
+  void Minsky::saveSnapshot(const std::string& filename, bool compress)
+  {
+    // tensor data is written as separate blocks, rather than encoded
+    // into the XML
+    schema3::Minsky m(*this, false);
+    ostringstream xml;
+    xml_pack_t saveFile(xml, schemaURL);
+    saveFile.prettyPrint=true;
+    xml_pack(saveFile, "Minsky", m);
+
+    snapshot::Writer writer;
+    writer.compress=compress;
+    for (auto& v: variableValues)
+      if (v.second->tensorInit.rank())
+        writer.addTensor(v.first, v.second->tensorInit);
+    writer.write(filename, xml.str());
+    flags &= ~is_edited;
+    fileVersion=minskyVersion;
+  }
+
   void Minsky::load(const std::string& filename) 
   {
     BusyCursor busy(*this);
     clearAllMaps();
 
-    ifstream inf(filename);
-    if (!inf)
-      throw runtime_error("failed to open "+filename);
-    stripByteOrderingMarker(inf);
-    xml_unpack_t saveFile(inf);
+    unique_ptr<snapshot::Reader> snapshotReader;
+    unique_ptr<istream> inf;
+    if (snapshot::isSnapshot(filename))
+      {
+        snapshotReader.reset(new snapshot::Reader(filename));
+        inf.reset(new istringstream(snapshotReader->xml()));
+      }
+    else
+      {
+        inf.reset(new ifstream(filename));
+        if (!*inf)
+          throw runtime_error("failed to open "+filename);
+        stripByteOrderingMarker(*inf);
+      }
+    xml_unpack_t saveFile(*inf);
     schema3::Minsky currentSchema(saveFile);
     *this=currentSchema;
+    if (snapshotReader)
+      for (auto& valueId: snapshotReader->tensors())
+        {
+          auto v=variableValues.find(valueId);
+          if (v!=variableValues.end() &&
+              snapshotReader->loadTensor(valueId, v->second->tensorInit))
+            v->second->hypercube(v->second->tensorInit.hypercube());
+        }
     if (currentSchema.schemaVersion<currentSchema.version)
       message("You are converting the model from an older version of Minsky. "
               "Once you save this file, you may not be able to open this file"
@@ -1260,63 +1556,210 @@ namespace minsky
   }
   
   bool Minsky::pushHistory()
+  {
+    historyIds.markAllChanged();
+    return pushHistoryChanges();
+  }
+
+  bool Minsky::pushHistoryChanges()
   {
     // go via a schema object, as serialising minsky::Minsky has
-    // problems due to port management
-    schema3::Minsky m(*this);
-    pack_t buf;
-    buf<<m;
-    if (history.empty())
-      {
-        history.emplace_back();
-        buf.swap(history.back());
-        historyPtr=history.size();
-        return true;
-      }
+    // problems due to port management. Tensor data is held
+    // separately by the history state, rather than encoded. Parts are
+    // shared with the current state, which is not the last after an undo.
+    const HistoryState* current=nullptr;
+    if (historyPtr>0 && historyPtr<=history.size())
+      current=&history[historyPtr-1];
+    else if (!history.empty())
+      current=&history.back();
+    HistoryState state(schema3::Minsky(*this, false, &historyIds), variableValues, current, historyIds);
+    historyIds.clearChanges();
     while (history.size()>maxHistory)
       history.pop_front();
-    if (memcmp(buf.data(), history.back().data(), buf.size())!=0)
+    if (history.empty() || !state.equivalent(history.back()))
       {
-        // check XML versions differ (slower)
-        ostringstream prev, curr;
-        xml_pack_t prevXbuf(prev), currXbuf(curr);
-        xml_pack(currXbuf,"Minsky",m);
-        history.back().reseto()>>m;
-        xml_pack(prevXbuf,"Minsky",m);
-
-        if (curr.str()!=prev.str())
-          {
-            // This bit of code outputs an XML representation that can be
-            //        used for debugging issues related to unnecessary
-            //        history pushes.
-            //  buf.reseto()>>m;
-            //  xml_pack_t tb(cout);
-            //  tb.prettyPrint=true;
-            //  xml_pack(tb,"Minsky",m); 
-            //  cout<<"------"<<endl;
-            history.emplace_back();
-            buf.swap(history.back());
-            historyPtr=history.size();
-            return true;
-          }
+        history.push_back(move(state));
+        historyPtr=history.size();
+        return true;
       }
     historyPtr=history.size();
     return false;
   }
 
+  namespace
+  {
+    typedef HistoryState::RecordPtr RecordPtr;
+    
+    template <class T>
+    bool sameOptional(const Optional<T>& x, const Optional<T>& y)
+    {return bool(x)==bool(y) && (!x || *x==*y);}
+
+    /// pairs of differing records of \a from and \a to with the same
+    /// id. @return false if the ids of \a from and \a to differ
+    bool changedRecords(const vector<RecordPtr>& from, const vector<RecordPtr>& to,
+                        vector<pair<RecordPtr,RecordPtr>>& changed)
+    {
+      if (from.size()!=to.size()) return false;
+      map<int,RecordPtr> fromById;
+      for (auto& i: from)
+        fromById.emplace(i->id, i);
+      for (auto& i: to)
+        {
+          auto f=fromById.find(i->id);
+          if (f==fromById.end()) return false;
+          if (f->second!=i && !(*f->second==*i))
+            changed.emplace_back(f->second, i);
+        }
+      return true;
+    }
+
+    template <class T>
+    T unpackRecord(const HistoryState::Record& r)
+    {
+      pack_t buf;
+      buf.packraw(r.data.data(), r.data.size());
+      T x;
+      buf>>x;
+      return x;
+    }
+
+    template <class T>
+    T* object(const HistoryIds& ids, int id)
+    {
+      auto i=ids.objects.find(id);
+      if (i==ids.objects.end()) return nullptr;
+      // objects are stored as their pointer to T
+      return static_cast<T*>(const_cast<void*>(i->second.lock().get()));
+    }
+
+    /// apply the records of \a to differing from \a from to the model
+    /// objects in place. @return false, leaving the model unchanged,
+    /// if they differ in objects or connections
+    bool patchModel(Minsky& m, const HistoryState& from, const HistoryState& to)
+    {
+      // only records whose objects and connections are unchanged can be
+      // applied in place
+      vector<pair<RecordPtr,RecordPtr>> changedItems, changedWires, changedGroups;
+      if (!changedRecords(from.items, to.items, changedItems) ||
+          !changedRecords(from.wires, to.wires, changedWires) ||
+          !changedRecords(from.groups, to.groups, changedGroups))
+        return false;
+
+      vector<pair<Item*,schema3::Item>> items;
+      for (auto& i: changedItems)
+        {
+          auto x=unpackRecord<schema3::Item>(*i.first), y=unpackRecord<schema3::Item>(*i.second);
+          auto item=object<Item>(m.historyIds, y.id);
+          if (!item || x.type!=y.type || x.ports!=y.ports ||
+              !sameOptional(x.intVar, y.intVar) || !sameOptional(x.lockGroup, y.lockGroup))
+            return false;
+          items.emplace_back(item, move(y));
+        }
+      vector<pair<Wire*,schema3::Wire>> wires;
+      for (auto& i: changedWires)
+        {
+          auto x=unpackRecord<schema3::Wire>(*i.first), y=unpackRecord<schema3::Wire>(*i.second);
+          auto wire=object<Wire>(m.historyIds, y.id);
+          if (!wire || x.from!=y.from || x.to!=y.to)
+            return false;
+          wires.emplace_back(wire, move(y));
+        }
+      vector<pair<Group*,schema3::Group>> groups;
+      for (auto& i: changedGroups)
+        {
+          auto x=unpackRecord<schema3::Group>(*i.first), y=unpackRecord<schema3::Group>(*i.second);
+          auto group=object<Group>(m.historyIds, y.id);
+          if (!group || x.items!=y.items || !sameOptional(x.inVariables, y.inVariables) ||
+              !sameOptional(x.outVariables, y.outVariables))
+            return false;
+          groups.emplace_back(group, move(y));
+        }
+
+      if (m.worker) m.worker->pause();
+      m.workerStateStale=true;
+      for (auto& i: items)
+        {
+          schema3::populateItem(*i.first, i.second);
+          if (auto v=i.first->variableCast())
+            {
+              if (i.second.init) v->init(*i.second.init);
+              if (i.second.units) v->setUnits(*i.second.units);
+            }
+          if (auto g=dynamic_cast<GodleyIcon*>(i.first))
+            try
+              {
+                g->update();
+              }
+            catch (...) {} //ignore exceptions: ticket #1045
+          i.first->renderCache.invalidate();
+          // reserialise on the next push, as attributes may not have
+          // been restored exactly
+          m.historyIds.markChanged(*i.first);
+        }
+      for (auto& i: wires)
+        {
+          schema3::populateWire(*i.first, i.second);
+          m.historyIds.markChanged(*i.first);
+        }
+      for (auto& i: groups)
+        {
+          schema3::populateItem(*i.first, i.second);
+          i.first->renderCache.invalidate();
+          m.historyIds.markChanged(*i.first);
+        }
+      for (auto& i: to.tensors)
+        {
+          auto f=from.tensors.find(i.first);
+          if (f!=from.tensors.end() && f->second==i.second) continue;
+          auto v=m.variableValues.find(i.first);
+          if (v!=m.variableValues.end())
+            {
+              v->second->tensorInit=*i.second;
+              v->second->hypercube(i.second->hypercube());
+            }
+        }
+      m.flags|=Minsky::reset_needed|Minsky::fullEqnDisplay_needed;
+      return true;
+    }
+  }
+
   void Minsky::undo(int changes)
   {
     // save current state for later restoration if needed
     if (historyPtr==history.size())
       pushHistory();
+    auto fromPtr=historyPtr;
     historyPtr-=changes;
     if (historyPtr > 0 && historyPtr <= history.size())
       {
+        auto& state=history[historyPtr-1];
+        // apply the changed records to the model in place where
+        // possible, otherwise rebuild it
+        if (fromPtr>0 && fromPtr<=history.size() && patchModel(*this, history[fromPtr-1], state))
+          return;
         schema3::Minsky m;
-        history[historyPtr-1].reseto()>>m;
+        state.unpack(m);
         clearAllMaps();
         model->clear();
-        m.populateGroup(*model);
+        // the restored objects take the ids of the restored state, so
+        // that subsequent states share its records
+        historyIds.ids.clear();
+        historyIds.objects.clear();
+        historyIds.records.clear();
+        m.populateGroup(*model, &historyIds);
+        for (auto r: {&state.items, &state.wires, &state.groups})
+          for (auto& i: *r)
+            historyIds.records[i->id]=i;
+        historyIds.clearChanges();
+        for (auto& i: state.tensors)
+          {
+            auto v=variableValues.find(i.first);
+            if (v!=variableValues.end())
+              {
+                v->second->tensorInit=*i.second;
+                v->second->hypercube(i.second->hypercube());
+              }
+          }
       }
     else
       historyPtr+=changes; // revert
@@ -34,6 +34,7 @@
 #include "equations.h"
 #include "latexMarkup.h"
 #include "integral.h"
+#include "jacobianSparsity.h"
 #include "variableValue.h"
 #include "canvas.h"
 #include "panopticon.h"
@@ -42,11 +43,15 @@
 #include "parameterSheet.h"
 #include "dimension.h"
 #include "rungeKutta.h"
+#include "history.h"
+#include "dataLogger.h"
+#include "simulationStats.h"
 
 #include <vector>
 #include <string>
 #include <set>
 #include <deque>
+#include <atomic>
 
 #include <ecolab.h>
 #include <xml_pack_base.h>
@@ -61,6 +66,9 @@ namespace minsky
   using namespace civita;
   
   struct RKdata; // an internal structure for holding Runge-Kutta data
+  class SimulationWorker;
+  class SharedThreadPool;
+  SharedThreadPool& sharedThreadPool();
 
   // handle the display of rendered equations on the screen
   class EquationDisplay: public CairoSurface
@@ -78,14 +86,64 @@ namespace minsky
     void requestRedraw() {if (surface.get()) surface->requestRedraw();}
   };
   
+  /// scratch buffers of the equation evaluation and solver, sized
+  /// by reset(), so that no heap allocation occurs within the RK
+  /// callbacks or steady state stepping. Also holds the state being
+  /// integrated, which belongs to the simulation worker thread
+  /// except while the worker is paused.
+  struct SolverWorkspace
+  {
+    vector<double> flow;          ///< flow variables
+    vector<double> ds, df, d;     ///< Jacobian column computation
+    vector<double> deriv;         ///< explicit Euler derivative
+    double t=0;                   ///< worker thread copy of t
+    vector<double> stockVars;     ///< worker thread copy of stockVars
+    vector<double> flowVars;      ///< worker thread copy of flowVars
+    bool reverse=false;           ///< direction of integration
+    SimulationStats stats;        ///< solver work done on the worker thread
+    void resize(size_t nStocks, size_t nFlows) {
+      flow.resize(nFlows); ds.resize(nStocks); df.resize(nFlows);
+      d.resize(nStocks); deriv.resize(nStocks); stockVars.resize(nStocks);
+      flowVars.resize(nFlows);
+    }
+    /// set the state to be integrated
+    void setState(double t, const vector<double>& stockVars, const vector<double>& flowVars) {
+      this->t=t;
+      this->stockVars.assign(stockVars.begin(), stockVars.end());
+      this->flowVars.assign(flowVars.begin(), flowVars.end());
+    }
+  };
+
   // a place to put working variables of the Minsky class that needn't
   // be serialised.
   struct MinskyExclude
   {
     EvalOpVector equations;
+    /// flattened form of equations used for fast evaluation
+    EvalOpProgram compiledEquations;
     vector<Integral> integrals;
+    /// sparsity structure and column colouring of the Jacobian
+    JacobianSparsity jacobianSparsity;
     shared_ptr<RKdata> ode;
-    shared_ptr<ofstream> outputDataFile;
+    SolverWorkspace solverWorkspace;
+    /// persistent thread on which the simulation is stepped
+    shared_ptr<SimulationWorker> worker;
+    /// the model has been modified since the worker state was last
+    /// synchronised, so must be copied to it before the next
+    /// step. Atomic, as values may be written from any thread
+    std::atomic<bool> workerStateStale{true};
+    /// stock and flow variables as last exchanged with the worker,
+    /// which only ever sees its own copy of them. Values written
+    /// since, by whatever means, differ from these.
+    std::vector<double> workerStockVars, workerFlowVars;
+    /// evaluate independent tensor operations concurrently on
+    /// sharedThreadPool()
+    bool concurrentEval=false;
+    /// simulation output log, and the values logged in its columns
+    shared_ptr<DataLogger> dataLogger;
+    vector<VariableValuePtr> loggedValues;
+    /// work done by the simulation since the last reset
+    SimulationStats simulationStats;
     
     enum StateFlags {is_edited=1, reset_needed=2, fullEqnDisplay_needed=4};
     int flags=reset_needed;
@@ -102,18 +160,17 @@ namespace minsky
     
     /// used to report a thrown exception on the simulation thread
     std::string threadErrMsg;
+    /// ids and cached records of the model objects in the history.
+    /// Objects changed by edits should be marked here, for
+    /// pushHistoryChanges() to pick up.
+    HistoryIds historyIds;
   protected:
     /// save history of model for undo
-    /* 
-       TODO: it should be sufficient to add move semantics to pack_t,
-       but for some reason copy semantics are required, requiring the
-       use of shared_ptr
-     */
-    std::deque<classdesc::pack_t> history;
+    std::deque<HistoryState> history;
     size_t historyPtr;
 
     /// flag indicates that RK engine is computing a step
-    volatile bool RKThreadRunning=false;
+    std::atomic<bool> RKThreadRunning{false};
   };
 
   /// convenience class for accessing matrix elements from a data array
@@ -138,7 +195,8 @@ namespace minsky
     /// NaN. Either a variable name, or and operator type.
     std::string diagnoseNonFinite() const;
 
-    /// write current state of all variables to the log file
+    /// write current state of all variables, as installed from the
+    /// last simulation snapshot, to the log file
     void logVariables() const;
 
     Exclude<boost::posix_time::ptime> lastRedraw;
@@ -172,12 +230,30 @@ namespace minsky
     }
     /// @}
 
-    /// evaluate the flow equations without stepping.
+    /// evaluate the flow equations without stepping. Pauses the
+    /// simulation worker, which restarts from the updated state on
+    /// the next step.
     /// @throw ecolab::error if equations are illdefined
-    void evalEquations() {
-      for (auto& eq: equations)
-        eq->eval(&flowVars[0], flowVars.size(), &stockVars[0]);
+    void evalEquations();
+
+    /// evaluate flow variables \a fv (of size \a n) from stock
+    /// variables \a sv, using the compiled program if compiledEval
+    /// is set, otherwise the reference EvalOpVector implementation
+    void evalFlows(double fv[], size_t n, const double sv[]) {
+      if (compiledEval && concurrentEval)
+        compiledEquations.eval(fv, n, sv, sharedThreadPool());
+      else if (compiledEval)
+        compiledEquations.eval(fv, n, sv);
+      else
+        for (auto& eq: equations)
+          eq->eval(fv, n, sv);
     }
+    /// use the flattened EvalOpProgram for evaluating equations
+    bool compiledEval=true;
+    /// number of threads in the pool shared by all concurrent
+    /// computation. 0 means one per core, 1 disables concurrent
+    /// evaluation of equations. Takes effect on the next reset.
+    unsigned numThreads=0;
     
     VariableValues variableValues;
     Dimensions dimensions;
@@ -211,6 +287,7 @@ namespace minsky
       model->iWidth(std::numeric_limits<float>::max());
       model->self=model;
     }
+    ~Minsky();
 
     GroupPtr model{new Group};
     Canvas canvas{model};
@@ -253,12 +330,15 @@ namespace minsky
     /// if there are some
     bool cycleCheck() const;
 
-    /// opens the log file, and writes out a header line describing
-    /// names of all variables
+    /// opens the log file, which logs the variables in logVarList
+    /// from then on. See DataLogger for the file format.
     void openLogFile(const string&);
-    /// closes log file
-    void closeLogFile() {outputDataFile.reset();}
+    /// closes log file, writing out any buffered data
+    void closeLogFile();
     std::set<string> logVarList;
+    /// convert log file \a logFile to CSV format in \a csvFile
+    void logFileToCSV(const string& logFile, const string& csvFile) const
+    {DataLogger::toCSV(logFile, csvFile);}
     
     /// construct the equations based on input data
     /// @throws ecolab::error if the data is inconsistent
@@ -277,6 +357,9 @@ namespace minsky
 
     typedef MinskyMatrix Matrix; 
     void jacobian(Matrix& jac, double t, const double vars[]);
+    /// compute the Jacobian one colour group of columns at a time,
+    /// rather than one column at a time
+    bool colouredJacobian=true;
     
     double t{0}; ///< time
     double t0{0}; ///< simulation start time
@@ -287,7 +370,12 @@ namespace minsky
 
     /// save to a file
     void save(const std::string& filename);
-    /// load from a file
+    /// save to a binary snapshot file, storing parameter tensor data
+    /// as raw blocks (see schema/snapshot.h). Much faster to save and
+    /// load than XML for models with large imported data sets.
+    /// @param compress compress the tensor data blocks
+    void saveSnapshot(const std::string& filename, bool compress=false);
+    /// load from a file, either XML or snapshot
     void load(const std::string& filename);
 
     void exportSchema(const char* filename, int schemaLevel=1);
@@ -312,6 +400,9 @@ namespace minsky
 
     /// push current model state onto history if it differs from previous
     bool pushHistory();
+    /// as pushHistory(), but only reserialising the model objects
+    /// marked in historyIds as changed since the last push
+    bool pushHistoryChanges();
 
     /// restore model to state \a changes ago 
     void undo(int changes=1);
@@ -30,6 +30,7 @@
 
 #include <math.h>
 #include <sstream>
+#include <boost/functional/hash.hpp>
 
 #ifndef M_PI
 #define M_PI		3.14159265358979323846
@@ -314,6 +315,14 @@ namespace minsky
   }
   
 
+  size_t OperationBase::displayedState() const
+  {
+    auto r=Item::displayedState();
+    boost::hash_combine(r, arg);
+    boost::hash_combine(r, axis);
+    return r;
+  }
+
   double OperationBase::value() const
   {
     try
@@ -504,6 +513,17 @@ namespace minsky
     return r;
   }
  
+  size_t IntOp::displayedState() const
+  {
+    auto r=OperationBase::displayedState();
+    if (intVar)
+      {
+        boost::hash_combine(r, coupled());
+        boost::hash_combine(r, intVar->displayedState());
+      }
+    return r;
+  }
+
   void IntOp::draw(cairo_t* cairo) const
   {
     // if rotation is in 1st or 3rd quadrant, rotate as
@@ -869,6 +889,13 @@ namespace minsky
     return m_description;
   }    
 
+  size_t DataOp::displayedState() const
+  {
+    auto r=OperationBase::displayedState();
+    boost::hash_combine(r, m_description);
+    return r;
+  }
+
   void DataOp::readData(const string& fileName)
   {
     ifstream f(fileName.c_str());
@@ -94,6 +94,7 @@ namespace minsky
     /// if binary op, then the union of dimension names is returned
     std::vector<std::string> dimensions() const;
     Units units(bool check=false) const override;
+    std::size_t displayedState() const override;
 
   protected:
 
@@ -183,6 +184,7 @@ namespace minsky
     {return intVar->valueId();}
       
     void draw(cairo_t*) const override;
+    std::size_t displayedState() const override;
     void resize(const LassoBox& b) override;  
     std::pair<double,Point> rotatedPoints() const override;        
 
@@ -228,6 +230,7 @@ namespace minsky
     std::string description() const;  
     std::string description(const std::string&);    
     /// @}
+    std::size_t displayedState() const override;
     std::map<double, double> data;
     void readData(const std::string& fileName);
     /// initialise with uniform random numbers 
@@ -0,0 +1,260 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "plotSeries.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+namespace minsky
+{
+  const size_t PlotSeries::fanout;
+
+  namespace
+  {
+    bool bySeq(const PlotSeries::Point& x, const PlotSeries::Point& y) {return x.seq<y.seq;}
+
+    /// range of \a points, sorted by x, within [xmin,xmax], extended
+    /// by one point either side so lines run to the edge of the range
+    pair<size_t,size_t> range(const vector<PlotSeries::Point>& points, double xmin, double xmax)
+    {
+      auto b=lower_bound(points.begin(), points.end(), xmin,
+                         [](const PlotSeries::Point& p, double x) {return p.x<x;});
+      auto e=upper_bound(points.begin(), points.end(), xmax,
+                         [](double x, const PlotSeries::Point& p) {return x<p.x;});
+      if (b!=points.begin()) --b;
+      if (e!=points.end()) ++e;
+      return {b-points.begin(), max(b,e)-points.begin()};
+    }
+  }
+
+  void PlotSeries::Summary::add(const Point& p)
+  {
+    if (empty)
+      {
+        first=last=minX=maxX=minY=maxY=p;
+        empty=false;
+        return;
+      }
+    last=p;
+    if (p.x<minX.x) minX=p;
+    if (p.x>maxX.x) maxX=p;
+    if (p.y<minY.y) minY=p;
+    if (p.y>maxY.y) maxY=p;
+  }
+
+  void PlotSeries::Summary::points(vector<Point>& r) const
+  {
+    if (empty) return;
+    Point p[]={first, minX, maxX, minY, maxY, last};
+    sort(p, p+6, bySeq);
+    auto e=unique(p, p+6, [](const Point& x, const Point& y) {return x.seq==y.seq;});
+    r.insert(r.end(), p, e);
+  }
+
+  void PlotSeries::add(double x, double y)
+  {
+    if (count>0 && x<lastX)
+      m_monotonic=false;
+    lastX=x;
+    Point p{x,y,count++};
+    if (spilled())
+      {
+        spill.write(reinterpret_cast<const char*>(&p.x), sizeof(p.x));
+        spill.write(reinterpret_cast<const char*>(&p.y), sizeof(p.y));
+        if (!spill)
+          throw runtime_error("Error writing plot data to "+spillName);
+      }
+    else
+      {
+        raw.push_back(p);
+        inMemory++;
+      }
+    if (levels.empty())
+      levels.emplace_back();
+    levels[0].open.add(p);
+    if (++levels[0].open.inputs==fanout)
+      closeBucket(0);
+    if (inMemory>maxInMemory)
+      enforceCap();
+  }
+
+  void PlotSeries::assign(const double* x, const double* y, size_t n)
+  {
+    clear();
+    for (size_t i=0; i<n; ++i)
+      add(x[i], y[i]);
+  }
+
+  void PlotSeries::clear()
+  {
+    count=inMemory=0;
+    m_monotonic=true;
+    raw.clear();
+    raw.shrink_to_fit();
+    levels.clear();
+    if (spilled())
+      {
+        spill.close();
+        boost::system::error_code ec; // ignore any error in removing the file
+        boost::filesystem::remove(spillName, ec);
+        spillName.clear();
+      }
+  }
+
+  void PlotSeries::closeBucket(size_t level)
+  {
+    vector<Point> points;
+    levels[level].open.points(points);
+    levels[level].open=Summary();
+    if (!levels[level].dropped)
+      {
+        levels[level].points.insert(levels[level].points.end(), points.begin(), points.end());
+        inMemory+=points.size();
+      }
+    if (level+1==levels.size())
+      levels.emplace_back();
+    auto& next=levels[level+1];
+    for (auto& p: points)
+      next.open.add(p);
+    if (++next.open.inputs==fanout)
+      closeBucket(level+1);
+  }
+
+  void PlotSeries::enforceCap()
+  {
+    if (!spilled())
+      {
+        spillName=(boost::filesystem::temp_directory_path()/
+                   boost::filesystem::unique_path("minsky-plot-%%%%-%%%%-%%%%-%%%%")).string();
+        spill.open(spillName, ios::binary);
+        if (!spill)
+          {
+            spillName.clear();
+            throw runtime_error("Unable to create plot data spill file");
+          }
+        for (auto& p: raw)
+          {
+            spill.write(reinterpret_cast<const char*>(&p.x), sizeof(p.x));
+            spill.write(reinterpret_cast<const char*>(&p.y), sizeof(p.y));
+          }
+        if (!spill)
+          throw runtime_error("Error writing plot data to "+spillName);
+        inMemory-=raw.size();
+        raw.clear();
+        raw.shrink_to_fit();
+      }
+    // drop the finest levels, while a coarser level holding closed
+    // buckets remains. The top level never has closed buckets.
+    for (size_t i=0; inMemory>maxInMemory && i+2<levels.size(); ++i)
+      if (!levels[i].dropped)
+        {
+          inMemory-=levels[i].points.size();
+          levels[i].points.clear();
+          levels[i].points.shrink_to_fit();
+          levels[i].dropped=true;
+        }
+  }
+
+  void PlotSeries::decimate(vector<double>& x, vector<double>& y, size_t buckets,
+                            double xmin, double xmax) const
+  {
+    x.clear();
+    y.clear();
+    if (count==0) return;
+    
+    // indices of \a points within the range
+    auto inRange=[&](const vector<Point>& points) {
+      if (!m_monotonic) return make_pair(size_t(0), points.size());
+      return range(points, xmin, xmax);
+    };
+    auto append=[&](const vector<Point>& points) {
+      auto r=inRange(points);
+      for (size_t i=r.first; i<r.second; ++i)
+        {
+          x.push_back(points[i].x);
+          y.push_back(points[i].y);
+        }
+    };
+    // 4 points per bucket suffices to draw the envelope of a time series
+    size_t maxPoints=4*max(buckets, size_t(1));
+
+    if (!spilled())
+      {
+        auto r=inRange(raw);
+        if (r.second-r.first<=maxPoints || levels.size()<2)
+          {
+            append(raw);
+            return;
+          }
+      }
+
+    // use the finest retained level with few enough points. The top
+    // level has no closed buckets, so always qualifies.
+    size_t level=levels.size()-1;
+    for (size_t i=0; i<levels.size(); ++i)
+      if (!levels[i].dropped)
+        {
+          auto r=inRange(levels[i].points);
+          if (r.second-r.first<=maxPoints)
+            {
+              level=i;
+              break;
+            }
+        }
+
+    append(levels[level].points);
+    // the open buckets hold points more recent than the closed buckets of level
+    vector<Point> recent;
+    for (size_t i=level+1; i-->0;)
+      levels[i].open.points(recent);
+    append(recent);
+  }
+
+  PlotSeries::Reader::Reader(const PlotSeries& series): series(series)
+  {
+    if (series.spilled())
+      {
+        series.spill.flush();
+        spill.open(series.spillName, ios::binary);
+        if (!spill)
+          throw runtime_error("Unable to read plot data from "+series.spillName);
+      }
+  }
+
+  bool PlotSeries::Reader::next(double& x, double& y)
+  {
+    if (spill.is_open())
+      {
+        if (spill.read(reinterpret_cast<char*>(&x), sizeof(x)) &&
+            spill.read(reinterpret_cast<char*>(&y), sizeof(y)))
+          return true;
+        spill.close();
+      }
+    if (pos<series.raw.size())
+      {
+        x=series.raw[pos].x;
+        y=series.raw[pos].y;
+        pos++;
+        return true;
+      }
+    return false;
+  }
+}
@@ -0,0 +1,133 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLOTSERIES_H
+#define PLOTSERIES_H
+
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  /**
+     Data points of a plot pen, held with a memory cap, and summarised
+     at multiple resolutions for drawing.
+
+     Level k of the summary pyramid divides the series into buckets of
+     fanout^k consecutive points. For each bucket, the first and last
+     points, and the points of minimum and maximum x and y, are
+     retained, in series order. This preserves the envelope of the
+     curve at every level, and for time series (x nondecreasing) is
+     the M4 decimation scheme.
+
+     When the points held exceed the memory cap, the full resolution
+     data is moved to a temporary spill file, and subsequently the
+     finest summary levels are discarded.
+  */
+  class PlotSeries
+  {
+  public:
+    struct Point
+    {
+      double x, y;
+      size_t seq; ///< position in the series
+    };
+    static const size_t fanout=16;
+
+    explicit PlotSeries(size_t maxInMemory=1000000): maxInMemory(maxInMemory) {}
+    /// series data is not shared between plots
+    PlotSeries(const PlotSeries& x): maxInMemory(x.maxInMemory) {}
+    PlotSeries& operator=(const PlotSeries& x) {
+      clear();
+      maxInMemory=x.maxInMemory;
+      return *this;
+    }
+    ~PlotSeries() {clear();}
+
+    void add(double x, double y);
+    /// replace the series with the \a n points (\a x,\a y)
+    void assign(const double* x, const double* y, size_t n);
+    void clear();
+    /// number of points in the series
+    size_t size() const {return count;}
+    /// true if x is nondecreasing along the series
+    bool monotonic() const {return m_monotonic;}
+    /// number of points currently held in memory
+    size_t pointsInMemory() const {return inMemory;}
+    /// true if the full resolution data has been moved to disk
+    bool spilled() const {return !spillName.empty();}
+
+    /// points describing the series at a resolution of about \a
+    /// buckets per unit of the range [\a xmin, \a xmax], in series
+    /// order. The range is only used to narrow the selection when
+    /// monotonic(). Up to 6 points are returned per bucket.
+    void decimate(std::vector<double>& x, std::vector<double>& y, size_t buckets,
+                  double xmin=-std::numeric_limits<double>::max(),
+                  double xmax=std::numeric_limits<double>::max()) const;
+
+    /// sequential reader of the full resolution series
+    class Reader
+    {
+      const PlotSeries& series;
+      std::ifstream spill;
+      size_t pos=0;
+    public:
+      Reader(const PlotSeries&);
+      /// read the next point
+      /// @return false at the end of the series
+      bool next(double& x, double& y);
+    };
+
+  private:
+    size_t maxInMemory;
+    size_t count=0, inMemory=0;
+    bool m_monotonic=true;
+    double lastX=0;
+    std::vector<Point> raw;
+    mutable std::ofstream spill;
+    std::string spillName;
+
+    /// extreme points of a bucket in the course of being filled
+    struct Summary
+    {
+      Point first, last, minX, maxX, minY, maxY;
+      bool empty=true;
+      size_t inputs=0; ///< number of points or buckets of the level below added
+      void add(const Point&);
+      /// retained points, in series order
+      void points(std::vector<Point>&) const;
+    };
+    struct Level
+    {
+      std::vector<Point> points; ///< points retained from closed buckets
+      Summary open;
+      bool dropped=false; ///< closed buckets have been discarded
+    };
+    /// levels[k] holds the summaries of level k+1
+    std::vector<Level> levels;
+
+    void closeBucket(size_t level);
+    void enforceCap();
+  };
+}
+
+#endif
@@ -26,6 +26,9 @@
 #include <cairo/cairo-ps.h>
 #include <cairo/cairo-pdf.h>
 #include <cairo/cairo-svg.h>
+#include <fstream>
+#include <sstream>
+#include <boost/functional/hash.hpp>
 
 #include "minsky_epilogue.h"
 using namespace ecolab::cairo;
@@ -118,6 +121,44 @@ namespace minsky
     xvars.resize(numLines);
    }
 
+  size_t PlotWidget::displayedState() const
+  {
+    auto r=Item::displayedState();
+    boost::hash_combine(r, dataVersion);
+    boost::hash_combine(r, title);
+    boost::hash_combine(r, xlabel);
+    boost::hash_combine(r, ylabel);
+    boost::hash_combine(r, y1label);
+    boost::hash_combine(r, logx);
+    boost::hash_combine(r, logy);
+    boost::hash_combine(r, percent);
+    boost::hash_combine(r, grid);
+    boost::hash_combine(r, subgrid);
+    boost::hash_combine(r, legend);
+    boost::hash_combine(r, int(legendSide));
+    boost::hash_combine(r, legendLeft);
+    boost::hash_combine(r, legendTop);
+    boost::hash_combine(r, legendFontSz);
+    boost::hash_combine(r, xtickAngle);
+    boost::hash_combine(r, exp_threshold);
+    boost::hash_combine(r, minx);
+    boost::hash_combine(r, maxx);
+    boost::hash_combine(r, miny);
+    boost::hash_combine(r, maxy);
+    boost::hash_combine(r, nxTicks);
+    boost::hash_combine(r, nyTicks);
+    boost::hash_combine(r, int(plotType));
+    for (auto& i: palette)
+      {
+        boost::hash_combine(r, i.colour.r);
+        boost::hash_combine(r, i.colour.g);
+        boost::hash_combine(r, i.colour.b);
+        boost::hash_combine(r, i.colour.a);
+        boost::hash_combine(r, i.width);
+      }
+    return r;
+  }
+
   void PlotWidget::draw(cairo_t* cairo) const
   {
     double z=zoomFactor();
@@ -198,6 +239,7 @@ namespace minsky
     cairo_set_line_width(cairo,1);
     double gw=w-2*portSpace, gh=h-portSpace;;
     if (!title.empty()) gh=h-portSpace-titleHeight;  // take into account room for the title
+    updatePens(max(gw,1.0));
     //TODO Urgh - fix up the const_casts here. Maybe pass plotType as parameter to draw
     auto& pt=const_cast<Plot*>(static_cast<const Plot*>(this))->plotType;
     switch (plotType)
@@ -253,25 +295,46 @@ namespace minsky
 
   }
   
-  void PlotWidget::scalePlot()
+  double PlotWidget::xBound(const VariableValue& v, double dflt) const
   {
-    // set any scale overrides
-    setMinMax();
-    if (xminVar.idx()>-1)
-      {
-        if (xIsSecsSinceEpoch && xminVar.units==Units("year"))
-          minx=yearToPTime(xminVar.value());
-        else
-          minx=xminVar.value();
-      }
+    if (v.idx()<0) return dflt;
+    if (xIsSecsSinceEpoch && v.units==Units("year"))
+      return yearToPTime(v.value());
+    return v.value();
+  }
 
-    if (xmaxVar.idx()>-1)
+  void PlotWidget::updatePens(size_t buckets) const
+  {
+    Decimation d;
+    d.buckets=buckets;
+    for (auto& i: penSeries)
+      d.points+=i.second.size();
+    d.xmin=xBound(xminVar, -numeric_limits<double>::max());
+    d.xmax=xBound(xmaxVar, numeric_limits<double>::max());
+    if (d==decimation) return;
+    decimation=d;
+
+    // summaries retain the extremes of the series at every
+    // resolution, so autoscaling is unaffected by the choice of buckets
+    auto& plot=const_cast<PlotWidget&>(*this);
+    vector<double> x, y;
+    for (auto& i: penSeries)
       {
-        if (xIsSecsSinceEpoch && xmaxVar.units==Units("year"))
-          maxx=yearToPTime(xmaxVar.value());
-        else
-          maxx=xmaxVar.value();
+        i.second.decimate(x, y, buckets, d.xmin, d.xmax);
+        // an empty selection clears the pen, rather than leaving data
+        // from outside the range plotted
+        plot.setPen(i.first, x.data(), y.data(), x.size());
       }
+  }
+
+  void PlotWidget::scalePlot()
+  {
+    // bring the plotted data up to date, at the last drawn resolution
+    updatePens(decimation.buckets? decimation.buckets: 500);
+    // set any scale overrides
+    setMinMax();
+    minx=xBound(xminVar, minx);
+    maxx=xBound(xmaxVar, maxx);
 
     if (yminVar.idx()>-1) {miny=yminVar.value();}
     if (ymaxVar.idx()>-1) {maxy=ymaxVar.value();}
@@ -394,6 +457,7 @@ namespace minsky
   
   void PlotWidget::addPlotPt(double t)
   {
+    ++dataVersion;
     size_t extraPen=2*numLines+1;
     for (size_t pen=0; pen<2*numLines; ++pen)
       if (pen<yvars.size() && yvars[pen])
@@ -404,22 +468,22 @@ namespace minsky
               {
               case 0: // use t, when x variable not attached
                 x=t;
-                y=(*yvars[pen])[i];
+                y=yvars[pen]->value(i);
                 break;
               case 1: // use the value of attached variable
                 assert(xvars[0] && xvars[0]->idx()>=0);  // xvars also vector of shared pointers and null derefencing error can likewise cause crash. for ticket 1248
                 if (xvars[0]->size()>1)
                   throw_error("Tensor valued x inputs not supported");
-                x=(*xvars[0])[0];
-                y=(*yvars[pen])[i];
+                x=xvars[0]->value();
+                y=yvars[pen]->value(i);
                 break;
               default:
                 if (pen < xvars.size() && xvars[pen] && xvars[pen]->idx()>=0) // xvars also vector of shared pointers and null derefencing error can likewise cause crash. for ticket 1248
                   {
                     if (xvars[pen]->size()>1)
                       throw_error("Tensor valued x inputs not supported");
-                    x=(*xvars[pen])[0];
-                    y=(*yvars[pen])[i];
+                    x=xvars[pen]->value();
+                    y=yvars[pen]->value(i);
                   }
                 else
                   throw error("x input not wired for pen %d",(int)pen+1);
@@ -433,7 +497,10 @@ namespace minsky
                   extraPen++;
                 p+=extraPen++;
               }
-            addPt(p, x, y);
+            auto s=penSeries.find(p);
+            if (s==penSeries.end())
+              s=penSeries.emplace(p, PlotSeries(maxPointsInMemory)).first;
+            s->second.add(x, y);
           }
     
     // throttle plot redraws
@@ -451,7 +518,9 @@ namespace minsky
 
   void PlotWidget::addConstantCurves()
   {
+    ++dataVersion;
     size_t extraPen=2*numLines;
+    constantCurves.clear();
 
     // determine if any of the incoming vectors has a ptime-based xVector
     xIsSecsSinceEpoch=false;
@@ -545,6 +614,12 @@ namespace minsky
                     stride*=d[i];
                   }
                 labelPen(extraPen,label);
+                string name=yv->name;
+                if (!label.empty())
+                  name+=" "+label.substr(0,label.size()-1); // drop trailing space
+                auto& curve=constantCurves.emplace
+                  (extraPen, make_pair(name, PlotSeries(maxPointsInMemory))).first->second;
+                curve.second.assign(x, yv->begin()+j, d[0]);
                 extraPen++;
               }      
         }
@@ -552,6 +627,144 @@ namespace minsky
   }
 
   
+  namespace
+  {
+    /// next point of \a r with a valid x value
+    bool nextPoint(PlotSeries::Reader& r, double& x, double& y)
+    {
+      while (r.next(x,y))
+        if (!isnan(x)) return true;
+      return false;
+    }
+
+    /// write a row for each distinct x value of \a series, read by
+    /// \a readers, in increasing order, with the y value of each pen
+    /// at x, or blank if none. Where a pen has several points at x,
+    /// the last is written.
+    void exportCSVRows(ostream& f, const vector<const PlotSeries*>& series,
+                       vector<unique_ptr<PlotSeries::Reader>>& readers)
+    {
+      if (all_of(series.begin(), series.end(), [](const PlotSeries* s) {return s->monotonic();}))
+        {
+          // merge the pens in order of x, without holding their data
+          struct Cursor {double x, y; bool valid;};
+          vector<Cursor> cursors(readers.size());
+          for (size_t i=0; i<readers.size(); ++i)
+            cursors[i].valid=nextPoint(*readers[i], cursors[i].x, cursors[i].y);
+          for (;;)
+            {
+              double x=0;
+              bool any=false;
+              for (auto& c: cursors)
+                if (c.valid && (!any || c.x<x))
+                  {
+                    x=c.x;
+                    any=true;
+                  }
+              if (!any) return;
+              f<<x;
+              for (size_t i=0; i<readers.size(); ++i)
+                {
+                  f<<",";
+                  auto& c=cursors[i];
+                  if (c.valid && c.x==x)
+                    {
+                      double y;
+                      do
+                        {
+                          y=c.y;
+                          c.valid=nextPoint(*readers[i], c.x, c.y);
+                        }
+                      while (c.valid && c.x==x);
+                      f<<y;
+                    }
+                }
+              f<<"\n";
+            }
+        }
+      else
+        {
+          // rows must be sorted in memory
+          map<double, map<size_t,double>> rows;
+          double x, y;
+          for (size_t i=0; i<readers.size(); ++i)
+            while (nextPoint(*readers[i], x, y))
+              rows[x][i]=y;
+          for (auto& r: rows)
+            {
+              f<<r.first;
+              for (size_t i=0; i<readers.size(); ++i)
+                {
+                  f<<",";
+                  auto j=r.second.find(i);
+                  if (j!=r.second.end()) f<<j->second;
+                }
+              f<<"\n";
+            }
+        }
+    }
+  }
+
+  void PlotWidget::exportCSV(const string& filename, bool xyPairs) const
+  {
+    ofstream f(filename);
+    if (!f) throw error("unable to open %s",filename.c_str());
+    f.precision(numeric_limits<double>::max_digits10);
+
+    vector<string> names;
+    vector<const PlotSeries*> series;
+    for (auto& i: penSeries)
+      {
+        names.push_back(i.first<yvars.size() && yvars[i.first]?
+                        yvars[i.first]->name: "pen "+to_string(i.first));
+        series.push_back(&i.second);
+      }
+    for (auto& i: constantCurves)
+      {
+        names.push_back(i.second.first);
+        series.push_back(&i.second.second);
+      }
+    // full resolution data is streamed from the series
+    vector<unique_ptr<PlotSeries::Reader>> readers;
+    for (auto s: series)
+      readers.emplace_back(new PlotSeries::Reader(*s));
+
+    if (!xyPairs)
+      {
+        f<<"\"x\"";
+        for (auto& i: names) f<<",\""<<i<<"\"";
+        f<<"\n";
+        exportCSVRows(f, series, readers);
+        if (!f) throw error("error writing %s",filename.c_str());
+        return;
+      }
+
+    for (size_t i=0; i<names.size(); ++i)
+      f<<(i? ",": "")<<"\"x\",\""<<names[i]<<"\"";
+    f<<"\n";
+    for (bool more=true; more;)
+      {
+        ostringstream row;
+        row.precision(f.precision());
+        more=false;
+        for (size_t i=0; i<readers.size(); ++i)
+          {
+            double x, y;
+            if (i>0) row<<",";
+            if (readers[i]->next(x,y))
+              {
+                row<<x<<","<<y;
+                more=true;
+              }
+            else
+              row<<",";
+          }
+        if (more)
+          f<<row.str()<<"\n";
+      }
+    if (!f) throw error("error writing %s",filename.c_str());
+  }
+
   void PlotWidget::connectVar(const shared_ptr<VariableValue>& var, unsigned port)
   {
     assert(var);
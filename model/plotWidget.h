@@ -23,11 +23,13 @@
 #include <TCL_obj_base.h>
 #include "classdesc_access.h"
 #include "plot.h"
+#include "plotSeries.h"
 #include "variable.h"
 #include "zoom.h"
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
+#include <map>
 
 namespace minsky
 {
@@ -54,6 +56,8 @@ namespace minsky
     // changed. Single shot flag that is reset after the next call to
     // draw(), which is const, so this attribute needs to be mutable.
     mutable bool justDataChanged=false;
+    /// incremented whenever the plotted data changes
+    unsigned long dataVersion=0;
     friend struct PlotItem;
 
     bool xIsSecsSinceEpoch=false;
@@ -62,6 +66,15 @@ namespace minsky
     using Item::y;
     using ecolab::CairoSurface::surface;
 
+    /// resolution and range at which pen data is decimated
+    struct Decimation
+    {
+      size_t buckets=0, points=0;
+      double xmin=0, xmax=0;
+      bool operator==(const Decimation& x) const
+      {return buckets==x.buckets && points==x.points && xmin==x.xmin && xmax==x.xmax;}
+    };
+
     /// variable port attached to (if any)
     std::vector<std::shared_ptr<VariableValue>> yvars;
     std::vector<std::shared_ptr<VariableValue>> xvars;
@@ -75,6 +88,11 @@ namespace minsky
 
     std::string title;
 
+    /// number of points of each pen held in memory, beyond which the
+    /// full resolution data is moved to a temporary file. Applies to
+    /// pens started after it is set.
+    size_t maxPointsInMemory=1000000;
+
     /// automatic means choose line or bar depending on the x-vector type.
     enum PlotType {line, bar, automatic};
     PlotType plotType=automatic;
@@ -94,11 +112,23 @@ namespace minsky
     void disconnectAllVars();
     using ecolab::Plot::draw;
     void draw(cairo_t* cairo) const override;
+    std::size_t displayedState() const override;
     void requestRedraw(); ///< redraw plot using current data to all open windows
     void redraw(int x0, int y0, int width, int height) override
-    {if (surface.get()) {Plot::draw(surface->cairo(),width,height); surface->blit();}}
+    {if (surface.get()) {updatePens(width); Plot::draw(surface->cairo(),width,height); surface->blit();}}
     void redrawWithBounds() override {redraw(0,0,500,500);}
     
+    /// remove all plot data
+    void clear() {
+      Plot::clear(); penSeries.clear(); constantCurves.clear();
+      decimation=Decimation(); ++dataVersion;
+    }
+    /// number of points added to \a pen by addPlotPt()
+    size_t numPoints(unsigned pen) const {
+      auto i=penSeries.find(pen);
+      return i==penSeries.end()? 0: i->second.size();
+    }
+
     /// add this as a display plot to its group
     void makeDisplayPlot();
           
@@ -115,10 +145,32 @@ namespace minsky
     void mouseMove(double,double);
     /// @}
 
-    /// export the plotted data as a CSV file
+    /// export the plotted data as a CSV file, at full resolution. A
+    /// single x column is followed by a column for each pen,
+    /// including the curves of addConstantCurves(), headed by the
+    /// pen's name, as for ecolab::Plot::exportAsCSV. Pens without a
+    /// point at a row's x value are left blank there.
     // implemented as a single argument function here for exposure to TCL
-    void exportAsCSV(const string& filename) {ecolab::Plot::exportAsCSV(filename);}
-
+    void exportAsCSV(const string& filename) {exportCSV(filename,false);}
+    /// as exportAsCSV, but with a pair of x,y columns for each pen,
+    /// which is more compact when pens are sampled at differing x values
+    void exportAsCSVxyPairs(const string& filename) {exportCSV(filename,true);}
+
+  private:
+    /// full data of the pens filled by addPlotPt(), indexed by
+    /// pen. The ecolab::Plot base only holds a decimated copy.
+    mutable classdesc::Exclude<std::map<unsigned, PlotSeries>> penSeries;
+    /// name and data of the pens filled by addConstantCurves(), indexed by pen
+    classdesc::Exclude<std::map<unsigned, std::pair<std::string, PlotSeries>>> constantCurves;
+    /// state the Plot's pen data was last decimated for
+    mutable classdesc::Exclude<Decimation> decimation;
+    /// copy decimated pen data, at a resolution of \a buckets across
+    /// the plot, into the Plot base
+    void updatePens(size_t buckets) const;
+    /// x axis override supplied by \a v, or \a dflt if not connected
+    double xBound(const VariableValue& v, double dflt) const;
+    /// implements exportAsCSV and, if \a xyPairs, exportAsCSVxyPairs
+    void exportCSV(const string& filename, bool xyPairs) const;
   };
 
 }
@@ -42,8 +42,13 @@ namespace minsky
 
   void Port::moveTo(float x, float y)
   {
-    m_x=x-item().x();
-    m_y=y-item().y();
+    float newX=x-item().x(), newY=y-item().y();
+    if (newX!=m_x || newY!=m_y)
+      {
+        m_x=newX;
+        m_y=newY;
+        geometryMoved(item());
+      }
   }
 
   GroupPtr Port::group() const
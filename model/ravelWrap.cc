@@ -27,6 +27,7 @@ static const int ravelVersion=3;
 
 #include <string>
 #include <cmath>
+#include <boost/functional/hash.hpp>
 using namespace std;
 
 #ifdef WIN32
@@ -497,8 +498,7 @@ namespace minsky
         ravel_clear(ravel);
         for (auto& i: hc.xvectors)
           {
-            vector<string> ss;
-            for (auto& j: i) ss.push_back(str(j,i.dimension.units));
+            auto ss=axisLabels[i].labels(i.dimension.units);
             vector<const char*> sl;
             for (auto& j: ss) sl.push_back(j.c_str());
             ravel_addHandle(ravel, i.name.c_str(), i.size(), &sl[0]);
@@ -773,6 +773,33 @@ namespace minsky
   }
 
   
+  size_t Ravel::displayedState() const
+  {
+    auto r=OperationBase::displayedState();
+    boost::hash_combine(r, explanation);
+    boost::hash_combine(r, onBorder);
+    if (lockGroup) boost::hash_combine(r, lockGroup->colour());
+    auto state=getState();
+    boost::hash_combine(r, state.radius);
+    boost::hash_combine(r, int(state.sortByValue));
+    for (auto& h: state.handleStates)
+      {
+        boost::hash_combine(r, h.first);
+        boost::hash_combine(r, h.second.x);
+        boost::hash_combine(r, h.second.y);
+        boost::hash_combine(r, h.second.collapsed);
+        boost::hash_combine(r, h.second.displayFilterCaliper);
+        boost::hash_combine(r, int(h.second.reductionOp));
+        boost::hash_combine(r, int(h.second.order));
+        boost::hash_range(r, h.second.customOrder.begin(), h.second.customOrder.end());
+        boost::hash_combine(r, h.second.minLabel);
+        boost::hash_combine(r, h.second.maxLabel);
+        boost::hash_combine(r, h.second.sliceLabel);
+      }
+    boost::hash_range(r, state.outputHandles.begin(), state.outputHandles.end());
+    return r;
+  }
+
   RavelState Ravel::getState() const
   {
     RavelState state;
@@ -913,7 +940,12 @@ namespace minsky
         for (auto& rr: lockGroup->ravels)
           if (auto r=rr.lock())
             if (r.get()!=this)
-              r->applyState(state/*,true*/);
+              {
+                r->applyState(state/*,true*/);
+                // its slicer and handles are drawn from the new state
+                r->renderCache.invalidate();
+                minsky().historyIds.markChanged(*r);
+              }
       }
   }
  
@@ -69,6 +69,10 @@ namespace minsky
     /// local override of axis dimensionality
     Dimensions axisDimensions;
 
+    /// typed labels of the axes this Ravel is applied to, shared by
+    /// populateHypercube and the slice and sort computations
+    mutable classdesc::Exclude<civita::TypedXVectorCache> axisLabels;
+
     /// group of ravels that move syncronously
     std::shared_ptr<RavelLockGroup> lockGroup;
     void leaveLockGroup();
@@ -80,6 +84,7 @@ namespace minsky
     std::string ravelVersion() const; ///< Ravel version string
     const char* lastErr() const;
     void draw(cairo_t* cairo) const override;
+    std::size_t displayedState() const override;
     void resize(const LassoBox&) override;
     double radius() const;
     ClickType::Type clickType(float x, float y) override;
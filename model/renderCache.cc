@@ -0,0 +1,61 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "renderCache.h"
+#include "item.h"
+#include "minsky_epilogue.h"
+using namespace std;
+
+namespace minsky
+{
+  RenderCache::Key::Key(const Item& item):
+    displayedState(item.displayedState()), x(item.m_x), y(item.m_y),
+    zoom(item.zoomFactor()), scale(item.scaleFactor()),
+    width(item.iWidth()), height(item.iHeight()), rotation(item.rotation()),
+    mouseFocus(item.mouseFocus), onResizeHandles(item.onResizeHandles),
+    selected(item.selected)
+  {}
+
+  const ecolab::cairo::Surface& RenderCache::render(const Item& item)
+  {
+    invalidate();
+    ecolab::cairo::SurfacePtr surf(new ecolab::cairo::Surface
+                                   (cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,nullptr)));
+    // match the line width set by Canvas::redrawUpdateRegion
+    cairo_set_line_width(surf->cairo(),1);
+    item.draw(surf->cairo());
+    // key is taken after drawing, as draw() may update the item's state
+    store(item, surf);
+    return *surface;
+  }
+
+  void RenderCache::replay(cairo_t* cairo) const
+  {
+    if (!surface) return;
+    cairo_save(cairo);
+    cairo_set_source_surface(cairo, surface->surface(), 0, 0);
+    cairo_paint(cairo);
+    cairo_restore(cairo);
+  }
+
+  bool RenderCache::inClip(float x, float y) const
+  {
+    return surface && cairo_in_clip(surface->cairo(), x, y);
+  }
+}
@@ -0,0 +1,90 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <cairo_base.h>
+#include <memory>
+
+namespace minsky
+{
+  class Item;
+
+  /// Retained rendering of an item, held as a recording surface in
+  /// the item's local coordinates. While the item's state is
+  /// unchanged, the recording is replayed in place of Item::draw(),
+  /// and the clip region it leaves is used for hit testing. Attributes
+  /// not recorded in the Key are hashed by Item::displayedState(), so
+  /// invalidate() is only needed for transient interaction state, such
+  /// as a Ravel's highlighted handle.
+  class RenderCache
+  {
+  public:
+    /// item state that a rendering depends on. The position within
+    /// the owning group is included, as drawing some items positions
+    /// others attached to them (eg I/O variables of groups), but the
+    /// rendering is otherwise independent of canvas position.
+    struct Key
+    {
+      std::size_t displayedState=0; ///< Item::displayedState()
+      float x=0, y=0, zoom=0, scale=0, width=0, height=0;
+      double rotation=0;
+      bool mouseFocus=false, onResizeHandles=false, selected=false;
+      Key() {}
+      Key(const Item&);
+      bool operator==(const Key& x) const {
+        return displayedState==x.displayedState && this->x==x.x && this->y==x.y && zoom==x.zoom && scale==x.scale &&
+          width==x.width && height==x.height && rotation==x.rotation &&
+          mouseFocus==x.mouseFocus && onResizeHandles==x.onResizeHandles &&
+          selected==x.selected;
+      }
+    };
+
+    RenderCache() {}
+    // renderings are not shared between items
+    RenderCache(const RenderCache&) {}
+    RenderCache& operator=(const RenderCache&) {invalidate(); return *this;}
+
+    void invalidate() {surface.reset();}
+    /// true if this holds a rendering of \a item in its current state
+    bool valid(const Item& item) const {return surface && key==Key(item);}
+
+    /// draw \a item into a new recording surface, and retain it
+    /// @return the retained surface
+    const ecolab::cairo::Surface& render(const Item& item);
+    /// retain \a surf, into which \a item has been drawn
+    void store(const Item& item, const ecolab::cairo::SurfacePtr& surf) {
+      key=Key(item);
+      surface=surf;
+    }
+    /// paint the retained rendering onto \a cairo, whose user space
+    /// origin is at the item's position
+    void replay(cairo_t* cairo) const;
+    /// whether (\a x,\a y), relative to the item's position, lies
+    /// within the clip region left by the retained rendering
+    bool inClip(float x, float y) const;
+
+  private:
+    Key key;
+    ecolab::cairo::SurfacePtr surface;
+  };
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include <cairo_base.h>
 #include <pango.h>
 #include "minsky_epilogue.h"
+#include <boost/functional/hash.hpp>
 
 using namespace minsky;
 using namespace ecolab;
@@ -158,6 +159,24 @@ void Sheet::draw(cairo_t* cairo) const
   catch (...) {/* exception most likely invalid variable value */}
 }
 
+size_t Sheet::displayedState() const
+{
+  auto r=Item::displayedState();
+  try
+    {
+      if (auto value=ports[0]->getVariableValue())
+        {
+          const VariableValue& v=*value;
+          auto dims=v.hypercube().dims();
+          boost::hash_range(r, dims.begin(), dims.end());
+          for (size_t i=0; i<v.size(); ++i)
+            boost::hash_combine(r, v[i]);
+        }
+    }
+  catch (...) {} // errors are reported by draw()
+  return r;
+}
+
 void Sheet::resize(const LassoBox& b)
 {
   auto invZ=1/zoomFactor();
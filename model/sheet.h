@@ -35,6 +35,8 @@ namespace minsky
     float m_width=100, m_height=100;
     Sheet();
     void draw(cairo_t* cairo) const override;
+    /// hash of the input values on display
+    std::size_t displayedState() const override;
     void resize(const LassoBox& b) override;
   };
 }
@@ -0,0 +1,69 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMULATIONSTATS_H
+#define SIMULATIONSTATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+namespace minsky
+{
+  /// Counts of, and wall clock time spent in, the phases of a
+  /// simulation since the last reset. The solve phase, including RHS
+  /// and Jacobian evaluations, and the flow variable update take place
+  /// on the simulation thread, and are published with each step.
+  struct SimulationStats
+  {
+    typedef std::chrono::steady_clock Clock;
+
+    size_t steps=0; ///< calls to Minsky::step()
+    size_t rhsEvaluations=0, jacobianEvaluations=0;
+    /// seconds spent in each phase
+    double reset=0, solve=0, rhs=0, jacobian=0, flows=0, log=0, updateIcons=0;
+
+    void clear() {*this=SimulationStats();}
+
+    /// accumulates the lifetime of this object into \a seconds
+    class Timer
+    {
+      double& seconds;
+      Clock::time_point start=Clock::now();
+    public:
+      Timer(double& seconds): seconds(seconds) {}
+      ~Timer() {seconds+=std::chrono::duration<double>(Clock::now()-start).count();}
+    };
+
+    /// write a human readable summary to \a o
+    void report(std::ostream& o) const {
+      o<<"steps: "<<steps<<"\n";
+      o<<"RHS evaluations: "<<rhsEvaluations<<"\n";
+      o<<"Jacobian evaluations: "<<jacobianEvaluations<<"\n";
+      o<<"phase times (s):\n";
+      o<<"  reset: "<<reset<<"\n";
+      o<<"  solve: "<<solve<<" (RHS: "<<rhs<<", Jacobian: "<<jacobian<<")\n";
+      o<<"  flow variables: "<<flows<<"\n";
+      o<<"  logging: "<<log<<"\n";
+      o<<"  item updates: "<<updateIcons<<"\n";
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "simulationWorker.h"
+#include <chrono>
+#include <exception>
+
+namespace minsky
+{
+  namespace
+  {
+    /// yield to other threads whilst waiting, sleeping once the wait
+    /// has gone on for some time, so that an idle worker does not
+    /// consume a core
+    void backoff(unsigned& waits)
+    {
+      if (++waits<1000)
+        boost::this_thread::yield();
+      else
+        boost::this_thread::sleep(boost::posix_time::milliseconds(waits<1100? 1: 10));
+    }
+  }
+
+  SimulationWorker::SimulationWorker(const Handler& handler):
+    handler(handler), thread([this]() {processCommands();}) {}
+
+  SimulationWorker::~SimulationWorker()
+  {
+    Command quit;
+    quit.type=Command::quit;
+    post(quit);
+    thread.join();
+  }
+
+  void SimulationWorker::post(const Command& c)
+  {
+    switch (c.type)
+      {
+      case Command::run:
+        m_posted.nSteps=c.nSteps;
+        m_posted.outputInterval=c.outputInterval;
+        m_posted.stepMax=c.stepMax;
+        break;
+      case Command::reverse:
+        m_posted.reversed=c.reversed;
+        break;
+      case Command::reset:
+        m_posted.epoch=c.epoch;
+        break;
+      default:
+        break;
+      }
+    for (unsigned waits=0; !commands.push(c); )
+      backoff(waits);
+  }
+
+  void SimulationWorker::pause()
+  {
+    Command c;
+    c.type=Command::pause;
+    post(c);
+    ++pausesPosted;
+    for (unsigned waits=0; pausesDone!=pausesPosted; )
+      backoff(waits);
+  }
+
+  void SimulationWorker::wait(unsigned ms)
+  {
+    auto deadline=std::chrono::steady_clock::now()+std::chrono::milliseconds(ms);
+    while (!snapshots.fresh() && std::chrono::steady_clock::now()<deadline)
+      boost::this_thread::yield();
+  }
+
+  void SimulationWorker::processCommands()
+  {
+    Command current; // settings of the current run
+    for (unsigned waits=0;;)
+      {
+        Command c;
+        while (commands.pop(c))
+          switch (c.type)
+            {
+            case Command::quit:
+              return;
+            case Command::pause:
+              running=false;
+              ++pausesDone;
+              break;
+            case Command::run:
+              current.nSteps=c.nSteps;
+              current.outputInterval=c.outputInterval;
+              current.stepMax=c.stepMax;
+              running=true;
+              break;
+            case Command::reverse:
+              current.reversed=c.reversed;
+              break;
+            case Command::reset:
+              current.epoch=c.epoch;
+              try
+                {
+                  handler(c, snapshots.writeBuffer());
+                }
+              catch (...) {} // any problem will be reported by the next step
+              break;
+            }
+
+        // wait until the consumer has taken the previous snapshot
+        if (!running || snapshots.fresh())
+          {
+            backoff(waits);
+            continue;
+          }
+        waits=0;
+
+        auto& snapshot=snapshots.writeBuffer();
+        snapshot.status=0;
+        snapshot.errMsg.clear();
+        snapshot.epoch=current.epoch;
+        try
+          {
+            handler(current, snapshot);
+          }
+        catch (const std::exception& ex)
+          {
+            // report back to the consumer thread
+            snapshot.errMsg=ex.what();
+          }
+        catch (...)
+          {
+            snapshot.errMsg="Unknown exception thrown on ODE solver thread";
+          }
+        // stepping on from a failed step is pointless
+        if (snapshot.status || !snapshot.errMsg.empty())
+          running=false;
+        snapshots.publish();
+      }
+  }
+}
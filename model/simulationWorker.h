@@ -0,0 +1,138 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIMULATIONWORKER_H
+#define SIMULATIONWORKER_H
+
+//#include <thread>
+// std::thread apparently not supported on MXE for now...
+#include <boost/thread.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include "simulationStats.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  /// Lock-free single producer, single consumer triple buffer. The
+  /// producer fills writeBuffer() and publishes it, and the consumer
+  /// acquires the most recently published buffer. Neither side
+  /// blocks, and buffers are exchanged rather than copied.
+  template <class T> class TripleBuffer
+  {
+    enum {indexMask=3, freshBit=4};
+    T buffers[3];
+    /// index of the buffer in transit between producer and
+    /// consumer, or'ed with freshBit if not yet acquired
+    std::atomic<unsigned> middle{1};
+    unsigned front=0, back=2;
+  public:
+    /// @{ producer interface
+    T& writeBuffer() {return buffers[back];}
+    void publish() {back=middle.exchange(back|freshBit)&indexMask;}
+    /// @}
+
+    /// @{ consumer interface
+    /// true if a buffer has been published, but not yet acquired
+    bool fresh() const {return middle.load()&freshBit;}
+    /// @return true, and updates readBuffer(), if a new buffer has
+    /// been published since the last call
+    bool acquire() {
+      if (!fresh()) return false;
+      front=middle.exchange(front)&indexMask;
+      return true;
+    }
+    T& readBuffer() {return buffers[front];}
+    /// @}
+  };
+
+  /// state of the simulation published at the end of each step
+  struct SimulationSnapshot
+  {
+    double t=0;
+    std::vector<double> stockVars, flowVars;
+    int status=0; ///< solver status code
+    std::string errMsg; ///< message of any exception thrown by the solver
+    unsigned epoch=0; ///< epoch of the reset command preceding this step
+    SimulationStats stats; ///< solver work done up to this step
+  };
+
+  /// Long lived thread performing the numerical integration. Once
+  /// set running, it steps continuously, publishing a snapshot of
+  /// each step via a lock-free TripleBuffer. Each snapshot must be
+  /// acquired by the consumer before the next is published, so the
+  /// worker computes at most one step ahead, and every step is
+  /// seen. Commands are passed over a lock-free queue, so neither
+  /// thread takes a lock.
+  class SimulationWorker
+  {
+  public:
+    struct Command
+    {
+      enum Type {run, pause, reset, reverse, quit};
+      Type type=run;
+      /// @{ solver parameters of a run, copied so that the worker
+      /// never reads them from the model
+      int nSteps=1;
+      double outputInterval=0, stepMax=0.01;
+      /// @}
+      bool reversed=false; ///< direction of integration
+      unsigned epoch=0; ///< tags snapshots of the steps following a reset
+    };
+    /// performs a step (\a command.type==run) into \a snapshot, or
+    /// discards solver state carried between steps (reset)
+    typedef std::function<void(const Command&, SimulationSnapshot&)> Handler;
+
+    TripleBuffer<SimulationSnapshot> snapshots;
+
+    SimulationWorker(const Handler& handler);
+    ~SimulationWorker();
+    SimulationWorker(const SimulationWorker&)=delete;
+    void operator=(const SimulationWorker&)=delete;
+
+    /// post a command to the worker, without waiting for it to be
+    /// processed
+    void post(const Command&);
+    /// parameters, direction and epoch of the commands posted so far
+    const Command& posted() const {return m_posted;}
+    /// stop stepping, waiting for any step in progress to
+    /// complete. Until the next run command, state used by the
+    /// handler may be modified by the calling thread.
+    void pause();
+    /// true while the worker is stepping. It stops on a pause
+    /// command, or after a step reporting an error or nonzero status
+    bool busy() const {return running;}
+    /// wait up to \a ms milliseconds for a snapshot to be published
+    void wait(unsigned ms);
+
+  private:
+    Handler handler;
+    boost::lockfree::spsc_queue<Command, boost::lockfree::capacity<16>> commands;
+    Command m_posted;
+    unsigned pausesPosted=0;
+    std::atomic<unsigned> pausesDone{0};
+    std::atomic<bool> running{false};
+    boost::thread thread;
+    void processCommands();
+  };
+}
+
+#endif
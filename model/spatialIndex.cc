@@ -0,0 +1,257 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spatialIndex.h"
+#include "group.h"
+#include "port.h"
+#include "wire.h"
+#include "minsky_epilogue.h"
+using namespace std;
+
+namespace minsky
+{
+  namespace
+  {
+    // allowance for rounding differences between the index and the
+    // exact hit tests
+    const float slack=1;
+
+    template <class T>
+    vector<shared_ptr<T>> collect(const SpatialGrid<T>& grid, const LassoBox& box)
+    {
+      vector<const typename SpatialGrid<T>::Entry*> entries;
+      grid.query(box, [&](const typename SpatialGrid<T>::Entry& e) {entries.push_back(&e);});
+      sort(entries.begin(), entries.end(), [](const typename SpatialGrid<T>::Entry* x,
+                                              const typename SpatialGrid<T>::Entry* y)
+           {return x->seq<y->seq;});
+      vector<shared_ptr<T>> r;
+      for (auto e: entries)
+        if (auto x=e->object.lock())
+          r.push_back(x);
+      return r;
+    }
+  }
+
+  LassoBox CanvasIndex::box(const Item& item)
+  {
+    // Item::contains() extends the bounding box by portRadius
+    float pad=item.zoomFactor()*portRadius+slack;
+    return LassoBox(item.left()-pad, item.top()-pad, item.right()+pad, item.bottom()+pad);
+  }
+
+  LassoBox CanvasIndex::box(const Group& group)
+  {
+    float r=group.clickRadius()+slack;
+    return LassoBox(group.x()-r, group.y()-r, group.x()+r, group.y()+r);
+  }
+
+  LassoBox CanvasIndex::box(const Port& port)
+  {
+    return LassoBox(port.x(), port.y(), port.x(), port.y());
+  }
+
+  LassoBox CanvasIndex::box(const Wire& wire)
+  {
+    float x0, y0, x1, y1;
+    wire.bounds(x0,y0,x1,y1);
+    return LassoBox(x0-slack, y0-slack, x1+slack, y1+slack);
+  }
+
+  void CanvasIndex::update(const Group& model)
+  {
+    if (root==&model && version==geometryVersion) return;
+    if (root!=&model || geometryVersion-version>geometryChanges.size())
+      build(model);
+    else
+      for (auto i=geometryChanges.end()-(geometryVersion-version); i!=geometryChanges.end(); ++i)
+        apply(*i);
+    version=geometryVersion;
+  }
+  
+  void CanvasIndex::build(const Group& model)
+  {
+    m_items.clear();
+    m_groups.clear();
+    m_ports.clear();
+    m_wires.clear();
+    root=&model;
+    ++builds;
+    itemSeq=groupSeq=portSeq=wireSeq=0;
+    model.recursiveDo(&GroupItems::items, [&](const Items&, Items::const_iterator i)
+                      {
+                        m_items.insert(*i, box(**i), itemSeq++);
+                        for (auto& p: (*i)->ports)
+                          m_ports.insert(p, box(*p), portSeq++);
+                        return false;
+                      });
+    model.recursiveDo(&GroupItems::groups, [&](const Groups&, Groups::const_iterator i)
+                      {
+                        m_groups.insert(*i, box(**i), groupSeq++);
+                        return false;
+                      });
+    model.recursiveDo(&GroupItems::wires, [&](const Wires&, Wires::const_iterator i)
+                      {
+                        if ((*i)->from() && (*i)->to())
+                          m_wires.insert(*i, box(**i), wireSeq++);
+                        return false;
+                      });
+  }
+
+  bool CanvasIndex::inModel(const Item& item) const
+  {
+    const Group* top=nullptr;
+    for (auto g=item.group.lock(); g; g=g->group.lock())
+      top=g.get();
+    return top && top==root;
+  }
+
+  void CanvasIndex::inserted(const ItemPtr& item)
+  {
+    m_items.insert(item, box(*item), itemSeq++);
+    for (auto& p: item->ports)
+      m_ports.insert(p, box(*p), portSeq++);
+    if (auto g=item->group.lock())
+      m_groups.move(g.get(), box(*g));
+  }
+
+  void CanvasIndex::inserted(const GroupPtr& group)
+  {
+    m_groups.insert(group, box(*group), groupSeq++);
+    group->recursiveDo(&GroupItems::items, [&](const Items&, Items::const_iterator i)
+                       {
+                         inserted(*i);
+                         return false;
+                       });
+    group->recursiveDo(&GroupItems::groups, [&](const Groups&, Groups::const_iterator i)
+                       {
+                         m_groups.insert(*i, box(**i), groupSeq++);
+                         return false;
+                       });
+    group->recursiveDo(&GroupItems::wires, [&](const Wires&, Wires::const_iterator i)
+                       {
+                         if ((*i)->from() && (*i)->to())
+                           m_wires.insert(*i, box(**i), wireSeq++);
+                         return false;
+                       });
+    if (auto g=group->group.lock())
+      m_groups.move(g.get(), box(*g));
+  }
+
+  void CanvasIndex::apply(const GeometryChange& c)
+  {
+    // moved objects are only dereferenced if their entry shows them
+    // to be alive
+    switch (c.type)
+      {
+      case GeometryChange::insertItem:
+        if (auto i=c.item.lock())
+          if (inModel(*i))
+            inserted(ItemPtr(i));
+        break;
+      case GeometryChange::insertGroup:
+        if (auto g=dynamic_pointer_cast<Group>(c.item.lock()))
+          if (inModel(*g))
+            inserted(GroupPtr(g));
+        break;
+      case GeometryChange::insertWire:
+        if (auto w=c.wire.lock())
+          if (w->from() && w->to() && inModel(w->from()->item()))
+            m_wires.insert(w, box(*w), wireSeq++);
+        break;
+      case GeometryChange::removeItem:
+        m_items.remove(static_cast<const Item*>(c.object));
+        break;
+      case GeometryChange::removeGroup:
+        m_groups.remove(static_cast<const Group*>(c.object));
+        break;
+      case GeometryChange::removePort:
+        m_ports.remove(static_cast<const Port*>(c.object));
+        break;
+      case GeometryChange::removeWire:
+        m_wires.remove(static_cast<const Wire*>(c.object));
+        break;
+      case GeometryChange::moveItem:
+        if (auto e=m_items.find(static_cast<const Item*>(c.object)))
+          if (auto i=e->object.lock())
+            moved(*i);
+        break;
+      case GeometryChange::moveGroup:
+        if (auto e=m_groups.find(static_cast<const Group*>(c.object)))
+          if (auto g=e->object.lock())
+            moved(*g);
+        break;
+      case GeometryChange::moveWire:
+        if (auto e=m_wires.find(static_cast<const Wire*>(c.object)))
+          if (auto w=e->object.lock())
+            moved(*w);
+        break;
+      }
+  }
+
+  void CanvasIndex::movedItem(const Item& item)
+  {
+    m_items.move(&item, box(item));
+    // ports may have been added since the item was indexed
+    for (auto& p: item.ports)
+      {
+        m_ports.insert(p, box(*p), portSeq++);
+        for (auto w: p->wires())
+          moved(*w);
+      }
+  }
+
+  void CanvasIndex::moved(const Item& item)
+  {
+    if (auto g=dynamic_cast<const Group*>(&item))
+      {
+        m_groups.move(g, box(*g));
+        movedItem(*g);
+        g->recursiveDo(&GroupItems::items, [&](const Items&, Items::const_iterator i)
+                       {
+                         movedItem(**i);
+                         return false;
+                       });
+        g->recursiveDo(&GroupItems::groups, [&](const Groups&, Groups::const_iterator i)
+                       {
+                         m_groups.move(i->get(), box(**i));
+                         return false;
+                       });
+      }
+    else
+      movedItem(item);
+    // a group's box encloses its I/O variables
+    if (auto g=item.group.lock())
+      m_groups.move(g.get(), box(*g));
+  }
+
+  void CanvasIndex::moved(const Wire& wire)
+  {
+    if (wire.from() && wire.to())
+      m_wires.move(&wire, box(wire));
+  }
+
+  vector<ItemPtr> CanvasIndex::items(const LassoBox& box) const
+  {return collect(m_items, box);}
+
+  vector<GroupPtr> CanvasIndex::groups(const LassoBox& box) const
+  {return collect(m_groups, box);}
+
+  vector<WirePtr> CanvasIndex::wires(const LassoBox& box) const
+  {return collect(m_wires, box);}
+}
@@ -0,0 +1,365 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include "selection.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace minsky
+{
+  /// A uniform grid of square cells, each listing the objects whose
+  /// bounding boxes overlap it. Objects are identified by address,
+  /// and are held by weak reference. Each entry carries a sequence
+  /// number, used to report objects in a consistent order.
+  template <class T>
+  class SpatialGrid
+  {
+  public:
+    struct Entry
+    {
+      std::weak_ptr<T> object;
+      LassoBox box;
+      size_t seq;
+      bool used;
+    };
+
+    explicit SpatialGrid(float cellSize=128): cellSize(cellSize) {}
+
+    void clear() {
+      entries.clear(); freeSlots.clear(); slotOf.clear();
+      cells.clear(); large.clear(); stamp.clear();
+    }
+    size_t size() const {return slotOf.size();}
+
+    /// insert \a x, or if already present, relocate it to \a box. An
+    /// entry left by a destroyed object at the same address is replaced.
+    void insert(const std::shared_ptr<T>& x, const LassoBox& box, size_t seq) {
+      if (!x) return;
+      auto i=slotOf.find(x.get());
+      if (i!=slotOf.end())
+        {
+          auto& e=entries[i->second];
+          unlink(i->second);
+          if (e.object.lock()!=x)
+            {
+              e.object=x;
+              e.seq=seq;
+            }
+          e.box=box;
+          link(i->second);
+          return;
+        }
+      size_t slot;
+      if (freeSlots.empty())
+        {
+          slot=entries.size();
+          entries.emplace_back();
+          stamp.push_back(0);
+        }
+      else
+        {
+          slot=freeSlots.back();
+          freeSlots.pop_back();
+        }
+      entries[slot]=Entry{x,box,seq,true};
+      slotOf[x.get()]=slot;
+      link(slot);
+    }
+
+    void remove(const T* x) {
+      auto i=slotOf.find(x);
+      if (i==slotOf.end()) return;
+      unlink(i->second);
+      entries[i->second]=Entry{{},{},0,false};
+      freeSlots.push_back(i->second);
+      slotOf.erase(i);
+    }
+
+    /// relocate the entry for \a x to \a box
+    /// @return false if \a x is not in the grid
+    bool move(const T* x, const LassoBox& box) {
+      auto i=slotOf.find(x);
+      if (i==slotOf.end()) return false;
+      unlink(i->second);
+      entries[i->second].box=box;
+      link(i->second);
+      return true;
+    }
+
+    /// entry for \a x, or nullptr if not present
+    const Entry* find(const T* x) const {
+      auto i=slotOf.find(x);
+      return i==slotOf.end()? nullptr: &entries[i->second];
+    }
+
+    /// call \a f(const Entry&) once for each entry whose box intersects \a box
+    template <class F>
+    void query(const LassoBox& box, F f) const {
+      int i0=cell(box.x0), i1=cell(box.x1), j0=cell(box.y0), j1=cell(box.y1);
+      if ((double(i1)-i0+1)*(double(j1)-j0+1) > entries.size())
+        {
+          // cheaper to check every entry
+          for (auto& e: entries)
+            if (e.used && intersects(e.box, box))
+              f(e);
+          return;
+        }
+      nextStamp();
+      for (int i=i0; i<=i1; ++i)
+        for (int j=j0; j<=j1; ++j)
+          {
+            auto c=cells.find(key(i,j));
+            if (c!=cells.end())
+              for (auto slot: c->second)
+                visit(slot, box, f);
+          }
+      for (auto slot: large)
+        visit(slot, box, f);
+    }
+
+    /// entry closest to (\a x,\a y) of those for which \a
+    /// accept(const Entry&) is true, or nullptr if there is none. The
+    /// location of an entry is taken as (box.x0, box.y0), so this is
+    /// intended for grids of points. Of equally distant entries, the
+    /// one with the lowest sequence number is returned.
+    template <class F>
+    const Entry* nearest(float x, float y, F accept) const {
+      const Entry* best=nullptr;
+      float bestD=std::numeric_limits<float>::max();
+      auto consider=[&](const Entry& e) {
+        if (!e.used || !accept(e)) return;
+        float d=sqr(e.box.x0-x)+sqr(e.box.y0-y);
+        if (d<bestD || (d==bestD && best && e.seq<best->seq))
+          {
+            bestD=d;
+            best=&e;
+          }
+      };
+
+      for (auto slot: large)
+        consider(entries[slot]);
+      if (cells.empty()) return best;
+
+      int ci=cell(x), cj=cell(y);
+      nextStamp();
+      for (int r=0;; ++r)
+        {
+          if (sqr(2.0*r+1) > 4.0*entries.size()+16)
+            {
+              // search has covered as many cells as there are
+              // entries, so finish with a linear scan
+              for (auto& e: entries)
+                consider(e);
+              return best;
+            }
+          // scan the ring of cells at Chebyshev distance r from (ci,cj)
+          for (int i=ci-r; i<=ci+r; ++i)
+            for (int j=cj-r; j<=cj+r; j+=(i==ci-r || i==ci+r || r==0)? 1: 2*r)
+              {
+                auto c=cells.find(key(i,j));
+                if (c!=cells.end())
+                  for (auto slot: c->second)
+                    if (stamp[slot]!=currentStamp)
+                      {
+                        stamp[slot]=currentStamp;
+                        consider(entries[slot]);
+                      }
+              }
+          // all unscanned cells lie at least r cells away
+          if (best && bestD<sqr(r*cellSize))
+            return best;
+          if (ci-r<=minI && ci+r>=maxI && cj-r<=minJ && cj+r>=maxJ)
+            return best;
+        }
+    }
+
+  private:
+    float cellSize;
+    std::vector<Entry> entries;
+    std::vector<size_t> freeSlots;
+    std::unordered_map<const T*, size_t> slotOf;
+    std::unordered_map<uint64_t, std::vector<size_t>> cells;
+    /// entries spanning too many cells to be stored in the grid
+    std::vector<size_t> large;
+    /// bounds of cell indices ever occupied
+    int minI=std::numeric_limits<int>::max(), maxI=std::numeric_limits<int>::min(),
+      minJ=std::numeric_limits<int>::max(), maxJ=std::numeric_limits<int>::min();
+    /// per entry marker of the last query visiting it, preventing
+    /// multiple visits to entries spanning several cells
+    mutable std::vector<unsigned> stamp;
+    mutable unsigned currentStamp=0;
+
+    static constexpr double maxCellsPerEntry=256;
+
+    template <class U> static U sqr(U x) {return x*x;}
+    static bool intersects(const LassoBox& x, const LassoBox& y)
+    {return x.x1>=y.x0 && x.x0<=y.x1 && x.y1>=y.y0 && x.y0<=y.y1;}
+
+    int cell(float x) const {
+      // clamp, to avoid overflow for the extremes of redraw regions
+      double c=std::floor(x/cellSize);
+      return std::max(-1e9, std::min(1e9, c));
+    }
+    static uint64_t key(int i, int j) {return (uint64_t(uint32_t(i))<<32)|uint32_t(j);}
+
+    void nextStamp() const {
+      if (++currentStamp==0)
+        {
+          std::fill(stamp.begin(), stamp.end(), 0);
+          currentStamp=1;
+        }
+    }
+
+    template <class F>
+    void visit(size_t slot, const LassoBox& box, F& f) const {
+      if (stamp[slot]==currentStamp) return;
+      stamp[slot]=currentStamp;
+      auto& e=entries[slot];
+      if (intersects(e.box, box))
+        f(e);
+    }
+
+    bool isLarge(const LassoBox& box, int& i0, int& i1, int& j0, int& j1) const {
+      i0=cell(box.x0); i1=cell(box.x1); j0=cell(box.y0); j1=cell(box.y1);
+      return (double(i1)-i0+1)*(double(j1)-j0+1) > maxCellsPerEntry;
+    }
+
+    void link(size_t slot) {
+      int i0, i1, j0, j1;
+      if (isLarge(entries[slot].box, i0, i1, j0, j1))
+        {
+          large.push_back(slot);
+          return;
+        }
+      minI=std::min(minI,i0); maxI=std::max(maxI,i1);
+      minJ=std::min(minJ,j0); maxJ=std::max(maxJ,j1);
+      for (int i=i0; i<=i1; ++i)
+        for (int j=j0; j<=j1; ++j)
+          cells[key(i,j)].push_back(slot);
+    }
+
+    void unlink(size_t slot) {
+      auto eraseSlot=[&](std::vector<size_t>& v) {
+        auto i=std::find(v.begin(), v.end(), slot);
+        if (i!=v.end())
+          {
+            *i=v.back();
+            v.pop_back();
+          }
+      };
+      int i0, i1, j0, j1;
+      if (isLarge(entries[slot].box, i0, i1, j0, j1))
+        {
+          eraseSlot(large);
+          return;
+        }
+      for (int i=i0; i<=i1; ++i)
+        for (int j=j0; j<=j1; ++j)
+          {
+            auto c=cells.find(key(i,j));
+            if (c!=cells.end())
+              {
+                eraseSlot(c->second);
+                if (c->second.empty())
+                  cells.erase(c);
+              }
+          }
+    }
+  };
+
+  /// Spatial index of the items, groups, ports and wires of a model,
+  /// used for hit testing the canvas. Entries are bounding boxes
+  /// enclosing the region in which an object responds to the mouse,
+  /// so query results are candidates to be tested exactly. Results
+  /// are returned in the order Group::recursiveDo() visited them
+  /// when the index was built, followed by objects inserted since.
+  class CanvasIndex
+  {
+  public:
+    /// value of geometryVersion when this index was last brought up to date
+    unsigned long version=std::numeric_limits<unsigned long>::max();
+    /// model this index was built from
+    const Group* root=nullptr;
+    /// number of times the index has been built from scratch
+    size_t builds=0;
+
+    /// bring the index up to date with \a model, applying the
+    /// geometry changes made since the last update, or rebuilding
+    /// it if they are not all available
+    void update(const Group& model);
+    /// rebuild the index from the contents of \a model
+    void build(const Group& model);
+    /// relocate \a item, its ports and attached wires, and if \a item
+    /// is a group, its contents, after it has been moved
+    void moved(const Item& item);
+    /// relocate \a wire after its handles have been edited
+    void moved(const Wire& wire);
+
+    /// items, groups and wires whose boxes intersect \a box
+    /// @{
+    std::vector<ItemPtr> items(const LassoBox& box) const;
+    std::vector<GroupPtr> groups(const LassoBox& box) const;
+    std::vector<WirePtr> wires(const LassoBox& box) const;
+    /// @}
+
+    /// closest port to (\a x,\a y) for which \a accept(const Port&)
+    /// is true. Of equally distant ports, the first in model traversal
+    /// order is returned.
+    template <class F>
+    std::shared_ptr<Port> closestPort(float x, float y, F accept) const {
+      auto e=m_ports.nearest(x,y,[&](const SpatialGrid<Port>::Entry& e) {
+          auto p=e.object.lock();
+          return p && accept(*p);
+        });
+      return e? e->object.lock(): nullptr;
+    }
+
+    /// boxes used for each type of object
+    /// @{
+    static LassoBox box(const Item&);
+    static LassoBox box(const Group&);
+    static LassoBox box(const Port&);
+    static LassoBox box(const Wire&);
+    /// @}
+  private:
+    SpatialGrid<Item> m_items;
+    SpatialGrid<Group> m_groups;
+    SpatialGrid<Port> m_ports;
+    SpatialGrid<Wire> m_wires;
+    /// sequence numbers for the next entries inserted
+    size_t itemSeq=0, groupSeq=0, portSeq=0, wireSeq=0;
+
+    void movedItem(const Item&);
+    void apply(const GeometryChange&);
+    /// insert \a item and its ports, or \a group and its contents
+    void inserted(const ItemPtr& item);
+    void inserted(const GroupPtr& group);
+    /// true if \a item is contained in the model indexed
+    bool inModel(const Item& item) const;
+  };
+}
+
+#endif
@@ -20,6 +20,7 @@
 #include "switchIcon.h"
 #include "minsky.h"
 #include "minsky_epilogue.h"
+#include <boost/functional/hash.hpp>
 using namespace ecolab::cairo;
 using namespace ecolab;
 using namespace std;
@@ -75,6 +76,19 @@ namespace minsky
     return r;
   } 
 
+  size_t SwitchIcon::displayedState() const
+  {
+    auto r=Item::displayedState();
+    boost::hash_combine(r, flipped);
+    boost::hash_combine(r, numCases());
+    try
+      {
+        boost::hash_combine(r, switchValue()+1);
+      }
+    catch (const std::exception&) {}
+    return r;
+  }
+
   void SwitchIcon::draw(cairo_t* cairo) const
   {
     cairo_set_line_width(cairo,1);
@@ -52,6 +52,7 @@ namespace minsky
 
     /// draw icon to \a context
     void draw(cairo_t* context) const override;
+    std::size_t displayedState() const override;
   };
 }
 
@@ -27,6 +27,7 @@
 
 #include <boost/regex.hpp>
 #include <boost/locale.hpp>
+#include <boost/functional/hash.hpp>
 using namespace boost::locale::conv;
 
 using namespace classdesc;
@@ -190,6 +191,34 @@ string VariableBase::name(const std::string& name)
   return this->name();
 }
 
+size_t VariableBase::displayedState() const
+{
+  auto r=Item::displayedState();
+  boost::hash_combine(r, name());
+  boost::hash_combine(r, int(type()));
+  boost::hash_combine(r, ioVar());
+  try
+    {
+      boost::hash_combine(r, value());
+    }
+  catch (...) {}
+  if (auto vv=vValue())
+    {
+      boost::hash_combine(r, vv->sliderVisible);
+      auto dims=vv->hypercube().dims();
+      boost::hash_range(r, dims.begin(), dims.end());
+    }
+  boost::hash_combine(r, sliderBoundsSet);
+  boost::hash_combine(r, sliderStepRel);
+  boost::hash_combine(r, sliderMin);
+  boost::hash_combine(r, sliderMax);
+  boost::hash_combine(r, sliderStep);
+  // I/O variables display their ports while their group has the mouse
+  if (auto g=group.lock())
+    boost::hash_combine(r, ioVar() && g->mouseFocus);
+  return r;
+}
+
 bool VariableBase::ioVar() const
 {return dynamic_cast<Group*>(controller.lock().get());}
 
@@ -236,6 +265,7 @@ string VariableBase::init(const string& x)
     {
       VariableValue& val=*minsky().variableValues[valueId()];
       val.init=x;     
+      minsky().workerStateStale=true;
       // for constant types, we may as well set the current value. See ticket #433. Also ignore errors (for now), as they will reappear at reset time.
       try
         {
@@ -260,7 +290,11 @@ double VariableBase::value() const
 double VariableBase::value(const double& x)
 {
   if (!m_name.empty() && VariableValue::isValueId(valueId()))
-    (*minsky().variableValues[valueId()])[0]=x;
+    {
+      auto& vv=*minsky().variableValues[valueId()];
+      vv[0]=x;
+      vv.valueChanged();
+    }
   return x;
 }
 
@@ -363,8 +397,7 @@ void VariableBase::importFromCSV(std::string filename, const DataSpec& spec)
   if (auto v=vValue()) {
     if (filename.find("://")!=std::string::npos)
       filename = v->csvDialog.loadWebFile(filename);
-    std::ifstream is(filename);
-    loadValueFromCSVFile(*v, is, spec);
+    loadValueFromCSVFile(*v, filename, spec);
     minsky().populateMissingDimensionsFromVariable(*v);
   }
 }
@@ -140,6 +140,7 @@ namespace minsky
     virtual double value(const double&);
     virtual double value() const override;  
     /// @}
+    std::size_t displayedState() const override;
     
     //    void setValue(const TensorVal&);
 
@@ -75,6 +75,7 @@ namespace minsky
             m_coords[i-1] = (coords[i+1]-coords[1])*d;
           }
       }
+    geometryChanged(GeometryChange::moveWire, this);
     return this->coords();
   }
 
@@ -117,6 +118,7 @@ namespace minsky
     m_to=to;
     from->m_wires.push_back(this);
     to->m_wires.push_back(this);
+    geometryChanged(GeometryChange::moveWire, this);
   }
 
   
@@ -143,27 +145,8 @@ namespace minsky
 namespace
 {
 
- // For ticket 1095. Returns coordinate pairs for both moving and "to be inserted" handles on a curved wire	
- vector<pair<float,float>> allHandleCoords(vector<float> coords) {
-        
-        vector<pair<float,float>> points(coords.size()-1);
-        
-        for (size_t i = 0; i < points.size(); i++) {
-			if (i%2 == 0) {
-				points[i].first = coords[i];
-				points[i].second = coords[i+1];
-			}
-			else {
-				points[i].first = 0.5*(coords[i-1]+coords[i+1]);
-				points[i].second = 0.5*(coords[i]+coords[i+2]);
-			}
-		}						
-		
-   return points;
- } 	  
- 	
  // For ticket 991/1092. Returns coordinate pairs for moving handles on a curved wire	
- vector<pair<float,float>> toCoordPair(vector<float> coords) {    
+ vector<pair<float,float>> toCoordPair(const vector<float>& coords) {    
    vector<pair<float,float>> points(coords.size()/2);
    
    for (size_t i = 0; i < coords.size(); i++)
@@ -174,35 +157,8 @@ namespace
    return points;
  } 	
 
-// For ticket 991. Construct tridoagonal matrix A which relates control points c and knots k (curved wire handles): Ac = k.
- vector<vector<float>> constructTriDiag(int length) {
-
-   vector<vector<float>> result(length,vector<float>(length));
-   
-   for (int i = 0; i < length; i++)  // rows
-      for (int j = 0; j < length; j++) {  // columns
- 		  
- 		//construct upper diagonal   
- 		   if (j > 0 && i == j-1 && i < length-1) result[i][j] = 1.0; 	 			
- 		   //construct main diagonal
- 		   else if (i == j) {
- 		      if (i == 0) result[i][j] = 2.0;
- 		      else if (i < length-1) result[i][j] = 4.0;
- 		      else if (i == length-1) result[i][j] = 7.0;
- 		   }   
- 		   //construct lower diagonal
- 	       else if (i == j+1) {
- 		   	if (j < length-2) result[i][j] = 1.0;
- 		   	else if (j == length-2) result[i][j] = 2.0;
- 		   }  
- 		   else result[i][j] = 0.0; 				
-  }
-  
-  return result;
- } 
-
 // For ticket 991. Vector of input knots k (all the handles on a curved wire).  
-  vector<pair<float,float>> constructTargetVector(int n, const vector<pair<float,float>> knots) {
+  vector<pair<float,float>> constructTargetVector(int n, const vector<pair<float,float>>& knots) {
 	  
 	assert(knots.size() > 2);  
 	  
@@ -277,52 +233,35 @@ namespace
  *      
  * (Source: http://www.industrial-maths.com/ms6021_thomas.pdf)
  */	 
- vector<pair<float,float>> computeControlPoints(vector<vector<float>> triDiag, const vector<pair<float,float>> knots, vector<pair<float,float>> target) {
+ vector<pair<float,float>> computeControlPoints(const vector<pair<float,float>>& knots) {
   
     assert(knots.size() > 2); 
     
     int n = knots.size() - 1;
+    auto target=constructTargetVector(n, knots);
+    auto lower=[&](int i) {return i==n-2? 2.0: 1.0;}; // d_i, for row i+1
+    auto diag=[&](int i) {return i==0? 2.0: i==n-1? 7.0: 4.0;}; // b_i
+    // upper diagonal elements a_i are all 1
     
     vector<pair<float,float>> result(2*n); 
+    // alpha_i of the forward sweep
+    vector<double> alpha(n);
  
-    // Vector of knots k' after Thomas' algorithm is applied to the initial system Ac = k
-    vector<pair<float,float>> newTarget(n); 
-    
-    // Matrix A' after Thomas' algorithm is applied to the initial system Ac = k
-    vector<vector<float>> newTriDiag(n,vector<float>(n));
- 
-    // forward sweep for control points c_i,0:
-    newTriDiag[0][1] = triDiag[0][1]/ triDiag[0][0]; 
- 
-    newTarget[0].first = target[0].first*(1.0 / triDiag[0][0]);
-    newTarget[0].second = target[0].second*(1.0 / triDiag[0][0]);        
-    
- 
-    for (int i = 1; i < n-1; i++)
- 	   for (int j = 0; j < n; j++)
-           if (i == j-1) newTriDiag[i][j] = triDiag[i][j] / (triDiag[i][i] - triDiag[i][j-2] * newTriDiag[i-1][j-1]);
- 
-    for (int i = 1; i < n; i++)
-      for (int j = 0; j < n; j++) {
-         if (i == j + 1)
-         {
-			float targetScale = 1.0/(triDiag[i][i] - triDiag[i][j] * newTriDiag[i-1][j+1]); 
-            newTarget[i].first = (target[i].first-(newTarget[i-1].first*(triDiag[i][j])))*(targetScale);
-            newTarget[i].second = (target[i].second-(newTarget[i-1].second*(triDiag[i][j])))*(targetScale);
-		}
+    // forward sweep for control points c_i,0, storing k'_i in result
+    alpha[0] = 1/diag(0);
+    result[0].first = target[0].first/diag(0);
+    result[0].second = target[0].second/diag(0);
+    for (int i = 1; i < n; i++) {
+      double scale = 1/(diag(i) - lower(i-1)*alpha[i-1]);
+      alpha[i] = scale;
+      result[i].first = (target[i].first - lower(i-1)*result[i-1].first)*scale;
+      result[i].second = (target[i].second - lower(i-1)*result[i-1].second)*scale;
     }
  
     // backward sweep for control points c_i,0:
-    result[n-1].first = newTarget[n-1].first;
-    result[n-1].second = newTarget[n-1].second;
-    
-    for (int i = n-2; i >= 0; i--) 
-       for (int j = n-1; j >= 0; j--) {		
-          if (i == j-1)
-          {
-             result[i].first = newTarget[i].first-(newTriDiag[i][j]*result[i+1].first);
-             result[i].second = newTarget[i].second-(newTriDiag[i][j]*result[i+1].second);
-		  }
+    for (int i = n-2; i >= 0; i--) {
+      result[i].first -= alpha[i]*result[i+1].first;
+      result[i].second -= alpha[i]*result[i+1].second;
     }
  
     // calculate remaining control points c_i,1 directly:
@@ -337,50 +276,67 @@ namespace
     return result;
   }
 
-}
-
-  void Wire::storeCairoCoords(cairo_t* cairo) const
+  // append a polyline approximating the Bezier curve p0-p3, excluding
+  // p0, to \a path, with segments no longer than maxSegLength
+  void flattenCurve(vector<pair<float,float>>& path, const pair<float,float>& p0,
+                    const pair<float,float>& p1, const pair<float,float>& p2,
+                    const pair<float,float>& p3)
   {
-    cairoCoords.clear(); 
-    cairo_path_t *path;
-    cairo_path_data_t *data;
-         
-    path = cairo_copy_path_flat(cairo);
-         
-    for (int j=0; j < path->num_data; j += path->data[j].header.length) {
-      data = &path->data[j];
-      switch (data->header.type) {
-      case CAIRO_PATH_MOVE_TO:
-        break;
-      case CAIRO_PATH_LINE_TO:
-        cairoCoords.push_back(make_pair(data[1].point.x,data[1].point.y));
-        break;
-      case CAIRO_PATH_CURVE_TO:
-        break;
-      case CAIRO_PATH_CLOSE_PATH:
-        break;
+    const float maxSegLength=2;
+    const int maxSegs=256;
+    // the curve is no longer than its control polygon
+    float len=sqrt(sqr(p1.first-p0.first)+sqr(p1.second-p0.second))+
+      sqrt(sqr(p2.first-p1.first)+sqr(p2.second-p1.second))+
+      sqrt(sqr(p3.first-p2.first)+sqr(p3.second-p2.second));
+    int m=max(1, min(maxSegs, int(ceil(len/maxSegLength))));
+    for (int j=1; j<=m; ++j)
+      {
+        float t=float(j)/m, u=1-t;
+        float b0=u*u*u, b1=3*u*u*t, b2=3*u*t*t, b3=t*t*t;
+        path.emplace_back(b0*p0.first+b1*p1.first+b2*p2.first+b3*p3.first,
+                          b0*p0.second+b1*p1.second+b2*p2.second+b3*p3.second);
       }
-    }
-    cairo_path_destroy (path);              
   }
-   
-  void Wire::draw(cairo_t* cairo) const
+
+  // returns true if x,y lies close to the line segment (x0,y0)-(x1,y1)
+  bool segNear(float x0, float y0, float x1, float y1, float x, float y)
   {
-    auto coords=this->coords();
-    if (coords.size()<4 || !visible()) return;
+    float d=sqrt(sqr(x1-x0)+sqr(y1-y0));
+    float d1=sqrt(sqr(x-x0)+sqr(y-y0)), d2=sqrt(sqr(x-x1)+sqr(y-y1));
+    return d1+d2<=d+5;
+  }
+    
+  inline float d2(float x0, float y0, float x1, float y1)
+  {return sqr(x1-x0)+sqr(y1-y0);}
 
-    float angle, lastx, lasty;
-    if (coords.size()==4)
+}
+
+  const Wire::Geometry& Wire::geometry() const
+  {
+    auto& g=static_cast<Geometry&>(m_geometry);
+    auto f=from(), t=to();
+    if (!f || !t)
       {
-        cairo_move_to(cairo,coords[0],coords[1]);
-        cairo_line_to(cairo, coords[2], coords[3]);
-        angle=atan2(coords[3]-coords[1], coords[2]-coords[0]);
-        lastx=coords[2]; lasty=coords[3];
+        g=Geometry();
+        return g;
       }
+    if (g.valid && g.fromX==f->x() && g.fromY==f->y() && g.toX==t->x() && g.toY==t->y() &&
+        g.handles==m_coords)
+      return g;
+
+    g=Geometry();
+    g.fromX=f->x(); g.fromY=f->y(); g.toX=t->x(); g.toY=t->y();
+    g.handles=m_coords;
+    g.coords=coords();
+    g.valid=true;
+    auto& c=g.coords;
+    if (c.size()<4) return g;
+
+    auto points=toCoordPair(c);
+    if (c.size()==4)
+      g.path=points;
     else
       {
-        cairo_move_to(cairo, coords[0], coords[1]);
-        
         /** 
          *  
          * Two control points are inserted between two adjacent handles (knots) of the curved wires on the canvas.
@@ -394,43 +350,58 @@ namespace
          *     \f] 
          * 
          */   
-        
-        // For ticket 991/1092. Convert to coordinate pairs.
-        vector<pair<float,float>> points = toCoordPair(coords);
-       
-        int n = points.size()-1;         
-        
-        // Initial vector of knots in the matrix equation Ac = k
-        vector<pair<float,float>> target = constructTargetVector(n, points);
-      
-        vector<vector<float>> A(n,vector<float>(n));
-        // Initial matrix A which relates control points c_i to knots k_i by matching first and second derivatives of cubic Bezier curves at common points (knots) between curves.
-        A = constructTriDiag(n);
-                                             
-        // For ticket 991. Apply Thomas' algorithm to matrix equation Ac=k
-        vector<pair<float,float>> controlPoints = computeControlPoints(A, points, target);
+        g.controlPoints=computeControlPoints(points);
+        int n=points.size()-1;
+        g.path.push_back(points[0]);
+        for (int i=0; i<n; ++i)
+          flattenCurve(g.path, points[i], g.controlPoints[i], g.controlPoints[n+i], points[i+1]);
+      }
+    g.arrowAngle=atan2(c[c.size()-1]-c[c.size()-3], c[c.size()-2]-c[c.size()-4]);
+
+    // bounding box of the region in which near() returns true. Each
+    // segment is padded to enclose the ellipse tested by segNear()
+    g.x0=g.y0=numeric_limits<float>::max();
+    g.x1=g.y1=-numeric_limits<float>::max();
+    auto& p=g.path;
+    for (size_t i=1; i<p.size(); ++i)
+      {
+        float pad=0.5*sqrt(10*sqrt(d2(p[i-1].first, p[i-1].second, p[i].first, p[i].second))+25);
+        g.x0=min(g.x0,min(p[i-1].first,p[i].first)-pad);
+        g.x1=max(g.x1,max(p[i-1].first,p[i].first)+pad);
+        g.y0=min(g.y0,min(p[i-1].second,p[i].second)-pad);
+        g.y1=max(g.y1,max(p[i-1].second,p[i].second)+pad);
+      }
+    return g;
+  }
+   
+  void Wire::draw(cairo_t* cairo) const
+  {
+    if (!visible()) return;
+    auto& g=geometry();
+    auto& coords=g.coords;
+    if (coords.size()<4) return;
 
+    cairo_move_to(cairo,coords[0],coords[1]);
+    if (coords.size()==4)
+      cairo_line_to(cairo, coords[2], coords[3]);
+    else
+      {
         // Decrease tolerance a bit, since it's going to be magnified
         cairo_set_tolerance (cairo, 0.01);
         
+        int n=coords.size()/2-1;
         for (int i = 0; i < n; i++) {      
-          cairo_curve_to(cairo, controlPoints[i].first,controlPoints[i].second,controlPoints[n+i].first,controlPoints[n+i].second,points[i+1].first,points[i+1].second);
+          cairo_curve_to(cairo, g.controlPoints[i].first,g.controlPoints[i].second,
+                         g.controlPoints[n+i].first,g.controlPoints[n+i].second,
+                         coords[2*i+2],coords[2*i+3]);
         }		    
-        
-        // Stash the internal cairo coordinates used to draw curved wires. for ticket 1079.
-        if (coords.size()>4) storeCairoCoords(cairo);    
-                                         
-        cairo_stroke(cairo);     
-        angle=atan2(coords[coords.size()-1]-coords[coords.size()-3], 
-                    coords[coords.size()-2]-coords[coords.size()-4]);                         
-        lastx=coords[coords.size()-2]; lasty=coords[coords.size()-1];
       } 
     cairo_stroke(cairo);
 
     // draw arrow
     cairo_save(cairo);
-    cairo_translate(cairo, lastx, lasty);
-    cairo_rotate(cairo,angle);
+    cairo_translate(cairo, coords[coords.size()-2], coords[coords.size()-1]);
+    cairo_rotate(cairo,g.arrowAngle);
     cairo_move_to(cairo,0,0);
     cairo_line_to(cairo,-5,-3); 
     cairo_line_to(cairo,-3,0); 
@@ -444,7 +415,7 @@ namespace
       {    
         cairo_save(cairo);        
         cairo_set_source_rgb(cairo,0,0,1);
-        if (cairoCoords.empty() || coords.size()==4)
+        if (coords.size()==4)
           {
             double midx=0.5*(coords[0]+coords[2]);
             double midy=0.5*(coords[1]+coords[3]);
@@ -453,11 +424,12 @@ namespace
           } 
         else 
           {
-            size_t numSmallHandles=0.5*(coords.size()-4)+1, numCairoCoords=cairoCoords.size()-1;
+            auto& path=g.path;
+            size_t numSmallHandles=0.5*(coords.size()-4)+1, numPathCoords=path.size()-1;
             for (size_t i=0; i<coords.size()-3; i+=2)
               {
-                double midx=cairoCoords[(i+1)*numCairoCoords/(2*numSmallHandles)].first;
-                double midy=cairoCoords[(i+1)*numCairoCoords/(2*numSmallHandles)].second;
+                double midx=path[(i+1)*numPathCoords/(2*numSmallHandles)].first;
+                double midy=path[(i+1)*numPathCoords/(2*numSmallHandles)].second;
                 cairo_arc(cairo,midx,midy,handleRadius, 0, 2*M_PI);
                 if (i>0) // draw existing interior gripping handle            
                   cairo_arc(cairo,coords[i],coords[i+1],1.5*handleRadius, 0, 2*M_PI); 
@@ -512,52 +484,43 @@ namespace
     else return {};
   }
 
-  namespace
-  {
-
-    // returns true if x,y lies close to the line segment (x0,y0)-(x1,y1)
-    bool segNear(float x0, float y0, float x1, float y1, float x, float y)
-    {
-      float d=sqrt(sqr(x1-x0)+sqr(y1-y0));
-      float d1=sqrt(sqr(x-x0)+sqr(y-y0)), d2=sqrt(sqr(x-x1)+sqr(y-y1));
-      return d1+d2<=d+5;
-    }
-    
-    inline float d2(float x0, float y0, float x1, float y1)
-    {return sqr(x1-x0)+sqr(y1-y0);}
-    	
-  }    
-  
   bool Wire::near(float x, float y) const
   {
-    auto c=coords();
+    auto& g=geometry();
+    auto& c=g.coords;
     assert(c.size()>=4);
     if (c.size()==4)
       return segNear(c[0],c[1],c[2],c[3],x,y);
-    else {
-      // fixes for tickets 991/1095
-      vector<pair<float,float>> p=allHandleCoords(c);
-      if (!cairoCoords.empty()) p=cairoCoords;   
+    else if (x>=g.x0 && x<=g.x1 && y>=g.y0 && y<=g.y1)
+      {
+        // fixes for tickets 991/1095
+        auto& p=g.path;
          
-      unsigned k=0; // nearest index
-      float closestD=d2(p[0].first,p[0].second,x,y);      
-      for (size_t i=0; i<p.size(); i++)
-        {
-          float d=d2(p[i].first,p[i].second,x,y);
-          if (d<=closestD)
-            {
-              closestD=d;
-              k=i;
-            }
-        }
+        unsigned k=0; // nearest index
+        float closestD=d2(p[0].first,p[0].second,x,y);      
+        for (size_t i=0; i<p.size(); i++)
+          {
+            float d=d2(p[i].first,p[i].second,x,y);
+            if (d<=closestD)
+              {
+                closestD=d;
+                k=i;
+              }
+          }
       
-      // Check for proximity to line segments about index k
-      if (k>0 && k<p.size()-1)  
-        return (segNear(p[k-1].first,p[k-1].second,p[k].first,p[k].second,x,y) || segNear(p[k].first,p[k].second,p[k+1].first,p[k+1].second,x,y));      
-    }
+        // Check for proximity to line segments about index k
+        if (k>0 && k<p.size()-1)  
+          return (segNear(p[k-1].first,p[k-1].second,p[k].first,p[k].second,x,y) || segNear(p[k].first,p[k].second,p[k+1].first,p[k+1].second,x,y));      
+      }
     return false;
   }
 
+  void Wire::bounds(float& x0, float& y0, float& x1, float& y1) const
+  {
+    auto& g=geometry();
+    x0=g.x0; y0=g.y0; x1=g.x1; y1=g.y1;
+  }
+
   unsigned Wire::nearestHandle(float x, float y)
   {
     auto c=coords();
@@ -629,6 +592,12 @@ namespace
     coords(c);
   } 
   
+  void Wire::straighten()
+  {
+    m_coords.clear();
+    geometryChanged(GeometryChange::moveWire, this);
+  }
+
   void Wire::editHandle(unsigned position, float x, float y)
   {
     position++;
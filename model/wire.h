@@ -51,7 +51,29 @@ namespace minsky
 
     constexpr static float handleRadius=3;
     mutable int unitsCtr=0; ///< for detecting wiring loops in units()
-    mutable std::vector<std::pair<float,float>> cairoCoords; ///< contains all the internal cairo coordinates used to draw a wire
+  public:
+    /// geometry of a wire on the canvas, derived from its coordinates
+    struct Geometry
+    {
+      /// port positions and handles this was computed from
+      float fromX=0, fromY=0, toX=0, toY=0;
+      std::vector<float> handles;
+      bool valid=false;
+      /// display coordinates, as returned by coords()
+      std::vector<float> coords;
+      /// Bezier control points of a curved wire. For n segments, the
+      /// first n are the control points following each knot, and the
+      /// last n those preceding the next knot
+      std::vector<std::pair<float,float>> controlPoints;
+      /// polyline through the wire, used for hit testing
+      std::vector<std::pair<float,float>> path;
+      /// direction of the arrow head at the end of the wire
+      float arrowAngle=0;
+      /// bounding box of the region in which near() returns true
+      float x0=0, y0=0, x1=0, y1=0;
+    };
+  private:
+    mutable classdesc::Exclude<Geometry> m_geometry;
   public:
 
     Wire() {}
@@ -64,17 +86,20 @@ namespace minsky
 
     /// switch ports this wire links to
     void moveToPorts(const std::shared_ptr<Port>& from, const std::shared_ptr<Port>& to);
-    /// stash all the internal cairo coordinates along a wire 
-    void storeCairoCoords(cairo_t* cairo) const;   
     /// draw this item into a cairo context
     void draw(cairo_t* cairo) const;
     
+    /// geometry of the wire, recomputed only when its ports or
+    /// handles have moved since last called
+    const Geometry& geometry() const;
     /// display coordinates 
     std::vector<float> coords() const;
     std::vector<float> coords(const std::vector<float>& coords);
     
     /// returns true if coordinates are near this wire
     bool near(float x, float y) const;
+    /// bounding box of the region in which near() returns true
+    void bounds(float& x0, float& y0, float& x1, float& y1) const;
     /// returns the index into the coordinate list if x,y is close to
     /// it. Otherwise inserts midpoints and returns that. Wire
     /// endpoints are not returned
@@ -84,7 +109,7 @@ namespace minsky
     void deleteHandle(float x, float y);    
     void editHandle(unsigned position, float x, float y);
     
-    void straighten() {m_coords.clear();}
+    void straighten();
 
     /// whether this wire is visible or not
     bool visible() const;
@@ -28,6 +28,13 @@ namespace minsky
     double epsRel{1e-2}, epsAbs{1e-3};
     int order{4};
     bool implicit{false};
+    /// use the built in Dormand-Prince integrator (or Rosenbrock if
+    /// implicit) instead of GSL
+    bool nativeSolver{false};
+    /// if positive, and using the native solver, each iteration
+    /// advances time by this amount, with the solution sampled via
+    /// dense output rather than by truncating steps
+    double outputInterval{0};
     int simulationDelay{0};
     std::string timeUnit;
   };
@@ -125,12 +125,23 @@ namespace schema3
   struct IdMap: public map<void*,int>
   {
     int nextId=0;
+    bool packTensorData=true;
+    /// ids from a previous conversion, retained by objects seen again
+    const map<void*,int>* previous=nullptr;
+    minsky::HistoryIds* ids=nullptr;
+    /// objects converted, by id
+    map<int, weak_ptr<const void>> objects;
     int at(void* o) {
       auto i=find(o);
-      if (i==end())
-        return emplace(o,nextId++).first->second;
-      else
+      if (i!=end())
         return i->second;
+      if (previous)
+        {
+          auto p=previous->find(o);
+          if (p!=previous->end())
+            return emplace(o,p->second).first->second;
+        }
+      return emplace(o,nextId++).first->second;
     }
     int operator[](void* o) {return at(o);}
     vector<int> at(const minsky::ItemPortVector& v) {
@@ -141,12 +152,41 @@ namespace schema3
     }
   
     template <class T>
-    bool emplaceIf(vector<Item>& items, minsky::Item* i)
+    bool emplaceIf(vector<Item>& items, const minsky::ItemPtr& ip)
     {
+      auto i=ip.get();
       auto j=dynamic_cast<T*>(i);
       if (j)
         {
-          items.emplace_back(at(i), *j, at(j->ports));
+          int id=at(i);
+          if (ids)
+            {
+              objects[id]=ip;
+              if (ids->isUnchanged(*i, id))
+                {
+                  // cached record is current, so only register the
+                  // ids of the objects it refers to
+                  at(i->ports);
+                  if (auto g=dynamic_cast<minsky::GodleyIcon*>(i))
+                    {
+                      for (auto& v: g->flowVars())
+                        at(v->ports[1].get());
+                      for (auto& v: g->stockVars())
+                        at(v->ports[0].get());
+                    }
+                  if (auto r=dynamic_cast<minsky::Ravel*>(i))
+                    if (r->lockGroup)
+                      at(r->lockGroup.get());
+                  items.emplace_back();
+                  items.back().id=id;
+                  ids->unchanged.insert(id);
+                  return true;
+                }
+            }
+          items.emplace_back(id, *j, at(j->ports));
+          if (auto v=dynamic_cast<minsky::VariableBase*>(i))
+            if (packTensorData)
+              items.back().packTensorInit(*v);
           if (auto g=dynamic_cast<minsky::GodleyIcon*>(i))
             {
               // insert port references from flow/stock vars
@@ -267,19 +307,27 @@ namespace schema3
   }
 
 
-  Minsky::Minsky(const minsky::Group& g)
+  Minsky::Minsky(const minsky::Group& g, bool packTensorData, minsky::HistoryIds* ids)
   {
     IdMap itemMap;
+    itemMap.packTensorData=packTensorData;
+    if (ids)
+      {
+        itemMap.previous=&ids->ids;
+        itemMap.nextId=ids->nextId;
+        itemMap.ids=ids;
+        ids->unchanged.clear();
+      }
 
     g.recursiveDo(&minsky::GroupItems::items,[&](const minsky::Items&,minsky::Items::const_iterator i) {
-        itemMap.emplaceIf<minsky::Ravel>(items, i->get()) ||
-        itemMap.emplaceIf<minsky::OperationBase>(items, i->get()) ||
-          itemMap.emplaceIf<minsky::VariableBase>(items, i->get()) ||
-          itemMap.emplaceIf<minsky::GodleyIcon>(items, i->get()) ||
-          itemMap.emplaceIf<minsky::PlotWidget>(items, i->get()) ||
-          itemMap.emplaceIf<minsky::SwitchIcon>(items, i->get()) ||
-          itemMap.emplaceIf<minsky::Sheet>(items, i->get()) ||
-          itemMap.emplaceIf<minsky::Item>(items, i->get());
+        itemMap.emplaceIf<minsky::Ravel>(items, *i) ||
+        itemMap.emplaceIf<minsky::OperationBase>(items, *i) ||
+          itemMap.emplaceIf<minsky::VariableBase>(items, *i) ||
+          itemMap.emplaceIf<minsky::GodleyIcon>(items, *i) ||
+          itemMap.emplaceIf<minsky::PlotWidget>(items, *i) ||
+          itemMap.emplaceIf<minsky::SwitchIcon>(items, *i) ||
+          itemMap.emplaceIf<minsky::Sheet>(items, *i) ||
+          itemMap.emplaceIf<minsky::Item>(items, *i);
         return false;
       });
     
@@ -288,6 +336,7 @@ namespace schema3
         if (auto integ=dynamic_cast<minsky::IntOp*>(i->get()))
           {
             int id=itemMap[i->get()];
+            if (ids && ids->unchanged.count(id)) return false;
             for (auto& j: items)
               if (j.id==id)
                 {
@@ -304,7 +353,19 @@ namespace schema3
         
     g.recursiveDo(&minsky::GroupItems::wires,
                   [&](const minsky::Wires&,minsky::Wires::const_iterator i) {
-                    wires.emplace_back(itemMap[i->get()], **i);
+                    int id=itemMap[i->get()];
+                    if (ids)
+                      {
+                        itemMap.objects[id]=*i;
+                        if (ids->isUnchanged(i->get(), id))
+                          {
+                            wires.emplace_back();
+                            wires.back().id=id;
+                            ids->unchanged.insert(id);
+                            return false;
+                          }
+                      }
+                    wires.emplace_back(id, **i);
                     assert(itemMap.count((*i)->from().get()) && itemMap.count((*i)->to().get()));
                     wires.back().from=itemMap[(*i)->from().get()];
                     wires.back().to=itemMap[(*i)->to().get()];
@@ -314,6 +375,8 @@ namespace schema3
     g.recursiveDo(&minsky::GroupItems::groups,
                   [&](const minsky::Groups&,minsky::Groups::const_iterator i) {
                     groups.emplace_back(itemMap[i->get()], **i);
+                    if (ids)
+                      itemMap.objects[groups.back().id]=*i;
                     for (auto& j: (*i)->items)
                       {
                         assert(itemMap.count(j.get()));
@@ -333,6 +396,14 @@ namespace schema3
                       }
                     return false;
                   });
+
+    if (ids)
+      {
+        // objects no longer in the model are forgotten
+        ids->nextId=itemMap.nextId;
+        ids->ids.swap(itemMap);
+        ids->objects.swap(itemMap.objects);
+      }
   }
       
   Minsky::operator minsky::Minsky() const
@@ -362,6 +433,7 @@ namespace schema3
     x.m_x=y.x;
     x.m_y=y.y;
     x.m_sf=y.scaleFactor;
+    minsky::geometryMoved(x);
     x.rotation(y.rotation);
     if (auto x1=dynamic_cast<minsky::DataOp*>(&x))
       {
@@ -485,7 +557,7 @@ namespace schema3
     LockGroupFactory(): shared_ptr<minsky::RavelLockGroup>(new minsky::RavelLockGroup) {}
   };
   
-  void Minsky::populateGroup(minsky::Group& g) const {
+  void Minsky::populateGroup(minsky::Group& g, minsky::HistoryIds* ids) const {
     map<int, minsky::ItemPtr> itemMap;
     map<int, shared_ptr<minsky::Port>> portMap;
     map<int, schema3::Item> schema3VarMap;
@@ -565,12 +637,13 @@ namespace schema3
             }
       }
         
+    map<int, minsky::WirePtr> wireMap;
     for (auto& w: wires)
       if (portMap.count(w.to) && portMap.count(w.from))
         {
           assert(portMap[w.from].use_count()>1 && portMap[w.to].use_count()>1);
           populateWire
-            (*g.addWire(new minsky::Wire(portMap[w.from],portMap[w.to])),w);
+            (*(wireMap[w.id]=g.addWire(new minsky::Wire(portMap[w.from],portMap[w.to]))),w);
         }
           
     for (auto& i: groups)
@@ -646,6 +719,35 @@ namespace schema3
                 }
           }
       }
+
+    if (ids)
+      {
+        // keyed as in the IdMap used by Minsky(const minsky::Group&)
+        auto record=[&](void* o, int id) {
+          ids->ids.emplace(o,id);
+          ids->nextId=max(ids->nextId, id+1);
+        };
+        for (auto& i: itemMap)
+          if (auto grp=dynamic_pointer_cast<minsky::Group>(i.second))
+            {
+              record(grp.get(), i.first);
+              ids->objects[i.first]=grp;
+            }
+          else if (i.second)
+            {
+              record(i.second.get(), i.first);
+              ids->objects[i.first]=i.second;
+            }
+        for (auto& i: portMap)
+          record(i.second.get(), i.first);
+        for (auto& i: wireMap)
+          {
+            record(i.second.get(), i.first);
+            ids->objects[i.first]=i.second;
+          }
+        for (auto& i: lockGroups)
+          record(i.second.get(), i.first);
+      }
   }
   
 }
@@ -134,7 +134,6 @@ namespace schema3
         slider.reset(new Slider(v.sliderStepRel,v.sliderMin,v.sliderMax,v.sliderStep));
       if (auto vv=v.vValue())
         units=vv->units.str();
-      packTensorInit(v);
     }
     Item(int id, const minsky::OperationBase& o, const std::vector<int>& ports):
       ItemBase(id,static_cast<const minsky::Item&>(o),ports),
@@ -226,9 +225,18 @@ namespace schema3
     minsky::ConversionsMap conversions;
     
     Minsky(): schemaVersion(0) {} // schemaVersion defined on read in
-    Minsky(const minsky::Group& g);
-    Minsky(const minsky::Minsky& m):
-      Minsky(*m.model)  {
+    /// @param packTensorData if false, the tensorInit data of
+    /// parameters is not serialised into the tensorData field (see
+    /// minsky::snapshot)
+    /// @param ids if not null, objects keep the ids given by the
+    /// previous conversion using \a ids, rather than being numbered
+    /// in traversal order. Updated with the ids of this conversion.
+    /// Items and wires whose cached record in \a ids is current are
+    /// left default constructed, bar their id, and listed in
+    /// ids->unchanged.
+    Minsky(const minsky::Group& g, bool packTensorData=true, minsky::HistoryIds* ids=nullptr);
+    Minsky(const minsky::Minsky& m, bool packTensorData=true, minsky::HistoryIds* ids=nullptr):
+      Minsky(*m.model, packTensorData, ids)  {
       minskyVersion=m.minskyVersion;
       rungeKutta=m;
       zoomFactor=m.model->zoomFactor();
@@ -254,9 +262,22 @@ namespace schema3
     /// populate a group object from this. This mutates the ids in a
     /// consistent way into the free id space of the global minsky
     /// object
-    void populateGroup(minsky::Group& g) const;
+    /// @param ids if not null, the ids of this are recorded against
+    /// the objects created, for subsequent conversions to use
+    void populateGroup(minsky::Group& g, minsky::HistoryIds* ids=nullptr) const;
   };
 
+  /// @{ apply the attributes of a schema object to an existing model
+  /// object. Variable value attributes are not applied, as they
+  /// require the variable to be homed in its group.
+  void populateItem(minsky::Item& x, const Item& y);
+  void populateWire(minsky::Wire& x, const Wire& y);
+  /// @}
+
+  /// @{ binary serialisation of tensor axes, as used by the tensorData field
+  void pack(classdesc::pack_t&, const civita::XVector&);
+  void unpack(classdesc::pack_t&, civita::XVector&);
+  /// @}
 
 }
 
@@ -22,38 +22,158 @@
 #include "minsky_epilogue.h"
 #include "a85.h"
 #include "zStream.h"
+#include "threadPool.h"
 #include <zlib.h>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 using namespace std;
 
 namespace minsky
 {
+  namespace
+  {
+    /// size of the independently compressed chunks of encoded data
+    const size_t encodeChunkSize=1<<20;
+    /// marks the chunked representation. These characters are not
+    /// part of the Ascii85 alphabet, so cannot appear in the older
+    /// single stream representation
+    const char chunkedMarker='z', chunkSeparator='y';
+
+    /// call \a f(i) for each i in [0,n), concurrently if n>1
+    void forEachChunk(size_t n, const function<void(size_t)>& f)
+    {
+      sharedThreadPool().parallelFor(n, [&](size_t begin, size_t end)
+                       {for (size_t i=begin; i<end; ++i) f(i);});
+    }
+
+    /// deflate \a n bytes of \a data as a zlib stream at \a level
+    vector<unsigned char> compress(const char* data, size_t n, int level)
+    {
+      uLongf zsize=compressBound(n);
+      vector<unsigned char> zbuf(zsize);
+      if (compress2(zbuf.data(), &zsize, reinterpret_cast<const Bytef*>(data), n,
+                    level)!=Z_OK)
+        throw runtime_error("compression failure");
+      zbuf.resize(zsize);
+      return zbuf;
+    }
+
+    /// Ascii85 encode \a zbuf into \a r, which has
+    /// a85::size_for_a85(zbuf.size(),false) characters
+    void toA85(const vector<unsigned char>& zbuf, char* r)
+    {
+      size_t n=a85::size_for_a85(zbuf.size(),false);
+      a85::to_a85(zbuf.data(), zbuf.size(), r, false);
+      // this ensures that the escape sequence ']]>' never appears in the data
+      replace(r, r+n, ']', '~');
+    }
+
+    /// decode the original, single zlib stream, representation
+    classdesc::pack_t decodeStream(const classdesc::CDATA& data)
+    {
+      string trimmed; //trim whitespace
+      for (auto c: data)
+        if (!isspace(c)) trimmed+=c;
+    
+      vector<unsigned char> zbuf(a85::size_for_bin(trimmed.size()));
+      // reverse transformation required to avoid the escape sequence ']]>'
+      replace(trimmed.begin(),trimmed.end(),'~',']'); 
+      a85::from_a85(trimmed.data(), trimmed.size(),zbuf.data());
+
+      InflateZStream zs(zbuf);
+      zs.inflate();
+      return move(zs.output);
+    }
+  }
+  
+  // The chunked representation is
+  //   z<size>,<chunk size>y<chunk>y<chunk>...
+  // where size is the length of the binary data, and each chunk is
+  // the Ascii85 encoded zlib stream of chunk size bytes of it (the
+  // last chunk may be shorter). It is understood from Minsky 2.19,
+  // and only written for data larger than one chunk, so files
+  // without large tensors or histories remain readable by earlier
+  // versions.
   classdesc::pack_t decode(const classdesc::CDATA& data)
   {
-    string trimmed; //trim whitespace
-    for (auto c: data)
-      if (!isspace(c)) trimmed+=c;
+    auto first=find_if(data.begin(), data.end(), [](char c){return !isspace(c);});
+    if (first==data.end() || *first!=chunkedMarker)
+      return decodeStream(data);
+
+    const char* end=data.data()+data.size();
+    char* next;
+    size_t size=strtoull(&*first+1, &next, 10);
+    if (*next!=',')
+      throw runtime_error("corrupt encoded data");
+    size_t chunkSize=strtoull(next+1, &next, 10);
     
-    vector<unsigned char> zbuf(a85::size_for_bin(trimmed.size()));
-    // reverse transformation required to avoid the escape sequence ']]>'
-    replace(trimmed.begin(),trimmed.end(),'~',']'); 
-    a85::from_a85(trimmed.data(), trimmed.size(),zbuf.data());
-
-    InflateZStream zs(zbuf);
-    zs.inflate();
-    return move(zs.output);
+    // offsets of the chunks within data, each chunk being preceded
+    // by a separator
+    vector<size_t> chunkBegin;
+    for (const char* p=next; (p=static_cast<const char*>(memchr(p, chunkSeparator, end-p))); ++p)
+      chunkBegin.push_back(p+1-data.data());
+    size_t numChunks=chunkBegin.size();
+    chunkBegin.push_back(data.size()+1); // sentinel
+    if (chunkSize==0 || numChunks!=max(size_t(1), (size+chunkSize-1)/chunkSize))
+      throw runtime_error("corrupt encoded data");
+
+    classdesc::pack_t r(size);
+    forEachChunk(numChunks, [&](size_t i) {
+        string trimmed;
+        trimmed.reserve(chunkBegin[i+1]-1-chunkBegin[i]);
+        for (size_t j=chunkBegin[i]; j<chunkBegin[i+1]-1; ++j)
+          if (!isspace(data[j]))
+            // reverse transformation required to avoid the escape sequence ']]>'
+            trimmed+=data[j]=='~'? ']': data[j];
+        vector<unsigned char> zbuf(a85::size_for_bin(trimmed.size()));
+        a85::from_a85(trimmed.data(), trimmed.size(), zbuf.data());
+
+        size_t offset=i*chunkSize;
+        uLongf n=min(chunkSize, size-offset);
+        if (uncompress(reinterpret_cast<Bytef*>(r.data())+offset, &n,
+                       zbuf.data(), zbuf.size())!=Z_OK ||
+            n!=min(chunkSize, size-offset))
+          throw runtime_error("corrupt encoded data");
+      });
+    return r;
   }
 
 
-  classdesc::CDATA encode(const classdesc::pack_t& buf)
+  classdesc::CDATA encode(const classdesc::pack_t& buf, int compressionLevel)
   {
-    vector<unsigned char> zbuf(buf.size());
-    DeflateZStream zs(buf, zbuf);
-    zs.deflate();
+    CDATA r;
+    if (buf.size()<=encodeChunkSize)
+      {
+        // single stream representation
+        auto zbuf=compress(buf.data(), buf.size(), compressionLevel);
+        r.resize(a85::size_for_a85(zbuf.size(),false));
+        toA85(zbuf, &r[0]);
+        return r;
+      }
     
-    vector<char> cbuf(a85::size_for_a85(zs.total_out,false));
-    a85::to_a85(&zbuf[0],zs.total_out, &cbuf[0], false);
-    // this ensures that the escape sequence ']]>' never appears in the data
-    replace(cbuf.begin(),cbuf.end(),']','~');
-    return CDATA(cbuf.begin(),cbuf.end());
+    size_t numChunks=(buf.size()+encodeChunkSize-1)/encodeChunkSize;
+    vector<vector<unsigned char>> zbufs(numChunks);
+    forEachChunk(numChunks, [&](size_t i) {
+        size_t offset=i*encodeChunkSize;
+        zbufs[i]=compress(buf.data()+offset, min(encodeChunkSize, buf.size()-offset),
+                          compressionLevel);
+      });
+
+    // Ascii85 encode each chunk in place in the output
+    r+=chunkedMarker+to_string(buf.size())+','+to_string(encodeChunkSize);
+    vector<size_t> offsets;
+    size_t size=r.size();
+    for (auto& i: zbufs)
+      {
+        offsets.push_back(size+1);
+        size+=a85::size_for_a85(i.size(),false)+1;
+      }
+    r.resize(size);
+    forEachChunk(numChunks, [&](size_t i) {
+        r[offsets[i]-1]=chunkSeparator;
+        toA85(zbufs[i], &r[offsets[i]]);
+      });
+    return r;
   }
 }
@@ -105,10 +105,17 @@ namespace minsky
       throw error("Minsky schema version %d not supported",currentSchema.schemaVersion);
   }
 
-  /// decode ascii-encoded representation to binary data
+  /// decode ascii-encoded representation to binary data. Both the
+  /// chunked representation produced by encode, and the older
+  /// single stream representation are accepted.
   classdesc::pack_t decode(const classdesc::CDATA&);
-  /// encode binary data to ascii-encoded 
-  classdesc::CDATA encode(const classdesc::pack_t&);
+  /// encode binary data to ascii-encoded. The data is deflated and
+  /// Ascii85 encoded as a single stream, or, for buffers larger than
+  /// one chunk, in independent chunks concurrently. The chunked
+  /// representation requires Minsky 2.19 or later to decode.
+  /// @param compressionLevel zlib compression level, from 1 (fastest)
+  /// to 9 (smallest)
+  classdesc::CDATA encode(const classdesc::pack_t&, int compressionLevel=6);
 
   
 }
@@ -0,0 +1,266 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "snapshot.h"
+#include "schema3.h"
+#include "minsky_epilogue.h"
+#include <zlib.h>
+#include <cstring>
+#include <fstream>
+using namespace std;
+
+namespace minsky
+{
+  namespace snapshot
+  {
+    namespace
+    {
+      const char magic[8]={'\x89','M','K','Y','S','N','P','\n'};
+      /// detects files written on a machine of different endianness
+      const uint32_t byteOrder=0x01020304;
+      /// alignment of data blocks within the file
+      const uint64_t alignment=64;
+
+      struct Header
+      {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t xmlOffset, xmlSize;
+        uint64_t directoryOffset, directorySize;
+      };
+
+      void align(ofstream& f)
+      {
+        static const char zeros[alignment]={};
+        uint64_t pos=f.tellp();
+        f.write(zeros, (alignment-pos%alignment)%alignment);
+      }
+
+      /// writes \a bytes of \a data at the next aligned position,
+      /// returning its offset and stored size. If \a compress is
+      /// set, and compression reduces the size, the data is
+      /// compressed, and \a compress remains set.
+      void writeBlock(ofstream& f, const void* data, size_t bytes, bool& compress,
+                      uint64_t& offset, uint64_t& stored)
+      {
+        align(f);
+        offset=f.tellp();
+        if (compress)
+          {
+            uLongf zbytes=compressBound(bytes);
+            vector<Bytef> zbuf(zbytes);
+            if (compress2(zbuf.data(), &zbytes, static_cast<const Bytef*>(data), bytes,
+                          Z_BEST_SPEED)==Z_OK && zbytes<bytes)
+              {
+                f.write(reinterpret_cast<const char*>(zbuf.data()), zbytes);
+                stored=zbytes;
+                return;
+              }
+            compress=false;
+          }
+        f.write(static_cast<const char*>(data), bytes);
+        stored=bytes;
+      }
+    }
+
+    bool isSnapshot(const string& filename)
+    {
+      ifstream f(filename, ios::binary);
+      char buf[sizeof(magic)];
+      return f.read(buf, sizeof(buf)) && memcmp(buf, magic, sizeof(magic))==0;
+    }
+
+    void Writer::write(const string& filename, const string& xml) const
+    {
+      ofstream f(filename, ios::binary);
+      if (!f)
+        throw runtime_error("cannot save to "+filename);
+
+      Header header;
+      memcpy(header.magic, magic, sizeof(magic));
+      header.version=version;
+      header.byteOrder=byteOrder;
+      // placeholder, rewritten once the block locations are known
+      f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+      header.xmlOffset=f.tellp();
+      header.xmlSize=xml.size();
+      f.write(xml.data(), xml.size());
+
+      classdesc::pack_t directory;
+      directory<<uint64_t(tensors.size());
+      for (auto& i: tensors)
+        {
+          auto& t=*i.second;
+          Block block;
+          // empty tensors have no data block, as size() is at least 1
+          block.size=t.storedSize();
+          block.compressed=compress && block.size;
+          if (block.size)
+            writeBlock(f, &*t.begin(), block.size*sizeof(double), block.compressed,
+                       block.dataOffset, block.dataBytes);
+
+          vector<uint64_t> index(t.index().begin(), t.index().end());
+          block.indexSize=index.size();
+          block.indexCompressed=compress;
+          writeBlock(f, index.data(), index.size()*sizeof(uint64_t), block.indexCompressed,
+                     block.indexOffset, block.indexBytes);
+
+          directory<<i.first<<block.size<<block.dataOffset<<block.dataBytes
+                   <<block.compressed<<block.indexSize<<block.indexOffset
+                   <<block.indexBytes<<block.indexCompressed;
+          auto& xvectors=t.hypercube().xvectors;
+          directory<<uint64_t(xvectors.size());
+          for (auto& xv: xvectors)
+            schema3::pack(directory, xv);
+        }
+
+      align(f);
+      header.directoryOffset=f.tellp();
+      header.directorySize=directory.size();
+      f.write(directory.data(), directory.size());
+      f.seekp(0);
+      f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      if (!f)
+        throw runtime_error("cannot save to "+filename);
+    }
+
+    Reader::Reader(const string& filename)
+    {
+      using namespace boost::interprocess;
+      try
+        {
+          file.reset(new file_mapping(filename.c_str(), read_only));
+          region.reset(new mapped_region(*file, read_only));
+        }
+      catch (const interprocess_exception&)
+        {
+          throw runtime_error("failed to open "+filename);
+        }
+      data=static_cast<const char*>(region->get_address());
+      fileSize=region->get_size();
+
+      Header header;
+      checkRange(0, sizeof(header));
+      memcpy(&header, data, sizeof(header));
+      if (memcmp(header.magic, magic, sizeof(magic))!=0)
+        throw runtime_error(filename+" is not a Minsky snapshot");
+      if (header.version>version)
+        throw runtime_error("Minsky snapshot version "+to_string(header.version)+
+                            " not supported");
+      if (header.byteOrder!=byteOrder)
+        throw runtime_error(filename+" was written on an incompatible machine");
+
+      checkRange(header.xmlOffset, header.xmlSize);
+      xmlOffset=header.xmlOffset;
+      xmlSize=header.xmlSize;
+
+      checkRange(header.directoryOffset, header.directorySize);
+      classdesc::pack_t directory;
+      directory.packraw(data+header.directoryOffset, header.directorySize);
+      uint64_t numBlocks, numXVectors;
+      directory>>numBlocks;
+      for (uint64_t i=0; i<numBlocks; ++i)
+        {
+          string valueId;
+          directory>>valueId;
+          auto& block=blocks[valueId];
+          directory>>block.size>>block.dataOffset>>block.dataBytes
+                   >>block.compressed>>block.indexSize>>block.indexOffset
+                   >>block.indexBytes>>block.indexCompressed;
+          directory>>numXVectors;
+          for (uint64_t j=0; j<numXVectors; ++j)
+            {
+              civita::XVector xv;
+              schema3::unpack(directory, xv);
+              block.hypercube.xvectors.push_back(move(xv));
+            }
+          checkRange(block.dataOffset, block.dataBytes);
+          checkRange(block.indexOffset, block.indexBytes);
+        }
+    }
+
+    void Reader::checkRange(uint64_t offset, uint64_t size) const
+    {
+      if (offset>fileSize || size>fileSize-offset)
+        throw runtime_error("corrupt Minsky snapshot");
+    }
+
+    vector<string> Reader::tensors() const
+    {
+      vector<string> r;
+      for (auto& i: blocks)
+        r.push_back(i.first);
+      return r;
+    }
+
+    namespace
+    {
+      /// copy a stored block into \a dest, which must hold \a bytes bytes
+      void readBlock(const char* src, uint64_t stored, bool compressed,
+                     void* dest, size_t bytes)
+      {
+        if (bytes==0 && stored==0) return;
+        if (compressed)
+          {
+            uLongf destLen=bytes;
+            if (uncompress(static_cast<Bytef*>(dest), &destLen,
+                           reinterpret_cast<const Bytef*>(src), stored)!=Z_OK ||
+                destLen!=bytes)
+              throw runtime_error("corrupt Minsky snapshot");
+          }
+        else
+          {
+            if (stored!=bytes)
+              throw runtime_error("corrupt Minsky snapshot");
+            memcpy(dest, src, bytes);
+          }
+      }
+    }
+
+    bool Reader::loadTensor(const string& valueId, civita::TensorVal& t) const
+    {
+      auto i=blocks.find(valueId);
+      if (i==blocks.end()) return false;
+      auto& block=i->second;
+
+      vector<uint64_t> index(block.indexSize);
+      readBlock(data+block.indexOffset, block.indexBytes, block.indexCompressed,
+                index.data(), index.size()*sizeof(uint64_t));
+      // Index requires its entries to be unique, sorted and within the hypercube
+      for (size_t j=1; j<index.size(); ++j)
+        if (index[j]<=index[j-1])
+          throw runtime_error("corrupt Minsky snapshot");
+      if (!index.empty() && index.back()>=block.hypercube.numElements())
+        throw runtime_error("corrupt Minsky snapshot");
+      t.index(civita::Index(vector<size_t>(index.begin(), index.end())));
+      t.hypercube(block.hypercube);
+      if (block.size)
+        {
+          if (t.storedSize()!=block.size)
+            throw runtime_error("corrupt Minsky snapshot");
+          readBlock(data+block.dataOffset, block.dataBytes, block.compressed,
+                    &*t.begin(), block.size*sizeof(double));
+        }
+      t.updateTimestamp();
+      return true;
+    }
+  }
+}
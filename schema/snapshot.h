@@ -0,0 +1,106 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+   @file Binary snapshot container for Minsky models. A snapshot holds
+   the schema3 XML description of the model, without the tensorData
+   fields, followed by the tensorInit data of parameters as raw,
+   64 byte aligned, optionally compressed blocks, which are read
+   directly from a memory mapping of the file on load.
+
+   Layout:
+   - header: magic, format version, location of the XML and of the block directory
+   - schema3 XML text
+   - data and index blocks
+   - block directory (classdesc packed), mapping valueIds to blocks and hypercubes
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "tensorVal.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace minsky
+{
+  namespace snapshot
+  {
+    static const int version=1;
+
+    /// true if \a filename is a snapshot file, rather than XML
+    bool isSnapshot(const std::string& filename);
+
+    /// location of a tensor's data within a snapshot file
+    struct Block
+    {
+      uint64_t size=0; ///< number of data values
+      uint64_t dataOffset=0, dataBytes=0;
+      uint64_t indexSize=0; ///< number of sparse index entries
+      uint64_t indexOffset=0, indexBytes=0;
+      bool compressed=false, indexCompressed=false;
+      civita::Hypercube hypercube;
+    };
+
+    class Writer
+    {
+      std::vector<std::pair<std::string, const civita::TensorVal*>> tensors;
+    public:
+      /// compress data blocks. Trades load and save speed for file size
+      bool compress=false;
+      /// add a tensor to be written, referenced by \a valueId. The
+      /// tensor must remain valid until write() is called
+      void addTensor(const std::string& valueId, const civita::TensorVal& t)
+      {tensors.emplace_back(valueId, &t);}
+      /// write snapshot to \a filename, with \a xml as the schema3
+      /// description of the model
+      void write(const std::string& filename, const std::string& xml) const;
+    };
+
+    class Reader
+    {
+      std::unique_ptr<boost::interprocess::file_mapping> file;
+      std::unique_ptr<boost::interprocess::mapped_region> region;
+      const char* data=nullptr;
+      size_t fileSize=0;
+      uint64_t xmlOffset=0, xmlSize=0;
+      std::map<std::string, Block> blocks;
+      /// throws unless [offset, offset+size) lies within the file
+      void checkRange(uint64_t offset, uint64_t size) const;
+    public:
+      /// maps \a filename
+      /// @throw if the file is not a valid snapshot
+      Reader(const std::string& filename);
+      /// schema3 XML description of the model
+      std::string xml() const {return std::string(data+xmlOffset, xmlSize);}
+      /// valueIds of tensors stored in this snapshot
+      std::vector<std::string> tensors() const;
+      /// load tensor data stored for \a valueId into \a t
+      /// @return false if no tensor stored under \a valueId
+      /// @throw if the stored data is inconsistent
+      bool loadTensor(const std::string& valueId, civita::TensorVal& t) const;
+    };
+  }
+}
+
+#endif
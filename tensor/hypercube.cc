@@ -20,6 +20,7 @@
 #include "hypercube.h"
 #include <error.h>
 #include <set>
+#include <unordered_set>
 
 using namespace std;
 
@@ -67,20 +68,28 @@ namespace civita
                 {
                 case Dimension::string:
                   {
-                    set<string> alabels;
-                    for (auto& k: i)
-                      alabels.insert(str(k));
-                    for (auto k: xvectors[j])
-                      if (alabels.count(str(k)))
-                        newLabels.push_back(k);
+                    auto l=TypedXVector(i).labels();
+                    unordered_set<string> alabels(l.begin(), l.end());
+                    l=TypedXVector(xvectors[j]).labels();
+                    for (size_t k=0; k<l.size(); ++k)
+                      if (alabels.count(l[k]))
+                        newLabels.push_back(xvectors[j][k]);
                     break;
                   }
                 default:
                   {
                     // set overlapping value ranges
-                    set<boost::any, AnyLess> vals(i.begin(), i.end());
+                    TypedXVector vals(i);
+                    if (vals.size()==0) break;
+                    size_t lo=0, hi=0;
+                    for (size_t k=1; k<vals.size(); ++k)
+                      {
+                        if (vals.less(k,lo)) lo=k;
+                        if (vals.less(hi,k)) hi=k;
+                      }
+                    auto min=vals[lo], max=vals[hi];
                     for (auto k: xvectors[j])
-                      if (diff(k, *vals.begin())>=0 && diff(k, *vals.rbegin())<=0)
+                      if (diff(k, min)>=0 && diff(k, max)<=0)
                         newLabels.push_back(k);
                     break;
                   }
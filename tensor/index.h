@@ -38,6 +38,8 @@ namespace civita
       Index() {}
       template <class T>
       Index(const T& indices) {*this=indices;}
+      /// construct from an already sorted vector of unique indices
+      explicit Index(std::vector<size_t>&& indices): index(std::move(indices)) {}
 
       // can only assign ordered containers
       template <class T, class C, class A>
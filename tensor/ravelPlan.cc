@@ -0,0 +1,383 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ravelPlan.h"
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <ecolab_epilogue.h>
+using namespace std;
+
+namespace civita
+{
+  namespace
+  {
+    using HandleState=minsky::RavelState::HandleState;
+
+    /// accumulates a reduction, with the same semantics as the
+    /// ReductionOp created for each type by createRavelChain
+    struct Accumulator
+    {
+      RavelPlan::ReductionType op;
+      double r, sqr;
+      size_t count;
+      Accumulator(RavelPlan::ReductionType op): op(op) {reset();}
+      void reset() {
+        sqr=0; count=0;
+        switch (op)
+          {
+          case HandleState::prod: r=1; break;
+          case HandleState::min: r=numeric_limits<double>::max(); break;
+          case HandleState::max: r=-numeric_limits<double>::max(); break;
+          default: r=0; break;
+          }
+      }
+      /// accumulate \a x, which must not be NaN
+      void add(double x) {
+        switch (op)
+          {
+          case HandleState::sum: r+=x; break;
+          case HandleState::prod: r*=x; break;
+          case HandleState::av: r+=x; ++count; break;
+          case HandleState::stddev: r+=x; sqr+=x*x; ++count; break;
+          case HandleState::min: if (x<r) r=x; break;
+          case HandleState::max: if (x>r) r=x; break;
+          }
+      }
+      /// accumulate the non-NaN elements of x[i*stride], i<n
+      void add(const double x[], size_t stride, size_t n) {
+        switch (op)
+          {
+          case HandleState::sum: forEach(x,stride,n,[&](double y){r+=y;}); break;
+          case HandleState::prod: forEach(x,stride,n,[&](double y){r*=y;}); break;
+          case HandleState::av: forEach(x,stride,n,[&](double y){r+=y; ++count;}); break;
+          case HandleState::stddev:
+            forEach(x,stride,n,[&](double y){r+=y; sqr+=y*y; ++count;});
+            break;
+          case HandleState::min: forEach(x,stride,n,[&](double y){if (y<r) r=y;}); break;
+          case HandleState::max: forEach(x,stride,n,[&](double y){if (y>r) r=y;}); break;
+          }
+      }
+      template <class F>
+      static void forEach(const double x[], size_t stride, size_t n, F f) {
+        for (size_t i=0; i<n; ++i, x+=stride)
+          if (!isnan(*x)) f(*x);
+      }
+      double result() const {
+        switch (op)
+          {
+          case HandleState::av: return r/count;
+          case HandleState::stddev:
+            {
+              double av=r/count;
+              return sqrt(std::max(0.0, sqr/count-av*av));
+            }
+          default: return r;
+          }
+      }
+    };
+  }
+
+  size_t RavelPlan::minParallelWork=1<<20;
+
+  shared_ptr<RavelPlan> RavelPlan::create(const minsky::RavelState& state, const TensorPtr& arg,
+                                          TypedXVectorCache& labels, const ParallelFor& parallelFor)
+  {
+    if (!arg || arg->rank()==0) return nullptr;
+    shared_ptr<RavelPlan> plan(new RavelPlan(arg));
+    plan->parallelFor=parallelFor;
+    auto& ahc=arg->hypercube();
+    auto& xv=ahc.xvectors;
+    auto findAxis=[&](const string& name) {
+      size_t a=0;
+      for (; a<xv.size() && xv[a].name!=name; ++a);
+      return a;
+    };
+
+    set<string> outputHandles(state.outputHandles.begin(), state.outputHandles.end());
+    // action for each axis of arg, and label permutation of output axes
+    enum Action {keep, slice, collapse};
+    vector<Action> actions(xv.size(), keep);
+    vector<size_t> sliceLabels(xv.size());
+    vector<bool> permuted(xv.size());
+    vector<vector<size_t>> permutations(xv.size());
+    vector<size_t> reducedAxes;
+    for (auto& i: state.handleStates)
+      {
+        auto a=findAxis(i.first);
+        if (!outputHandles.count(i.first))
+          {
+            // missing axes, and unknown reductions, are handled by createRavelChain
+            if (a==xv.size() || actions[a]!=keep ||
+                (i.second.collapsed && i.second.reductionOp>HandleState::max))
+              return nullptr;
+            if (i.second.collapsed)
+              {
+                actions[a]=collapse;
+                reducedAxes.push_back(a);
+                plan->reductions.push_back
+                  (Reduction{i.second.reductionOp, 0, xv[a].size()});
+              }
+            else
+              {
+                actions[a]=slice;
+                sliceLabels[a]=sliceIndex(i.second, xv[a], labels);
+              }
+          }
+        else if (i.second.order!=HandleState::none || i.second.displayFilterCaliper)
+          {
+            if (a==xv.size()) return nullptr;
+            permuted[a]=true;
+            permutations[a]=handlePermutation(i.second, xv[a], labels);
+          }
+      }
+
+    // construct the view and the result's hypercube
+    auto& view=plan->view;
+    view=StridedView(ahc.dims());
+    vector<size_t> remaining;
+    for (size_t a=0; a<xv.size(); ++a)
+      if (actions[a]==keep)
+        {
+          remaining.push_back(a);
+          if (permuted[a])
+            view.permuteLabels(a, permutations[a]);
+        }
+    for (size_t a=xv.size(); a-->0;)
+      switch (actions[a])
+        {
+        case slice: view.slice(a, sliceLabels[a]); break;
+        case collapse: view.collapse(a); break;
+        default: break;
+        }
+    for (size_t i=0; i<reducedAxes.size(); ++i)
+      plan->reductions[i].stride=view.stride(reducedAxes[i]);
+
+    // final pivot, as applied by createRavelChain
+    if (remaining.size()>1)
+      {
+        vector<size_t> perm;
+        set<size_t> placed;
+        for (auto& i: state.outputHandles)
+          {
+            size_t j=0;
+            for (; j<remaining.size() && xv[remaining[j]].name!=i; ++j);
+            if (j==remaining.size())
+              throw runtime_error("axis "+i+" not found in argument");
+            perm.push_back(j);
+            placed.insert(j);
+          }
+        for (size_t j=0; j<remaining.size(); ++j)
+          if (!placed.count(j))
+            perm.push_back(j);
+        vector<size_t> pivoted;
+        for (auto j: perm) pivoted.push_back(remaining[j]);
+        remaining.swap(pivoted);
+        view.permuteAxes(perm);
+      }
+    Hypercube hc;
+    for (auto a: remaining)
+      {
+        hc.xvectors.push_back(xv[a]);
+        if (permuted[a])
+          {
+            auto& pxv=hc.xvectors.back();
+            pxv.clear();
+            for (auto i: permutations[a])
+              pxv.push_back(xv[a][i]);
+          }
+      }
+
+    auto& argIndex=arg->index();
+    if (argIndex.empty())
+      {
+        plan->cachedResult.hypercube(move(hc));
+        return plan;
+      }
+
+    // sort the argument's elements by result index, then by labels of
+    // the reduced axes, outermost reduction first
+    vector<pair<size_t,size_t>> keys;
+    vector<size_t> positions;
+    keys.reserve(argIndex.size());
+    positions.reserve(argIndex.size());
+    for (size_t i=0; i<argIndex.size(); ++i)
+      {
+        auto h=argIndex[i];
+        auto r=view.inverse(h);
+        if (r==StridedView::npos) continue;
+        size_t reduced=0, scale=1;
+        for (auto& j: plan->reductions)
+          {
+            reduced+=(h/j.stride%j.size)*scale;
+            scale*=j.size;
+          }
+        keys.emplace_back(r, reduced);
+        positions.push_back(i);
+      }
+    if (keys.empty()) return nullptr;
+    vector<size_t> order(keys.size());
+    for (size_t i=0; i<order.size(); ++i) order[i]=i;
+    if (!is_sorted(keys.begin(), keys.end()))
+      sort(order.begin(), order.end(), [&](size_t i, size_t j) {return keys[i]<keys[j];});
+
+    vector<size_t> index;
+    for (size_t i=0; i<order.size(); ++i)
+      {
+        auto& key=keys[order[i]];
+        if (index.empty() || key.first!=index.back())
+          {
+            index.push_back(key.first);
+            plan->groupStart.push_back(i);
+          }
+        plan->entries.push_back(Entry{positions[order[i]], key.second});
+      }
+    plan->groupStart.push_back(plan->entries.size());
+    plan->cachedResult.index(Index(move(index)));
+    plan->cachedResult.hypercube(move(hc));
+    return plan;
+  }
+
+  double RavelPlan::reduce(const double data[], size_t level, size_t offset) const
+  {
+    if (level==0) return data[offset];
+    auto& red=reductions[level-1];
+    Accumulator acc(red.op);
+    if (level==1)
+      {
+        acc.add(data+offset, red.stride, red.size);
+        return acc.result();
+      }
+    for (size_t j=0; j<red.size; ++j)
+      {
+        double x=reduce(data, level-1, offset+j*red.stride);
+        if (!isnan(x)) acc.add(x);
+      }
+    return acc.result();
+  }
+
+  void RavelPlan::computeDense(const double data[], size_t begin, size_t end) const
+  {
+    size_t offsets[evalBlockSize];
+    for (size_t b=begin; b<end; b+=evalBlockSize)
+      {
+        size_t m=min(evalBlockSize, end-b);
+        view.offsets(offsets, b, m);
+        auto r=&cachedResult[b];
+        if (reductions.empty())
+          for (size_t j=0; j<m; ++j)
+            r[j]=data[offsets[j]];
+        else
+          for (size_t j=0; j<m; ++j)
+            r[j]=reduce(data, reductions.size(), offsets[j]);
+      }
+  }
+
+  void RavelPlan::computeSparse(const double data[], size_t begin, size_t end) const
+  {
+    vector<Accumulator> acc;
+    for (auto& i: reductions) acc.emplace_back(i.op);
+    // lineal index of labels along reduced axes above each level
+    vector<size_t> scale(reductions.size()+1, 1);
+    for (size_t l=0; l<reductions.size(); ++l)
+      scale[l+1]=scale[l]*reductions[l].size;
+    // fold the accumulator of level l into level l+1
+    auto fold=[&](size_t l) {
+      double x=acc[l].result();
+      acc[l].reset();
+      if (!isnan(x)) acc[l+1].add(x);
+    };
+    
+    for (size_t g=begin; g<end; ++g)
+      {
+        auto first=groupStart[g], last=groupStart[g+1];
+        if (reductions.empty())
+          {
+            assert(last==first+1);
+            cachedResult[g]=data[entries[first].pos];
+            continue;
+          }
+        for (auto e=first; e<last; ++e)
+          {
+            if (e>first)
+              {
+                // finalise levels whose outer labels have changed
+                size_t h=reductions.size()-1;
+                for (; h>0 && entries[e].reduced/scale[h]==entries[e-1].reduced/scale[h]; --h);
+                for (size_t l=0; l<h; ++l) fold(l);
+              }
+            double x=data[entries[e].pos];
+            if (!isnan(x)) acc[0].add(x);
+          }
+        for (size_t l=0; l+1<reductions.size(); ++l) fold(l);
+        cachedResult[g]=acc.back().result();
+        acc.back().reset();
+      }
+  }
+  
+  void RavelPlan::computeTensor() const
+  {
+    // argument elements are addressed directly if stored contiguously
+    const double* data;
+    auto val=dynamic_cast<const ITensorVal*>(arg.get());
+    if (val && val->size()==arg->size())
+      data=val->begin();
+    else
+      {
+        argData.resize(arg->size());
+        arg->evalBlock(argData.data(), 0, argData.size());
+        data=argData.data();
+      }
+
+    if (entries.empty())
+      {
+        size_t work=size();
+        for (auto& i: reductions) work*=i.size;
+        split(size(), work, [&](size_t begin, size_t end)
+              {computeDense(data, begin, end);});
+      }
+    else
+      split(groupStart.size()-1, entries.size(), [&](size_t begin, size_t end)
+            {computeSparse(data, begin, end);});
+  }
+
+  void RavelPlan::split(size_t n, size_t work, const std::function<void(size_t,size_t)>& f) const
+  {
+    if (parallelFor && work>=minParallelWork)
+      parallelFor(n, f);
+    else
+      f(0,n);
+  }
+
+  vector<TensorPtr> createFusedRavelChain(const minsky::RavelState& state, const TensorPtr& arg,
+                                          TypedXVectorCache& labels, const ParallelFor& parallelFor)
+  {
+    auto plan=RavelPlan::create(state, arg, labels, parallelFor);
+    if (!plan)
+      return createRavelChain(state, arg, labels);
+    vector<TensorPtr> chain{arg, plan};
+    if (state.sortByValue!=HandleState::none && plan->rank()==1)
+      {
+        auto sortByValue=make_shared<SortByValue>(state.sortByValue);
+        sortByValue->setArgument(plan);
+        chain.push_back(sortByValue);
+      }
+    return chain;
+  }
+}
@@ -0,0 +1,112 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIVITA_RAVELPLAN_H
+#define CIVITA_RAVELPLAN_H
+#include "tensorOp.h"
+#include <functional>
+
+namespace civita
+{
+  /// runs \a f(begin,end) over a partition of [0,n), possibly
+  /// concurrently. Supplied by the application to split up large
+  /// computations.
+  typedef std::function<void(size_t n, const std::function<void(size_t,size_t)>& f)> ParallelFor;
+
+  /// The slices, reductions, axis permutations and final pivot of a
+  /// Ravel chain (see createRavelChain), compiled into a single
+  /// gather/reduce kernel. Each result element is computed directly
+  /// from the argument's data, without passing through intermediate
+  /// tensors, and the result is cached until the argument's
+  /// timestamp changes.
+  class RavelPlan: public CachedTensorOp
+  {
+  public:
+    typedef minsky::RavelState::HandleState::ReductionOp ReductionType;
+    /// compile \a state applied to \a arg, with typed axis labels
+    /// taken from \a labels. Large results are computed with \a
+    /// parallelFor, if supplied.
+    /// @return nullptr if the state cannot be fused, or leaves no
+    /// elements of a sparse argument, in which case createRavelChain
+    /// should be used
+    static std::shared_ptr<RavelPlan> create(const minsky::RavelState& state,
+                                             const TensorPtr& arg,
+                                             TypedXVectorCache& labels,
+                                             const ParallelFor& parallelFor=ParallelFor());
+    void computeTensor() const override;
+    Timestamp timestamp() const override {return arg->timestamp();}
+    /// as the result may be empty
+    size_t size() const override {return ITensor::size();}
+
+    /// minimum number of argument elements visited for the result to
+    /// be computed with parallelFor
+    static size_t minParallelWork;
+
+  private:
+    TensorPtr arg;
+    ParallelFor parallelFor;
+    /// maps result indices to the first argument element reduced over
+    StridedView view;
+    struct Reduction
+    {
+      ReductionType op;
+      size_t stride, size;
+    };
+    /// reductions in order of application, innermost first
+    std::vector<Reduction> reductions;
+    /// @{ sparse argument support. The argument elements contributing
+    /// to result element i are entries [groupStart[i],groupStart[i+1]).
+    /// Entries hold the position of the argument element, and the
+    /// lineal index of its labels along the reduced axes, innermost
+    /// reduction varying fastest
+    struct Entry {size_t pos, reduced;};
+    std::vector<Entry> entries;
+    std::vector<size_t> groupStart;
+    /// @}
+    /// copy of the argument's data, if not directly addressable
+    mutable std::vector<double> argData;
+
+    // ensure the result is computed on first use, even if arg has
+    // a default timestamp
+    RavelPlan(const TensorPtr& arg): arg(arg) {m_timestamp=Timestamp::min();}
+    void computeDense(const double data[], size_t begin, size_t end) const;
+    void computeSparse(const double data[], size_t begin, size_t end) const;
+    double reduce(const double data[], size_t level, size_t offset) const;
+    /// call \a f(begin,end) over [0,n), split with parallelFor if
+    /// \a work is large enough
+    void split(size_t n, size_t work, const std::function<void(size_t,size_t)>& f) const;
+  };
+
+  /// creates a chain of tensor operations equivalent to
+  /// createRavelChain(\a state, \a arg, \a labels), with the slices,
+  /// reductions, permutations and pivot fused into a RavelPlan where
+  /// possible. See RavelPlan::create for \a parallelFor.
+  std::vector<TensorPtr> createFusedRavelChain(const minsky::RavelState& state,
+                                               const TensorPtr& arg,
+                                               TypedXVectorCache& labels,
+                                               const ParallelFor& parallelFor=ParallelFor());
+  inline std::vector<TensorPtr> createFusedRavelChain(const minsky::RavelState& state,
+                                                      const TensorPtr& arg)
+  {
+    TypedXVectorCache labels;
+    return createFusedRavelChain(state, arg, labels);
+  }
+}
+
+#endif
@@ -0,0 +1,244 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stridedView.h"
+#include <algorithm>
+#include <assert.h>
+#include <stdexcept>
+using namespace std;
+
+namespace civita
+{
+  const size_t StridedView::npos, StridedView::collapsed, StridedView::maxFixedRank;
+
+  StridedView::StridedView(const vector<unsigned>& d):
+    dims(d.begin(), d.end()), fixed(d.size(), npos)
+  {
+    size_t stride=1;
+    for (size_t i=0; i<dims.size(); ++i)
+      {
+        strides.push_back(stride);
+        axes.push_back(Axis{i,{}});
+        for (size_t j=0; j<dims[i]; ++j)
+          axes.back().labels.push_back(j);
+        stride*=dims[i];
+      }
+    update();
+  }
+
+  size_t StridedView::size() const
+  {
+    size_t r=1;
+    for (auto& a: axes) r*=a.labels.size();
+    return r;
+  }
+  
+  void StridedView::slice(size_t axis, size_t label)
+  {
+    assert(axis<axes.size());
+    auto& a=axes[axis];
+    if (label>=a.labels.size())
+      throw out_of_range("slice label "+to_string(label)+" out of range");
+    fixed[a.source]=a.labels[label];
+    axes.erase(axes.begin()+axis);
+    update();
+  }
+
+  void StridedView::collapse(size_t axis)
+  {
+    assert(axis<axes.size());
+    fixed[axes[axis].source]=collapsed;
+    axes.erase(axes.begin()+axis);
+    update();
+  }
+
+  void StridedView::permuteAxes(const vector<size_t>& perm)
+  {
+    assert(perm.size()==axes.size());
+    vector<Axis> newAxes;
+    for (auto i: perm)
+      newAxes.push_back(axes[i]);
+    axes.swap(newAxes);
+    update();
+  }
+
+  void StridedView::permuteLabels(size_t axis, const vector<size_t>& perm)
+  {
+    assert(axis<axes.size());
+    auto& labels=axes[axis].labels;
+    vector<size_t> newLabels;
+    for (auto i: perm)
+      newLabels.push_back(labels[i]);
+    labels.swap(newLabels);
+    update();
+  }
+
+  void StridedView::update()
+  {
+    base=0;
+    inverseTables.assign(dims.size(), {});
+    for (size_t i=0; i<dims.size(); ++i)
+      switch (fixed[i])
+        {
+        case npos: // filled in below
+          inverseTables[i].assign(dims[i], npos);
+          break;
+        case collapsed:
+          inverseTables[i].assign(dims[i], 0);
+          break;
+        default:
+          base+=fixed[i]*strides[i];
+          inverseTables[i].assign(dims[i], npos);
+          inverseTables[i][fixed[i]]=0;
+          break;
+        }
+
+    offsetTables.clear();
+    size_t viewStride=1;
+    for (auto& a: axes)
+      {
+        offsetTables.emplace_back();
+        auto& table=offsetTables.back();
+        auto& inverse=inverseTables[a.source];
+        for (size_t j=0; j<a.labels.size(); ++j)
+          {
+            table.push_back(a.labels[j]*strides[a.source]);
+            inverse[a.labels[j]]=j*viewStride;
+          }
+        viewStride*=a.labels.size();
+      }
+  }
+
+  void StridedView::offsets(size_t r[], size_t begin, size_t n) const
+  {
+    if (n==0) return;
+    if (offsetTables.empty())
+      {
+        fill(r, r+n, base);
+        return;
+      }
+    // odometer over the view axes. outer is the offset contributed
+    // by all but the first axis. Views of tensors of modest rank
+    // need no allocation for the odometer
+    size_t fixedLabel[maxFixedRank];
+    vector<size_t> dynamicLabel;
+    size_t* label=fixedLabel;
+    if (offsetTables.size()>maxFixedRank)
+      {
+        dynamicLabel.resize(offsetTables.size());
+        label=dynamicLabel.data();
+      }
+    size_t outer=base, i=begin;
+    for (size_t a=0; a<offsetTables.size(); ++a)
+      {
+        size_t m=offsetTables[a].size();
+        label[a]=i%m;
+        i/=m;
+        if (a>0) outer+=offsetTables[a][label[a]];
+      }
+    auto& first=offsetTables[0];
+    for (size_t j=0, k=label[0];;)
+      {
+        for (; k<first.size() && j<n; ++k, ++j)
+          r[j]=outer+first[k];
+        if (j==n) return;
+        k=0;
+        for (size_t a=1; a<offsetTables.size(); ++a)
+          {
+            auto& t=offsetTables[a];
+            outer-=t[label[a]];
+            if (++label[a]<t.size())
+              {
+                outer+=t[label[a]];
+                break;
+              }
+            label[a]=0;
+            outer+=t[0];
+          }
+      }
+  }
+
+  size_t StridedView::inverse(size_t h) const
+  {
+    size_t r=0;
+    for (size_t i=0; i<dims.size(); ++i)
+      {
+        size_t c=inverseTables[i][h%dims[i]];
+        if (c==npos) return npos;
+        r+=c;
+        h/=dims[i];
+      }
+    return r;
+  }
+
+  void StridedView::sparseIndex(const Index& argIndex, vector<size_t>& index,
+                                vector<size_t>& argPos) const
+  {
+    vector<pair<size_t,size_t>> entries;
+    entries.reserve(argIndex.size());
+    bool sorted=true;
+    for (size_t i=0; i<argIndex.size(); ++i)
+      {
+        auto v=inverse(argIndex[i]);
+        if (v==npos) continue;
+        if (!entries.empty() && v<entries.back().first)
+          sorted=false;
+        entries.emplace_back(v,i);
+      }
+    // slices preserve the order of the argument's index. Pairs are
+    // ordered by position within equal view indices
+    if (!sorted)
+      sort(entries.begin(), entries.end());
+    index.clear(); index.reserve(entries.size());
+    argPos.clear(); argPos.reserve(entries.size());
+    for (auto& i: entries)
+      {
+        index.push_back(i.first);
+        argPos.push_back(i.second);
+      }
+  }
+
+  void evalView(const StridedView& view, const ITensor& arg,
+                double r[], size_t begin, size_t n)
+  {
+    size_t offsets[evalBlockSize];
+    bool dense=arg.index().empty();
+    for (size_t b=0; b<n; b+=evalBlockSize)
+      {
+        size_t m=min(evalBlockSize, n-b);
+        view.offsets(offsets, begin+b, m);
+        double* rb=r+b;
+        if (dense)
+          for (size_t j=0; j<m;)
+            {
+              // find run of contiguous elements
+              size_t k=j+1;
+              while (k<m && offsets[k]==offsets[k-1]+1) ++k;
+              if (k-j>1)
+                arg.evalBlock(rb+j, offsets[j], k-j);
+              else
+                rb[j]=arg[offsets[j]];
+              j=k;
+            }
+        else
+          for (size_t j=0; j<m; ++j)
+            rb[j]=arg.atHCIndex(offsets[j]);
+      }
+  }
+}
@@ -0,0 +1,124 @@
+/*
+  @copyright Russell Standish 2020
+  @author Russell Standish
+  This file is part of Civita.
+
+  Civita is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Civita is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Civita.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CIVITA_STRIDEDVIEW_H
+#define CIVITA_STRIDEDVIEW_H
+#include "tensorInterface.h"
+#include <vector>
+
+namespace civita
+{
+  /// Maps hypercube indices of a view of a tensor (a slice, pivot,
+  /// selection of labels etc) onto hypercube indices of the
+  /// underlying tensor. Each axis of the view selects a sequence of
+  /// labels of an axis of the underlying tensor, and the remaining
+  /// axes of the underlying tensor are fixed at a single label, or
+  /// collapsed. Offset tables are precomputed when the view is
+  /// constructed, so that mapping an index requires no allocation.
+  class StridedView
+  {
+  public:
+    static const size_t npos=~size_t(0);
+
+    StridedView() {}
+    /// identity view of a tensor of dimensions \a dims
+    explicit StridedView(const std::vector<unsigned>& dims);
+
+    size_t rank() const {return axes.size();}
+    /// number of elements of the view
+    size_t size() const;
+    /// stride of axis \a axis of the underlying tensor
+    size_t stride(size_t axis) const {return strides[axis];}
+
+    /// @{ view transformations. Axis numbers refer to the axes of
+    /// the view, prior to the transformation
+    /// remove \a axis, fixing it at label \a label
+    /// @throw std::out_of_range if \a label is not a label of \a axis
+    void slice(size_t axis, size_t label);
+    /// remove \a axis, such that all labels along it map to the
+    /// same element of the view. Used for reductions, the collapsed
+    /// axis taking its first label in the forward map
+    void collapse(size_t axis);
+    /// reorder axes, such that axis i becomes the current axis \a perm[i]
+    void permuteAxes(const std::vector<size_t>& perm);
+    /// select labels along \a axis, such that label i becomes the
+    /// current label \a perm[i]
+    void permuteLabels(size_t axis, const std::vector<size_t>& perm);
+    /// @}
+
+    /// underlying hypercube index of view hypercube index \a i
+    size_t operator()(size_t i) const {
+      size_t r=base;
+      for (auto& t: offsetTables)
+        {
+          size_t n=t.size();
+          r+=t[i%n];
+          i/=n;
+        }
+      return r;
+    }
+    /// underlying hypercube indices of view elements [\a begin, \a
+    /// begin+\a n), computed incrementally
+    void offsets(size_t r[], size_t begin, size_t n) const;
+    /// view hypercube index of underlying hypercube index \a h
+    /// @return npos if \a h is not within the view
+    size_t inverse(size_t h) const;
+    /// sparse index of the view of a tensor with index \a
+    /// argIndex. On return, \a index contains the sorted view
+    /// hypercube indices of the elements present in the view, and \a
+    /// argPos their corresponding positions within \a argIndex. Where
+    /// axes are collapsed, elements mapping to the same view index
+    /// are all returned, ordered by position.
+    void sparseIndex(const Index& argIndex, std::vector<size_t>& index,
+                     std::vector<size_t>& argPos) const;
+
+  private:
+    struct Axis
+    {
+      size_t source; ///< axis of the underlying tensor
+      std::vector<size_t> labels; ///< selected labels of the source axis
+    };
+    std::vector<Axis> axes;
+    /// dimensions and strides of the underlying tensor
+    std::vector<size_t> dims, strides;
+    /// label of each underlying axis not in the view, npos for
+    /// those in the view, or collapsed
+    std::vector<size_t> fixed;
+    static const size_t collapsed=npos-1;
+    /// largest view rank handled by offsets() without allocation
+    static const size_t maxFixedRank=16;
+
+    /// @{ derived tables, computed by update()
+    size_t base=0;
+    /// underlying offset of each label of each view axis
+    std::vector<std::vector<size_t>> offsetTables;
+    /// view offset of each label of each underlying axis, or npos
+    std::vector<std::vector<size_t>> inverseTables;
+    /// @}
+    void update();
+  };
+
+  /// evaluate elements [\a begin, \a begin+\a n) of \a view over \a
+  /// arg into \a r. Runs of contiguous elements of a dense \a arg are
+  /// evaluated by arg.evalBlock().
+  void evalView(const StridedView& view, const ITensor& arg,
+                double r[], size_t begin, size_t n);
+}
+
+#endif
@@ -33,6 +33,11 @@ namespace civita
   class ITensor;
   using TensorPtr=std::shared_ptr<ITensor>;
 
+  /// number of elements evaluated at a time by block evaluations
+  /// requiring scratch storage. Sized for the working set of an
+  /// expression tree to remain in cache
+  const size_t evalBlockSize=256;
+
   class ITensor
   {
   public:
@@ -68,6 +73,12 @@ namespace civita
     virtual const Index& index() const {return m_index;}
     /// return or compute data at a location
     virtual double operator[](size_t) const=0;
+    /// compute elements [\a begin, \a begin+\a n) into \a r, which
+    /// must not alias this tensor's data. Equivalent to calling
+    /// operator[] for each element, but overridden by expression
+    /// nodes to evaluate a whole block without per element indirect calls
+    virtual void evalBlock(double r[], size_t begin, size_t n) const
+    {for (size_t j=0; j<n; ++j) r[j]=(*this)[begin+j];}
     /// return number of elements in tensor - maybe less than hypercube.numElements if sparse
     virtual size_t size() const {
       size_t s=index().size();
@@ -99,6 +110,11 @@ namespace civita
     /// be. Used in CachedTensorOp to determine when to invalidate the
     /// cache
     virtual Timestamp timestamp() const=0;
+    /// offset of the first element that may have changed since \a t,
+    /// or size() if none. Allows cached results to be extended
+    /// incrementally when data is appended.
+    virtual size_t firstChangedSince(Timestamp t) const
+    {return timestamp()>t? 0: size();}
 
     /// arguments relevant for tensor expressions, not always meaningful. Exception thrown if not.
     virtual void setArgument(const TensorPtr&, const std::string& dimension={},
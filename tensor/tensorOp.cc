@@ -19,12 +19,78 @@
 
 #include "tensorOp.h"
 #include <exception>
+#include <iterator>
 #include <set>
 #include <ecolab_epilogue.h>
 using namespace std;
 
 namespace civita
 {
+  bool elementwiseIndex(const vector<TensorPtr>& args, const Hypercube& hc, Index& index)
+  {
+    vector<size_t> merged, tmp;
+    bool sparse=false;
+    for (auto& a: args)
+      if (a && !a->index().empty())
+        {
+          sparse=true;
+          tmp.clear();
+          tmp.reserve(merged.size()+a->index().size());
+          set_union(merged.begin(), merged.end(), a->index().begin(), a->index().end(),
+                    back_inserter(tmp));
+          merged.swap(tmp);
+        }
+    if (sparse && merged.size()>=denseFillRatio*hc.numElements())
+      {
+        index.clear();
+        return true;
+      }
+    index=Index(move(merged));
+    return false;
+  }
+
+  void mergeJoin(const ITensor& a, const Index& idx, double r[], size_t begin, size_t n,
+                 bool present[])
+  {
+    auto& ai=a.index();
+    if (ai.empty())
+      {
+        if (idx.empty())
+          a.evalBlock(r, begin, n);
+        else
+          for (size_t j=0; j<n; ++j)
+            r[j]=a[idx[begin+j]];
+        return;
+      }
+    if (n==0) return;
+    // position in ai of the first entry not preceding the block
+    size_t p=lower_bound(ai.begin(), ai.end(), idx[begin])-ai.begin();
+    double x[evalBlockSize];
+    for (size_t b=0; b<n; b+=evalBlockSize)
+      {
+        size_t m=min(evalBlockSize, n-b);
+        // entries of a within this chunk are at [p,q)
+        size_t last=idx[begin+b+m-1], q=p;
+        while (q<ai.size() && ai[q]<=last) ++q;
+        bool blocked=q-p<=evalBlockSize;
+        if (blocked) a.evalBlock(x, p, q-p);
+        for (size_t j=0, k=p; j<m; ++j)
+          {
+            size_t h=idx[begin+b+j];
+            while (k<q && ai[k]<h) ++k;
+            if (k<q && ai[k]==h)
+              {
+                r[b+j]=blocked? x[k-p]: a[k];
+                if (present) present[b+j]=true;
+                ++k;
+              }
+            else
+              r[b+j]=nan("");
+          }
+        p=q;
+      }
+  }
+
   void BinOp::setArguments(const TensorPtr& a1, const TensorPtr& a2)
   {
     arg1=a1; arg2=a2;
@@ -37,29 +103,23 @@ namespace civita
       }
     else if (arg2)
       hypercube(arg2->hypercube());
-    set<size_t> indices;
-    if (arg1) indices.insert(arg1->index().begin(), arg1->index().end());
-    if (arg2) indices.insert(arg2->index().begin(), arg2->index().end());
-    m_index=indices;
+    masked=elementwiseIndex({arg1,arg2}, hypercube(), m_index);
   }
 
 
   void ReduceArguments::setArguments(const vector<TensorPtr>& a,const std::string&,double)
   {
     hypercube({});
+    m_index.clear();
+    masked=false;
     if (!a.empty())
       {
         auto hc=a[0]->hypercube();
         hypercube(hc);
-        size_t cnt=0;
-        set<size_t> idx;
         for (auto& i: a)
-          {
-            if (i->rank()>0 && i->hypercube()!=hc)
-              throw runtime_error("arguments not conformal");
-            idx.insert(i->index().begin(), i->index().end());
-          }
-        m_index=idx;
+          if (i->rank()>0 && i->hypercube()!=hc)
+            throw runtime_error("arguments not conformal");
+        masked=elementwiseIndex(a, hc, m_index);
       }
     args=a;
   }
@@ -68,12 +128,8 @@ namespace civita
   {
     if (args.empty()) return init;
     assert(i<size());
-    double r=init; 
-    for (auto j: args)
-      {
-        auto x=j->rank()==0? (*j)[0]: (*j)[i];
-        if (!isnan(x)) f(r, x);
-      }
+    double r;
+    evalBlockWith(f,&r,i,1);
     return r;
   }
 
@@ -88,10 +144,13 @@ namespace civita
   double ReduceAllOp::operator[](size_t) const
   {
     double r=init;
-    for (size_t i=0; i<arg->size(); ++i)
+    double x[evalBlockSize];
+    for (size_t i=0; i<arg->size(); i+=evalBlockSize)
       {
-        double x=(*arg)[i];
-        if (!isnan(x)) f(r,x,i);
+        size_t m=min(evalBlockSize, arg->size()-i);
+        arg->evalBlock(x, i, m);
+        for (size_t j=0; j<m; ++j)
+          if (!isnan(x[j])) f(r,x[j],i+j);
       }
     return r;
   }
@@ -108,21 +167,32 @@ namespace civita
         for (auto i=xv.begin(); i!=xv.end(); ++i)
           if (i->name==dimName)
             dimension=i-xv.begin();
+        m_index.clear();
+        sumOverIndices.clear();
+        sumOverStart.clear();
         if (dimension<arg->rank())
           {
             xv.erase(xv.begin()+dimension);
+            view=StridedView(arg->shape());
+            view.collapse(dimension);
+            reductionStride=view.stride(dimension);
+            reductionSize=ahc.xvectors[dimension].size();
             // compute index - enter index elements that have any in the argument
-            set<size_t> indices;
-            for (size_t i=0; i<arg->size(); ++i)
+            vector<size_t> idx, argPos, indices;
+            auto& argIndex=arg->index();
+            view.sparseIndex(argIndex, idx, argPos);
+            for (size_t i=0; i<idx.size(); ++i)
               {
-                auto splitIdx=ahc.splitIndex(arg->index()[i]);
-                SOI soi{i,splitIdx[dimension]};
-                splitIdx.erase(splitIdx.begin()+dimension);
-                auto idx=m_hypercube.linealIndex(splitIdx);
-                sumOverIndices[idx].emplace_back(soi);
-                indices.insert(idx);
+                if (indices.empty() || idx[i]!=indices.back())
+                  {
+                    indices.push_back(idx[i]);
+                    sumOverStart.push_back(i);
+                  }
+                sumOverIndices.push_back
+                  (SOI{argPos[i], argIndex[argPos[i]]/reductionStride%reductionSize});
               }
-            m_index=indices;
+            sumOverStart.push_back(idx.size());
+            m_index=Index(move(indices));
           }
         else
           m_hypercube.xvectors.clear(); //reduce all, return scalar
@@ -142,30 +212,20 @@ namespace civita
         double r=init;
         if (index().empty())
           {
-            auto argDims=arg->shape();
-            size_t stride=1;
-            for (size_t j=0; j<dimension; ++j)
-              stride*=argDims[j];
-            auto quotRem=ldiv(i, stride); // quotient and remainder calc in one hit
-            auto start=quotRem.quot*stride*argDims[dimension] + quotRem.rem;
-            assert(stride*argDims[dimension]>0);
-            for (size_t j=0; j<argDims[dimension]; ++j)
+            auto start=view(i);
+            for (size_t j=0; j<reductionSize; ++j)
               {
-                double x=arg->atHCIndex(j*stride+start);
+                double x=arg->atHCIndex(j*reductionStride+start);
                 if (!isnan(x)) f(r,x,j);
               }
           }
         else
-          {
-            auto soi=sumOverIndices.find(index()[i]);
-            assert(soi!=sumOverIndices.end());
-            if (soi!=sumOverIndices.end())
-              for (auto j: soi->second)
-                {
-                  double x=(*arg)[j.index];
-                  if (!isnan(x)) f(r,x,j.dimIndex);
-                }
-          }
+          for (size_t j=sumOverStart[i]; j<sumOverStart[i+1]; ++j)
+            {
+              auto& soi=sumOverIndices[j];
+              double x=(*arg)[soi.index];
+              if (!isnan(x)) f(r,x,soi.dimIndex);
+            }
         return r;
       }
   }
@@ -180,6 +240,16 @@ namespace civita
     return cachedResult[i];
   }
 
+  void CachedTensorOp::evalBlock(double r[], size_t begin, size_t n) const
+  {
+    assert(begin+n<=size());
+    if (m_timestamp<timestamp()) {
+      computeTensor();
+      m_timestamp=Timestamp::clock::now();
+    }
+    cachedResult.evalBlock(r, begin, n);
+  }
+
   void DimensionedArgCachedOp::setArgument(const TensorPtr& a, const std::string& dimName, double av)
   {
     arg=a;
@@ -197,99 +267,79 @@ namespace civita
   
   void Scan::computeTensor() const
   {
+    size_t n=hypercube().numElements(), stride=1, dimSize=n;
+    // argVal is interpreted as the binning window. -ve argVal ignored
+    bool windowed=false;
     if (dimension<rank())
       {
         auto argDims=arg->hypercube().dims();
-        size_t stride=1;
         for (size_t j=0; j<dimension; ++j)
           stride*=argDims[j];
-        if (argVal>=1 && argVal<argDims[dimension])
-          // argVal is interpreted as the binning window. -ve argVal ignored
-          for (size_t i=0; i<hypercube().numElements(); i+=stride*argDims[dimension])
-            for (size_t j=0; j<stride; ++j)
-              for (size_t j1=0; j1<argDims[dimension]*stride; j1+=stride)
-                {
-                  size_t k=i+j+max(ssize_t(0), ssize_t(j1-ssize_t(argVal-1)*stride));
-                  cachedResult[i+j+j1]=arg->atHCIndex(i+j+j1);
-                  for (; k<i+j+j1; k+=stride)
-                    {
-                      f(cachedResult[i+j+j1], arg->atHCIndex(k), k);
-                    }
+        dimSize=argDims[dimension];
+        windowed=argVal>=1 && argVal<dimSize;
+      }
+
+    if (n==0) return;
+    bool dense=arg->index().empty();
+    // offset of the first argument element that may have changed
+    // since the cached result was computed
+    size_t changed=0;
+    if (argValues.size()==n && dense)
+      changed=arg->firstChangedSince(m_timestamp);
+    else
+      argValues.resize(n);
+    if (changed>=n) return;
+    if (dense)
+      arg->evalBlock(argValues.data()+changed, changed, n-changed);
+    else
+      for (size_t i=0; i<n; ++i)
+        argValues[i]=arg->atHCIndex(i);
+
+    // elements before the changed position along the scanned
+    // dimension within its block, and all preceding blocks, are
+    // unaffected
+    size_t block=stride*dimSize, start=changed/block*block;
+    for (size_t i=start; i<n; i+=block)
+      for (size_t j=0; j<stride; ++j)
+        for (size_t p=i==start? changed/stride%dimSize: 0; p<dimSize; ++p)
+          {
+            size_t k=i+j+p*stride;
+            if (windowed)
+              {
+                cachedResult[k]=argValues[k];
+                for (size_t l=i+j+max(ssize_t(0), ssize_t(p*stride-ssize_t(argVal-1)*stride)); l<k; l+=stride)
+                  f(cachedResult[k], argValues[l], l);
               }
-        else // scan over whole dimension
-          for (size_t i=0; i<hypercube().numElements(); i+=stride*argDims[dimension])
-            for (size_t j=0; j<stride; ++j)
+            else if (p==0)
+              cachedResult[k]=argValues[k];
+            else
               {
-                cachedResult[i+j]=arg->atHCIndex(i+j);
-                for (size_t k=i+j+stride; k<i+j+stride*argDims[dimension]; k+=stride)
-                  {
-                    cachedResult[k] = cachedResult[k-stride];
-                    f(cachedResult[k], arg->atHCIndex(k), k);
-                  }
+                cachedResult[k]=cachedResult[k-stride];
+                f(cachedResult[k], argValues[k], k);
               }
           }
-    else
-      {
-        cachedResult[0]=arg->atHCIndex(0);
-        for (size_t i=1; i<hypercube().numElements(); ++i)
-          {
-            cachedResult[i]=cachedResult[i-1];
-            f(cachedResult[i], arg->atHCIndex(i), i);
-          }
-      }
   }
 
   void Slice::setArgument(const TensorPtr& a,const string& axis, double index)
   {
     arg=a;
-    sliceIndex=index;
     if (arg)
       {
         auto& xv=arg->hypercube().xvectors;
         Hypercube hc;
+        view=StridedView(arg->shape());
         // find axis where slicing along
-        split=1;
-        size_t splitAxis=0;
-        auto i=xv.begin();
-        for (; i!=xv.end(); ++i)
-          if (i->name==axis)
-            {
-              stride=split*i->size();
-              break;
-            }
+        for (size_t i=0; i<xv.size(); ++i)
+          if (xv[i].name==axis && view.rank()==xv.size())
+            view.slice(i, index>=0? size_t(index): StridedView::npos);
           else
-            {
-              hc.xvectors.push_back(*i);
-              split*=i->size();
-              splitAxis++;
-            }
-
-        if (i==xv.end())
-          split=stride=1;
-        else
-          for (i++; i!=xv.end(); ++i)
-            // finish building hypercube
-            hc.xvectors.push_back(*i);
-        hypercube(hc);
+            hc.xvectors.push_back(xv[i]);
+        hypercube(move(hc));
 
         // set up index vector
-        auto& ahc=arg->hypercube();
-        map<size_t, size_t> ai;
-        for (size_t i=0; i<arg->index().size(); ++i)
-          {
-            auto splitIdx=ahc.splitIndex(arg->index()[i]);
-            if (splitIdx[splitAxis]==sliceIndex)
-              {
-                splitIdx.erase(splitIdx.begin()+splitAxis);
-                auto l=hc.linealIndex(splitIdx);
-                ai[l]=i;
-              }
-          }
-        m_index=ai;
-        arg_index.resize(ai.size());
-        // convert into lineal addressing
-        size_t j=0;
-        for (auto& i: ai) arg_index[j++]=i.second;
+        vector<size_t> indices;
+        view.sparseIndex(arg->index(), indices, arg_index);
+        m_index=Index(move(indices));
       }
   }
 
@@ -297,13 +347,20 @@ namespace civita
   {
     assert(i<size());
     if (m_index.empty())
-      {
-        auto res=div(ssize_t(i), ssize_t(split));
-        return arg->atHCIndex(res.quot*stride + sliceIndex*split + res.rem);
-      }
+      return arg->atHCIndex(view(i));
     else
       return (*arg)[arg_index[i]];
   }
+
+  void Slice::evalBlock(double r[], size_t begin, size_t n) const
+  {
+    assert(begin+n<=size());
+    if (m_index.empty())
+      evalView(view, *arg, r, begin, n);
+    else
+      for (size_t j=0; j<n; ++j)
+        r[j]=(*arg)[arg_index[begin+j]];
+  }
   
   void Pivot::setArgument(const TensorPtr& a,const std::string&,double)
   {
@@ -326,16 +383,14 @@ namespace civita
         xVectorMap[ahc.xvectors[i].name]=ahc.xvectors[i];
       }
     Hypercube hc;
-    permutation.clear();
+    vector<size_t> permutation;
     set<string> axisSet;
-    map<size_t, size_t> invPermutation;
     for (auto& i: axes)
       {
         axisSet.insert(i);
         auto v=pMap.find(i);
         if (v==pMap.end())
           throw runtime_error("axis "+i+" not found in argument");
-        invPermutation[v->second]=permutation.size();
         permutation.push_back(v->second);
         hc.xvectors.push_back(xVectorMap[i]);
       }
@@ -349,43 +404,33 @@ namespace civita
 
     assert(hc.rank()==arg->rank());
     hypercube(move(hc));
+    view=StridedView(ahc.dims());
+    view.permuteAxes(permutation);
     // permute the index vector
-    map<size_t, size_t> pi;
-    for (size_t i=0; i<arg->index().size(); ++i)
-      {
-        auto idx=arg->hypercube().splitIndex(arg->index()[i]);
-        auto pidx=idx;
-        for (size_t j=0; j<idx.size(); ++j)
-          pidx[invPermutation[j]]=idx[j];
-        auto l=hypercube().linealIndex(pidx);
-        assert(pi.count(l)==0);
-        pi[l]=i;
-      }
-    m_index=pi;
-    // convert to lineal indexing
-    permutedIndex.clear();
-    for (auto& i: pi) permutedIndex.push_back(i.second);
-    if (permutedIndex.size()) permutation.clear(); // not used in sparse case
-  }
-
-  size_t Pivot::pivotIndex(size_t i) const
-  {
-    auto idx=hypercube().splitIndex(i);
-    auto pidx=idx;
-    for (size_t i=0; i<idx.size(); ++i)
-      pidx[permutation[i]]=idx[i];
-    return arg->hypercube().linealIndex(pidx);
+    vector<size_t> indices;
+    view.sparseIndex(arg->index(), indices, permutedIndex);
+    m_index=Index(move(indices));
   }
 
   double Pivot::operator[](size_t i) const
   {
     assert(i<size());
     if (index().empty())
-      return arg->atHCIndex(pivotIndex(i));
+      return arg->atHCIndex(view(i));
     else
       return (*arg)[permutedIndex[i]];
   }
 
+  void Pivot::evalBlock(double r[], size_t begin, size_t n) const
+  {
+    assert(begin+n<=size());
+    if (index().empty())
+      evalView(view, *arg, r, begin, n);
+    else
+      for (size_t j=0; j<n; ++j)
+        r[j]=(*arg)[permutedIndex[begin+j]];
+  }
+
   
   namespace
   {
@@ -409,14 +454,15 @@ namespace civita
   {
     arg=a;
     hypercube(arg->hypercube());
-    m_index=arg->index();
     for (m_axis=0; m_axis<m_hypercube.xvectors.size(); ++m_axis)
       if (m_hypercube.xvectors[m_axis].name==axisName)
         break;
     if (m_axis==m_hypercube.xvectors.size())
       throw runtime_error("axis "+axisName+" not found");
+    vector<size_t> identity;
     for (size_t i=0; i<m_hypercube.xvectors[m_axis].size(); ++i)
-      m_permutation.push_back(i);
+      identity.push_back(i);
+    setPermutation(move(identity));
   }
 
   void PermuteAxis::setPermutation(vector<size_t>&& p)
@@ -427,44 +473,40 @@ namespace civita
     auto& axv=arg->hypercube().xvectors[m_axis];
     for (auto i: m_permutation)
       xv.push_back(axv[i]);
-    vector<unsigned> reverseIndex(axv.size(),axv.size());
-    for (size_t i=0; i<m_permutation.size(); ++i)
-      reverseIndex[m_permutation[i]]=i;
-    map<size_t,size_t> indices;
-    for (size_t i=0; i<arg->index().size(); ++i)
-      {
-        auto splitted=arg->hypercube().splitIndex(arg->index()[i]);
-        if ((splitted[m_axis]=reverseIndex[splitted[m_axis]])<axv.size())
-          indices[hypercube().linealIndex(splitted)]=i;
-      }
-    m_index=indices;
-    permutedIndex.clear();
-    for (auto& i: indices) permutedIndex.push_back(i.second);
+    view=StridedView(arg->shape());
+    view.permuteLabels(m_axis, m_permutation);
+    vector<size_t> indices;
+    view.sparseIndex(arg->index(), indices, permutedIndex);
+    m_index=Index(move(indices));
   }
   
   double PermuteAxis::operator[](size_t i) const
   {
     assert(i<size());
     if (index().empty())
-      {
-        auto splitted=hypercube().splitIndex(i);
-        splitted[m_axis]=m_permutation[splitted[m_axis]];
-        return arg->atHCIndex(arg->hypercube().linealIndex(splitted));
-      }
+      return arg->atHCIndex(view(i));
     return (*arg)[permutedIndex[i]];
   }
 
+  void PermuteAxis::evalBlock(double r[], size_t begin, size_t n) const
+  {
+    assert(begin+n<=size());
+    if (index().empty())
+      evalView(view, *arg, r, begin, n);
+    else
+      for (size_t j=0; j<n; ++j)
+        r[j]=(*arg)[permutedIndex[begin+j]];
+  }
+
 
   void SortByValue::computeTensor() const 
   {
     assert(arg->rank()==1);
     vector<size_t> idx; idx.reserve(arg->size());
-    vector<double> tmp;
+    vector<double> tmp(arg->size());
+    arg->evalBlock(tmp.data(), 0, tmp.size());
     for (size_t i=0; i<arg->size(); ++i)
-      {
-        idx.push_back(i);
-        tmp.push_back((*arg)[i]);
-      }
+      idx.push_back(i);
     switch (order)
       {
       case minsky::RavelState::HandleState::forward:
@@ -488,7 +530,71 @@ namespace civita
   }
 
   
-  vector<TensorPtr> createRavelChain(const minsky::RavelState& state, const TensorPtr& arg)
+  size_t sliceIndex(const minsky::RavelState::HandleState& hs, const XVector& xv,
+                    TypedXVectorCache& labels)
+  {
+    auto sliceIdx=labels[xv].find(hs.sliceLabel, xv.dimension.units);
+    return sliceIdx!=TypedXVector::npos? sliceIdx: 0;
+  }
+
+  vector<size_t> handlePermutation(const minsky::RavelState::HandleState& hs, const XVector& xv,
+                                   TypedXVectorCache& typedLabels)
+  {
+    auto& labels=typedLabels[xv];
+    vector<size_t> perm;
+    for (size_t i=0; i<xv.size(); ++i)
+      perm.push_back(i);
+    switch (hs.order)
+      {
+      case minsky::RavelState::HandleState::none: break;
+      case minsky::RavelState::HandleState::forward:
+        sort(perm.begin(), perm.end(),
+             [&](size_t i, size_t j) {return labels.less(i,j);});
+        break;
+      case minsky::RavelState::HandleState::reverse:
+        sort(perm.begin(), perm.end(),
+             [&](size_t i, size_t j) {return labels.less(j,i);});
+        break;
+      case minsky::RavelState::HandleState::custom:
+        {
+          auto l=labels.labels(xv.dimension.units);
+          unordered_map<string, size_t> offsets;
+          for (size_t i=0; i<l.size(); ++i)
+            offsets[l[i]]=i;
+          perm.clear();
+          for (auto& j: hs.customOrder)
+            {
+              auto k=offsets.find(j);
+              if (k!=offsets.end())
+                perm.push_back(k->second);
+            }
+          break;
+        }
+      }
+    // remove any permutation items outside calipers
+    if (!hs.minLabel.empty() || !hs.maxLabel.empty())
+      {
+        auto l=labels.labels(xv.dimension.units);
+        if (!hs.minLabel.empty())
+          for (auto j=perm.begin(); j!=perm.end(); ++j)
+            if (l[*j] == hs.minLabel)
+              {
+                perm.erase(perm.begin(), j);
+                break;
+              }
+        if (!hs.maxLabel.empty())
+          for (auto j=perm.begin(); j!=perm.end(); ++j)
+            if (l[*j] == hs.maxLabel)
+              {
+                perm.erase(j+1, perm.end());
+                break;
+              }
+      }
+    return perm;
+  }
+
+  vector<TensorPtr> createRavelChain(const minsky::RavelState& state, const TensorPtr& arg,
+                                     TypedXVectorCache& labels)
   {
     set<string> outputHandles(state.outputHandles.begin(), state.outputHandles.end());
     vector<TensorPtr> chain{arg};
@@ -509,13 +615,7 @@ namespace civita
               auto axisIt=find_if(xv.begin(), xv.end(),
                                   [&](const XVector& j){return j.name==i.first;});
               if (axisIt==xv.end()) throw runtime_error("axis "+i.first+" not found");
-              auto sliceIt=find_if(axisIt->begin(), axisIt->end(),
-                                   [&](const boost::any& j){return str(j,axisIt->dimension.units)==i.second.sliceLabel;});
-              // determine slice index
-              size_t sliceIdx=0;
-              if (sliceIt!=axisIt->end())
-                sliceIdx=sliceIt-axisIt->begin();
-              chain.back()->setArgument(arg, i.first, sliceIdx);
+              chain.back()->setArgument(arg, i.first, sliceIndex(i.second, *axisIt, labels));
             }
         }
       else if (i.second.order!=minsky::RavelState::HandleState::none || i.second.displayFilterCaliper)
@@ -524,47 +624,7 @@ namespace civita
           auto permuteAxis=make_shared<PermuteAxis>();
           permuteAxis->setArgument(chain.back(), i.first);
           auto& xv=chain.back()->hypercube().xvectors[permuteAxis->axis()];
-          vector<size_t> perm;
-          for (size_t i=0; i<xv.size(); ++i)
-            perm.push_back(i);
-          switch (i.second.order)
-            {
-            case minsky::RavelState::HandleState::none: break;
-            case minsky::RavelState::HandleState::forward:
-              sort(perm.begin(), perm.end(),
-                   [&](size_t i, size_t j) {return diff(xv[i],xv[j])<0;});
-              break;
-            case minsky::RavelState::HandleState::reverse:
-              sort(perm.begin(), perm.end(),
-                   [&](size_t i, size_t j) {return diff(xv[i],xv[j])>0;});
-              break;
-            case minsky::RavelState::HandleState::custom:
-              {
-                map<string, size_t> offsets;
-                for (size_t i=0; i<xv.size(); ++i)
-                  offsets[str(xv[i], xv.dimension.units)]=i;
-                perm.clear();
-                for (auto& j: i.second.customOrder)
-                  if (offsets.count(j))
-                    perm.push_back(offsets[j]);
-                break;
-              }
-            }
-          // remove any permutation items outside calipers
-          if (!i.second.minLabel.empty())
-            for (auto j=perm.begin(); j!=perm.end(); ++j)
-              if (str(xv[*j],xv.dimension.units) == i.second.minLabel)
-                {
-                  perm.erase(perm.begin(), j);
-                  break;
-                }
-          if (!i.second.maxLabel.empty())
-            for (auto j=perm.begin(); j!=perm.end(); ++j)
-              if (str(xv[*j],xv.dimension.units) == i.second.maxLabel)
-                {
-                  perm.erase(j+1, perm.end());
-                  break;
-                }
+          auto perm=handlePermutation(i.second, xv, labels);
           permuteAxis->setPermutation(move(perm));
           chain.push_back(permuteAxis);
         }
@@ -20,8 +20,11 @@
 #ifndef CIVITA_TENSOROP_H
 #define CIVITA_TENSOROP_H
 #include "tensorVal.h"
+#include "stridedView.h"
 #include "ravelState.h"
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -40,10 +43,46 @@ namespace civita
     const Hypercube& hypercube() const override {return arg? arg->hypercube(): m_hypercube;}
     const Index& index() const override {return arg? arg->index(): m_index;}
     double operator[](size_t i) const override {return arg? f((*arg)[i]): 0;}
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {evalBlockWith(f,r,begin,n);}
     size_t size() const override {return arg? arg->size(): 1;}
     Timestamp timestamp() const override {return arg? arg->timestamp(): Timestamp();}
+  protected:
+    /// block evaluation applying \a g, which must compute the same
+    /// function as f. Derived classes pass a directly callable \a g
+    /// to avoid the std::function call per element.
+    template <class G>
+    void evalBlockWith(const G& g, double r[], size_t begin, size_t n) const
+    {
+      if (!arg)
+        {
+          std::fill(r, r+n, 0.0);
+          return;
+        }
+      arg->evalBlock(r, begin, n);
+      for (size_t j=0; j<n; ++j) r[j]=g(r[j]);
+    }
   };
 
+  /// elementwise results whose sparse arguments fill at least this
+  /// fraction of the hypercube are stored densely
+  const double denseFillRatio=0.5;
+
+  /// union of the indices of the sparse arguments in \a args, as
+  /// the index of an elementwise result over \a hc. If the union is
+  /// dense enough, \a index is left empty.
+  /// @return true if the result is stored densely, but has sparse
+  /// arguments, so elements absent from all of them are missing
+  bool elementwiseIndex(const std::vector<TensorPtr>& args, const Hypercube& hc, Index& index);
+
+  /// gather elements of \a a at hypercube indices idx[begin]
+  /// ... idx[begin+n-1] (which must be increasing) into \a r, merge
+  /// joining with a's index. Elements absent from \a a are NaN. If
+  /// \a a is sparse, and \a present is not null, present[j] is set
+  /// for elements present in \a a.
+  void mergeJoin(const ITensor& a, const Index& idx, double r[], size_t begin, size_t n,
+                 bool present[]=nullptr);
+  
   /// perform a binary operation elementwise over two tensor arguments.
   /// Arguments need to be conformal: at least one must be a scalar, or both arguments have the same shape
   class BinOp: public ITensor
@@ -58,16 +97,72 @@ namespace civita
     
     void setArguments(const TensorPtr& a1, const TensorPtr& a2) override;
 
-    // TODO merge indices
     double operator[](size_t i) const override {
-      auto hcIndex=index()[i];
-      // scalars are broadcast
-      return f(arg1->rank()? arg1->atHCIndex(hcIndex): (*arg1)[0],
-               arg2->rank()? arg2->atHCIndex(hcIndex): (*arg2)[0]);
+      double r;
+      evalBlockWith(f,&r,i,1);
+      return r;
+    }
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {evalBlockWith(f,r,begin,n);}
+    size_t size() const override {
+      if (!index().empty() || masked) return ITensor::size();
+      return arg1 && arg1->size()>1? arg1->size(): (arg2? arg2->size(): 0);
     }
-    size_t size() const override {return arg1 && arg1->size()>1? arg1->size(): (arg2? arg2->size(): 0);}
     Timestamp timestamp() const override
     {return max(arg1->timestamp(), arg2->timestamp());}
+  protected:
+    /// dense result of sparse arguments, see elementwiseIndex()
+    bool masked=false;
+    
+    /// block evaluation applying \a g, which must compute the same
+    /// function as f. Arguments are evaluated a block at a time, and
+    /// sparse arguments merge joined with the result's index.
+    template <class G>
+    void evalBlockWith(const G& g, double r[], size_t begin, size_t n) const
+    {
+      if (!index().empty() || masked)
+        {
+          double x[evalBlockSize], y[evalBlockSize];
+          bool present[evalBlockSize];
+          for (size_t b=0; b<n; b+=evalBlockSize)
+            {
+              size_t m=std::min(evalBlockSize, n-b);
+              std::fill(present, present+m, false);
+              // scalars are broadcast
+              if (arg1->rank())
+                mergeJoin(*arg1, index(), x, begin+b, m, present);
+              else
+                std::fill(x, x+m, (*arg1)[0]);
+              if (arg2->rank())
+                mergeJoin(*arg2, index(), y, begin+b, m, present);
+              else
+                std::fill(y, y+m, (*arg2)[0]);
+              for (size_t j=0; j<m; ++j)
+                r[b+j]=masked && !present[j]? std::nan(""): g(x[j],y[j]);
+            }
+          return;
+        }
+      double y[evalBlockSize];
+      for (size_t b=0; b<n; b+=evalBlockSize)
+        {
+          size_t m=std::min(evalBlockSize, n-b);
+          double* rb=r+b;
+          if (arg1->rank())
+            arg1->evalBlock(rb, begin+b, m);
+          else
+            std::fill(rb, rb+m, (*arg1)[0]);
+          if (arg2->rank())
+            {
+              arg2->evalBlock(y, begin+b, m);
+              for (size_t j=0; j<m; ++j) rb[j]=g(rb[j],y[j]);
+            }
+          else
+            {
+              double y0=(*arg2)[0];
+              for (size_t j=0; j<m; ++j) rb[j]=g(rb[j],y0);
+            }
+        }
+    }
   };
 
   /// elementwise reduction over a vector of arguments
@@ -80,7 +175,59 @@ namespace civita
     template <class F> ReduceArguments(F f, double init): f(f), init(init) {}
     void setArguments(const std::vector<TensorPtr>& a,const std::string&,double) override;
     double operator[](size_t i) const override;
+    void evalBlock(double r[], size_t begin, size_t n) const override
+    {evalBlockWith(f,r,begin,n);}
     Timestamp timestamp() const override;
+  protected:
+    /// dense result of sparse arguments, see elementwiseIndex()
+    bool masked=false;
+
+    /// block evaluation accumulating with \a g, which must compute
+    /// the same function as f. Sparse arguments are merge joined
+    /// with the result's index.
+    template <class G>
+    void evalBlockWith(const G& g, double r[], size_t begin, size_t n) const
+    {
+      std::fill(r, r+n, init);
+      double x[evalBlockSize];
+      if (!index().empty() || masked)
+        {
+          bool present[evalBlockSize];
+          for (size_t b=0; b<n; b+=evalBlockSize)
+            {
+              size_t m=std::min(evalBlockSize, n-b);
+              std::fill(present, present+m, false);
+              for (auto& a: args)
+                {
+                  if (a->rank()==0)
+                    std::fill(x, x+m, (*a)[0]);
+                  else
+                    mergeJoin(*a, index(), x, begin+b, m, present);
+                  for (size_t j=0; j<m; ++j)
+                    if (!std::isnan(x[j])) g(r[b+j],x[j]);
+                }
+              if (masked)
+                for (size_t j=0; j<m; ++j)
+                  if (!present[j]) r[b+j]=std::nan("");
+            }
+          return;
+        }
+      for (auto& a: args)
+        if (a->rank()==0)
+          {
+            double x0=(*a)[0];
+            if (!std::isnan(x0))
+              for (size_t j=0; j<n; ++j) g(r[j],x0);
+          }
+        else
+          for (size_t b=0; b<n; b+=evalBlockSize)
+            {
+              size_t m=std::min(evalBlockSize, n-b);
+              a->evalBlock(x, begin+b, m);
+              for (size_t j=0; j<m; ++j)
+                if (!std::isnan(x[j])) g(r[b+j],x[j]);
+            }
+    }
   };
     
     
@@ -105,8 +252,15 @@ namespace civita
   class ReductionOp: public ReduceAllOp
   {
     size_t dimension;
+    /// maps indices of this to the first argument element reduced over
+    StridedView view;
+    /// stride and size of the dimension reduced over
+    size_t reductionStride=1, reductionSize=1;
     struct SOI {size_t index, dimIndex;};
-    std::map<size_t, std::vector<SOI>> sumOverIndices;
+    /// argument elements reduced over by sparse element i are
+    /// sumOverIndices[sumOverStart[i]..sumOverStart[i+1])
+    std::vector<SOI> sumOverIndices;
+    std::vector<size_t> sumOverStart;
   public:
    
     template <class F>
@@ -130,6 +284,7 @@ namespace civita
     const Index& index() const override {return cachedResult.index();}
     size_t size() const override {return cachedResult.size();}
     double operator[](size_t i) const override;
+    void evalBlock(double r[], size_t begin, size_t n) const override;
     const Hypercube& hypercube() const override {return cachedResult.hypercube();}
     const Hypercube& hypercube(const Hypercube& hc) override {return cachedResult.hypercube(hc);}
     const Hypercube& hypercube(Hypercube&& hc) override {return cachedResult.hypercube(std::move(hc));}
@@ -199,6 +354,12 @@ namespace civita
   
   class Scan: public DimensionedArgCachedOp
   {
+    /// argument values used for the current cachedResult. Elements
+    /// of the result only depend on preceding elements along the
+    /// scanned dimension, so only those at or beyond the first changed
+    /// position (see ITensor::firstChangedSince) need to be reread
+    /// and recomputed.
+    mutable std::vector<double> argValues;
   public:
     std::function<void(double&,double,size_t)> f;
     template <class F>
@@ -206,6 +367,7 @@ namespace civita
     {Scan::setArgument(arg,dimName,av);}
     void setArgument(const TensorPtr& arg, const std::string& dimName,double argVal) override {
       DimensionedArgCachedOp::setArgument(arg,dimName,argVal);
+      argValues.clear();
       if (arg)
         cachedResult.hypercube(arg->hypercube());
       // TODO - can we handle sparse data?
@@ -216,29 +378,29 @@ namespace civita
   /// corresponds to OLAP slice operation
   class Slice: public ITensor
   {
-    size_t stride=1, split=1, sliceIndex=0;
+    StridedView view; /// maps indices of this to those of arg
     TensorPtr arg;
     std::vector<size_t> arg_index;
   public:
     void setArgument(const TensorPtr& a,const std::string&,double) override;
     double operator[](size_t i) const override;
+    void evalBlock(double r[], size_t begin, size_t n) const override;
     Timestamp timestamp() const override {return arg->timestamp();}
   };
 
   /// corresponds to the OLAP pivot operation
   class Pivot: public ITensor
   {
-    std::vector<size_t> permutation;   /// permutation of axes
+    StridedView view; /// maps indices of this to those of arg
     std::vector<size_t> permutedIndex; /// argument indices corresponding to this indices, when sparse
     TensorPtr arg;
-    // returns hypercube index of arg given hypercube index of this
-    size_t pivotIndex(size_t i) const;
   public:
     void setArgument(const TensorPtr& a,const std::string& axis="",double arg=0) override;
     /// set's the pivots orientation
     /// @param axes - list of axes that are the output
     void setOrientation(const std::vector<std::string>& axes);
     double operator[](size_t i) const override;
+    void evalBlock(double r[], size_t begin, size_t n) const override;
     Timestamp timestamp() const override {return arg->timestamp();}
   };
 
@@ -247,6 +409,7 @@ namespace civita
     TensorPtr arg;
     size_t m_axis;
     std::vector<size_t> m_permutation;
+    StridedView view; /// maps indices of this to those of arg
     std::vector<size_t> permutedIndex; /// argument indices corresponding to this indices, when sparse
   public:
     void setArgument(const TensorPtr& a,const std::string& axis="",double arg=0) override;
@@ -254,6 +417,7 @@ namespace civita
     size_t axis() const {return m_axis;}
     const std::vector<size_t>& permutation() const {return m_permutation;}
     double operator[](size_t i) const override;
+    void evalBlock(double r[], size_t begin, size_t n) const override;
     Timestamp timestamp() const override {return arg->timestamp();}
   };
 
@@ -284,9 +448,26 @@ namespace civita
   };
 
   
+  /// @{ Ravel handle helpers, with the typed labels of \a xv taken from \a labels
+  /// index of the slice label of handle \a hs along axis \a xv, or 0 if not found
+  size_t sliceIndex(const minsky::RavelState::HandleState& hs, const XVector& xv,
+                    TypedXVectorCache& labels);
+  /// labels of \a xv selected by the sort order and calipers of handle \a hs
+  std::vector<size_t> handlePermutation(const minsky::RavelState::HandleState& hs,
+                                        const XVector& xv, TypedXVectorCache& labels);
+  /// @}
+
   /// creates a chain of tensor operations that represents a Ravel in
-  /// state \a state, operating on \a arg
-  std::vector<TensorPtr> createRavelChain(const minsky::RavelState&, const TensorPtr& arg);
+  /// state \a state, operating on \a arg. Typed axis labels are
+  /// taken from \a labels, which may be retained between calls.
+  std::vector<TensorPtr> createRavelChain(const minsky::RavelState&, const TensorPtr& arg,
+                                          TypedXVectorCache& labels);
+  inline std::vector<TensorPtr> createRavelChain(const minsky::RavelState& state,
+                                                 const TensorPtr& arg)
+  {
+    TypedXVectorCache labels;
+    return createRavelChain(state, arg, labels);
+  }
 
 }
 
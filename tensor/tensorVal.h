@@ -21,6 +21,7 @@
 #define CIVITA_TENSORVAL_H
 
 #include "tensorInterface.h"
+#include <algorithm>
 #include <vector>
 #include <chrono>
 
@@ -84,9 +85,9 @@ namespace civita
 
     using ITensorVal::index;
     const Index& index(Index&& idx) override {
-      m_index=idx;
+      m_index=std::move(idx);
       if (!m_index.empty()) {
-        data.resize(idx.size());
+        data.resize(m_index.size());
       }
       return m_index;
     }
@@ -108,7 +109,13 @@ namespace civita
     
     double operator[](size_t i) const override {return data.empty()? 0: data[i];}
     double& operator[](size_t i) override {return data[i];}
+    void evalBlock(double r[], size_t begin, size_t n) const override {
+      if (data.empty()) std::fill(r, r+n, 0.0);
+      else std::copy(data.begin()+begin, data.begin()+begin+n, r);
+    }
     size_t size() const override {return std::max(data.size(),size_t(1));}
+    /// number of values actually stored, which may be zero, unlike size()
+    size_t storedSize() const {return data.size();}
     const TensorVal& operator=(const ITensor& x) override {
       hypercube(x.hypercube());
       m_index=index();
@@ -31,6 +31,10 @@ using namespace boost::posix_time;
 using namespace boost::gregorian;
 
 #include <time.h>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <sstream>
 
 namespace civita
 {
@@ -300,4 +304,202 @@ namespace civita
       i=anyVal(dimension, str(i));
   }
 
+  namespace
+  {
+    const ptime epoch(date(1970,Jan,1));
+    
+    int64_t toTicks(const ptime& x)
+    {
+      if (x.is_pos_infinity()) return numeric_limits<int64_t>::max();
+      if (x.is_special()) return numeric_limits<int64_t>::min();
+      return (x-epoch).ticks();
+    }
+
+    ptime fromTicks(int64_t x)
+    {
+      if (x==numeric_limits<int64_t>::max()) return ptime(pos_infin);
+      if (x==numeric_limits<int64_t>::min()) return ptime(not_a_date_time);
+      return epoch+time_duration(0,0,0,x);
+    }
+  }
+  
+  const size_t TypedXVector::npos;
+
+  TypedXVector::TypedXVector(const XVector& x):
+    m_type(x.dimension.type), m_size(x.size())
+  {
+    switch (m_type)
+      {
+      case Dimension::string:
+        {
+          // intern labels in order of appearance, then renumber so
+          // that ids are ordered as their labels
+          unordered_map<string, unsigned> interned;
+          ids.reserve(m_size);
+          for (auto& i: x)
+            {
+              auto s=any_cast<string>(&i);
+              auto r=interned.emplace(s? *s: str(i), dictionary.size());
+              if (r.second) dictionary.push_back(r.first->first);
+              ids.push_back(r.first->second);
+            }
+          vector<unsigned> order(dictionary.size()), rank(dictionary.size());
+          for (size_t i=0; i<order.size(); ++i) order[i]=i;
+          sort(order.begin(), order.end(),
+               [&](unsigned i, unsigned j) {return dictionary[i]<dictionary[j];});
+          vector<string> sorted;
+          sorted.reserve(dictionary.size());
+          for (size_t i=0; i<order.size(); ++i)
+            {
+              rank[order[i]]=i;
+              sorted.push_back(move(dictionary[order[i]]));
+            }
+          dictionary.swap(sorted);
+          for (auto& i: ids) i=rank[i];
+          break;
+        }
+      case Dimension::time:
+        ticks.reserve(m_size);
+        for (auto& i: x)
+          if (auto t=any_cast<ptime>(&i))
+            ticks.push_back(toTicks(*t));
+          else
+            ticks.push_back(toTicks(any_cast<ptime>(anyVal(x.dimension, str(i)))));
+        break;
+      case Dimension::value:
+        values.reserve(m_size);
+        for (auto& i: x)
+          if (auto v=any_cast<double>(&i))
+            values.push_back(*v);
+          else
+            values.push_back(any_cast<double>(anyVal(x.dimension, str(i))));
+        break;
+      }
+  }
+
+  boost::any TypedXVector::operator[](size_t i) const
+  {
+    switch (m_type)
+      {
+      case Dimension::string: return dictionary[ids[i]];
+      case Dimension::time: return fromTicks(ticks[i]);
+      default: return values[i];
+      }
+  }
+
+  vector<string> TypedXVector::labels(const string& format) const
+  {
+    vector<string> r;
+    r.reserve(m_size);
+    switch (m_type)
+      {
+      case Dimension::string:
+        for (auto i: ids) r.push_back(dictionary[i]);
+        break;
+      case Dimension::time:
+        if (format.empty())
+          for (auto i: ticks) r.push_back(to_iso_extended_string(fromTicks(i)));
+        else
+          {
+            // share the one facet between all labels
+            ostringstream os;
+            os.imbue(locale(os.getloc(), new time_facet(format.c_str())));
+            for (auto i: ticks)
+              {
+                os.str("");
+                os<<fromTicks(i);
+                r.push_back(os.str());
+              }
+          }
+        break;
+      case Dimension::value:
+        for (auto i: values) r.push_back(to_string(i));
+        break;
+      }
+    return r;
+  }
+
+  size_t TypedXVector::find(const string& label, const string& format) const
+  {
+    if (!indexed || format!=indexFormat)
+      {
+        labelIndex.clear();
+        auto l=labels(format);
+        for (size_t i=0; i<l.size(); ++i)
+          labelIndex.emplace(move(l[i]), i); // first occurrence retained
+        indexFormat=format;
+        indexed=true;
+      }
+    auto i=labelIndex.find(label);
+    return i==labelIndex.end()? npos: i->second;
+  }
+
+  namespace
+  {
+    void hashCombine(size_t& h, size_t x)
+    {h^=x+0x9e3779b9+(h<<6)+(h>>2);}
+
+    /// true if \a x and \a y have the same name, dimension and
+    /// labels. Unlike XVector::operator==, labels need not be of the
+    /// dimension's type.
+    bool sameAxis(const XVector& x, const XVector& y)
+    {
+      if (x.name!=y.name || x.dimension.type!=y.dimension.type ||
+          x.dimension.units!=y.dimension.units || x.size()!=y.size())
+        return false;
+      for (auto i=x.begin(), j=y.begin(); i!=x.end(); ++i, ++j)
+        {
+          if (i->type()!=j->type()) return false;
+          if (auto s=any_cast<string>(&*i))
+            {if (*s!=any_cast<string>(*j)) return false;}
+          else if (auto t=any_cast<ptime>(&*i))
+            {if (*t!=any_cast<ptime>(*j)) return false;}
+          else if (auto v=any_cast<double>(&*i))
+            {if (*v!=any_cast<double>(*j)) return false;}
+          else if (str(*i)!=str(*j))
+            return false;
+        }
+      return true;
+    }
+  }
+  
+  size_t TypedXVectorCache::hash(const XVector& x)
+  {
+    size_t h=std::hash<string>()(x.name);
+    hashCombine(h, x.dimension.type);
+    hashCombine(h, std::hash<string>()(x.dimension.units));
+    hashCombine(h, x.size());
+    for (auto& i: x)
+      if (auto s=any_cast<string>(&i))
+        hashCombine(h, std::hash<string>()(*s));
+      else if (auto t=any_cast<ptime>(&i))
+        hashCombine(h, std::hash<int64_t>()(toTicks(*t)));
+      else if (auto v=any_cast<double>(&i))
+        hashCombine(h, std::hash<double>()(*v));
+      else
+        hashCombine(h, std::hash<string>()(str(i)));
+    return h;
+  }
+
+  const TypedXVector& TypedXVectorCache::operator[](const XVector& x)
+  {
+    size_t h=hash(x);
+    auto i=cache.find(x.name);
+    if (i==cache.end())
+      i=cache.emplace(x.name, Entry(h, x)).first;
+    // equal hashes may still be distinct axes
+    else if (i->second.hash!=h || !sameAxis(i->second.axis, x))
+      i->second=Entry(h, x);
+    return i->second.typed;
+  }
+
+  XVector TypedXVector::xvector(const string& name, const Dimension& dimension) const
+  {
+    XVector r(name);
+    r.dimension=dimension;
+    r.reserve(m_size);
+    for (size_t i=0; i<m_size; ++i)
+      r.V::push_back((*this)[i]);
+    return r;
+  }
 }
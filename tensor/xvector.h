@@ -24,6 +24,9 @@
 #include <boost/date_time.hpp>
 #include <vector>
 #include <initializer_list>
+#include <map>
+#include <unordered_map>
+#include <stdint.h>
 
 namespace civita
 {
@@ -77,6 +80,77 @@ namespace civita
 
   };
 
+  /// Typed, columnar representation of the labels of an XVector,
+  /// for operations over large axes. String labels are interned into
+  /// a sorted dictionary, time labels are stored as ticks since the
+  /// epoch, and value labels as doubles, so labels can be compared
+  /// without any_casts or string comparisons.
+  class TypedXVector
+  {
+  public:
+    static const size_t npos=~size_t(0);
+    /// labels of \a x not of the type given by its dimension are
+    /// converted, as in XVector::imposeDimension()
+    explicit TypedXVector(const XVector& x);
+    Dimension::Type type() const {return m_type;}
+    size_t size() const {return m_size;}
+    /// ordering of labels, consistent with diff(x[i],x[j])<0
+    bool less(size_t i, size_t j) const {
+      switch (m_type)
+        {
+        case Dimension::string: return ids[i]<ids[j];
+        case Dimension::time: return ticks[i]<ticks[j];
+        default: return values[i]<values[j];
+        }
+    }
+    /// label \a i
+    boost::any operator[](size_t i) const;
+    /// all labels converted to strings, as str(x[i],format)
+    std::vector<std::string> labels(const std::string& format="") const;
+    /// index of the first label whose string representation (as
+    /// given by labels(format)) is \a label, or npos if none
+    /// matches. Constant time once an index for \a format is built.
+    size_t find(const std::string& label, const std::string& format="") const;
+    /// convert back to an XVector
+    XVector xvector(const std::string& name, const Dimension& dimension) const;
+  private:
+    Dimension::Type m_type;
+    size_t m_size;
+    std::vector<std::string> dictionary; ///< distinct string labels, sorted
+    std::vector<unsigned> ids; ///< string labels, as indices into dictionary
+    std::vector<int64_t> ticks; ///< time labels
+    std::vector<double> values; ///< value labels
+    /// label to index lookup, built by find for indexFormat
+    mutable std::unordered_map<std::string, size_t> labelIndex;
+    mutable std::string indexFormat;
+    mutable bool indexed=false;
+  };
+
+  /// TypedXVectors of a set of axes, keyed by axis name. Each is
+  /// built on first use, and rebuilt only when its axis changes, as
+  /// detected by a hash of its name, dimension and labels, and
+  /// confirmed by comparison with the axis it was built from.
+  class TypedXVectorCache
+  {
+  public:
+    /// typed representation of \a x
+    const TypedXVector& operator[](const XVector& x);
+    void clear() {cache.clear();}
+    /// hash of the name, dimension and labels of \a x. Computed
+    /// without copying labels, so is much cheaper than comparing
+    /// XVectors.
+    static size_t hash(const XVector& x);
+  private:
+    struct Entry
+    {
+      size_t hash; ///< hash of axis
+      XVector axis; ///< the axis typed was built from
+      TypedXVector typed;
+      Entry(size_t hash, const XVector& axis): hash(hash), axis(axis), typed(axis) {}
+    };
+    std::map<std::string, Entry> cache;
+  };
+
 }
 
 #endif
@@ -0,0 +1,49 @@
+#! /bin/sh
+
+here=`pwd`
+if test $? -ne 0; then exit 2; fi
+tmp=/tmp/$$
+mkdir $tmp
+if test $? -ne 0; then exit 2; fi
+cd $tmp
+if test $? -ne 0; then exit 2; fi
+
+fail()
+{
+    echo "FAILED" 1>&2
+    cd $here
+    chmod -R u+w $tmp
+    rm -rf $tmp
+    exit 1
+}
+
+pass()
+{
+    echo "PASSED" 1>&2
+    cd $here
+    chmod -R u+w $tmp
+    rm -rf $tmp
+    exit 0
+}
+
+trap "fail" 1 2 3 15
+
+$here/batch/minskyBatch --steps 100 --output out.csv $here/examples/GoodwinLinear02.mky >report
+if [ $? -ne 0 ]; then fail; fi
+
+# header line, and one row per step
+if [ `wc -l <out.csv` -ne 101 ]; then fail; fi
+if [ -f out.csv.mlog ]; then fail; fi
+
+grep -q "^steps: 100$" report
+if [ $? -ne 0 ]; then fail; fi
+grep -q "^steps/s: " report
+if [ $? -ne 0 ]; then fail; fi
+grep -q "^RHS evaluations: [1-9]" report
+if [ $? -ne 0 ]; then fail; fi
+
+# missing run length is an error
+$here/batch/minskyBatch $here/examples/GoodwinLinear02.mky >/dev/null
+if [ $? -eq 0 ]; then fail; fi
+
+pass
@@ -8,7 +8,7 @@ here=`pwd`
 mkdir /tmp/$$
 cd /tmp/$$
 
-cp -r $here/test/testEq.mky $here/gui-tk/icons/bank.svg .
+cp -r $here/test/testEq.mky $here/gui-tk/icons/bank.svg $here/examples .
 if [ -x $here/test/unittests ]; then
     $here/test/unittests
 else
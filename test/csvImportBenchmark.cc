@@ -0,0 +1,85 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Measures the throughput of loading a synthetic CSV file of n rows,
+  with a string, a year and a region dimension, followed by c data
+  columns in tabular format.
+
+  usage: csvImportBenchmark [n] [c] [repetitions]
+*/
+
+#include "CSVParser.h"
+#include "minsky.h"
+#include "minsky_epilogue.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+using namespace minsky;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  size_t n=argc>1? atol(argv[1]): 1000000;
+  unsigned c=argc>2? atoi(argv[2]): 4;
+  unsigned reps=argc>3? atoi(argv[3]): 3;
+
+  Minsky m;
+  LocalMinsky lm(m);
+
+  string fname="csvImportBenchmark.csv";
+  {
+    ofstream f(fname);
+    f<<"product,year,region";
+    for (unsigned j=0; j<c; ++j) f<<",c"<<j;
+    f<<"\n";
+    // distinct keys, so duplicateKeyAction does not come into play
+    for (size_t i=0; i<n; ++i)
+      {
+        f<<"\"product "<<i/1000<<"\","<<1900+i/20%50<<",R"<<i%20;
+        for (unsigned j=0; j<c; ++j) f<<","<<0.01*(i+j);
+        f<<"\n";
+      }
+  }
+  ifstream is(fname, ios::ate|ios::binary);
+  double megabytes=is.tellg()/1e6;
+  is.close();
+
+  DataSpec spec;
+  spec.separator=',';
+  spec.setDataArea(1,3);
+  spec.headerRow=0;
+  spec.dimensionCols={0,1,2};
+  spec.dimensionNames={"product","year","region"};
+  spec.dimensions.assign(3, Dimension(Dimension::string,""));
+  spec.horizontalDimName="column";
+
+  for (unsigned k=0; k<reps; ++k)
+    {
+      VariableValue v(VariableType::parameter);
+      auto start=chrono::high_resolution_clock::now();
+      loadValueFromCSVFile(v, fname, spec);
+      chrono::duration<double> t=chrono::high_resolution_clock::now()-start;
+      cout << megabytes<<"MB, "<<n<<" rows, "<<v.tensorInit.size()<<" values: "
+           << t.count()<<"s, "<<megabytes/t.count()<<" MB/s, "
+           << n/t.count()/1e6<<" Mrows/s"<<endl;
+    }
+  remove(fname.c_str());
+}
@@ -0,0 +1,71 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Compares the time taken to compute the dense (column by column) and
+  graph coloured Jacobian of a large generated model, consisting of a
+  chain of n integrators x_i'=x_{i-1}-x_i.
+
+  usage: jacobianBenchmark [n] [repetitions]
+*/
+
+#include "minsky.h"
+#include "minsky_epilogue.h"
+#include <chrono>
+#include <iostream>
+using namespace minsky;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  unsigned n=argc>1? atoi(argv[1]): 2000;
+  unsigned reps=argc>2? atoi(argv[2]): 3;
+
+  Minsky m;
+  LocalMinsky lm(m);
+  auto prev=m.model->addItem(VariablePtr(VariableType::parameter,"c"));
+  prev->variableCast()->init("1");
+  for (unsigned i=0; i<n; ++i)
+    {
+      auto sub=m.model->addItem(OperationPtr(OperationType::subtract));
+      auto integ=m.model->addItem(OperationPtr(OperationType::integrate));
+      m.model->addWire(*prev, *sub, 1);
+      m.model->addWire(*integ, *sub, 2);
+      m.model->addWire(*sub, *integ, 1);
+      prev=integ;
+    }
+  m.implicit=true;
+  m.reset();
+
+  size_t ns=m.stockVars.size();
+  cout << "stock variables: "<<ns<<" colours: "<<m.jacobianSparsity.numColours()<<endl;
+  vector<double> j(ns*ns);
+  Minsky::Matrix jac(ns, j.data());
+
+  for (bool coloured: {false, true})
+    {
+      m.colouredJacobian=coloured;
+      auto start=chrono::high_resolution_clock::now();
+      for (unsigned r=0; r<reps; ++r)
+        m.jacobian(jac, m.t, m.stockVars.data());
+      chrono::duration<double> elapsed=chrono::high_resolution_clock::now()-start;
+      cout << (coloured? "coloured": "dense   ")<<" Jacobian: "
+           << elapsed.count()/reps<<"s per evaluation"<<endl;
+    }
+}
@@ -0,0 +1,78 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Measures the throughput of the blocked matrix product used by the
+  innerProduct operator for square matrices, compared with a naive
+  triple loop for the smaller sizes.
+
+  usage: matrixProductBenchmark [n...]   (default 1024 2048 4096)
+*/
+
+#include "matrixProduct.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+using namespace minsky;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  vector<size_t> sizes;
+  for (int i=1; i<argc; ++i)
+    sizes.push_back(atoi(argv[i]));
+  if (sizes.empty())
+    sizes={1024, 2048, 4096};
+
+  for (auto n: sizes)
+    {
+      vector<double> a(n*n), b(n*n), c(n*n);
+      for (size_t i=0; i<n*n; ++i)
+        {
+          a[i]=sin(i);
+          b[i]=cos(i);
+        }
+      double flops=2.0*n*n*n;
+
+      auto start=chrono::high_resolution_clock::now();
+      matrixProduct(c.data(), MatrixView(a.data(),n,n,1,n), MatrixView(b.data(),n,n,1,n));
+      chrono::duration<double> blocked=chrono::high_resolution_clock::now()-start;
+      cout << n<<"×"<<n<<": blocked "<<flops/blocked.count()*1e-9<<" GFLOP/s";
+
+      if (n<=1024)
+        {
+          vector<double> r(n*n);
+          start=chrono::high_resolution_clock::now();
+          for (size_t j=0; j<n; ++j)
+            for (size_t p=0; p<n; ++p)
+              {
+                double bpj=b[p+n*j];
+                for (size_t i=0; i<n; ++i)
+                  r[i+n*j]+=a[i+n*p]*bpj;
+              }
+          chrono::duration<double> naive=chrono::high_resolution_clock::now()-start;
+          double maxErr=0;
+          for (size_t i=0; i<n*n; ++i)
+            maxErr=max(maxErr, fabs(r[i]-c[i]));
+          cout << ", naive "<<flops/naive.count()*1e-9<<" GFLOP/s, max difference "<<maxErr;
+        }
+      cout << endl;
+    }
+}
@@ -336,4 +336,43 @@ SUITE(CSVParser)
       }
     }
   
+  TEST_FIXTURE(DataSpec, loadLargeFile)
+    {
+      // large enough to be parsed in several chunks
+      const size_t rows=200000;
+      string fname="loadLargeFile.csv";
+      {
+        ofstream f(fname);
+        f<<"region,year,value\n";
+        for (size_t i=0; i<rows; ++i)
+          f<<"r"<<i%7<<","<<1990+i%11<<","<<i%5<<"\n";
+      }
+      setDataArea(1,2);
+      headerRow=0;
+      dimensionNames={"region","year"};
+      dimensionCols={0,1};
+      dimensions.assign(2, Dimension(Dimension::string,""));
+      
+      VariableValue v(VariableType::parameter);
+      CHECK_THROW(loadValueFromCSVFile(v,fname,*this), std::exception);
+
+      duplicateKeyAction=sum;
+      loadValueFromCSVFile(v,fname,*this);
+      CHECK_ARRAY_EQUAL(vector<unsigned>({7,11}),v.hypercube().dims(),2);
+      CHECK_EQUAL("r0", str(v.hypercube().xvectors[0][0]));
+      CHECK_EQUAL("1990", str(v.hypercube().xvectors[1][0]));
+      CHECK_EQUAL(77, v.tensorInit.size());
+      vector<double> sums(77);
+      for (size_t i=0; i<rows; ++i)
+        sums[i%7+7*(i%11)]+=i%5;
+      CHECK_ARRAY_EQUAL(sums, v.tensorInit, 77);
+
+      // stream input gives the same result
+      VariableValue v2(VariableType::parameter);
+      ifstream is(fname);
+      loadValueFromCSVFile(v2,is,*this);
+      CHECK_ARRAY_EQUAL(v.tensorInit, v2.tensorInit, 77);
+      remove(fname.c_str());
+    }
+  
 }
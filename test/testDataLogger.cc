@@ -0,0 +1,138 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "minsky.h"
+#include "dataLogger.h"
+#include "minsky_epilogue.h"
+#include <UnitTest++/UnitTest++.h>
+#include <boost/filesystem.hpp>
+using namespace minsky;
+using namespace std;
+
+namespace
+{
+  // read back the rows of a CSV file, skipping the header line
+  vector<vector<double>> readCSV(const string& file, string& header)
+  {
+    ifstream f(file);
+    getline(f, header);
+    vector<vector<double>> r;
+    string line;
+    while (getline(f, line))
+      {
+        r.emplace_back();
+        istringstream is(line);
+        for (string x; getline(is, x, ',');)
+          r.back().push_back(stod(x));
+      }
+    return r;
+  }
+
+  struct TempFiles
+  {
+    string log=boost::filesystem::unique_path("%%%%-%%%%-%%%%.mlog").string();
+    string csv=boost::filesystem::unique_path("%%%%-%%%%-%%%%.csv").string();
+    ~TempFiles() {
+      boost::filesystem::remove(log);
+      boost::filesystem::remove(csv);
+    }
+  };
+
+  // dx/dt = c
+  struct SimulationFixture: public Minsky, public TempFiles
+  {
+    LocalMinsky lm;
+    SimulationFixture(): lm(*this)
+    {
+      auto c=model->addItem(VariablePtr(VariableType::parameter,"c"));
+      c->variableCast()->init("2");
+      auto integ=model->addItem(OperationPtr(OperationType::integrate));
+      model->addWire(*c, *integ, 1);
+    }
+  };
+}
+
+SUITE(DataLogger)
+{
+  TEST_FIXTURE(TempFiles, roundTrip)
+    {
+      {
+        // small blocks, so that rows pass through every buffer block
+        DataLogger logger(log, {{"x"}, {"y,z",3}}, 10, 2);
+        CHECK_EQUAL(5, logger.rowSize());
+        for (int i=0; i<1000; ++i)
+          {
+            auto row=logger.nextRow();
+            row[0]=i;
+            row[1]=2*i;
+            for (int j=0; j<3; ++j)
+              row[2+j]=i+0.1*j;
+            logger.commit();
+          }
+        logger.close();
+      }
+      DataLogger::toCSV(log, csv);
+      string header;
+      auto rows=readCSV(csv, header);
+      CHECK_EQUAL("time,x,\"y,z[0]\",\"y,z[1]\",\"y,z[2]\"", header);
+      CHECK_EQUAL(1000, rows.size());
+      for (size_t i=0; i<rows.size(); ++i)
+        {
+          CHECK_EQUAL(5, rows[i].size());
+          CHECK_EQUAL(i, rows[i][0]);
+          CHECK_EQUAL(2*i, rows[i][1]);
+          CHECK_EQUAL(i+0.2, rows[i][4]);
+        }
+    }
+
+  TEST_FIXTURE(TempFiles, notALogFile)
+    {
+      {
+        ofstream f(log);
+        f<<"#time a b\n0 1 2\n";
+      }
+      CHECK_THROW(DataLogger::toCSV(log, csv), std::runtime_error);
+    }
+
+  TEST_FIXTURE(SimulationFixture, logSimulation)
+    {
+      reset();
+      for (auto& v: variableValues)
+        if (!v.second->isZero() && v.second->type()!=VariableType::constant)
+          logVarList.insert(v.first);
+      CHECK_EQUAL(2, logVarList.size());
+      openLogFile(log);
+      for (int i=0; i<5; ++i)
+        step();
+      closeLogFile();
+
+      logFileToCSV(log, csv);
+      string header;
+      auto rows=readCSV(csv, header);
+      CHECK_EQUAL(5, rows.size());
+      // columns are in the order of variableValues
+      size_t paramCol=variableValues[*logVarList.begin()]->type()==VariableType::parameter? 1: 2;
+      for (auto& r: rows)
+        {
+          CHECK_EQUAL(3, r.size());
+          CHECK(r[0]>0);
+          CHECK_EQUAL(2, r[paramCol]);
+          CHECK_CLOSE(2*r[0], r[3-paramCol], 1e-6);
+        }
+    }
+}
@@ -0,0 +1,127 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "minsky.h"
+#include "ensemble.h"
+#include "minsky_epilogue.h"
+#include <UnitTest++/UnitTest++.h>
+#include <fstream>
+using namespace minsky;
+using namespace std;
+
+namespace
+{
+  // dx/dt = c/d - x
+  struct TestFixture: public Minsky
+  {
+    LocalMinsky lm;
+    TestFixture(): lm(*this)
+    {
+      auto c=model->addItem(VariablePtr(VariableType::parameter,"c"));
+      c->variableCast()->init("1");
+      auto d=model->addItem(VariablePtr(VariableType::parameter,"d"));
+      d->variableCast()->init("1");
+      auto divOp=model->addItem(OperationPtr(OperationType::divide));
+      auto sub=model->addItem(OperationPtr(OperationType::subtract));
+      auto integ=model->addItem(OperationPtr(OperationType::integrate));
+      auto x=model->addItem(VariablePtr(VariableType::flow,"x"));
+      model->addWire(*c, *divOp, 1);
+      model->addWire(*d, *divOp, 2);
+      model->addWire(*divOp, *sub, 1);
+      model->addWire(*integ, *sub, 2);
+      model->addWire(*sub, *integ, 1);
+      model->addWire(*integ, *x, 1);
+      epsAbs=epsRel=1e-8;
+    }
+  };
+}
+
+SUITE(Ensemble)
+{
+  TEST_FIXTURE(TestFixture,parameterSweep)
+    {
+      Ensemble ensemble(*this, 37);
+      ensemble.sweep("c", 0, 3.6);
+      ensemble.run(2, 0.25, 4);
+      CHECK_EQUAL(9, ensemble.times().size());
+      auto x=ensemble.result("x");
+      CHECK_EQUAL(2, x.rank());
+      CHECK_EQUAL(37*9, x.size());
+      for (size_t ti=0; ti<ensemble.times().size(); ++ti)
+        {
+          double t=ensemble.times()[ti];
+          for (size_t i=0; i<ensemble.size(); ++i)
+            {
+              CHECK(!ensemble.failed(i));
+              CHECK_CLOSE(0.1*i*(1-exp(-t)), x[ti*ensemble.size()+i], 1e-6);
+            }
+        }
+
+      // single threaded run gives the same result
+      ensemble.run(2, 0.25, 1);
+      auto x1=ensemble.result("x");
+      for (size_t i=0; i<x.size(); ++i)
+        CHECK_CLOSE(x[i], x1[i], 1e-6);
+    }
+
+  TEST_FIXTURE(TestFixture,failedInstancesAreIsolated)
+    {
+      Ensemble ensemble(*this, 4);
+      ensemble.setValue("d", 2, 0);
+      ensemble.run(1, 0.5);
+      auto x=ensemble.result("x");
+      for (size_t i=0; i<ensemble.size(); ++i)
+        CHECK_EQUAL(i==2, ensemble.failed(i));
+      CHECK_CLOSE(1-exp(-1), x[2*4+0], 1e-6);
+      CHECK(std::isnan(x[2*4+2]));
+    }
+
+  TEST_FIXTURE(TestFixture,instanceErrorNotDiluted)
+    {
+      epsAbs=epsRel=1e-3;
+      Ensemble single(*this, 1);
+      single.stepMax=1;
+      single.run(2, 0.25, 1);
+      auto x1=single.result("x");
+      // the other instances are at rest, so should not affect the
+      // step size chosen for instance 0
+      Ensemble ensemble(*this, 64);
+      ensemble.stepMax=1;
+      ensemble.sweep("c", 0, 0);
+      ensemble.setValue("c", 0, 1);
+      ensemble.run(2, 0.25, 1);
+      auto x=ensemble.result("x");
+      for (size_t ti=0; ti<ensemble.times().size(); ++ti)
+        CHECK_CLOSE(x1[ti], x[ti*ensemble.size()], 1e-12);
+    }
+
+  TEST_FIXTURE(TestFixture,exportCSV)
+    {
+      Ensemble ensemble(*this, 3);
+      ensemble.sweep("c", 1, 3);
+      ensemble.run(1, 0.5);
+      ensemble.exportCSV("ensemble.csv", "x");
+      ifstream f("ensemble.csv");
+      string line;
+      getline(f, line);
+      CHECK_EQUAL("\"time\",0,1,2", line);
+      int rows=0;
+      while (getline(f, line)) ++rows;
+      CHECK_EQUAL(3, rows);
+    }
+}
@@ -91,4 +91,18 @@ SUITE(Ravel)
     CHECK(!d->lockGroup);
   }
 
+  // locked Ravels are redrawn when another in the group changes
+  TEST_FIXTURE(Canvas, LockGroupInvalidatesRenderings)
+  {
+    auto a=make_shared<Ravel>(), b=make_shared<Ravel>(), c=make_shared<Ravel>();
+    selection.items={a,b};
+    lockRavelsInSelection();
+    for (auto& r: {a,b,c})
+      r->renderCache.render(*r);
+    a->broadcastStateToLockGroup();
+    CHECK(a->renderCache.valid(*a));
+    CHECK(!b->renderCache.valid(*b));
+    CHECK(c->renderCache.valid(*c));
+  }
+
 }
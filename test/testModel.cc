@@ -25,6 +25,7 @@
 #include "minsky_epilogue.h"
 
 #include <UnitTest++/UnitTest++.h>
+#include <fstream>
 using namespace minsky;
 using namespace std;
 
@@ -241,6 +242,91 @@ SUITE(Group)
       CHECK(!group0->displayPlot);
     }
 
+  // curves from tensor inputs are exported along with streamed pens
+  TEST(plotExportConstantCurves)
+    {
+      PlotWidget plot;
+      auto x=make_shared<VariableValue>(VariableType::flow, ":x");
+      auto y=make_shared<VariableValue>(VariableType::flow, ":y");
+      x->hypercube(Hypercube(vector<unsigned>{3}));
+      y->hypercube(Hypercube(vector<unsigned>{3}));
+      for (size_t i=0; i<3; ++i)
+        {
+          (*x)[i]=10*(i+1);
+          (*y)[i]=i*i;
+        }
+      plot.connectVar(y, 6); // first pen
+      plot.connectVar(x, 14); // its x input
+      plot.addConstantCurves();
+      plot.exportAsCSV("plotExportConstantCurves.csv");
+      ifstream f("plotExportConstantCurves.csv");
+      vector<string> lines;
+      for (string line; getline(f, line);)
+        lines.push_back(line);
+      remove("plotExportConstantCurves.csv");
+      CHECK_EQUAL(4, lines.size());
+      if (lines.size()==4)
+        {
+          CHECK_EQUAL("\"x\",\":y\"", lines[0]);
+          CHECK_EQUAL("10,0", lines[1]);
+          CHECK_EQUAL("30,4", lines[3]);
+        }
+    }
+
+  // pens sampled at differing x values share a single x column,
+  // unless x,y column pairs are requested
+  TEST(plotExportLayouts)
+    {
+      PlotWidget plot;
+      auto pen=[&](const string& name, const vector<double>& xs, const vector<double>& ys,
+                   unsigned yPort, unsigned xPort) {
+        auto x=make_shared<VariableValue>(VariableType::flow, ":x"+name);
+        auto y=make_shared<VariableValue>(VariableType::flow, ":"+name);
+        x->hypercube(Hypercube(vector<unsigned>{unsigned(xs.size())}));
+        y->hypercube(Hypercube(vector<unsigned>{unsigned(ys.size())}));
+        for (size_t i=0; i<xs.size(); ++i)
+          {
+            (*x)[i]=xs[i];
+            (*y)[i]=ys[i];
+          }
+        plot.connectVar(y, yPort);
+        plot.connectVar(x, xPort);
+      };
+      pen("y", {10,20,30}, {0,1,4}, 6, 14);
+      pen("z", {20,25}, {5,6}, 7, 15);
+      plot.addConstantCurves();
+      auto exported=[](const string& filename) {
+        ifstream f(filename);
+        vector<string> lines;
+        for (string line; getline(f, line);)
+          lines.push_back(line);
+        remove(filename.c_str());
+        return lines;
+      };
+
+      plot.exportAsCSV("plotExportLayouts.csv");
+      auto lines=exported("plotExportLayouts.csv");
+      CHECK_EQUAL(5, lines.size());
+      if (lines.size()==5)
+        {
+          CHECK_EQUAL("\"x\",\":y\",\":z\"", lines[0]);
+          CHECK_EQUAL("10,0,", lines[1]);
+          CHECK_EQUAL("20,1,5", lines[2]);
+          CHECK_EQUAL("25,,6", lines[3]);
+          CHECK_EQUAL("30,4,", lines[4]);
+        }
+
+      plot.exportAsCSVxyPairs("plotExportLayouts.csv");
+      lines=exported("plotExportLayouts.csv");
+      CHECK_EQUAL(4, lines.size());
+      if (lines.size()==4)
+        {
+          CHECK_EQUAL("\"x\",\":y\",\"x\",\":z\"", lines[0]);
+          CHECK_EQUAL("10,0,20,5", lines[1]);
+          CHECK_EQUAL("30,4,,", lines[3]);
+        }
+    }
+
   TEST_FIXTURE(TestFixture, findGroup)
     {
       CHECK(model->findGroup(*group0)==group0);
@@ -397,6 +483,232 @@ SUITE(Canvas)
       canvas.getWireAt(x,y);
       CHECK(canvas.wire==ab);
     }
+
+  TEST_FIXTURE(TestFixture, spatialIndex)
+    {
+      for (int i=0; i<100; ++i)
+        model->addItem(OperationPtr(OperationType::exp))->moveTo(37*(i%10), 29*(i/10));
+      model->addWire(new Wire(c->ports[0], model->items.back()->ports[1], {250,50, 300,20}));
+
+      // compare the indexed queries with exhaustive searches of the model
+      auto checkQueries=[&]() {
+        for (float x=-40; x<450; x+=7)
+          for (float y=-40; y<320; y+=9)
+            {
+              ItemPtr item;
+              auto minD=numeric_limits<float>::max();
+              model->recursiveDo(&GroupItems::items, [&](const Items&, Items::const_iterator i)
+                                 {
+                                   float d=(*i)->x()-x, e=(*i)->y()-y;
+                                   if (d*d+e*e<minD && (*i)->visible() && (*i)->contains(x,y))
+                                     {
+                                       minD=d*d+e*e;
+                                       item=*i;
+                                     }
+                                   return false;
+                                 });
+              if (!item)
+                item=model->findAny(&Group::groups, [&](const GroupPtr& i)
+                                    {return i->visible() && i->clickType(x,y)!=ClickType::outside;});
+              CHECK(item==canvas.itemAt(x,y));
+
+              shared_ptr<Port> port;
+              minD=numeric_limits<float>::max();
+              model->recursiveDo(&GroupItems::items, [&](const Items&, Items::const_iterator i)
+                                 {
+                                   if ((*i)->group.lock()->displayContents())
+                                     for (auto& p: (*i)->ports)
+                                       {
+                                         float d=p->x()-x, e=p->y()-y;
+                                         if (d*d+e*e<minD)
+                                           {
+                                             minD=d*d+e*e;
+                                             port=p;
+                                           }
+                                       }
+                                   return false;
+                                 });
+              CHECK(port==canvas.closestInPort(x,y));
+
+              canvas.getWireAt(x,y);
+              CHECK(canvas.wire==model->findAny(&Group::wires, [&](const WirePtr& i){return i->near(x,y);}));
+            }
+      };
+      checkQueries();
+
+      // drag an item, which updates the index incrementally
+      cairo::Surface surf(cairo_recording_surface_create(CAIRO_CONTENT_COLOR,nullptr));
+      c->draw(surf.cairo());// reposition ports
+      canvas.selection.clear();
+      canvas.mouseDown(c->x(),c->y());
+      canvas.mouseMove(c->x()+30,c->y()+40);
+      canvas.mouseUp(c->x()+30,c->y()+40);
+      checkQueries();
+
+      LassoBox lasso(0,0,200,150);
+      canvas.select(lasso);
+      auto topLevel=model->minimalEnclosingGroup(lasso.x0,lasso.y0,lasso.x1,lasso.y1);
+      if (!topLevel) topLevel=model.get();
+      vector<ItemPtr> selected;
+      for (auto& i: topLevel->items)
+        if (i->visible() && lasso.intersects(*i))
+          selected.push_back(i);
+      CHECK_EQUAL(selected.size(), canvas.selection.items.size());
+      CHECK(equal(selected.begin(), selected.end(), canvas.selection.items.begin()));
+    }
+
+  TEST_FIXTURE(TestFixture, spatialIndexIncremental)
+    {
+      auto d=model->addItem(OperationPtr(OperationType::cos));
+      d->moveTo(200,300);
+      CanvasIndex index;
+      index.update(*model);
+      CHECK_EQUAL(1, index.builds);
+
+      // edits that are journalled are applied without a rebuild
+      auto e=model->addItem(OperationPtr(OperationType::exp));
+      e->moveTo(400,300);
+      auto w=model->addWire(new Wire(c->ports[0], e->ports[1]));
+      model->removeItem(*d);
+      a->moveTo(150,200);
+      group0->moveTo(50,250);
+      auto g=model->addGroup(new Group);
+      g->addItem(OperationPtr(OperationType::sin))->moveTo(500,500);
+      index.update(*model);
+      CHECK_EQUAL(1, index.builds);
+
+      // compare with an index built from scratch
+      CanvasIndex fresh;
+      fresh.build(*model);
+      LassoBox all(-1000,-1000,1000,1000);
+      auto sorted=[](vector<ItemPtr> x) {sort(x.begin(),x.end()); return x;};
+      CHECK(sorted(fresh.items(all))==sorted(index.items(all)));
+      for (float x=0; x<600; x+=20)
+        for (float y=0; y<600; y+=20)
+          {
+            LassoBox box(x,y,x+20,y+20);
+            CHECK(sorted(fresh.items(box))==sorted(index.items(box)));
+            auto fg=fresh.groups(box), ig=index.groups(box);
+            CHECK(set<GroupPtr>(fg.begin(),fg.end())==set<GroupPtr>(ig.begin(),ig.end()));
+            auto fw=fresh.wires(box), iw=index.wires(box);
+            CHECK(set<WirePtr>(fw.begin(),fw.end())==set<WirePtr>(iw.begin(),iw.end()));
+          }
+      auto wires=index.wires(all);
+      CHECK(find(wires.begin(), wires.end(), w)!=wires.end());
+      auto items=index.items(all);
+      CHECK(find(items.begin(), items.end(), d)==items.end());
+
+      // a model wide change rebuilds
+      model->zoom(0,0,2);
+      index.update(*model);
+      CHECK_EQUAL(2, index.builds);
+    }
+
+  TEST_FIXTURE(TestFixture, renderCache)
+    {
+      OperationPtr op(OperationType::exp);
+      model->addItem(op);
+      op->moveTo(200,200);
+      // hit test against a fresh rendering of the item
+      auto uncached=[&](float x, float y) {
+        cairo::Surface surf(cairo_recording_surface_create(CAIRO_CONTENT_COLOR_ALPHA,nullptr));
+        op->draw(surf.cairo());
+        return bool(cairo_in_clip(surf.cairo(), x-op->x(), y-op->y()));
+      };
+      auto checkClicks=[&]() {
+        for (float x=op->left(); x<op->right(); x+=3)
+          for (float y=op->top(); y<op->bottom(); y+=3)
+            if (op->onResizeHandle(x,y) || op->select(x,y))
+              continue;
+            else if (uncached(x,y))
+              CHECK_EQUAL(ClickType::onItem, op->clickType(x,y));
+            else
+              CHECK(ClickType::onItem!=op->clickType(x,y));
+      };
+      
+      checkClicks();
+      CHECK(op->renderCache.valid(*op));
+      // rendering is retained when the item is translated with the canvas
+      model->moveTo(model->x()+50, model->y()+20);
+      CHECK(op->renderCache.valid(*op));
+      checkClicks();
+
+      op->rotation(90);
+      CHECK(!op->renderCache.valid(*op));
+      checkClicks();
+      op->iWidth(2*op->iWidth());
+      CHECK(!op->renderCache.valid(*op));
+      checkClicks();
+      checkClicks();
+      // editing the model elsewhere retains the rendering
+      markEdited();
+      CHECK(op->renderCache.valid(*op));
+
+      // a variable is rerendered when the value it displays changes
+      VariablePtr var(VariableType::flow,"renderCacheVar");
+      model->addItem(var);
+      var->moveTo(100,100);
+      var->renderCache.render(*var);
+      CHECK(var->renderCache.valid(*var));
+      var->value(2);
+      CHECK(!var->renderCache.valid(*var));
+      CHECK(op->renderCache.valid(*op));
+      var->renderCache.render(*var);
+      var->name("renamedVar");
+      CHECK(!var->renderCache.valid(*var));
+
+      // attributes set directly, eg from a script, are detected
+      var->renderCache.render(*var);
+      var->sliderMax=var->sliderMax+1;
+      CHECK(!var->renderCache.valid(*var));
+      op->renderCache.render(*op);
+      op->tooltip="a tooltip";
+      CHECK(!op->renderCache.valid(*op));
+      op->renderCache.render(*op);
+      op->axis="x";
+      CHECK(!op->renderCache.valid(*op));
+      group0->renderCache.render(*group0);
+      group0->title="renamed";
+      CHECK(!group0->renderCache.valid(*group0));
+      auto plot=new PlotWidget;
+      model->addItem(plot);
+      plot->renderCache.render(*plot);
+      plot->title="a plot";
+      CHECK(!plot->renderCache.valid(*plot));
+      plot->renderCache.render(*plot);
+      plot->xlabel="x";
+      CHECK(!plot->renderCache.valid(*plot));
+    }
+
+  TEST_FIXTURE(TestFixture, wireGeometry)
+    {
+      auto c=ab->coords();
+      c.insert(c.begin()+2, {0.5f*(c[0]+c[2])+20, 0.5f*(c[1]+c[3])-30});
+      ab->coords(c);
+      auto& g=ab->geometry();
+      CHECK(g.coords==ab->coords());
+      CHECK_EQUAL(4, g.controlPoints.size());
+      // the curve passes through the interior handle
+      CHECK(find(g.path.begin(), g.path.end(), make_pair(g.coords[2],g.coords[3]))!=g.path.end());
+      for (size_t i=1; i<g.path.size()-1; ++i)
+        CHECK(ab->near(g.path[i].first, g.path[i].second));
+      float x0, y0, x1, y1;
+      ab->bounds(x0,y0,x1,y1);
+      for (auto& p: g.path)
+        {
+          CHECK(p.first>=x0 && p.first<=x1);
+          CHECK(p.second>=y0 && p.second<=y1);
+        }
+      
+      // geometry follows the ports when the items move
+      a->moveTo(a->x()+50, a->y()+10);
+      cairo::Surface surf(cairo_recording_surface_create(CAIRO_CONTENT_COLOR,nullptr));
+      a->draw(surf.cairo());// reposition ports
+      CHECK(ab->geometry().coords==ab->coords());
+      ab->straighten();
+      CHECK_EQUAL(4, ab->geometry().coords.size());
+      CHECK(ab->geometry().controlPoints.empty());
+    }
   
   TEST_FIXTURE(Canvas,findVariableDefinition)
     {
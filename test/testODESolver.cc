@@ -0,0 +1,134 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "minsky.h"
+#include "odeSolver.h"
+#include "minsky_epilogue.h"
+#include <UnitTest++/UnitTest++.h>
+#include <cmath>
+using namespace minsky;
+using namespace std;
+
+namespace
+{
+  // simple harmonic oscillator y''=-y
+  void oscillator(double, const double y[], double f[])
+  {
+    f[0]=y[1];
+    f[1]=-y[0];
+  }
+
+  // stiff problem y'=-1000(y-cos t)
+  void stiff(double t, const double y[], double f[])
+  {f[0]=-1000*(y[0]-cos(t));}
+
+  void stiffJacobian(double, const double[], double dfdy[])
+  {dfdy[0]=-1000;}
+
+  double stiffSolution(double t)
+  {return (1e6*cos(t)+1000*sin(t)-1e6*exp(-1000*t))/(1e6+1)+exp(-1000*t);}
+
+  // dx/dt = 1-x
+  struct RelaxationModel: public Minsky
+  {
+    LocalMinsky lm;
+    RelaxationModel(): lm(*this)
+    {
+      auto c=model->addItem(VariablePtr(VariableType::parameter,"c"));
+      c->variableCast()->init("1");
+      auto sub=model->addItem(OperationPtr(OperationType::subtract));
+      auto integ=model->addItem(OperationPtr(OperationType::integrate));
+      model->addWire(*c, *sub, 1);
+      model->addWire(*integ, *sub, 2);
+      model->addWire(*sub, *integ, 1);
+      nativeSolver=true;
+      epsAbs=epsRel=1e-8;
+      stepMax=0.1;
+    }
+  };
+}
+
+SUITE(ODESolver)
+{
+  TEST(dormandPrinceDenseOutput)
+    {
+      DormandPrince solver(oscillator);
+      solver.epsAbs=solver.epsRel=1e-8;
+      solver.hmax=1;
+      double y[]={1,0};
+      solver.init(0,y,2);
+      for (int i=1; i<=100; ++i)
+        {
+          double t=solver.advanceTo(0.1*i, y, 100000);
+          CHECK_EQUAL(0.1*i, t);
+          CHECK_CLOSE(cos(t), y[0], 1e-6);
+          CHECK_CLOSE(-sin(t), y[1], 1e-6);
+        }
+      // output sampling should not constrain the step size
+      CHECK(solver.numSteps<100);
+    }
+
+  TEST(rosenbrockStiff)
+    {
+      Rosenbrock solver(stiff, stiffJacobian);
+      solver.epsAbs=solver.epsRel=1e-6;
+      solver.hmax=1;
+      double y[]={1};
+      solver.init(0,y,1);
+      CHECK_EQUAL(1, solver.advanceTo(1, y, 100000));
+      CHECK_CLOSE(stiffSolution(1), y[0], 1e-5);
+      CHECK(solver.numJacobian>0);
+      CHECK(solver.numRejected<solver.numSteps);
+    }
+
+  TEST(syncRestartsOnChangedState)
+    {
+      DormandPrince solver(oscillator);
+      double y[]={1,0};
+      solver.init(0,y,2);
+      solver.takeSteps(3,y);
+      double t=solver.time();
+      solver.sync(t,y,2); // unchanged, so no restart
+      CHECK_EQUAL(t, solver.time());
+      y[0]=2;
+      solver.sync(t,y,2);
+      CHECK_EQUAL(t, solver.previousTime());
+      CHECK_EQUAL(2, solver.state()[0]);
+    }
+
+  TEST_FIXTURE(RelaxationModel,nativeSolverSimulation)
+    {
+      for (bool imp: {false, true})
+        {
+          implicit=imp;
+          outputInterval=0.5;
+          reset();
+          for (int i=1; i<=4; ++i)
+            {
+              step();
+              CHECK_CLOSE(0.5*i, t, 1e-10);
+              CHECK_CLOSE(1-exp(-t), stockVars[0], imp? 1e-4: 1e-6);
+            }
+          outputInterval=0;
+          nSteps=5;
+          step();
+          CHECK(t>2);
+          CHECK_CLOSE(1-exp(-t), stockVars[0], imp? 1e-4: 1e-6);
+        }
+    }
+}
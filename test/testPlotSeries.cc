@@ -0,0 +1,134 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "plotSeries.h"
+#include <UnitTest++/UnitTest++.h>
+#include <algorithm>
+#include <cmath>
+using namespace minsky;
+using namespace std;
+
+SUITE(PlotSeriesTests)
+{
+  TEST(smallSeriesUnchanged)
+    {
+      PlotSeries s;
+      for (int i=0; i<10; ++i)
+        s.add(i, i*i);
+      vector<double> x, y;
+      s.decimate(x, y, 100);
+      CHECK_EQUAL(10, x.size());
+      for (int i=0; i<10; ++i)
+        {
+          CHECK_EQUAL(i, x[i]);
+          CHECK_EQUAL(i*i, y[i]);
+        }
+    }
+
+  TEST(decimationPreservesExtremes)
+    {
+      PlotSeries s;
+      const size_t n=100000;
+      double ymin=0, ymax=0;
+      for (size_t i=0; i<n; ++i)
+        {
+          double y=sin(i*1e-3);
+          // isolated spikes, which naive subsampling would miss
+          if (i==12345) y=5;
+          if (i==777) y=-7;
+          ymin=min(ymin,y);
+          ymax=max(ymax,y);
+          s.add(i, y);
+        }
+      vector<double> x, y;
+      s.decimate(x, y, 100);
+      CHECK(x.size()<=6*100);
+      CHECK_EQUAL(ymin, *min_element(y.begin(), y.end()));
+      CHECK_EQUAL(ymax, *max_element(y.begin(), y.end()));
+      CHECK_EQUAL(0, x.front());
+      CHECK_EQUAL(n-1, x.back());
+      CHECK(is_sorted(x.begin(), x.end()));
+    }
+
+  TEST(decimateRange)
+    {
+      PlotSeries s;
+      for (size_t i=0; i<100000; ++i)
+        s.add(i, i%7);
+      vector<double> x, y;
+      s.decimate(x, y, 100, 5000, 6000);
+      CHECK(x.size()<=6*100);
+      // at most one point either side of the range is included
+      CHECK(count_if(x.begin(), x.end(), [](double x){return x<5000;})<=1);
+      CHECK(count_if(x.begin(), x.end(), [](double x){return x>6000;})<=1);
+    }
+
+  TEST(memoryCapAndSpill)
+    {
+      const size_t cap=1000, n=100000;
+      PlotSeries s(cap);
+      for (size_t i=0; i<n; ++i)
+        s.add(0.5*i, cos(i*0.01));
+      CHECK_EQUAL(n, s.size());
+      CHECK(s.spilled());
+      CHECK(s.pointsInMemory()<=cap);
+
+      // full resolution data is recovered from the spill file
+      PlotSeries::Reader r(s);
+      double x, y;
+      size_t i=0;
+      for (; r.next(x,y); ++i)
+        {
+          CHECK_EQUAL(0.5*i, x);
+          CHECK_EQUAL(cos(i*0.01), y);
+        }
+      CHECK_EQUAL(n, i);
+
+      vector<double> dx, dy;
+      s.decimate(dx, dy, 50);
+      CHECK(!dx.empty() && dx.size()<=6*50);
+      CHECK_EQUAL(0.5*(n-1), dx.back());
+
+      s.clear();
+      CHECK_EQUAL(0, s.size());
+      CHECK(!s.spilled());
+    }
+
+  TEST(nonMonotonic)
+    {
+      PlotSeries s(1000);
+      for (size_t i=0; i<100000; ++i)
+        s.add(cos(i*0.01), sin(i*0.013));
+      CHECK(!s.monotonic());
+      vector<double> x, y;
+      s.decimate(x, y, 100);
+      CHECK(!x.empty() && x.size()<=6*100);
+      CHECK(*max_element(x.begin(), x.end())>0.999);
+      CHECK(*min_element(y.begin(), y.end())<-0.999);
+    }
+
+  TEST(copyIsEmpty)
+    {
+      PlotSeries s;
+      s.add(1,2);
+      PlotSeries t(s);
+      CHECK_EQUAL(0, t.size());
+      t=s;
+      CHECK_EQUAL(0, t.size());
+    }
+}
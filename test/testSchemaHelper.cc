@@ -0,0 +1,119 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "schemaHelper.h"
+#include "a85.h"
+#include "zStream.h"
+#include "minsky_epilogue.h"
+using namespace minsky;
+
+#include <UnitTest++/UnitTest++.h>
+
+namespace
+{
+  // the single stream encoding written by earlier versions of Minsky
+  classdesc::CDATA encodeStream(const classdesc::pack_t& buf)
+  {
+    vector<unsigned char> zbuf(buf.size());
+    DeflateZStream zs(buf, zbuf);
+    zs.deflate();
+    vector<char> cbuf(a85::size_for_a85(zs.total_out,false));
+    a85::to_a85(&zbuf[0],zs.total_out, &cbuf[0], false);
+    replace(cbuf.begin(),cbuf.end(),']','~');
+    return classdesc::CDATA(cbuf.begin(),cbuf.end());
+  }
+
+  // the decoder of earlier versions of Minsky
+  classdesc::pack_t decodeStream(const classdesc::CDATA& data)
+  {
+    string trimmed;
+    for (auto c: data)
+      if (!isspace(c)) trimmed+=c;
+    vector<unsigned char> zbuf(a85::size_for_bin(trimmed.size()));
+    replace(trimmed.begin(),trimmed.end(),'~',']'); 
+    a85::from_a85(trimmed.data(), trimmed.size(),zbuf.data());
+    InflateZStream zs(zbuf);
+    zs.inflate();
+    return move(zs.output);
+  }
+
+  // true if the first buf.size() bytes of x match buf
+  bool matches(const classdesc::pack_t& buf, const classdesc::pack_t& x)
+  {return x.size()>=buf.size() && memcmp(buf.data(), x.data(), buf.size())==0;}
+}
+
+SUITE(SchemaHelper)
+{
+  TEST(encodeDecode)
+    {
+      // large enough to span several chunks
+      classdesc::pack_t buf;
+      for (size_t i=0; i<500000; ++i)
+        buf<<double(i%1000);
+      auto encoded=encode(buf);
+      CHECK_EQUAL('z', encoded[0]);
+      CHECK(encoded.find("]]>")==string::npos);
+      CHECK(matches(buf, decode(encoded)));
+
+      // whitespace is ignored
+      string spaced;
+      for (size_t i=0; i<encoded.size(); ++i)
+        {
+          spaced+=encoded[i];
+          if (i%76==75) spaced+="\n  ";
+        }
+      CHECK(matches(buf, decode(classdesc::CDATA(spaced.begin(), spaced.end()))));
+
+      classdesc::pack_t empty;
+      CHECK_EQUAL(0, decode(encode(empty)).size());
+    }
+
+  TEST(decodeStream)
+    {
+      classdesc::pack_t buf;
+      for (size_t i=0; i<1000; ++i)
+        buf<<double(i%10);
+      CHECK(matches(buf, decode(encodeStream(buf))));
+    }
+
+  // data fitting in one chunk remains readable by earlier versions
+  TEST(smallDataReadableByEarlierVersions)
+    {
+      classdesc::pack_t buf;
+      for (size_t i=0; i<1000; ++i)
+        buf<<double(i%10);
+      auto encoded=encode(buf);
+      CHECK(encoded[0]!='z');
+      CHECK(encoded.find("]]>")==string::npos);
+      CHECK(matches(buf, decodeStream(encoded)));
+      CHECK(matches(buf, decode(encoded)));
+    }
+
+  TEST(compressionLevel)
+    {
+      classdesc::pack_t buf;
+      for (size_t i=0; i<10000; ++i)
+        buf<<double(i%100);
+      auto fast=encode(buf,1);
+      auto small=encode(buf,9);
+      CHECK(small.size()<=fast.size());
+      CHECK(matches(buf, decode(fast)));
+      CHECK(matches(buf, decode(small)));
+    }
+}
@@ -0,0 +1,274 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "minsky.h"
+#include "simulationWorker.h"
+#include "minsky_epilogue.h"
+#include <UnitTest++/UnitTest++.h>
+using namespace minsky;
+using namespace std;
+
+namespace
+{
+  // dx/dt = c, y = x
+  struct TestFixture: public Minsky
+  {
+    LocalMinsky lm;
+    ItemPtr c, y;
+    TestFixture(): lm(*this)
+    {
+      c=model->addItem(VariablePtr(VariableType::parameter,"c"));
+      c->variableCast()->init("2");
+      auto integ=model->addItem(OperationPtr(OperationType::integrate));
+      y=model->addItem(VariablePtr(VariableType::flow,"y"));
+      model->addWire(*c, *integ, 1);
+      model->addWire(*integ, *y, 1);
+    }
+  };
+
+  // as TestFixture, with y plotted
+  struct PlotFixture: public TestFixture
+  {
+    ItemPtr plot;
+    PlotFixture()
+    {
+      plot=model->addItem(new PlotWidget);
+      model->addWire(*y, *plot, 6); // first pen
+    }
+  };
+
+  /// waits for, and returns, the next snapshot published by \a worker
+  SimulationSnapshot& nextSnapshot(SimulationWorker& worker)
+  {
+    while (!worker.snapshots.acquire())
+      worker.wait(1);
+    return worker.snapshots.readBuffer();
+  }
+}
+
+SUITE(SimulationWorker)
+{
+  TEST(tripleBuffer)
+    {
+      TripleBuffer<int> buffer;
+      CHECK(!buffer.acquire());
+      buffer.writeBuffer()=1;
+      buffer.publish();
+      buffer.writeBuffer()=2;
+      buffer.publish();
+      // only the most recently published value is seen
+      CHECK(buffer.acquire());
+      CHECK_EQUAL(2, buffer.readBuffer());
+      CHECK(!buffer.acquire());
+      CHECK_EQUAL(2, buffer.readBuffer());
+      buffer.writeBuffer()=3;
+      buffer.publish();
+      CHECK(buffer.acquire());
+      CHECK_EQUAL(3, buffer.readBuffer());
+    }
+
+  TEST(workerReportsExceptions)
+    {
+      double t=0;
+      SimulationWorker worker([&](const SimulationWorker::Command& c, SimulationSnapshot& s) {
+          if (c.type!=SimulationWorker::Command::run) return;
+          if (t>=1000) throw runtime_error("too late");
+          s.t=++t;
+        });
+      worker.post(SimulationWorker::Command());
+      // the worker runs continuously, and every step is seen
+      for (int i=1; i<=1000; ++i)
+        {
+          auto& s=nextSnapshot(worker);
+          CHECK(s.errMsg.empty());
+          CHECK_EQUAL(i, s.t);
+        }
+      CHECK_EQUAL("too late", nextSnapshot(worker).errMsg);
+      CHECK(!worker.busy());
+    }
+
+  TEST(readerSeesConsistentSnapshots)
+    {
+      // every element of the state is set to the time of the step
+      vector<double> state(10000);
+      double t=0;
+      SimulationWorker worker([&](const SimulationWorker::Command& c, SimulationSnapshot& s) {
+          if (c.type==SimulationWorker::Command::reset)
+            {
+              t=0;
+              return;
+            }
+          t+=c.reversed? -1: 1;
+          for (auto& x: state) x=t;
+          s.t=t;
+          s.stockVars.assign(state.begin(), state.end());
+          s.flowVars.assign(state.begin(), state.end());
+        });
+      worker.post(SimulationWorker::Command());
+
+      auto consistent=[](const SimulationSnapshot& s) {
+        if (s.stockVars.size()!=10000 || s.flowVars.size()!=10000) return false;
+        for (size_t i=0; i<s.stockVars.size(); ++i)
+          if (s.stockVars[i]!=s.t || s.flowVars[i]!=s.t) return false;
+        return true;
+      };
+      
+      double lastT=0;
+      for (int i=0; i<1000; ++i)
+        {
+          auto& s=nextSnapshot(worker);
+          CHECK_EQUAL(lastT+1, s.t);
+          lastT=s.t;
+          // the worker is computing the next step meanwhile
+          boost::this_thread::yield();
+          CHECK(consistent(s));
+        }
+
+      // the state may be modified by this thread whilst paused
+      worker.pause();
+      CHECK(!worker.busy());
+      SimulationWorker::Command c;
+      c.type=SimulationWorker::Command::reset;
+      c.epoch=worker.posted().epoch+1;
+      worker.post(c);
+      c.type=SimulationWorker::Command::reverse;
+      c.reversed=true;
+      worker.post(c);
+      worker.post(SimulationWorker::Command());
+      CHECK(worker.posted().reversed);
+      CHECK_EQUAL(1, worker.posted().epoch);
+      
+      // skip the step computed before the pause
+      SimulationSnapshot* s;
+      do
+        s=&nextSnapshot(worker);
+      while (s->epoch!=worker.posted().epoch);
+      CHECK_EQUAL(-1, s->t);
+      CHECK(consistent(*s));
+      CHECK_EQUAL(-2, nextSnapshot(worker).t);
+    }
+
+  TEST_FIXTURE(TestFixture, stepUsesPersistentWorker)
+    {
+      reset();
+      step();
+      auto w=worker;
+      CHECK(w);
+      for (int i=0; i<10; ++i)
+        step();
+      CHECK(w==worker);
+      CHECK(t>0);
+      CHECK_CLOSE(2*t, stockVars[0], 1e-8);
+      double t1=t;
+      reverse=true;
+      step();
+      CHECK(t<t1);
+      CHECK_CLOSE(2*t, stockVars[0], 1e-8);
+    }
+
+  TEST_FIXTURE(TestFixture, stepInstallsConsistentState)
+    {
+      reset();
+      auto& y=*variableValues[VariableValue::valueId("y")];
+      for (int i=0; i<100; ++i)
+        {
+          step();
+          // the worker is already computing the next step
+          CHECK(worker->busy());
+          CHECK_CLOSE(2*t, stockVars[0], 1e-8);
+          CHECK_EQUAL(stockVars[0], y.value());
+          // the worker steps at its own time
+          CHECK_EQUAL(t, EvalOpBase::t());
+        }
+    }
+
+  TEST_FIXTURE(PlotFixture, plottingDoesNotResetWorker)
+    {
+      reset();
+      step();
+      auto& yv=*variableValues[VariableValue::valueId("y")];
+      auto epoch=worker->posted().epoch;
+      auto version=yv.version();
+      auto plotted=plot->displayedState();
+      for (int i=0; i<100; ++i)
+        {
+          step();
+          CHECK(worker->busy());
+          CHECK_CLOSE(2*t, stockVars[0], 1e-8);
+        }
+      CHECK(plot->displayedState()!=plotted);
+      // the plot only reads the installed state, so the step computed
+      // ahead is kept, and cached computations remain valid
+      CHECK(!workerStateStale);
+      CHECK_EQUAL(epoch, worker->posted().epoch);
+      CHECK_EQUAL(version, yv.version());
+    }
+
+  TEST_FIXTURE(TestFixture, editWhilstRunning)
+    {
+      reset();
+      for (int i=0; i<10; ++i)
+        step();
+      double t1=t, x1=stockVars[0];
+      // takes effect from the state already installed, discarding any
+      // step computed ahead
+      c->variableCast()->value(3);
+      for (int i=0; i<10; ++i)
+        step();
+      CHECK(t>t1);
+      CHECK_CLOSE(3*(t-t1), stockVars[0]-x1, 1e-8);
+
+      nSteps=5;
+      t1=t;
+      step();
+      CHECK_CLOSE(5*stepMax, t-t1, 1e-8);
+    }
+
+  // values written without flagging the change are picked up too
+  TEST_FIXTURE(TestFixture, unflaggedEditWhilstRunning)
+    {
+      reset();
+      for (int i=0; i<10; ++i)
+        step();
+      double t1=t, x1=stockVars[0];
+      (*variableValues[VariableValue::valueId("c")])[0]=3;
+      CHECK(!workerStateStale);
+      for (int i=0; i<10; ++i)
+        step();
+      CHECK_CLOSE(3*(t-t1), stockVars[0]-x1, 1e-8);
+    }
+
+  TEST_FIXTURE(TestFixture, simulationStats)
+    {
+      reset();
+      CHECK_EQUAL(0, simulationStats.steps);
+      CHECK_EQUAL(0, simulationStats.rhsEvaluations);
+      for (int i=0; i<10; ++i)
+        step();
+      CHECK_EQUAL(10, simulationStats.steps);
+      CHECK(simulationStats.rhsEvaluations>=10);
+      CHECK_EQUAL(0, simulationStats.jacobianEvaluations);
+      CHECK(simulationStats.solve>=simulationStats.rhs);
+
+      implicit=true;
+      reset();
+      CHECK_EQUAL(0, simulationStats.steps);
+      step();
+      CHECK(simulationStats.jacobianEvaluations>0);
+    }
+}
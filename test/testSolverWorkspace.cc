@@ -0,0 +1,140 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "minsky.h"
+#include "minsky_epilogue.h"
+#include <UnitTest++/UnitTest++.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+using namespace minsky;
+
+// count heap allocations whilst countAllocations is set, to check the
+// RK callbacks do not allocate. Other tests in this executable allocate
+// as normal. Atomic, as steps are computed on the simulation thread
+namespace
+{
+  std::atomic<bool> countAllocations{false};
+  std::atomic<size_t> numAllocations{0};
+
+  /// counts allocations for the lifetime of this object
+  struct CountAllocations
+  {
+    CountAllocations() {numAllocations=0; countAllocations=true;}
+    ~CountAllocations() {countAllocations=false;}
+  };
+}
+
+void* operator new(size_t sz)
+{
+  if (countAllocations)
+    ++numAllocations;
+  if (void* p=malloc(sz? sz: 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {free(p);}
+
+namespace
+{
+  struct TestFixture: public Minsky
+  {
+    LocalMinsky lm;
+    TestFixture(): lm(*this)
+    {
+      // a = int(c+d), b = a*e
+      auto addOp=model->addItem(OperationPtr(OperationType::add));
+      auto intOp=model->addItem(OperationPtr(OperationType::integrate));
+      auto mulOp=model->addItem(OperationPtr(OperationType::multiply));
+      auto a=model->addItem(VariablePtr(VariableType::flow,"a"));
+      auto b=model->addItem(VariablePtr(VariableType::flow,"b"));
+      auto c=model->addItem(VariablePtr(VariableType::parameter,"c"));
+      auto d=model->addItem(VariablePtr(VariableType::parameter,"d"));
+      auto e=model->addItem(VariablePtr(VariableType::parameter,"e"));
+      model->addWire(*c, *addOp, 1);
+      model->addWire(*d, *addOp, 2);
+      model->addWire(*addOp, *intOp, 1);
+      model->addWire(*intOp, *a, 1);
+      model->addWire(*intOp, *mulOp, 1);
+      model->addWire(*e, *mulOp, 2);
+      model->addWire(*mulOp, *b, 1);
+    }
+  };
+}
+
+SUITE(SolverWorkspace)
+{
+  TEST_FIXTURE(TestFixture,evalEquationsDoesNotAllocate)
+    {
+      reset();
+      vector<double> result(stockVars.size()), sv(stockVars);
+      evalEquations(result.data(), t, sv.data()); // warm up
+      size_t allocations=numAllocations;
+      for (int i=0; i<100; ++i)
+        evalEquations(result.data(), t, sv.data());
+      CHECK_EQUAL(allocations, numAllocations);
+    }
+
+  TEST_FIXTURE(TestFixture,jacobianDoesNotAllocate)
+    {
+      implicit=true;
+      reset();
+      vector<double> j(stockVars.size()*stockVars.size()), sv(stockVars);
+      Matrix jac(stockVars.size(),j.data());
+      jacobian(jac, t, sv.data()); // warm up
+      size_t allocations=numAllocations;
+      for (int i=0; i<100; ++i)
+        jacobian(jac, t, sv.data());
+      CHECK_EQUAL(allocations, numAllocations);
+    }
+
+  TEST_FIXTURE(TestFixture,evalEquationsBeforeReset)
+    {
+      // evaluation before reset uses the workspace, without setting up the solver
+      vector<double> result(stockVars.size()), sv(stockVars);
+      evalEquations(result.data(), t, sv.data());
+      CHECK(!ode);
+    }
+
+  TEST_FIXTURE(TestFixture,stepDoesNotAllocate)
+    {
+      reset();
+      // warm up, until all buffers exchanged with the simulation
+      // thread have been sized
+      for (int i=0; i<5; ++i)
+        step();
+      auto& ws=solverWorkspace;
+      const double* buffers[]={ws.flow.data(), ws.ds.data(), ws.df.data(),
+                               ws.d.data(), ws.deriv.data()};
+      size_t capacities[]={ws.flow.capacity(), ws.ds.capacity(), ws.df.capacity(),
+                           ws.d.capacity(), ws.deriv.capacity()};
+      {
+        CountAllocations counting;
+        for (int i=0; i<100; ++i)
+          step();
+      }
+      CHECK_EQUAL(0, numAllocations.load());
+      const double* buffersAfter[]={ws.flow.data(), ws.ds.data(), ws.df.data(),
+                                    ws.d.data(), ws.deriv.data()};
+      size_t capacitiesAfter[]={ws.flow.capacity(), ws.ds.capacity(), ws.df.capacity(),
+                                ws.d.capacity(), ws.deriv.capacity()};
+      CHECK_ARRAY_EQUAL(buffers, buffersAfter, 5);
+      CHECK_ARRAY_EQUAL(capacities, capacitiesAfter, 5);
+    }
+}
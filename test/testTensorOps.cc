@@ -22,6 +22,8 @@
 #include "selection.h"
 #include "xvector.h"
 #include "minskyTensorOps.h"
+#include "threadPool.h"
+#include "ravelPlan.h"
 #include "minsky.h"
 #include "minsky_epilogue.h"
 #include <UnitTest++/UnitTest++.h>
@@ -230,6 +232,106 @@ SUITE(TensorOps)
       }
     }
 
+  TEST_FIXTURE(TestFixture, incrementalScan)
+    {
+      // counts the number of times the scan is computed
+      struct RunningSum: public civita::Scan
+      {
+        mutable unsigned computed=0;
+        RunningSum(): Scan([](double& x,double y,size_t){x+=y;}) {}
+        void computeTensor() const override {++computed; Scan::computeTensor();}
+      };
+
+      vector<unsigned> dims{5,5};
+      fromVal.hypercube(Hypercube(dims));
+      for (size_t i=0; i<fromVal.size(); ++i)
+        fromVal[i]=i;
+      auto ev=make_shared<EvalCommon>();
+      auto update=[&]() {
+        ev->update(ValueVector::flowVars.data(), ValueVector::flowVars.size(), ValueVector::stockVars.data());
+      };
+      update();
+      RunningSum scan;
+      auto arg=make_shared<ConstTensorVarVal>(from.vValue(),ev);
+      arg->tracked=ev->trackInput(from.vValue());
+      scan.setArgument(arg,"1",0);
+      auto check=[&]() {
+        for (size_t i=0; i<dims[0]; ++i)
+          for (size_t j=0; j<dims[1]; ++j)
+            {
+              double ref=0;
+              for (size_t k=0; k<=j; ++k)
+                ref+=fromVal({i,k});
+              CHECK_EQUAL(ref,scan[i+j*dims[0]]);
+            }
+      };
+      check();
+      CHECK_EQUAL(1,scan.computed);
+
+      // inputs are unchanged, so the cached result is used
+      update();
+      check();
+      CHECK_EQUAL(1,scan.computed);
+
+      // partial recomputation from the changed position
+      fromVal({2,3})=100;
+      fromVal.valueChanged();
+      update();
+      check();
+      CHECK_EQUAL(2,scan.computed);
+      fromVal({0,0})=-1;
+      fromVal.valueChanged();
+      update();
+      check();
+      CHECK_EQUAL(3,scan.computed);
+    }
+
+  TEST_FIXTURE(TestFixture, incrementalScanOfEvaluatedInput)
+    {
+      // counts the number of elements accumulated by the scan
+      size_t accumulated=0;
+      civita::Scan scan([&](double& x,double y,size_t){x+=y; ++accumulated;});
+
+      vector<unsigned> dims{3,5};
+      fromVal.hypercube(Hypercube(dims));
+      for (size_t i=0; i<fromVal.size(); ++i)
+        fromVal[i]=i;
+      auto ev=make_shared<EvalCommon>();
+      auto update=[&]() {
+        ev->update(ValueVector::flowVars.data(), ValueVector::flowVars.size(), ValueVector::stockVars.data());
+      };
+      update();
+      // as for a defined flow variable, written directly by the evaluation
+      auto arg=make_shared<ConstTensorVarVal>(from.vValue(),ev);
+      arg->tracked=ev->trackInput(from.vValue(),true);
+      scan.setArgument(arg,"1",0);
+      auto check=[&]() {
+        for (size_t i=0; i<dims[0]; ++i)
+          for (size_t j=0; j<dims[1]; ++j)
+            {
+              double ref=0;
+              for (size_t k=0; k<=j; ++k)
+                ref+=fromVal({i,k});
+              CHECK_EQUAL(ref,scan[i+j*dims[0]]);
+            }
+      };
+      check();
+      CHECK_EQUAL(12,accumulated);
+
+      // unchanged values are not rescanned
+      accumulated=0;
+      update();
+      check();
+      CHECK_EQUAL(0,accumulated);
+
+      // only positions along the scanned dimension from the first
+      // changed element are recomputed
+      ValueVector::flowVars[fromVal.idx()+1+3*dims[0]]=100;
+      update();
+      check();
+      CHECK_EQUAL(6,accumulated);
+    }
+
   TEST_FIXTURE(TestFixture, difference2D)
     {
       vector<unsigned> dims{5,5};
@@ -424,6 +526,251 @@ SUITE(TensorOps)
         }
     }
 
+  // elementwise operations over contiguous or broadcast scalar
+  // operands are compiled to vectorised instructions, which must agree
+  // with the reference evaluation
+  TEST_FIXTURE(MinskyFixture, vectorisedEvalOps)
+    {
+      vector<XVector> xv{{"a",{"a1","a2","a3","a4","a5","a6"}}};
+      VariableValue from1(VariableType::flow), from2(VariableType::flow),
+        scalar(VariableType::flow), t1(VariableType::flow), t2(VariableType::flow),
+        t3(VariableType::flow), t4(VariableType::flow), t5(VariableType::flow);
+      from1.hypercube(xv);
+      from2.hypercube(xv);
+      scalar.allocValue();
+      EvalOpVector ops;
+      ops.push_back(EvalOpPtr(OperationType::add, nullptr, t1, from1, from2));
+      ops.push_back(EvalOpPtr(OperationType::multiply, nullptr, t2, t1, scalar));
+      ops.push_back(EvalOpPtr(OperationType::exp, nullptr, t3, t2));
+      ops.push_back(EvalOpPtr(OperationType::divide, nullptr, t4, scalar, from1));
+      ops.push_back(EvalOpPtr(OperationType::sin, nullptr, t5, t4));
+      for (size_t i=0; i<ValueVector::flowVars.size(); ++i)
+        ValueVector::flowVars[i]=0.1*(i+1);
+
+      EvalOpProgram program;
+      program.compile(ops);
+      CHECK_EQUAL(ops.size(), program.size());
+      for (auto& i: program.instructions())
+        CHECK_EQUAL(from1.size(), i.count);
+
+      vector<double> reference(ValueVector::flowVars), compiled(ValueVector::flowVars);
+      for (auto& i: ops)
+        i->eval(reference.data(), reference.size(), ValueVector::stockVars.data());
+      program.eval(compiled.data(), compiled.size(), ValueVector::stockVars.data());
+      CHECK_ARRAY_EQUAL(reference, compiled, reference.size());
+
+      // each kernel agrees with the scalar operation
+      vector<double> x{0.3,0.5,0.7,0.9}, y{1.5,0.5,0.25,2}, r(x.size());
+      for (auto op: {OperationType::subtract, OperationType::pow, OperationType::max,
+            OperationType::lt, OperationType::sqrt, OperationType::exp, OperationType::ln,
+            OperationType::log, OperationType::frac})
+        {
+          unique_ptr<ScalarEvalOp> scalarOp(ScalarEvalOp::create(op));
+          auto kernel=vectorKernel(op);
+          CHECK(kernel);
+          kernel(r.data(), x.data(), 1, y.data(), 1, x.size());
+          for (size_t i=0; i<x.size(); ++i)
+            CHECK_EQUAL(scalarOp->evaluate(x[i],y[i]), r[i]);
+          kernel(r.data(), x.data(), 1, y.data(), 0, x.size());
+          for (size_t i=0; i<x.size(); ++i)
+            CHECK_EQUAL(scalarOp->evaluate(x[i],y[0]), r[i]);
+          // in place
+          r=x;
+          kernel(r.data(), r.data(), 1, y.data(), 1, x.size());
+          for (size_t i=0; i<x.size(); ++i)
+            CHECK_EQUAL(scalarOp->evaluate(x[i],y[i]), r[i]);
+        }
+      CHECK(!vectorKernel(OperationType::integrate));
+    }
+
+  // the approximate exp, ln and log kernels agree with libm to within
+  // a few ulp over the whole range of doubles, including special values
+  TEST(vectorTranscendentals)
+    {
+      struct Approximate
+      {
+        Approximate() {approximateVectorMath=true;}
+        ~Approximate() {approximateVectorMath=false;}
+      } approximate;
+      const double inf=numeric_limits<double>::infinity();
+      vector<double> x{0, -0.0, 1, -1, 0.5, 2, 1e-300, 5e-324, 2.2250738585072014e-308,
+                       1.7976931348623157e308, 709.78, 709.79, 710, -745.1, -745.2, -746,
+                       inf, -inf, nan("")};
+      for (int i=-1100; i<=1100; ++i)
+        x.push_back(ldexp(1.0+(i%7)/7.0, i));
+      for (double i=-750; i<=750; i+=0.37)
+        x.push_back(i);
+      vector<double> r(x.size()), y{10};
+      auto check=[&](OperationType::Type op, double (*f)(double)) {
+        vectorKernel(op)(r.data(), x.data(), 1, y.data(), 0, x.size());
+        for (size_t i=0; i<x.size(); ++i)
+          {
+            double expected=f(x[i]);
+            if (isnan(expected))
+              CHECK(isnan(r[i]));
+            else if (isinf(expected) || expected==0)
+              CHECK_EQUAL(expected, r[i]);
+            else
+              // subnormal results are accurate to within an absolute
+              // rather than relative ulp
+              CHECK_CLOSE(expected, r[i], max(1e-15*fabs(expected), 1e-323));
+          }
+      };
+      check(OperationType::exp, [](double x) {return exp(x);});
+      check(OperationType::ln, [](double x) {return log(x);});
+      check(OperationType::log, [](double x) {return log(x)/log(10.0);});
+    }
+
+  TEST_FIXTURE(TestFixture, concurrentTensorEval)
+    {
+      Variable<VariableType::flow> a("a"), b("b"), c("c");
+      fromVal.hypercube(Hypercube(vector<unsigned>{20000}));
+      for (auto& i: fromVal)
+        i=0.001*(&i-&fromVal[0]+1);
+      Operation<OperationType::sqrt> sqrtOp;
+      Operation<OperationType::exp> expOp;
+      Operation<OperationType::sin> sinOp;
+      Wire w1(from.ports[0], sqrtOp.ports[1]), w2(sqrtOp.ports[0], a.ports[1]),
+        w3(from.ports[0], expOp.ports[1]), w4(expOp.ports[0], b.ports[1]),
+        w5(a.ports[0], sinOp.ports[1]), w6(sinOp.ports[0], c.ports[1]);
+      // a and b are independent, c depends on a
+      EvalOpVector ops;
+      ops.emplace_back(new Eval(a, sqrtOp));
+      ops.emplace_back(new Eval(b, expOp));
+      ops.emplace_back(new Eval(c, sinOp));
+
+      EvalOpProgram program;
+      program.compile(ops);
+      CHECK(program.concurrent());
+
+      vector<double> reference(ValueVector::flowVars), concurrent(ValueVector::flowVars);
+      for (auto& i: ops)
+        i->eval(reference.data(), reference.size(), ValueVector::stockVars.data());
+      SharedThreadPool pool(4);
+      program.eval(concurrent.data(), concurrent.size(), ValueVector::stockVars.data(), pool);
+      CHECK_ARRAY_EQUAL(reference, concurrent, reference.size());
+      CHECK_CLOSE(sin(sqrt(0.001)), concurrent[c.vValue()->idx()], 1e-10);
+    }
+
+  TEST(innerOuterProduct)
+    {
+      // hypercube with axes named \a names, of dimensions \a dims
+      auto cube=[](const vector<string>& names, const vector<unsigned>& dims) {
+        Hypercube hc(dims);
+        for (size_t i=0; i<names.size(); ++i)
+          hc.xvectors[i].name=names[i];
+        return hc;
+      };
+      auto m=make_shared<TensorVal>(), v=make_shared<TensorVal>(), sv=make_shared<TensorVal>();
+      m->hypercube(cube({"i","p"},{2,3}));
+      v->hypercube(cube({"p"},{3}));
+      // m = [[1,3,5],[2,4,6]], v=[1,2,3]
+      for (size_t i=0; i<m->size(); ++i) (*m)[i]=i+1;
+      for (size_t i=0; i<v->size(); ++i) (*v)[i]=i+1;
+      // sparse vector with only the second element
+      *sv=map<size_t,double>{{1,2}};
+      sv->hypercube(v->hypercube());
+      for (auto i: {m,v,sv}) i->updateTimestamp();
+
+      // cached results are not invalidated by setArguments, so
+      // construct a new operation for each product
+      auto product=[](OperationType::Type op, TensorPtr x, TensorPtr y) {
+        auto r=TensorOpFactory().create(op);
+        r->setArguments(x,y);
+        return r;
+      };
+      auto ip=product(OperationType::innerProduct,m,v);
+      CHECK_EQUAL(1, ip->rank());
+      CHECK_EQUAL(2, ip->size());
+      CHECK_EQUAL(1*1+3*2+5*3, (*ip)[0]);
+      CHECK_EQUAL(2*1+4*2+6*3, (*ip)[1]);
+      ip=product(OperationType::innerProduct,m,sv);
+      CHECK_EQUAL(3*2, (*ip)[0]);
+      CHECK_EQUAL(4*2, (*ip)[1]);
+      ip=product(OperationType::innerProduct,v,v);
+      CHECK_EQUAL(0, ip->rank());
+      CHECK_EQUAL(1+4+9, (*ip)[0]);
+      // the shared axis is found by name, wherever it is
+      ip=product(OperationType::innerProduct,v,m);
+      CHECK_EQUAL(1, ip->rank());
+      CHECK_EQUAL("i", ip->hypercube().xvectors[0].name);
+      CHECK_EQUAL(1*1+3*2+5*3, (*ip)[0]);
+      CHECK_EQUAL(2*1+4*2+6*3, (*ip)[1]);
+      ip=product(OperationType::innerProduct,sv,m);
+      CHECK_EQUAL(3*2, (*ip)[0]);
+      CHECK_EQUAL(4*2, (*ip)[1]);
+      // no shared axis, or the shared axis has different labels
+      auto u=make_shared<TensorVal>(cube({"q"},{3}));
+      CHECK_THROW(product(OperationType::innerProduct,m,u), std::exception);
+      u->hypercube(cube({"p"},{4}));
+      CHECK_THROW(product(OperationType::innerProduct,m,u), std::exception);
+      // ambiguous
+      CHECK_THROW(product(OperationType::innerProduct,m,m), std::exception);
+
+      // larger product, computed by the blocked kernel
+      auto a=make_shared<TensorVal>(), b=make_shared<TensorVal>();
+      a->hypercube(cube({"i","p"},{150,300}));
+      b->hypercube(cube({"p","j"},{300,70}));
+      for (size_t i=0; i<a->size(); ++i) (*a)[i]=sin(i);
+      for (size_t i=0; i<b->size(); ++i) (*b)[i]=cos(i);
+      a->updateTimestamp(); b->updateTimestamp();
+      ip=product(OperationType::innerProduct,a,b);
+      for (size_t i=0; i<150; i+=7)
+        for (size_t j=0; j<70; j+=3)
+          {
+            double sum=0;
+            for (size_t p=0; p<300; ++p)
+              sum+=(*a)[i+150*p]*(*b)[p+300*j];
+            CHECK_CLOSE(sum, (*ip)[i+150*j], 1e-10);
+          }
+
+      // contracting a middle axis, dense and sparse
+      a->hypercube(cube({"i","p","i1"},{4,5,3}));
+      b->hypercube(cube({"j","p","j1"},{2,5,6}));
+      for (size_t i=0; i<a->size(); ++i) (*a)[i]=sin(i);
+      for (size_t i=0; i<b->size(); ++i) (*b)[i]=cos(i);
+      a->updateTimestamp(); b->updateTimestamp();
+      auto sb=make_shared<TensorVal>();
+      map<size_t,double> sbData;
+      for (size_t i=0; i<b->size(); i+=7) sbData[i]=(*b)[i];
+      *sb=sbData;
+      sb->hypercube(b->hypercube());
+      sb->updateTimestamp();
+      ip=product(OperationType::innerProduct,a,b);
+      auto sip=product(OperationType::innerProduct,a,sb);
+      CHECK_EQUAL(4, ip->rank());
+      CHECK_EQUAL(4*3*2*6, ip->size());
+      for (size_t i=0; i<4; ++i)
+        for (size_t i1=0; i1<3; ++i1)
+          for (size_t j=0; j<2; ++j)
+            for (size_t j1=0; j1<6; ++j1)
+              {
+                double sum=0, ssum=0;
+                for (size_t p=0; p<5; ++p)
+                  {
+                    size_t bi=j+2*(p+5*j1);
+                    sum+=(*a)[i+4*(p+5*i1)]*(*b)[bi];
+                    if (sbData.count(bi))
+                      ssum+=(*a)[i+4*(p+5*i1)]*sbData[bi];
+                  }
+                size_t r=i+4*(i1+3*(j+2*j1));
+                CHECK_CLOSE(sum, (*ip)[r], 1e-10);
+                CHECK_CLOSE(ssum, (*sip)[r], 1e-10);
+              }
+
+      auto op=product(OperationType::outerProduct,m,v);
+      CHECK_EQUAL(3, op->rank());
+      CHECK_EQUAL(18, op->size());
+      for (size_t i=0; i<6; ++i)
+        for (size_t j=0; j<3; ++j)
+          CHECK_EQUAL((*m)[i]*(*v)[j], (*op)[i+6*j]);
+      op=product(OperationType::outerProduct,v,sv);
+      CHECK_EQUAL(3, op->size());
+      for (size_t i=0; i<3; ++i)
+        CHECK_EQUAL(2*(*v)[i], op->atHCIndex(i+3));
+      CHECK(isnan(op->atHCIndex(0)));
+    }
+
   template <OperationType::Type op, class F, class F2>
     void multiWireTest(double identity, F f, F2 f2)
   {
@@ -462,6 +809,89 @@ SUITE(TensorOps)
       multiWireTest<OperationType::or_>(0, [](double x,double y){return x>0.5 || y>0.5;}, id);
     }
 
+  // block evaluation of an expression tree must agree with element
+  // by element evaluation, for dense, sparse and broadcast arguments
+  TEST(evalBlock)
+    {
+      auto x=make_shared<TensorVal>(), y=make_shared<TensorVal>();
+      x->hypercube(Hypercube(vector<unsigned>{1000}));
+      y->hypercube(Hypercube(vector<unsigned>{1000}));
+      for (size_t i=0; i<x->size(); ++i)
+        {
+          (*x)[i]=0.01*i;
+          (*y)[i]=i%7? 1+0.1*i: nan("");
+        }
+      auto two=make_shared<TensorVal>(2.0);
+
+      auto sq=make_shared<ElementWiseOp>([](double a){return a*a;}, x);
+      auto prod=make_shared<BinOp>([](double a,double b){return a*b;}, sq, two);
+      auto sum=make_shared<ReduceArguments>([](double& a,double b){a+=b;}, 0);
+      sum->setArguments(vector<TensorPtr>{prod, y, two},{},0);
+      auto diff=make_shared<BinOp>([](double a,double b){return a-b;}, sum, x);
+
+      for (auto& t: vector<TensorPtr>{sq, prod, sum, diff})
+        {
+          vector<double> r(700);
+          t->evalBlock(r.data(), 150, r.size());
+          for (size_t i=0; i<r.size(); ++i)
+            CHECK_EQUAL((*t)[150+i], r[i]);
+        }
+
+      ReduceAllOp total([](double& a,double b,size_t){a+=b;}, 0, diff);
+      double expected=0;
+      for (size_t i=0; i<diff->size(); ++i)
+        expected+=(*diff)[i];
+      CHECK_CLOSE(expected, total[0], 1e-10*fabs(expected));
+
+      // sparse arguments
+      auto s=make_shared<TensorVal>();
+      s->hypercube(Hypercube(vector<unsigned>{1000}));
+      *s=map<size_t,double>{{3,1},{10,2},{500,3},{999,4}};
+      auto sparseSum=make_shared<BinOp>([](double a,double b){return a+b;}, s, x);
+      vector<double> r(sparseSum->size());
+      sparseSum->evalBlock(r.data(), 0, r.size());
+      for (size_t i=0; i<r.size(); ++i)
+        CHECK_EQUAL((*sparseSum)[i], r[i]);
+    }
+
+  // strided views must agree with splitting and recombining indices
+  TEST(stridedView)
+    {
+      Hypercube hc(vector<unsigned>{3,4,5});
+      StridedView view(hc.dims());
+      view.permuteLabels(1, {3,1,2});
+      view.slice(2, 4);
+      view.permuteAxes({1,0});
+      CHECK_EQUAL(9, view.size());
+      vector<size_t> offsets(view.size());
+      view.offsets(offsets.data(), 0, offsets.size());
+      vector<size_t> labels{3,1,2};
+      for (size_t i=0; i<view.size(); ++i)
+        {
+          // view axis 0 is argument axis 1, view axis 1 is argument axis 0
+          auto expected=hc.linealIndex({i/3, labels[i%3], 4});
+          CHECK_EQUAL(expected, view(i));
+          CHECK_EQUAL(expected, offsets[i]);
+          CHECK_EQUAL(i, view.inverse(expected));
+        }
+      CHECK_EQUAL(StridedView::npos, view.inverse(hc.linealIndex({0,0,4})));
+      CHECK_EQUAL(StridedView::npos, view.inverse(hc.linealIndex({0,3,3})));
+      CHECK_THROW(StridedView(hc.dims()).slice(1, 4), std::out_of_range);
+
+      // offsets from the middle of the view
+      view.offsets(offsets.data(), 4, 5);
+      for (size_t i=0; i<5; ++i)
+        CHECK_EQUAL(view(i+4), offsets[i]);
+
+      Index argIndex(set<size_t>{hc.linealIndex({2,1,4}), hc.linealIndex({0,2,4}),
+                                 hc.linealIndex({1,1,3}), hc.linealIndex({1,3,4})});
+      vector<size_t> index, argPos;
+      view.sparseIndex(argIndex, index, argPos);
+      vector<size_t> expectedIndex{2,3,7}, expectedPos{2,3,1};
+      CHECK_ARRAY_EQUAL(expectedIndex, index, 3);
+      CHECK_ARRAY_EQUAL(expectedPos, argPos, 3);
+    }
+
   struct TensorValFixture
   {
     RavelState state;
@@ -481,6 +911,52 @@ SUITE(TensorOps)
     }
   };
   
+  TEST(sparseElementwise)
+    {
+      Hypercube hc(vector<unsigned>{5,4});
+      auto a=make_shared<TensorVal>(hc), b=make_shared<TensorVal>(hc);
+      a->index(set<size_t>{1,3,8,15});
+      b->index(set<size_t>{3,4,15,19});
+      for (size_t i=0; i<a->size(); ++i) (*a)[i]=i+1;
+      for (size_t i=0; i<b->size(); ++i) (*b)[i]=10*(i+1);
+
+      // result indices are the union of the argument indices
+      BinOp add([](double x,double y){return x+y;}, a, b);
+      vector<size_t> expectedi{1,3,4,8,15,19};
+      CHECK_EQUAL(expectedi.size(), add.size());
+      CHECK_ARRAY_EQUAL(expectedi, add.index(), expectedi.size());
+      vector<double> r(add.size());
+      add.evalBlock(r.data(),0,r.size());
+      for (size_t i=0; i<r.size(); ++i)
+        {
+          auto h=expectedi[i];
+          double expected=a->atHCIndex(h)+b->atHCIndex(h);
+          CHECK(isnan(expected)? isnan(r[i]): expected==r[i]);
+          CHECK(isnan(expected)? isnan(add[i]): expected==add[i]);
+        }
+
+      ReduceArguments sum([](double& x,double y){x+=y;},0);
+      sum.setArguments({a,b},"",0);
+      CHECK_ARRAY_EQUAL(expectedi, sum.index(), expectedi.size());
+      vector<double> expectedf{1,12,20,3,34,40};
+      CHECK_ARRAY_EQUAL(expectedf, sum, expectedf.size());
+
+      // sufficiently filled results are stored densely, with absent elements missing
+      a->index(set<size_t>{0,1,2,3,4,5,6,7,8,9});
+      for (size_t i=0; i<a->size(); ++i) (*a)[i]=i;
+      BinOp dense([](double x,double y){return x+y;}, a, b);
+      CHECK(dense.index().empty());
+      CHECK_EQUAL(hc.numElements(), dense.size());
+      for (size_t i=0; i<dense.size(); ++i)
+        if (i<10 || i==15 || i==19)
+          {
+            double expected=a->atHCIndex(i)+b->atHCIndex(i);
+            CHECK(isnan(expected)? isnan(dense[i]): expected==dense[i]);
+          }
+        else
+          CHECK(isnan(dense[i]));
+    }
+
   TEST_FIXTURE(TensorValFixture, sliced2dswapped)
     {
       state.handleStates["sex"].sliceLabel="male";
@@ -600,4 +1076,93 @@ SUITE(TensorOps)
       vector<size_t> dims={2,2};
       CHECK_ARRAY_EQUAL(dims, chain.back()->shape(), 2);
     }
+
+    // fused evaluation must agree with the chain of tensor operations
+    TEST_FIXTURE(TensorValFixture, fusedRavelChain)
+    {
+      for (auto& i: arg->hypercube().xvectors)
+        state.handleStates[i.name].displayFilterCaliper=true;
+      state.handleStates["sex"].collapsed=true;
+      state.handleStates["sex"].reductionOp=RavelState::HandleState::av;
+      state.handleStates["country"].order=RavelState::HandleState::reverse;
+      state.handleStates["date"].minLabel="2011";
+      state.outputHandles={"date","country"};
+      auto check=[&]() {
+        auto chain=createRavelChain(state, arg);
+        auto fused=createFusedRavelChain(state, arg);
+        CHECK(dynamic_pointer_cast<RavelPlan>(fused[1]));
+        CHECK(chain.back()->hypercube()==fused.back()->hypercube());
+        CHECK_EQUAL(chain.back()->size(), fused.back()->size());
+        CHECK_ARRAY_EQUAL(chain.back()->index(), fused.back()->index(),
+                          chain.back()->index().size());
+        CHECK_ARRAY_EQUAL(*chain.back(), *fused.back(), chain.back()->size());
+      };
+      check();
+      state.outputHandles={"country"};
+      state.handleStates["date"].collapsed=true;
+      state.handleStates["date"].reductionOp=RavelState::HandleState::max;
+      check();
+      state.handleStates["sex"].collapsed=false;
+      state.handleStates["sex"].sliceLabel="female";
+      check();
+      arg->index({0,4,8,12,16});
+      check();
+      state.handleStates["date"].collapsed=false;
+      state.outputHandles={"date","country"};
+      check();
+    }
+
+    // results computed on the thread pool must agree with serial evaluation
+    TEST_FIXTURE(TensorValFixture, parallelRavelPlan)
+    {
+      state.handleStates["sex"].collapsed=true;
+      state.handleStates["sex"].reductionOp=RavelState::HandleState::sum;
+      state.outputHandles={"date","country"};
+      auto minParallelWork=RavelPlan::minParallelWork;
+      SharedThreadPool pool(2);
+      ParallelFor parallelFor=[&](size_t n, const std::function<void(size_t,size_t)>& f)
+        {pool.parallelFor(n,f);};
+      TypedXVectorCache labels;
+      auto check=[&]() {
+        RavelPlan::minParallelWork=numeric_limits<size_t>::max();
+        auto serial=createFusedRavelChain(state, arg, labels, parallelFor);
+        CHECK(dynamic_pointer_cast<RavelPlan>(serial[1]));
+        vector<double> expected;
+        for (size_t i=0; i<serial.back()->size(); ++i)
+          expected.push_back((*serial.back())[i]);
+        RavelPlan::minParallelWork=0;
+        auto parallel=createFusedRavelChain(state, arg, labels, parallelFor);
+        CHECK_EQUAL(expected.size(), parallel.back()->size());
+        CHECK_ARRAY_EQUAL(expected, *parallel.back(), expected.size());
+      };
+      check();
+      state.handleStates["date"].collapsed=true;
+      state.handleStates["date"].reductionOp=RavelState::HandleState::max;
+      state.outputHandles={"country"};
+      check();
+      arg->index({0,4,8,12,16});
+      check();
+      RavelPlan::minParallelWork=minParallelWork;
+    }
+
+    // computations started from within the tasks of another
+    // computation holding the pool run serially, rather than deadlock
+    TEST(nestedSharedThreadPool)
+    {
+      SharedThreadPool pool(2);
+      vector<unsigned> innerSizes(4);
+      vector<size_t> sums(4);
+      SharedThreadPool::Lease outer(pool);
+      CHECK_EQUAL(2u, outer.size());
+      vector<ThreadPool::Task> tasks;
+      for (size_t i=0; i<4; ++i)
+        tasks.emplace_back([&,i]() {
+          innerSizes[i]=SharedThreadPool::Lease(pool).size();
+          pool.parallelFor(10, [&](size_t begin, size_t end)
+                           {for (auto j=begin; j<end; ++j) sums[i]+=j;});
+        });
+      outer.run(tasks);
+      CHECK_ARRAY_EQUAL(vector<unsigned>(4,1), innerSizes, 4);
+      CHECK_ARRAY_EQUAL(vector<size_t>(4,45), sums, 4);
+    }
 }
@@ -178,4 +178,71 @@ SUITE(XVector)
       CHECK_THROW(push_back("foo"),std::exception);
 
     }
+
+  TEST(typedXVector)
+    {
+      XVector x("x",{"b","a","c","a"});
+      TypedXVector tx(x);
+      CHECK_EQUAL(4, tx.size());
+      for (size_t i=0; i<x.size(); ++i)
+        for (size_t j=0; j<x.size(); ++j)
+          CHECK_EQUAL(diff(x[i],x[j])<0, tx.less(i,j));
+      vector<string> labels{"b","a","c","a"};
+      CHECK_ARRAY_EQUAL(labels, tx.labels(), 4);
+      CHECK_EQUAL(1, tx.find("a"));
+      CHECK_EQUAL(2, tx.find("c"));
+      CHECK_EQUAL(TypedXVector::npos, tx.find("d"));
+      CHECK(x==tx.xvector(x.name, x.dimension));
+
+      XVector t("t");
+      t.dimension=Dimension(Dimension::time,"%Y-%m-%d");
+      t.push_back("2018-04-01");
+      t.push_back("2017-12-31");
+      t.push_back("2019-01-15");
+      TypedXVector tt(t);
+      for (size_t i=0; i<t.size(); ++i)
+        {
+          CHECK_EQUAL(str(t[i],"%Y-%m-%d"), tt.labels("%Y-%m-%d")[i]);
+          CHECK_EQUAL(str(t[i]), tt.labels()[i]);
+          for (size_t j=0; j<t.size(); ++j)
+            CHECK_EQUAL(diff(t[i],t[j])<0, tt.less(i,j));
+        }
+      CHECK_EQUAL(2, tt.find("2019-01-15","%Y-%m-%d"));
+      CHECK(t==tt.xvector(t.name, t.dimension));
+
+      XVector v("v");
+      v.dimension.type=Dimension::value;
+      for (auto i: {3.0, -1.5, 2.0})
+        v.push_back(boost::any(i));
+      TypedXVector tv(v);
+      for (size_t i=0; i<v.size(); ++i)
+        for (size_t j=0; j<v.size(); ++j)
+          CHECK_EQUAL(diff(v[i],v[j])<0, tv.less(i,j));
+      CHECK_EQUAL(1, tv.find(str(v[1])));
+      CHECK(v==tv.xvector(v.name, v.dimension));
+    }
+
+  TEST(typedXVectorCache)
+    {
+      TypedXVectorCache cache;
+      XVector x("x",{"b","a","c"}), y("y",{"d","e"});
+      auto tx=&cache[x];
+      CHECK_EQUAL(3, tx->size());
+      CHECK_EQUAL(2, cache[y].size());
+      // unchanged axes, including copies, are not rebuilt
+      CHECK_EQUAL(tx, &cache[x]);
+      XVector copy(x);
+      CHECK_EQUAL(TypedXVectorCache::hash(x), TypedXVectorCache::hash(copy));
+      CHECK_EQUAL(tx, &cache[copy]);
+      CHECK_EQUAL(1, cache[copy].find("a"));
+      // changed axes are
+      copy[1]=string("z");
+      CHECK(TypedXVectorCache::hash(x)!=TypedXVectorCache::hash(copy));
+      CHECK_EQUAL(1, cache[copy].find("z"));
+      CHECK_EQUAL(TypedXVector::npos, cache[copy].find("a"));
+      copy.push_back("a");
+      CHECK_EQUAL(4, cache[copy].size());
+      CHECK_EQUAL(3, cache[copy].find("a"));
+      CHECK_EQUAL(2, cache[y].size());
+    }
 }
@@ -0,0 +1,74 @@
+/*
+  @copyright Steve Keen 2020
+  @author Russell Standish
+  This file is part of Minsky.
+
+  Minsky is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Minsky is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Minsky.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Compares the throughput of the vectorised elementwise kernels with
+  per element virtual evaluation, for a selection of operations over
+  tensors of n elements.
+
+  usage: vectorKernelBenchmark [n] [repetitions] [approximate]
+
+  where a nonzero approximate selects the approximate exp, ln and
+  log kernels (see approximateVectorMath).
+*/
+
+#include "evalOp.h"
+#include "minsky_epilogue.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+using namespace minsky;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  size_t n=argc>1? atoi(argv[1]): 1000000;
+  unsigned reps=argc>2? atoi(argv[2]): 20;
+  approximateVectorMath=argc>3 && atoi(argv[3]);
+
+  cout << "instruction set: "<<vectorISA()<<endl;
+  vector<double> x(n), y(n), r(n);
+  for (size_t i=0; i<n; ++i)
+    {
+      x[i]=0.5+double(i)/n;
+      y[i]=1.5-double(i)/n;
+    }
+
+  for (auto op: {OperationType::add, OperationType::multiply, OperationType::divide,
+        OperationType::max, OperationType::sqrt, OperationType::exp,
+        OperationType::ln, OperationType::log, OperationType::sin})
+    {
+      unique_ptr<ScalarEvalOp> scalarOp(ScalarEvalOp::create(op));
+      auto start=chrono::high_resolution_clock::now();
+      for (unsigned k=0; k<reps; ++k)
+        for (size_t i=0; i<n; ++i)
+          r[i]=scalarOp->evaluate(x[i],y[i]);
+      chrono::duration<double> scalar=chrono::high_resolution_clock::now()-start;
+
+      auto kernel=vectorKernel(op);
+      start=chrono::high_resolution_clock::now();
+      for (unsigned k=0; k<reps; ++k)
+        kernel(r.data(), x.data(), 1, y.data(), 1, n);
+      chrono::duration<double> vectorised=chrono::high_resolution_clock::now()-start;
+
+      cout << OperationType::typeName(op)<<": scalar "
+           << n*reps/scalar.count()/1e6<<" Melem/s, vector "
+           << n*reps/vectorised.count()/1e6<<" Melem/s"<<endl;
+    }
+}